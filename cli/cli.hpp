@@ -46,8 +46,11 @@ extern const Command dump_command;
 extern const Command dump_images_command;
 extern const Command leaks_command;
 extern const Command pickle_command;
+extern const Command profile_export_command;
+extern const Command profile_report_command;
 extern const Command repack_command;
 extern const Command retrace_command;
+extern const Command ring_convert_command;
 extern const Command sed_command;
 extern const Command trace_command;
 extern const Command trim_command;
@@ -23,54 +23,508 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  * SOFTWARE.
  *
+ *
  *********************************************************************/
 
+#include <assert.h>
 #include <string.h>
+#include <limits.h> // for CHAR_MAX
+#include <getopt.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "cli.hpp"
-#include "os_string.hpp"
-#include "os_process.hpp"
-#include "cli_resources.hpp"
+#include "image.hpp"
+
+namespace fs = std::filesystem;
+
 
 static const char *synopsis = "Identify differences between two image dumps.";
 
-static os::String
-find_command(void)
+static const unsigned thumbSize = 320;
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace diff-images [OPTIONS] REF_PREFIX SRC_PREFIX\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help             show this help message and exit\n"
+        "    -v, --verbose          verbose output\n"
+        "    -o, --output=FILE      output HTML filename [default: index.html]\n"
+        "        --json=FILE        also write a JSON summary to FILE\n"
+        "    -f, --fuzz=RATIO       fuzz ratio [default: 0.05]\n"
+        "    -a, --alpha            take alpha channel in consideration\n"
+        "    -j, --jobs=N           number of images to compare in parallel\n"
+        "                           [default: number of CPUs]\n"
+        "        --overwrite        overwrite images\n"
+        "        --show-all         show all images, including similar ones\n"
+        "\n"
+        "Exits with status 1 if any image is missing or mismatches.\n"
+        "\n";
+}
+
+enum {
+    JSON_OPT = CHAR_MAX + 1,
+    OVERWRITE_OPT,
+    SHOW_ALL_OPT,
+};
+
+const static char *
+shortOptions = "hvo:f:aj:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"verbose", no_argument, 0, 'v'},
+    {"output", required_argument, 0, 'o'},
+    {"json", required_argument, 0, JSON_OPT},
+    {"fuzz", required_argument, 0, 'f'},
+    {"alpha", no_argument, 0, 'a'},
+    {"jobs", required_argument, 0, 'j'},
+    {"overwrite", no_argument, 0, OVERWRITE_OPT},
+    {"show-all", no_argument, 0, SHOW_ALL_OPT},
+    {0, 0, 0, 0}
+};
+
+
+struct Options
+{
+    bool verbose = false;
+    double fuzz = 0.05;
+    bool alpha = false;
+    bool overwrite = false;
+    bool showAll = false;
+};
+
+
+enum Result {
+    RESULT_MATCH,
+    RESULT_MISMATCH,
+    RESULT_MISSING,
+};
+
+static const char *resultNames[] = {
+    "MATCH",
+    "MISMATCH",
+    "MISSING",
+};
+
+
+struct Entry
+{
+    std::string name;
+    Result result = RESULT_MISSING;
+    image::Comparison comparison;
+
+    // HTML table cells for the reference, source, and delta images
+    std::string cells;
+};
+
+
+static bool
+isImage(const std::string &path)
 {
-    return findScript("snapdiff.py");
+    fs::path name = fs::path(path).filename();
+    std::string ext1 = name.extension().string();
+    std::string ext2 = name.stem().extension().string();
+    return (ext1 == ".png" || ext1 == ".bmp" || ext1 == ".pnm" || ext1 == ".ppm") &&
+           ext2 != ".diff" && ext2 != ".thumb";
 }
 
+
 static void
-usage(void)
+walkDirectory(const std::string &dirname, const std::string &prefix, std::vector<std::string> &images)
+{
+    std::error_code ec;
+    fs::directory_iterator it(dirname.empty() ? fs::path(".") : fs::path(dirname), ec);
+    if (ec) {
+        return;
+    }
+
+    for (const fs::directory_entry &entry : it) {
+        std::string filepath = entry.path().filename().string();
+        if (!dirname.empty()) {
+            char last = dirname.back();
+            if (last == '/' || last == fs::path::preferred_separator) {
+                filepath = dirname + filepath;
+            } else {
+                filepath = dirname + '/' + filepath;
+            }
+        }
+
+        if (entry.is_directory(ec)) {
+            walkDirectory(filepath, prefix, images);
+        } else if (filepath.compare(0, prefix.size(), prefix) == 0 && isImage(filepath)) {
+            images.push_back(filepath.substr(prefix.size()));
+        }
+    }
+}
+
+
+/*
+ * Find the image files starting with the given prefix, returning the
+ * remainder of their paths.
+ */
+static std::vector<std::string>
+findImages(const std::string &prefix)
+{
+    std::string dirname;
+    std::error_code ec;
+    if (fs::is_directory(prefix, ec)) {
+        dirname = prefix;
+    } else {
+        dirname = fs::path(prefix).parent_path().string();
+    }
+
+    std::vector<std::string> images;
+    walkDirectory(dirname, prefix, images);
+    return images;
+}
+
+
+static image::Image *
+readImage(const std::string &filename)
+{
+    std::string ext = fs::path(filename).extension().string();
+    if (ext == ".png") {
+        return image::readPNG(filename.c_str());
+    }
+    if (ext == ".bmp") {
+        return image::readBMP(filename.c_str());
+    }
+
+    std::ifstream is(filename, std::ifstream::binary);
+    if (!is) {
+        return nullptr;
+    }
+    std::string buffer((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return image::readPNM(buffer.data(), buffer.size());
+}
+
+
+static bool
+isOutdated(const std::string &output, const std::string &input)
 {
-    os::String command = find_command();
+    std::error_code ec;
+    fs::file_time_type outputTime = fs::last_write_time(output, ec);
+    if (ec) {
+        return true;
+    }
+    fs::file_time_type inputTime = fs::last_write_time(input, ec);
+    return !ec && outputTime < inputTime;
+}
+
+
+static std::string
+escapeHTML(const std::string &s)
+{
+    std::string escaped;
+    for (char c : s) {
+        switch (c) {
+        case '&': escaped += "&amp;"; break;
+        case '<': escaped += "&lt;"; break;
+        case '>': escaped += "&gt;"; break;
+        case '"': escaped += "&quot;"; break;
+        default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+
+static std::string
+escapeJSON(const std::string &s)
+{
+    std::string escaped;
+    for (unsigned char c : s) {
+        switch (c) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\t': escaped += "\\t"; break;
+        default:
+            if (c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof buf, "\\u%04x", c);
+                escaped += buf;
+            } else {
+                escaped += c;
+            }
+            break;
+        }
+    }
+    return escaped;
+}
+
+
+/*
+ * Emit a table cell for the image, (re)generating its thumbnail as needed.
+ * The image is only decoded if it wasn't already.
+ */
+static std::string
+surface(const std::string &filename, const image::Image *decoded)
+{
+    fs::path thumbPath(filename);
+    thumbPath.replace_extension(".thumb.png");
+    std::string thumb = thumbPath.string();
+
+    std::error_code ec;
+    std::ostringstream cell;
+
+    if (fs::exists(filename, ec) && isOutdated(thumb, filename)) {
+        std::unique_ptr<image::Image> loaded;
+        if (!decoded) {
+            loaded.reset(readImage(filename));
+            decoded = loaded.get();
+        }
+
+        if (decoded) {
+            unsigned width = decoded->width;
+            unsigned height = decoded->height;
+            if (width <= thumbSize && height <= thumbSize) {
+                if (width >= height) {
+                    height = height * thumbSize / width;
+                    width = thumbSize;
+                } else {
+                    width = width * thumbSize / height;
+                    height = thumbSize;
+                }
+                cell << "        <td><img src=\"" << escapeHTML(filename) << "\" "
+                     << "width=\"" << width << "\" height=\"" << height << "\"/></td>\n";
+                return cell.str();
+            }
+
+            std::unique_ptr<image::Image> thumbnail(image::thumbnail(*decoded, thumbSize));
+            if (!thumbnail || !thumbnail->writePNG(thumb.c_str(), false, true)) {
+                thumb = filename;
+            }
+        }
+    }
+
+    cell << "        <td><a href=\"" << escapeHTML(filename) << "\">"
+         << "<img src=\"" << escapeHTML(thumb) << "\"/></a></td>\n";
+    return cell.str();
+}
+
+
+static void
+compareEntry(Entry &entry,
+             const std::string &refPrefix,
+             const std::string &srcPrefix,
+             const Options &options)
+{
+    std::string refImage = refPrefix + entry.name;
+    std::string srcImage = srcPrefix + entry.name;
+
+    fs::path deltaPath(srcImage);
+    deltaPath.replace_extension(".diff.png");
+    std::string deltaImage = deltaPath.string();
 
-    char *args[4];
-    args[0] = (char *) APITRACE_PYTHON_EXECUTABLE;
-    args[1] = (char *) command.str();
-    args[2] = (char *) "--help";
-    args[3] = NULL;
+    std::unique_ptr<image::Image> ref;
+    std::unique_ptr<image::Image> src;
+    std::unique_ptr<image::Image> delta;
 
-    os::execute(args);
+    std::error_code ec;
+    if (fs::exists(refImage, ec) && fs::exists(srcImage, ec)) {
+        ref.reset(readImage(refImage));
+        src.reset(readImage(srcImage));
+    }
+
+    bool match = false;
+    if (ref && src) {
+        entry.comparison = image::compare(*ref, *src, options.fuzz, options.alpha);
+        match = entry.comparison.absoluteError == 0;
+        entry.result = match ? RESULT_MATCH : RESULT_MISMATCH;
+    } else {
+        entry.result = RESULT_MISSING;
+    }
+
+    if (!match || options.showAll) {
+        if (ref && src &&
+            (options.overwrite ||
+             (isOutdated(deltaImage, refImage) && isOutdated(deltaImage, srcImage)))) {
+            delta.reset(image::diff(*ref, *src, options.fuzz, options.alpha));
+            if (delta) {
+                delta->writePNG(deltaImage.c_str(), false, true);
+            }
+        }
+
+        entry.cells += surface(refImage, ref.get());
+        entry.cells += surface(srcImage, src.get());
+        entry.cells += surface(deltaImage, delta.get());
+    }
 }
 
+
 static int
 command(int argc, char *argv[])
 {
-    int i;
+    Options options;
+    const char *output = "index.html";
+    const char *jsonOutput = nullptr;
+    unsigned jobs = std::thread::hardware_concurrency();
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'v':
+            options.verbose = true;
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case JSON_OPT:
+            jsonOutput = optarg;
+            break;
+        case 'f':
+            options.fuzz = atof(optarg);
+            break;
+        case 'a':
+            options.alpha = true;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case OVERWRITE_OPT:
+            options.overwrite = true;
+            break;
+        case SHOW_ALL_OPT:
+            options.showAll = true;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc - optind != 2) {
+        std::cerr << "error: apitrace diff-images requires exactly two prefixes as arguments.\n";
+        usage();
+        return 1;
+    }
+
+    std::string refPrefix = argv[optind];
+    std::string srcPrefix = argv[optind + 1];
+
+    std::set<std::string> names;
+    for (auto & name : findImages(refPrefix)) {
+        names.insert(name);
+    }
+    for (auto & name : findImages(srcPrefix)) {
+        names.insert(name);
+    }
+
+    std::vector<Entry> entries(names.size());
+    auto nameIt = names.begin();
+    for (auto & entry : entries) {
+        entry.name = *nameIt++;
+    }
+
+    // Compare in parallel, but report in order
+    std::atomic<size_t> nextEntry(0);
+    std::mutex verboseMutex;
+    auto worker = [&] () {
+        size_t i;
+        while ((i = nextEntry++) < entries.size()) {
+            Entry &entry = entries[i];
+            compareEntry(entry, refPrefix, srcPrefix, options);
+            if (options.verbose) {
+                std::lock_guard<std::mutex> lock(verboseMutex);
+                std::cout << "Comparing " << refPrefix << entry.name << " and "
+                          << srcPrefix << entry.name << " ... "
+                          << resultNames[entry.result] << "\n";
+            }
+        }
+    };
+
+    jobs = std::max(std::min<size_t>(jobs, entries.size()), size_t(1));
+    std::vector<std::thread> threads;
+    for (unsigned j = 1; j < jobs; ++j) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto & thread : threads) {
+        thread.join();
+    }
+
+    unsigned failures = 0;
+    for (auto & entry : entries) {
+        failures += entry.result != RESULT_MATCH;
+    }
+
+    std::ofstream htmlFile;
+    if (output[0] && strcmp(output, "-") != 0) {
+        htmlFile.open(output);
+        if (!htmlFile) {
+            std::cerr << "error: failed to open " << output << "\n";
+            return 1;
+        }
+    }
+    std::ostream &html = htmlFile.is_open() ? htmlFile : std::cout;
+
+    html << "<html>\n"
+            "  <body>\n"
+            "    <table border=\"1\">\n"
+            "      <tr><th>File</th><th>" << escapeHTML(refPrefix) << "</th><th>"
+         << escapeHTML(srcPrefix) << "</th><th>&Delta;</th></tr>\n";
+    for (auto & entry : entries) {
+        const char *bgcolor = entry.result == RESULT_MATCH ? "#20ff20" : "#ff2020";
+        html << "      <tr>\n"
+             << "        <td bgcolor=\"" << bgcolor << "\"><a href=\""
+             << escapeHTML(refPrefix + entry.name) << "\">" << escapeHTML(entry.name) << "</a></td>\n"
+             << entry.cells
+             << "      </tr>\n";
+    }
+    html << "    </table>\n"
+            "  </body>\n"
+            "</html>\n";
 
-    os::String command = find_command();
+    if (jsonOutput) {
+        std::ofstream json(jsonOutput);
+        if (!json) {
+            std::cerr << "error: failed to open " << jsonOutput << "\n";
+            return 1;
+        }
 
-    std::vector<const char *> args;
-    args.push_back(APITRACE_PYTHON_EXECUTABLE);
-    args.push_back(command.str());
-    for (i = 1; i < argc; i++) {
-        args.push_back(argv[i]);
+        json << "{\n"
+             << "  \"ref\": \"" << escapeJSON(refPrefix) << "\",\n"
+             << "  \"src\": \"" << escapeJSON(srcPrefix) << "\",\n"
+             << "  \"fuzz\": " << options.fuzz << ",\n"
+             << "  \"failures\": " << failures << ",\n"
+             << "  \"images\": [";
+        const char *sep = "\n";
+        for (auto & entry : entries) {
+            json << sep << "    {\"name\": \"" << escapeJSON(entry.name) << "\", "
+                 << "\"result\": \"" << resultNames[entry.result] << "\"";
+            if (entry.result != RESULT_MISSING && !entry.comparison.sizeMismatch) {
+                json << ", \"absolute_error\": " << entry.comparison.absoluteError
+                     << ", \"precision\": " << entry.comparison.precision;
+            }
+            json << "}";
+            sep = ",\n";
+        }
+        json << "\n  ]\n"
+             << "}\n";
     }
-    args.push_back(NULL);
 
-    return os::execute((char * const *)&args[0]);
+    return failures ? 1 : 0;
 }
 
 const Command diff_images_command = {
@@ -94,9 +94,12 @@ static const Command * commands[] = {
     &gltrim_command,
     &leaks_command,
     &pickle_command,
+    &profile_export_command,
+    &profile_report_command,
     &sed_command,
     &repack_command,
     &retrace_command,
+    &ring_convert_command,
     &trace_command,
     &trim_command,
     &info_command,
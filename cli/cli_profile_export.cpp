@@ -0,0 +1,133 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <getopt.h>
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "cli.hpp"
+
+#include "trace_event_writer.hpp"
+#include "trace_profiler.hpp"
+
+
+static const char *synopsis = "Convert a replay profile to Chrome trace events.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace profile-export [OPTIONS] PROFILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Reads a text or binary profile, as written by `apitrace replay --pcpu --pgpu`,\n"
+        "and writes it as Chrome trace event JSON, for chrome://tracing or Perfetto.\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -o, --output=FILE    output file [default: stdout]\n"
+        "\n"
+    ;
+}
+
+const static char *
+shortOptions = "ho:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"output", required_argument, 0, 'o'},
+    {0, 0, 0, 0}
+};
+
+static int
+command(int argc, char *argv[])
+{
+    const char *output = nullptr;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'o':
+            output = optarg;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: exactly one profile must be specified\n";
+        usage();
+        return 1;
+    }
+
+    trace::ProfileReader reader;
+    if (!reader.open(argv[optind])) {
+        std::cerr << "error: failed to open " << argv[optind] << "\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (output) {
+        file.open(output, std::ios::out | std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "error: failed to open " << output << "\n";
+            return 1;
+        }
+    }
+
+    trace::TraceEventWriter writer(output ? file : std::cout);
+
+    /* Only a frame is held in memory at a time */
+    std::vector<trace::Profile::Call> calls;
+    trace::Profile::Frame frame;
+    while (reader.readFrame(calls, frame)) {
+        const std::vector<std::string> &names = reader.getNames();
+        writer.setTimeBase(reader.getTimeBase());
+        for (auto & call : calls) {
+            writer.writeCall(call, names[call.name].c_str());
+        }
+        writer.writeFrameEnd();
+    }
+
+    writer.close();
+
+    return 0;
+}
+
+const Command profile_export_command = {
+    "profile-export",
+    synopsis,
+    usage,
+    command
+};
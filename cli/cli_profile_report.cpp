@@ -0,0 +1,577 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Rollups of replay profiles per program, frame and call signature.
+ */
+
+
+#include <string.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "md5.h"
+
+#include "cli.hpp"
+
+#include "trace_parser.hpp"
+#include "trace_profiler.hpp"
+
+
+static const char *synopsis = "Report the costliest programs, frames and calls of a replay profile.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace profile-report [OPTIONS] PROFILE\n"
+        << synopsis << "\n"
+        "\n"
+        "Reads a text or binary profile, as written by `apitrace replay --pgpu --pcpu --ppd`,\n"
+        "and rolls up its calls per shader program, per frame and per call signature.\n"
+        "\n"
+        "    -h, --help           show this help message and exit\n"
+        "    -n, --top=N          only list the top N entries of each table, 0 for all [default: 10]\n"
+        "    -s, --sort=KEY       sort by `gpu`, `cpu`, `pixels` or `calls` [default: gpu]\n"
+        "    -t, --trace=TRACE    trace the profile was recorded from, to identify programs\n"
+        "                         by a hash of their shader sources\n"
+        "\n"
+    ;
+}
+
+const static char *
+shortOptions = "hn:s:t:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"top", required_argument, 0, 'n'},
+    {"sort", required_argument, 0, 's'},
+    {"trace", required_argument, 0, 't'},
+    {0, 0, 0, 0}
+};
+
+
+enum SortKey {
+    SORT_GPU,
+    SORT_CPU,
+    SORT_PIXELS,
+    SORT_CALLS,
+};
+
+static const char *sortNames[] = {
+    "GPU time",
+    "CPU time",
+    "pixels drawn",
+    "call count",
+};
+
+
+struct Rollup {
+    uint64_t calls = 0;
+    int64_t gpuTotal = 0;
+    int64_t cpuTotal = 0;
+    int64_t pixelTotal = 0;
+
+    /* Call with the longest GPU duration, or CPU when GPU times weren't recorded */
+    unsigned longestCall = 0;
+    int64_t longestDuration = -1;
+
+    void
+    add(const trace::Profile::Call &call) {
+        ++calls;
+        gpuTotal += call.gpuDuration;
+        cpuTotal += call.cpuDuration;
+        if (call.pixels > 0) {
+            pixelTotal += call.pixels;
+        }
+        int64_t duration = call.gpuDuration ? call.gpuDuration : call.cpuDuration;
+        if (duration > longestDuration) {
+            longestCall = call.no;
+            longestDuration = duration;
+        }
+    }
+
+    int64_t
+    value(SortKey key) const {
+        switch (key) {
+        case SORT_GPU:
+            return gpuTotal;
+        case SORT_CPU:
+            return cpuTotal;
+        case SORT_PIXELS:
+            return pixelTotal;
+        case SORT_CALLS:
+            return int64_t(calls);
+        }
+        return 0;
+    }
+};
+
+
+struct Row {
+    std::string label;
+    std::string hash;
+    Rollup rollup;
+};
+
+
+static std::string
+finalDigest(MD5Context &md5c)
+{
+    unsigned char signature[16];
+    MD5Final(signature, &md5c);
+
+    const char hex[] = "0123456789abcdef";
+    std::string digest(32, '0');
+    for (size_t i = 0; i < sizeof signature; ++i) {
+        digest[2*i    ] = hex[signature[i] >> 4];
+        digest[2*i + 1] = hex[signature[i] & 0xf];
+    }
+    return digest;
+}
+
+
+/**
+ * Tracks the shader sources each program is linked from, hashed, as the
+ * trace is parsed.  Only the digests are kept, never the sources.
+ */
+class ShaderHashes
+{
+public:
+    bool
+    scan(const char *filename) {
+        trace::Parser parser;
+        if (!parser.open(filename)) {
+            return false;
+        }
+
+        /* Only the few shader and program calls need their arguments */
+        trace::Call *call;
+        while ((call = parser.scan_call(isShaderCall))) {
+            parseCall(*call);
+            delete call;
+        }
+        return true;
+    }
+
+    /* Hash of the shaders program was last linked from before callNo */
+    std::string
+    lookup(unsigned program, unsigned callNo) const {
+        auto it = links.find(program);
+        if (it == links.end()) {
+            return std::string();
+        }
+        auto link = std::upper_bound(it->second.begin(), it->second.end(), callNo,
+            [] (unsigned no, const Link &link) { return no < link.callNo; });
+        if (link == it->second.begin()) {
+            return std::string();
+        }
+        return (--link)->hash;
+    }
+
+private:
+    struct Link {
+        unsigned callNo;
+        std::string hash;
+    };
+
+    std::map<unsigned, std::string> shaders;
+    std::map<unsigned, std::set<unsigned>> attached;
+    std::map<unsigned, std::vector<Link>> links;
+
+    static std::string
+    hashSources(const trace::Value *value) {
+        MD5Context md5c;
+        MD5Init(&md5c);
+        const trace::Array *array = value ? value->toArray() : nullptr;
+        if (array) {
+            for (auto element : array->values) {
+                const char *source = element ? element->toString() : nullptr;
+                if (source) {
+                    MD5Update(&md5c, (unsigned char *)source, unsigned(strlen(source)));
+                }
+            }
+        } else if (value && value->toString()) {
+            const char *source = value->toString();
+            MD5Update(&md5c, (unsigned char *)source, unsigned(strlen(source)));
+        }
+        return finalDigest(md5c);
+    }
+
+    /* Programs are hashed from their shaders' digests, in a stable order */
+    void
+    link(unsigned program, unsigned callNo, const std::vector<std::string> &digests) {
+        MD5Context md5c;
+        MD5Init(&md5c);
+        for (auto & digest : digests) {
+            MD5Update(&md5c, (unsigned char *)digest.data(), unsigned(digest.size()));
+        }
+        links[program].push_back({callNo, finalDigest(md5c)});
+    }
+
+    static bool
+    isShaderCall(const char *name) {
+        static const char *names[] = {
+            "glShaderSource",
+            "glShaderSourceARB",
+            "glAttachShader",
+            "glAttachObjectARB",
+            "glDetachShader",
+            "glDetachObjectARB",
+            "glLinkProgram",
+            "glLinkProgramARB",
+            "glCreateShaderProgramv",
+            "glCreateShaderProgramvEXT",
+            "glCreateShaderProgramEXT",
+            "glProgramBinary",
+            "glProgramBinaryOES",
+        };
+        for (auto n : names) {
+            if (strcmp(name, n) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void
+    parseCall(trace::Call &call) {
+        const char *name = call.name();
+
+        if (strcmp(name, "glShaderSource") == 0 ||
+            strcmp(name, "glShaderSourceARB") == 0) {
+            shaders[call.arg(0).toUInt()] = hashSources(&call.arg(2));
+        } else if (strcmp(name, "glAttachShader") == 0 ||
+                   strcmp(name, "glAttachObjectARB") == 0) {
+            attached[call.arg(0).toUInt()].insert(call.arg(1).toUInt());
+        } else if (strcmp(name, "glDetachShader") == 0 ||
+                   strcmp(name, "glDetachObjectARB") == 0) {
+            attached[call.arg(0).toUInt()].erase(call.arg(1).toUInt());
+        } else if (strcmp(name, "glLinkProgram") == 0 ||
+                   strcmp(name, "glLinkProgramARB") == 0) {
+            unsigned program = call.arg(0).toUInt();
+            std::vector<std::string> digests;
+            for (unsigned shader : attached[program]) {
+                auto it = shaders.find(shader);
+                if (it != shaders.end()) {
+                    digests.push_back(it->second);
+                }
+            }
+            std::sort(digests.begin(), digests.end());
+            link(program, call.no, digests);
+        } else if (strcmp(name, "glCreateShaderProgramv") == 0 ||
+                   strcmp(name, "glCreateShaderProgramvEXT") == 0) {
+            if (call.ret) {
+                link(call.ret->toUInt(), call.no, {hashSources(&call.arg(2))});
+            }
+        } else if (strcmp(name, "glCreateShaderProgramEXT") == 0) {
+            if (call.ret) {
+                link(call.ret->toUInt(), call.no, {hashSources(&call.arg(1))});
+            }
+        } else if (strcmp(name, "glProgramBinary") == 0 ||
+                   strcmp(name, "glProgramBinaryOES") == 0) {
+            /* No sources, so hash the binary itself */
+            const trace::Blob *blob = call.arg(2).toBlob();
+            MD5Context md5c;
+            MD5Init(&md5c);
+            if (blob) {
+                MD5Update(&md5c, (unsigned char *)blob->buf, unsigned(blob->size));
+            }
+            link(call.arg(0).toUInt(), call.no, {finalDigest(md5c)});
+        }
+    }
+};
+
+
+/* Keeps only the top N frames, so memory doesn't grow with the profile */
+class TopFrames
+{
+public:
+    TopFrames(size_t _limit, SortKey _key) :
+        limit(_limit),
+        queue(Compare{_key})
+    {}
+
+    void
+    add(Row &&row) {
+        queue.push(std::move(row));
+        if (limit && queue.size() > limit) {
+            queue.pop();
+        }
+    }
+
+    std::vector<Row>
+    take(void) {
+        std::vector<Row> rows;
+        rows.reserve(queue.size());
+        while (!queue.empty()) {
+            rows.push_back(queue.top());
+            queue.pop();
+        }
+        std::reverse(rows.begin(), rows.end());
+        return rows;
+    }
+
+private:
+    struct Compare {
+        SortKey key;
+        /* Smallest on top, to be evicted first */
+        bool operator () (const Row &a, const Row &b) const {
+            return a.rollup.value(key) > b.rollup.value(key);
+        }
+    };
+
+    size_t limit;
+    std::priority_queue<Row, std::vector<Row>, Compare> queue;
+};
+
+
+static void
+sortRows(std::vector<Row> &rows, SortKey key, size_t limit)
+{
+    auto compare = [key] (const Row &a, const Row &b) {
+        return a.rollup.value(key) > b.rollup.value(key);
+    };
+    if (limit && limit < rows.size()) {
+        std::partial_sort(rows.begin(), rows.begin() + limit, rows.end(), compare);
+        rows.resize(limit);
+    } else {
+        std::stable_sort(rows.begin(), rows.end(), compare);
+    }
+}
+
+
+static void
+printTable(const char *title, const char *labelTitle, const char *callsTitle,
+           const std::vector<Row> &rows, size_t total, int64_t gpuTotal,
+           bool hashes)
+{
+    size_t labelWidth = strlen(labelTitle);
+    for (auto & row : rows) {
+        labelWidth = std::max(labelWidth, row.label.size());
+    }
+
+    std::cout << title;
+    if (rows.size() < total) {
+        std::cout << " (top " << rows.size() << " of " << total << ")";
+    }
+    std::cout << ":\n\n";
+
+    std::cout << "  " << std::left << std::setw(int(labelWidth)) << labelTitle << std::right;
+    if (hashes) {
+        std::cout << "  " << std::left << std::setw(32) << "shader hash" << std::right;
+    }
+    std::cout
+        << std::setw(12) << callsTitle
+        << std::setw(16) << "GPU [ns]"
+        << std::setw(8) << "GPU %"
+        << std::setw(16) << "CPU [ns]"
+        << std::setw(14) << "pixels"
+        << std::setw(12) << "longest"
+        << "\n";
+
+    for (auto & row : rows) {
+        const Rollup &rollup = row.rollup;
+
+        std::ostringstream percent;
+        if (gpuTotal > 0) {
+            percent << std::fixed << std::setprecision(1)
+                    << 100.0 * double(rollup.gpuTotal) / double(gpuTotal);
+        } else {
+            percent << "-";
+        }
+
+        std::cout << "  " << std::left << std::setw(int(labelWidth)) << row.label << std::right;
+        if (hashes) {
+            std::cout << "  " << std::left << std::setw(32)
+                      << (row.hash.empty() ? "-" : row.hash) << std::right;
+        }
+        std::cout
+            << std::setw(12) << rollup.calls
+            << std::setw(16) << rollup.gpuTotal
+            << std::setw(8) << percent.str()
+            << std::setw(16) << rollup.cpuTotal
+            << std::setw(14) << rollup.pixelTotal
+            << std::setw(12) << rollup.longestCall
+            << "\n";
+    }
+
+    std::cout << "\n";
+}
+
+
+static int
+command(int argc, char *argv[])
+{
+    size_t limit = 10;
+    SortKey key = SORT_GPU;
+    const char *traceName = nullptr;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'n':
+            limit = strtoul(optarg, nullptr, 0);
+            break;
+        case 's':
+            if (strcmp(optarg, "gpu") == 0) {
+                key = SORT_GPU;
+            } else if (strcmp(optarg, "cpu") == 0) {
+                key = SORT_CPU;
+            } else if (strcmp(optarg, "pixels") == 0) {
+                key = SORT_PIXELS;
+            } else if (strcmp(optarg, "calls") == 0) {
+                key = SORT_CALLS;
+            } else {
+                std::cerr << "error: unknown sort key `" << optarg << "`\n";
+                usage();
+                return 1;
+            }
+            break;
+        case 't':
+            traceName = optarg;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1) {
+        std::cerr << "error: exactly one profile must be specified\n";
+        usage();
+        return 1;
+    }
+
+    ShaderHashes hashes;
+    if (traceName && !hashes.scan(traceName)) {
+        std::cerr << "error: failed to open " << traceName << "\n";
+        return 1;
+    }
+
+    trace::ProfileReader reader;
+    if (!reader.open(argv[optind])) {
+        std::cerr << "error: failed to open " << argv[optind] << "\n";
+        return 1;
+    }
+
+    /*
+     * Memory is bounded by the number of distinct programs and call names,
+     * plus the top frames and the calls of the frame being read.
+     */
+    std::map<std::pair<unsigned, std::string>, Rollup> programs;
+    std::vector<Rollup> signatures;
+    TopFrames frames(limit, key);
+
+    Rollup callTotal;
+    Rollup drawTotal;
+    int64_t frameGpuTotal = 0;
+    size_t frameCount = 0;
+
+    std::vector<trace::Profile::Call> calls;
+    trace::Profile::Frame frame;
+    while (reader.readFrame(calls, frame)) {
+        Rollup frameRollup;
+        for (auto & call : calls) {
+            frameRollup.add(call);
+            callTotal.add(call);
+
+            if (signatures.size() <= call.name) {
+                signatures.resize(call.name + 1);
+            }
+            signatures[call.name].add(call);
+
+            /* As Profile::Program, only draw calls are attributed to programs */
+            if (call.pixels >= 0) {
+                std::string hash;
+                if (traceName) {
+                    hash = hashes.lookup(call.program, call.no);
+                }
+                programs[std::make_pair(call.program, hash)].add(call);
+                drawTotal.add(call);
+            }
+        }
+
+        /* Frames are timed as a whole, including the gaps between calls */
+        frameRollup.gpuTotal = frame.gpuDuration;
+        frameRollup.cpuTotal = frame.cpuDuration;
+        frameGpuTotal += frame.gpuDuration;
+        ++frameCount;
+
+        frames.add({std::to_string(frame.no), std::string(), frameRollup});
+    }
+
+    std::cout
+        << frameCount << " frames, "
+        << callTotal.calls << " calls (" << drawTotal.calls << " draws), "
+        << callTotal.gpuTotal << " ns GPU, "
+        << callTotal.cpuTotal << " ns CPU, "
+        << callTotal.pixelTotal << " pixels, "
+        << "sorted by " << sortNames[key] << "\n\n";
+
+    std::vector<Row> rows;
+    for (auto & program : programs) {
+        rows.push_back({std::to_string(program.first.first), program.first.second, program.second});
+    }
+    size_t total = rows.size();
+    sortRows(rows, key, limit);
+    printTable("Programs", "program", "draws", rows, total, drawTotal.gpuTotal, traceName != nullptr);
+
+    rows.clear();
+    const std::vector<std::string> &names = reader.getNames();
+    for (size_t i = 0; i < signatures.size(); ++i) {
+        if (signatures[i].calls) {
+            rows.push_back({names[i], std::string(), signatures[i]});
+        }
+    }
+    total = rows.size();
+    sortRows(rows, key, limit);
+    printTable("Calls", "name", "calls", rows, total, callTotal.gpuTotal, false);
+
+    printTable("Frames", "frame", "calls", frames.take(), frameCount, frameGpuTotal, false);
+
+    return 0;
+}
+
+const Command profile_report_command = {
+    "profile-report",
+    synopsis,
+    usage,
+    command
+};
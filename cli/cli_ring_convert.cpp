@@ -0,0 +1,112 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <string.h>
+#include <getopt.h>
+
+#include <iostream>
+#include <string>
+
+#include "cli.hpp"
+
+#include "trace_ostream.hpp"
+
+
+static const char *synopsis = "Convert a TRACE_RING_SIZE dump into a trace file.";
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: apitrace ring-convert [options] <ring-dump> [<out-trace-file>]\n"
+        << synopsis << "\n"
+        << "\n"
+        << "The output defaults to the dump file name without the .ring extension.\n"
+        << "\n"
+        << "    -h, --help             Show this help message and exit\n"
+        << "\n";
+}
+
+const static char *
+shortOptions = "h";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+};
+
+
+static int
+command(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (argc != optind + 1 && argc != optind + 2) {
+        std::cerr << "error: incorrect number of arguments\n";
+        usage();
+        return 1;
+    }
+
+    const char *dumpFileName = argv[optind];
+    std::string outFileName;
+    if (argc == optind + 2) {
+        outFileName = argv[optind + 1];
+    } else {
+        outFileName = dumpFileName;
+        size_t length = outFileName.length();
+        if (length > 5 && outFileName.compare(length - 5, 5, ".ring") == 0) {
+            outFileName.resize(length - 5);
+        } else {
+            outFileName += ".trace";
+        }
+    }
+
+    if (!trace::convertRingDump(dumpFileName, outFileName.c_str())) {
+        std::cerr << "error: failed to convert " << dumpFileName << "\n";
+        return 1;
+    }
+
+    return 0;
+}
+
+const Command ring_convert_command = {
+    "ring-convert",
+    synopsis,
+    usage,
+    command
+};
@@ -150,7 +150,7 @@ public:
         const trace::Profile::Call& call = m_profile->calls[index];
 
         QString text;
-        text  = QString::fromStdString(call.name);
+        text  = QString::fromStdString(m_profile->names[call.name]);
         text += QString("\nCall: %1").arg(call.no);
         text += QString("\nCPU Duration: %1").arg(Profiling::getTimeString(call.cpuDuration));
 
@@ -8,6 +8,9 @@
 #include "trace_profiler.hpp"
 
 #include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
 #include <QVariant>
 #include <QList>
 #include <QImage>
@@ -128,6 +131,46 @@ qint64 BlockingIODevice::writeData(const char * data, qint64 maxSize)
 
 Q_DECLARE_METATYPE(QList<ApiTraceError>);
 
+/**
+ * Replace the values marked as unchanged by an incremental state dump with
+ * the ones at the same place in the previous state.
+ *
+ * Returns false if the previous state doesn't have them.
+ */
+static bool
+resolveUnchanged(QVariant &value, const QVariant &previous)
+{
+    if (value.userType() == QMetaType::QVariantMap) {
+        QVariantMap map = value.toMap();
+        if (map.value(QLatin1String("__unchanged__")).toBool()) {
+            if (!previous.isValid()) {
+                return false;
+            }
+            value = previous;
+            return true;
+        }
+
+        QVariantMap previousMap = previous.toMap();
+        for (QVariantMap::iterator it = map.begin(); it != map.end(); ++it) {
+            if (!resolveUnchanged(it.value(), previousMap.value(it.key()))) {
+                return false;
+            }
+        }
+        value = map;
+    } else if (value.userType() == QMetaType::QVariantList) {
+        QVariantList list = value.toList();
+        QVariantList previousList = previous.toList();
+        for (int i = 0; i < list.size(); ++i) {
+            if (!resolveUnchanged(list[i], previousList.value(i))) {
+                return false;
+            }
+        }
+        value = list;
+    }
+    return true;
+}
+
+
 Retracer::Retracer(QObject *parent)
     : QThread(parent),
       m_benchmarking(false),
@@ -402,6 +445,9 @@ void Retracer::run()
         }
         arguments << QLatin1String("-s"); // emit snapshots
         arguments << QLatin1String("-"); // emit to stdout
+        // Only thumbnails are shown, so don't read back full frames
+        arguments << QLatin1String("--snapshot-max-size");
+        arguments << QString::number(THUMBNAIL_SIZE);
     } else if (isProfiling()) {
         if (m_profileGpu) {
             arguments << QLatin1String("--pgpu");
@@ -414,6 +460,9 @@ void Retracer::run()
         if (m_profilePixels) {
             arguments << QLatin1String("--ppd");
         }
+
+        arguments << QLatin1String("--profile-format");
+        arguments << QLatin1String("binary");
     } else {
         if (!m_doubleBuffered) {
             arguments << QLatin1String("--sb");
@@ -449,6 +498,30 @@ void Retracer::run()
         arguments << callsStr;
     }
 
+    /*
+     * Capture states incrementally, as long as the previous capture was made
+     * with the same options on the same trace.
+     */
+
+    QString digestsFileName;
+    if (m_captureState && m_remoteTarget.isEmpty() && m_tempDir.isValid()) {
+        digestsFileName = m_tempDir.filePath(QLatin1String("state-digests"));
+
+        // Everything but the call number
+        QStringList stateArguments = arguments;
+        stateArguments.removeAt(stateArguments.indexOf(QLatin1String("-D")) + 1);
+        stateArguments << m_fileName;
+        stateArguments << QFileInfo(m_fileName).lastModified().toString(Qt::ISODate);
+        if (stateArguments != m_lastStateArguments) {
+            QFile::remove(digestsFileName);
+            m_lastState.clear();
+            m_lastStateArguments = stateArguments;
+        }
+
+        arguments << QLatin1String("--dump-digests");
+        arguments << QDir::toNativeSeparators(digestsFileName);
+    }
+
     arguments << m_fileName;
 
     /*
@@ -489,14 +562,17 @@ void Retracer::run()
     ImageHash thumbnails;
     QVariantMap parsedJson;
     trace::Profile* profile = NULL;
+    bool stateResolved = true;
 
     process.setReadChannel(QProcess::StandardOutput);
     if (process.waitForReadyRead(-1)) {
         BlockingIODevice io(&process);
 
         if (m_captureState) {
-            parsedJson = decodeUBJSONObject(&io).toMap();
+            QVariant state = decodeUBJSONObject(&io);
             process.waitForFinished(-1);
+            stateResolved = resolveUnchanged(state, m_lastState);
+            parsedJson = state.toMap();
         } else if (m_captureThumbnails) {
             /*
              * Parse concatenated PNM images from output.
@@ -551,18 +627,20 @@ void Retracer::run()
 
             Q_ASSERT(process.state() != QProcess::Running);
         } else if (isProfiling()) {
-            profile = new trace::Profile();
-
+            QByteArray output;
             while (!io.atEnd()) {
-                char line[256];
-                qint64 lineLength;
-
-                lineLength = io.readLine(line, 256);
-
-                if (lineLength == -1)
+                char buffer[64 * 1024];
+                qint64 readBytes = io.read(buffer, sizeof buffer);
+                if (readBytes <= 0)
                     break;
+                output.append(buffer, readBytes);
+            }
 
-                trace::Profiler::parseLine(line, profile);
+            profile = new trace::Profile();
+            if (!trace::Profiler::parseBinary(output.constData(), output.size(), profile)) {
+                msg = QLatin1String("Failed to parse profile");
+                delete profile;
+                profile = NULL;
             }
         } else {
             QByteArray output;
@@ -585,6 +663,25 @@ void Retracer::run()
         msg = QLatin1String("Process exited with non zero exit code");
     }
 
+    if (!digestsFileName.isEmpty()) {
+        bool succeeded = process.exitStatus() == QProcess::NormalExit &&
+                         process.exitCode() == 0;
+        if (succeeded && stateResolved) {
+            m_lastState = parsedJson;
+        } else {
+            // Start afresh next time
+            QFile::remove(digestsFileName);
+            m_lastState.clear();
+            m_lastStateArguments.clear();
+
+            if (succeeded) {
+                // The previous state is gone, so capture the whole state
+                run();
+                return;
+            }
+        }
+    }
+
     /*
      * Parse errors.
      */
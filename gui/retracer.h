@@ -6,6 +6,9 @@
 
 #include <QThread>
 #include <QProcess>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QVariant>
 
 class ApiTraceState;
 
@@ -111,4 +114,13 @@ private:
     QList<qlonglong> m_thumbnailsToCapture;
 
     QList<RetracerCallRange> m_callsToIgnore;
+
+    /*
+     * State captures are incremental: the digests of the last captured state
+     * are kept in a file, so that the next retrace only sends the images and
+     * buffers which changed, and the rest is taken from m_lastState.
+     */
+    QTemporaryDir m_tempDir;
+    QVariantMap m_lastState;
+    QStringList m_lastStateArguments;
 };
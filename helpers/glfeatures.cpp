@@ -359,6 +359,12 @@ Features::load(const Profile & profile, const Extensions & ext)
                               ext.has("GL_ARB_pixel_buffer_object") ||
                               ext.has("GL_EXT_pixel_buffer_object");
 
+        map_buffer_range = profile.versionGreaterOrEqual(3, 0) ||
+                           ext.has("GL_ARB_map_buffer_range");
+
+        sync = profile.versionGreaterOrEqual(3, 2) ||
+               ext.has("GL_ARB_sync");
+
         read_buffer = 1;
 
         // GL_EXT_framebuffer_object requires different entry points
@@ -382,6 +388,12 @@ Features::load(const Profile & profile, const Extensions & ext)
         pixel_buffer_object = profile.versionGreaterOrEqual(3, 0) ||
                               ext.has("GL_NV_pixel_buffer_object");
 
+        // GL_EXT_map_buffer_range requires different entry points
+        map_buffer_range = profile.versionGreaterOrEqual(3, 0);
+
+        // GL_APPLE_sync requires different entry points
+        sync = profile.versionGreaterOrEqual(3, 0);
+
         // GL_EXT_multiview_draw_buffers requires different entry points
         // GL_NV_read_buffer requires different entry points
         read_buffer = 0;
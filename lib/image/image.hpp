@@ -30,11 +30,13 @@
 #pragma once
 
 #include <assert.h>
+#include <stdint.h>
 #include <string.h>
 
 #include <iostream>
 
 #include <string>
+#include <vector>
 
 
 namespace image {
@@ -128,11 +130,16 @@ public:
     void
     writeMD5(std::ostream &os) const;
 
+    // Write the perceptualHash as a single line of text
+    void
+    writePerceptualHash(std::ostream &os, const char *comment = NULL, unsigned tileSize = 64) const;
+
+    // fast trades compression ratio for encoding speed
     bool
-    writePNG(std::ostream &os, bool strip_alpha = false) const;
+    writePNG(std::ostream &os, bool strip_alpha = false, bool fast = false) const;
 
     bool
-    writePNG(const char *filename, bool strip_alpha = false) const;
+    writePNG(const char *filename, bool strip_alpha = false, bool fast = false) const;
 
     void
     writeRAW(std::ostream &os) const;
@@ -142,6 +149,36 @@ public:
 };
 
 
+/**
+ * Allocate an image, reusing the pixel storage of a previously released image
+ * with the same dimensions when available.  Thread-safe.
+ */
+Image *
+acquireImage(unsigned w, unsigned h, unsigned c = 4, bool f = false, ChannelType t = TYPE_UNORM8);
+
+/**
+ * Dispose of an image, keeping up to 256MB of them around for acquireImage to
+ * reuse.
+ */
+void
+releaseImage(Image *image);
+
+/**
+ * Free released images until at most maxBytes are kept.  Returns the bytes
+ * still kept.
+ */
+size_t
+trimFreeImages(size_t maxBytes);
+
+
+/**
+ * Compute the MD5 digest of height rows of pixels, as written by
+ * Image::writeMD5, without needing an Image.
+ */
+void
+md5(const unsigned char *start, signed stride, unsigned rowSize, unsigned height, char digest[33]);
+
+
 Image *
 readPNG(std::istream &is);
 
@@ -165,6 +202,74 @@ Image *
 readPNM(const char *buffer, size_t bufferSize);
 
 
+/**
+ * Read an uncompressed 24 or 32 bits BMP file.
+ */
+Image *
+readBMP(const char *filename);
+
+
+struct Comparison
+{
+    bool sizeMismatch = false;
+
+    // Number of pixels where the error of any channel exceeds 255*fuzz
+    unsigned long long absoluteError = 0;
+
+    // Matching bits of precision, derived from the mean square error of the
+    // RGB channels
+    double precision = 0.0;
+};
+
+/**
+ * Compare two images, taking only the RGB channels into account unless alpha
+ * is set.
+ */
+Comparison
+compare(const Image &ref, const Image &src, double fuzz = 0.05, bool alpha = false);
+
+/**
+ * Make an RGB image highlighting the pixels where the images differ more
+ * than 255*fuzz, or NULL if their sizes don't match.
+ */
+Image *
+diff(const Image &ref, const Image &src, double fuzz = 0.05, bool alpha = false);
+
+/**
+ * Downscale an image so that neither dimension exceeds maxSize.
+ */
+Image *
+thumbnail(const Image &image, unsigned maxSize);
+
+
+/**
+ * Fingerprint of an image which tolerates small differences, for comparing
+ * snapshots without keeping them.
+ */
+struct PerceptualHash
+{
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned tileSize = 0;
+    unsigned tilesX = 0;
+    unsigned tilesY = 0;
+
+    // One bit per cell of an 8x8 grid, set when brighter than average, so
+    // that similar images differ in few bits
+    unsigned long long hash = 0;
+
+    // Average color of each tile, as 0xRRGGBBAA, top to bottom
+    std::vector<uint32_t> tiles;
+
+    // Largest range of any channel within each tile, so that changes to a
+    // few pixels still show when they barely move the average
+    std::vector<uint8_t> ranges;
+};
+
+PerceptualHash
+perceptualHash(const Image &image, unsigned tileSize = 64);
+
+
 } /* namespace image */
 
 
@@ -139,4 +139,59 @@ Image::writeBMP(const char *filename) const {
 }
 
 
+Image *
+readBMP(const char *filename)
+{
+    std::ifstream stream(filename, std::ifstream::binary);
+    if (!stream) {
+        return nullptr;
+    }
+
+    struct FileHeader bmfh;
+    struct InfoHeader bmih;
+    if (!stream.read((char *)&bmfh, 14) ||
+        !stream.read((char *)&bmih, 40) ||
+        bmfh.bfType != 0x4d42) {
+        return nullptr;
+    }
+
+    // Only uncompressed true color bitmaps, as written by writeBMP
+    if ((bmih.biBitCount != 24 && bmih.biBitCount != 32) ||
+        (bmih.biCompression != 0 && bmih.biCompression != 3) ||
+        bmih.biWidth <= 0 || bmih.biHeight == 0) {
+        std::cerr << "error: unsupported BMP " << filename << "\n";
+        return nullptr;
+    }
+
+    unsigned width = bmih.biWidth;
+    bool bottomUp = bmih.biHeight > 0;
+    unsigned height = bottomUp ? bmih.biHeight : -(int64_t)bmih.biHeight;
+    unsigned bytesPerPixel = bmih.biBitCount / 8;
+    unsigned rowSize = (width * bytesPerPixel + 3) & ~3U;
+
+    if (!stream.seekg(bmfh.bfOffBits)) {
+        return nullptr;
+    }
+
+    Image *image = new Image(width, height, 4);
+    std::vector<unsigned char> row(rowSize);
+    for (unsigned y = 0; y < height; ++y) {
+        if (!stream.read((char *)row.data(), rowSize)) {
+            delete image;
+            return nullptr;
+        }
+        unsigned char *dst = image->pixels + (bottomUp ? height - 1 - y : y) * width * 4;
+        for (unsigned x = 0; x < width; ++x) {
+            const unsigned char *src = &row[x * bytesPerPixel];
+            dst[x*4 + 0] = src[2];
+            dst[x*4 + 1] = src[1];
+            dst[x*4 + 2] = src[0];
+            dst[x*4 + 3] = bytesPerPixel == 4 ? src[3] : 0xff;
+        }
+    }
+
+    return image;
+}
+
+
 } /* namespace image */
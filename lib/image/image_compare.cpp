@@ -0,0 +1,543 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Snapshot comparison, following the metrics of scripts/snapdiff.py.
+ *
+ * Both images are converted row by row to RGBA8, and then compared four
+ * pixels at a time where SSE2 is available.
+ */
+
+
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include "image.hpp"
+
+
+namespace image {
+
+
+/*
+ * Convert a row of any image to RGBA8.
+ */
+static void
+readRowRGBA8(const Image &image, unsigned y, uint8_t *dst)
+{
+    const unsigned char *row = image.start() + (signed)y * image.stride();
+    unsigned channels = image.channels;
+
+    if (image.channelType == TYPE_UNORM8 && channels == 4) {
+        memcpy(dst, row, image.width * 4);
+        return;
+    }
+
+    for (unsigned x = 0; x < image.width; ++x) {
+        uint8_t value[4] = {0, 0, 0, 255};
+        for (unsigned c = 0; c < std::min(channels, 4U); ++c) {
+            if (image.channelType == TYPE_FLOAT) {
+                float f = ((const float *)row)[x*channels + c];
+                f = std::max(std::min(f, 1.0f), 0.0f);
+                value[c] = (uint8_t)(f * 255.0f + 0.5f);
+            } else {
+                value[c] = row[x*channels + c];
+            }
+        }
+        if (channels <= 2) {
+            // Luminance (alpha)
+            value[3] = channels == 2 ? value[1] : 255;
+            value[1] = value[2] = value[0];
+        }
+        memcpy(dst + x*4, value, 4);
+    }
+}
+
+
+struct RowStats
+{
+    unsigned long long squareError = 0;
+    unsigned long long absoluteError = 0;
+};
+
+
+static void
+compareRowGeneric(const uint8_t *ref, const uint8_t *src, unsigned n,
+                  unsigned channels, unsigned threshold, RowStats &stats)
+{
+    for (unsigned x = 0; x < n; ++x) {
+        unsigned maxError = 0;
+        for (unsigned c = 0; c < channels; ++c) {
+            unsigned error = abs((int)ref[x*4 + c] - (int)src[x*4 + c]);
+            if (c < 3) {
+                stats.squareError += error * error;
+            }
+            maxError = std::max(maxError, error);
+        }
+        stats.absoluteError += maxError > threshold;
+    }
+}
+
+
+#ifdef HAVE_SSE2
+
+static void
+compareRowSSE2(const uint8_t *ref, const uint8_t *src, unsigned n,
+               unsigned channels, unsigned threshold, RowStats &stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgbMask = _mm_set1_epi32(0x00ffffff);
+    const __m128i channelMask = _mm_set1_epi32(channels == 4 ? -1 : 0x00ffffff);
+    const __m128i byteMask = _mm_set1_epi32(0xff);
+    const __m128i thresholdVec = _mm_set1_epi32(threshold);
+
+    __m128i squareError = zero;
+    unsigned absoluteError = 0;
+
+    unsigned x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(ref + x*4));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + x*4));
+
+        // |a - b| per channel, ignoring alpha unless requested
+        __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        d = _mm_and_si128(d, channelMask);
+
+        // Sum of squares of the RGB channels, widened to 64 bits so rows of
+        // any size can't overflow
+        __m128i rgb = _mm_and_si128(d, rgbMask);
+        __m128i lo = _mm_unpacklo_epi8(rgb, zero);
+        __m128i hi = _mm_unpackhi_epi8(rgb, zero);
+        __m128i sq = _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+        squareError = _mm_add_epi64(squareError, _mm_unpacklo_epi32(sq, zero));
+        squareError = _mm_add_epi64(squareError, _mm_unpackhi_epi32(sq, zero));
+
+        // Largest channel error of each pixel
+        __m128i m = _mm_max_epu8(d, _mm_srli_epi32(d, 8));
+        m = _mm_max_epu8(m, _mm_srli_epi32(d, 16));
+        m = _mm_max_epu8(m, _mm_srli_epi32(d, 24));
+        m = _mm_and_si128(m, byteMask);
+
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(m, thresholdVec)));
+        absoluteError += (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, squareError);
+    stats.squareError += lanes[0] + lanes[1];
+    stats.absoluteError += absoluteError;
+
+    compareRowGeneric(ref + x*4, src + x*4, n - x, channels, threshold, stats);
+}
+
+#endif /* HAVE_SSE2 */
+
+
+Comparison
+compare(const Image &ref, const Image &src, double fuzz, bool alpha)
+{
+    Comparison result;
+
+    if (ref.width != src.width ||
+        ref.height != src.height) {
+        result.sizeMismatch = true;
+        result.absoluteError = std::numeric_limits<unsigned long long>::max();
+        return result;
+    }
+
+    unsigned width = ref.width;
+    unsigned height = ref.height;
+    unsigned channels = alpha ? 4 : 3;
+    unsigned threshold = (unsigned)std::max(std::min(255.0 * fuzz, 255.0), 0.0);
+
+    std::vector<uint8_t> refRow(width * 4);
+    std::vector<uint8_t> srcRow(width * 4);
+
+    RowStats stats;
+    for (unsigned y = 0; y < height; ++y) {
+        readRowRGBA8(ref, y, refRow.data());
+        readRowRGBA8(src, y, srcRow.data());
+#ifdef HAVE_SSE2
+        compareRowSSE2(refRow.data(), srcRow.data(), width, channels, threshold, stats);
+#else
+        compareRowGeneric(refRow.data(), srcRow.data(), width, channels, threshold, stats);
+#endif
+    }
+
+    result.absoluteError = stats.absoluteError;
+
+    // See also http://effbot.org/zone/pil-comparing-images.htm
+    //
+    // Like snapdiff.py, the precision only accounts the RGB channels, even
+    // when alpha is compared.
+    double relError = double(stats.squareError*2 + 1) /
+                      (double(width) * height * 3 * 255 * 255 * 2);
+    result.precision = -log2(relError);
+
+    return result;
+}
+
+
+Image *
+diff(const Image &ref, const Image &src, double fuzz, bool alpha)
+{
+    if (ref.width != src.width ||
+        ref.height != src.height) {
+        return nullptr;
+    }
+
+    // Similar to ImageMagick's compare utility: a faded version of the source
+    // image, where pixels whose error exceeds 255*fuzz are colored strong red.
+    static const unsigned lowlight[3] = {0xff, 0xff, 0xff};
+    static const unsigned highlight[3] = {0xf1, 0x00, 0x1e};
+    static const unsigned opacity = 0xcc;
+
+    unsigned width = ref.width;
+    unsigned height = ref.height;
+    unsigned channels = alpha ? 4 : 3;
+
+    Image *image = new Image(width, height, 3);
+
+    std::vector<uint8_t> refRow(width * 4);
+    std::vector<uint8_t> srcRow(width * 4);
+
+    for (unsigned y = 0; y < height; ++y) {
+        readRowRGBA8(ref, y, refRow.data());
+        readRowRGBA8(src, y, srcRow.data());
+
+        unsigned char *dst = image->pixels + y*width*3;
+        for (unsigned x = 0; x < width; ++x) {
+            unsigned maxError = 0;
+            for (unsigned c = 0; c < channels; ++c) {
+                unsigned error = abs((int)refRow[x*4 + c] - (int)srcRow[x*4 + c]);
+                maxError = std::max(maxError, error);
+            }
+
+            // Scale values so that errors equal or above 255*fuzz become 255
+            unsigned mask = fuzz > 0.0 ? (unsigned)std::min(maxError / fuzz, 255.0)
+                                       : (maxError ? 255 : 0);
+
+            for (unsigned c = 0; c < 3; ++c) {
+                unsigned color = (highlight[c]*mask + lowlight[c]*(255 - mask) + 127) / 255;
+                dst[x*3 + c] = (srcRow[x*4 + c]*(255 - opacity) + color*opacity + 127) / 255;
+            }
+        }
+    }
+
+    return image;
+}
+
+
+Image *
+thumbnail(const Image &image, unsigned maxSize)
+{
+    unsigned width = image.width;
+    unsigned height = image.height;
+    if (!width || !height || !maxSize) {
+        return nullptr;
+    }
+
+    unsigned thumbWidth = width;
+    unsigned thumbHeight = height;
+    if (width >= height) {
+        if (width > maxSize) {
+            thumbWidth = maxSize;
+            thumbHeight = std::max(1ULL, (unsigned long long)height * maxSize / width);
+        }
+    } else {
+        if (height > maxSize) {
+            thumbHeight = maxSize;
+            thumbWidth = std::max(1ULL, (unsigned long long)width * maxSize / height);
+        }
+    }
+
+    Image *thumb = new Image(thumbWidth, thumbHeight, 4);
+
+    // Box filter over the source pixels covered by each thumbnail pixel
+    std::vector<uint8_t> row(width * 4);
+    std::vector<unsigned> sums(thumbWidth * 4);
+    std::vector<unsigned> counts(thumbWidth);
+
+    unsigned y = 0;
+    for (unsigned ty = 0; ty < thumbHeight; ++ty) {
+        unsigned yEnd = std::max(y + 1, (unsigned)((unsigned long long)(ty + 1) * height / thumbHeight));
+
+        std::fill(sums.begin(), sums.end(), 0);
+        std::fill(counts.begin(), counts.end(), 0);
+
+        for (; y < yEnd; ++y) {
+            readRowRGBA8(image, y, row.data());
+            for (unsigned x = 0; x < width; ++x) {
+                unsigned tx = (unsigned)((unsigned long long)x * thumbWidth / width);
+                for (unsigned c = 0; c < 4; ++c) {
+                    sums[tx*4 + c] += row[x*4 + c];
+                }
+                counts[tx] += 1;
+            }
+        }
+
+        unsigned char *dst = thumb->pixels + ty*thumbWidth*4;
+        for (unsigned tx = 0; tx < thumbWidth; ++tx) {
+            unsigned count = std::max(counts[tx], 1U);
+            for (unsigned c = 0; c < 4; ++c) {
+                dst[tx*4 + c] = (sums[tx*4 + c] + count/2) / count;
+            }
+        }
+    }
+
+    return thumb;
+}
+
+
+/*
+ * Add the channels of n RGBA8 pixels to sums[0..3].
+ */
+static void
+sumRowGeneric(const uint8_t *row, unsigned n, uint32_t sums[4])
+{
+    for (unsigned x = 0; x < n; ++x) {
+        sums[0] += row[x*4 + 0];
+        sums[1] += row[x*4 + 1];
+        sums[2] += row[x*4 + 2];
+        sums[3] += row[x*4 + 3];
+    }
+}
+
+
+#ifdef HAVE_SSE2
+
+static void
+sumRowSSE2(const uint8_t *row, unsigned n, uint32_t sums[4])
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum32 = zero;
+
+    unsigned x = 0;
+    while (x + 4 <= n) {
+        // 16-bit lanes can take 128 iterations of two pixels each
+        __m128i sum16 = zero;
+        unsigned end = std::min(n & ~3U, x + 4*128);
+        for (; x < end; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(row + x*4));
+            sum16 = _mm_add_epi16(sum16, _mm_unpacklo_epi8(p, zero));
+            sum16 = _mm_add_epi16(sum16, _mm_unpackhi_epi8(p, zero));
+        }
+        sum32 = _mm_add_epi32(sum32, _mm_unpacklo_epi16(sum16, zero));
+        sum32 = _mm_add_epi32(sum32, _mm_unpackhi_epi16(sum16, zero));
+    }
+
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, sum32);
+    for (unsigned c = 0; c < 4; ++c) {
+        sums[c] += lanes[c];
+    }
+
+    sumRowGeneric(row + x*4, n - x, sums);
+}
+
+#endif /* HAVE_SSE2 */
+
+
+/*
+ * Accumulate the per channel minimum and maximum of n RGBA8 pixels.
+ */
+static void
+minMaxRowGeneric(const uint8_t *row, unsigned n, uint8_t mins[4], uint8_t maxs[4])
+{
+    for (unsigned x = 0; x < n; ++x) {
+        for (unsigned c = 0; c < 4; ++c) {
+            mins[c] = std::min(mins[c], row[x*4 + c]);
+            maxs[c] = std::max(maxs[c], row[x*4 + c]);
+        }
+    }
+}
+
+
+#ifdef HAVE_SSE2
+
+static void
+minMaxRowSSE2(const uint8_t *row, unsigned n, uint8_t mins[4], uint8_t maxs[4])
+{
+    uint32_t minPixel, maxPixel;
+    memcpy(&minPixel, mins, 4);
+    memcpy(&maxPixel, maxs, 4);
+    __m128i vmin = _mm_set1_epi32(minPixel);
+    __m128i vmax = _mm_set1_epi32(maxPixel);
+
+    unsigned x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i p = _mm_loadu_si128((const __m128i *)(row + x*4));
+        vmin = _mm_min_epu8(vmin, p);
+        vmax = _mm_max_epu8(vmax, p);
+    }
+
+    // Fold the four pixels of each vector
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 8));
+    vmin = _mm_min_epu8(vmin, _mm_srli_si128(vmin, 4));
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+    minPixel = _mm_cvtsi128_si32(vmin);
+    maxPixel = _mm_cvtsi128_si32(vmax);
+    memcpy(mins, &minPixel, 4);
+    memcpy(maxs, &maxPixel, 4);
+
+    minMaxRowGeneric(row + x*4, n - x, mins, maxs);
+}
+
+#endif /* HAVE_SSE2 */
+
+
+PerceptualHash
+perceptualHash(const Image &image, unsigned tileSize)
+{
+    assert(tileSize > 0);
+
+    PerceptualHash result;
+    result.width = image.width;
+    result.height = image.height;
+    result.tileSize = tileSize;
+    result.tilesX = (image.width + tileSize - 1) / tileSize;
+    result.tilesY = (image.height + tileSize - 1) / tileSize;
+
+    unsigned tileCount = result.tilesX * result.tilesY;
+    if (!tileCount) {
+        return result;
+    }
+
+    // Per channel sums and extremes of every tile, in a single pass over the
+    // pixels
+    std::vector<uint32_t> sums(tileCount * 4);
+    std::vector<uint8_t> mins(tileCount * 4, 0xff);
+    std::vector<uint8_t> maxs(tileCount * 4, 0);
+    std::vector<uint8_t> row(image.width * 4);
+    for (unsigned y = 0; y < image.height; ++y) {
+        readRowRGBA8(image, y, row.data());
+        unsigned first = (y / tileSize) * result.tilesX * 4;
+        for (unsigned tx = 0; tx < result.tilesX; ++tx) {
+            unsigned x = tx * tileSize;
+            unsigned n = std::min(tileSize, image.width - x);
+            unsigned i = first + tx*4;
+#ifdef HAVE_SSE2
+            sumRowSSE2(&row[x*4], n, &sums[i]);
+            minMaxRowSSE2(&row[x*4], n, &mins[i], &maxs[i]);
+#else
+            sumRowGeneric(&row[x*4], n, &sums[i]);
+            minMaxRowGeneric(&row[x*4], n, &mins[i], &maxs[i]);
+#endif
+        }
+    }
+
+    // Average color of each tile, quantized back to 8 bits
+    result.tiles.resize(tileCount);
+    result.ranges.resize(tileCount);
+    for (unsigned ty = 0; ty < result.tilesY; ++ty) {
+        unsigned h = std::min(tileSize, image.height - ty*tileSize);
+        for (unsigned tx = 0; tx < result.tilesX; ++tx) {
+            unsigned w = std::min(tileSize, image.width - tx*tileSize);
+            unsigned area = w * h;
+            unsigned i = ty*result.tilesX + tx;
+            uint32_t color = 0;
+            uint8_t range = 0;
+            for (unsigned c = 0; c < 4; ++c) {
+                color |= ((sums[i*4 + c] + area/2) / area) << (24 - 8*c);
+                range = std::max<uint8_t>(range, maxs[i*4 + c] - mins[i*4 + c]);
+            }
+            result.tiles[i] = color;
+            result.ranges[i] = range;
+        }
+    }
+
+    // Average hash over an 8x8 grid of tiles: each bit tells whether a cell
+    // is brighter than the whole image, so that small differences don't
+    // flip bits
+    static const unsigned gridSize = 8;
+    double luminance[gridSize * gridSize] = {0};
+    unsigned counts[gridSize * gridSize] = {0};
+    for (unsigned ty = 0; ty < result.tilesY; ++ty) {
+        for (unsigned tx = 0; tx < result.tilesX; ++tx) {
+            uint32_t color = result.tiles[ty*result.tilesX + tx];
+            double l = 0.299 * (color >> 24) +
+                       0.587 * ((color >> 16) & 0xff) +
+                       0.114 * ((color >> 8) & 0xff);
+            unsigned cell = (ty * gridSize / result.tilesY) * gridSize +
+                            tx * gridSize / result.tilesX;
+            luminance[cell] += l;
+            counts[cell] += 1;
+        }
+    }
+
+    double mean = 0.0;
+    unsigned cells = 0;
+    for (unsigned cell = 0; cell < gridSize * gridSize; ++cell) {
+        if (counts[cell]) {
+            luminance[cell] /= counts[cell];
+            mean += luminance[cell];
+            ++cells;
+        }
+    }
+    mean /= cells;
+
+    result.hash = 0;
+    for (unsigned cell = 0; cell < gridSize * gridSize; ++cell) {
+        if (counts[cell] && luminance[cell] > mean) {
+            result.hash |= 1ULL << cell;
+        }
+    }
+
+    return result;
+}
+
+
+void
+Image::writePerceptualHash(std::ostream &os, const char *comment, unsigned tileSize) const
+{
+    PerceptualHash hash = perceptualHash(*this, tileSize);
+
+    char buf[64];
+    snprintf(buf, sizeof buf, "%ux%u %016llx %u",
+             hash.width, hash.height, hash.hash, hash.tileSize);
+    if (comment) {
+        os << comment << " ";
+    }
+    os << buf;
+    for (size_t i = 0; i < hash.tiles.size(); ++i) {
+        snprintf(buf, sizeof buf, " %08x%02x", hash.tiles[i], hash.ranges[i]);
+        os << buf;
+    }
+    os << "\n";
+}
+
+
+} /* namespace image */
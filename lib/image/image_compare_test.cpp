@@ -0,0 +1,191 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "image.hpp"
+
+#include "gtest/gtest.h"
+
+
+static void
+fill(image::Image &image, unsigned char value)
+{
+    memset(image.pixels, value, image.sizeInBytes());
+}
+
+
+TEST(image_compare, match)
+{
+    // Odd width to exercise the remainder of vectorized rows
+    image::Image ref(37, 5);
+    image::Image src(37, 5);
+    fill(ref, 0x80);
+    fill(src, 0x80);
+
+    image::Comparison comparison = image::compare(ref, src);
+    EXPECT_FALSE(comparison.sizeMismatch);
+    EXPECT_EQ(comparison.absoluteError, 0);
+    EXPECT_GT(comparison.precision, 20.0);
+}
+
+
+TEST(image_compare, mismatch)
+{
+    image::Image ref(37, 5);
+    image::Image src(37, 5);
+    fill(ref, 0x80);
+    fill(src, 0x80);
+
+    // Below the default fuzz
+    src.pixels[(2*37 + 1)*4 + 0] += 5;
+    // Above the default fuzz, in a vectorized and a remainder pixel
+    src.pixels[(3*37 + 2)*4 + 1] += 40;
+    src.pixels[(4*37 + 36)*4 + 2] -= 40;
+
+    image::Comparison comparison = image::compare(ref, src);
+    EXPECT_EQ(comparison.absoluteError, 2);
+    EXPECT_LT(comparison.precision, 20.0);
+
+    EXPECT_EQ(image::compare(ref, src, 0.0).absoluteError, 3);
+    EXPECT_EQ(image::compare(ref, src, 1.0).absoluteError, 0);
+}
+
+
+TEST(image_compare, alpha)
+{
+    image::Image ref(8, 8);
+    image::Image src(8, 8);
+    fill(ref, 0x80);
+    fill(src, 0x80);
+    src.pixels[3] = 0;
+
+    EXPECT_EQ(image::compare(ref, src, 0.05, false).absoluteError, 0);
+    EXPECT_EQ(image::compare(ref, src, 0.05, true).absoluteError, 1);
+
+    // Precision only accounts RGB, as snapdiff.py does
+    EXPECT_EQ(image::compare(ref, src, 0.05, true).precision,
+              image::compare(ref, ref, 0.05, true).precision);
+}
+
+
+TEST(image_compare, channels)
+{
+    image::Image ref(9, 3, 3);
+    image::Image src(9, 3, 4);
+    fill(ref, 0x40);
+    fill(src, 0x40);
+
+    EXPECT_EQ(image::compare(ref, src).absoluteError, 0);
+
+    image::Image small(9, 2, 4);
+    image::Comparison comparison = image::compare(ref, small);
+    EXPECT_TRUE(comparison.sizeMismatch);
+    EXPECT_EQ(image::diff(ref, small), nullptr);
+}
+
+
+TEST(image_compare, bmp)
+{
+    image::Image src(7, 3);
+    for (unsigned i = 0; i < src.sizeInBytes(); ++i) {
+        src.pixels[i] = (unsigned char)(i * 7);
+    }
+
+    std::string filename = ::testing::TempDir() + "image_compare_test.bmp";
+    ASSERT_TRUE(src.writeBMP(filename.c_str()));
+
+    image::Image *dst = image::readBMP(filename.c_str());
+    ASSERT_NE(dst, nullptr);
+    EXPECT_EQ(dst->width, 7);
+    EXPECT_EQ(dst->height, 3);
+    EXPECT_EQ(memcmp(dst->pixels, src.pixels, src.sizeInBytes()), 0);
+    delete dst;
+    remove(filename.c_str());
+}
+
+
+TEST(image_compare, thumbnail)
+{
+    image::Image image(1000, 500, 3);
+    fill(image, 0x33);
+
+    image::Image *thumb = image::thumbnail(image, 320);
+    ASSERT_NE(thumb, nullptr);
+    EXPECT_EQ(thumb->width, 320);
+    EXPECT_EQ(thumb->height, 160);
+    EXPECT_EQ(thumb->pixels[0], 0x33);
+    EXPECT_EQ(thumb->pixels[3], 0xff);
+    delete thumb;
+}
+
+
+TEST(image_compare, perceptual_hash)
+{
+    // Partial tiles on the right and bottom
+    image::Image image(150, 70, 3);
+    for (unsigned y = 0; y < image.height; ++y) {
+        for (unsigned x = 0; x < image.width; ++x) {
+            unsigned char *pixel = image.pixels + (y*image.width + x)*3;
+            pixel[0] = x < 64 ? 0x10 : 0xf0;
+            pixel[1] = 0x20;
+            pixel[2] = 0x30;
+        }
+    }
+
+    image::PerceptualHash hash = image::perceptualHash(image, 64);
+    EXPECT_EQ(hash.tilesX, 3);
+    EXPECT_EQ(hash.tilesY, 2);
+    ASSERT_EQ(hash.tiles.size(), 6);
+    EXPECT_EQ(hash.tiles[0], 0x102030ff);
+    EXPECT_EQ(hash.tiles[2], 0xf02030ff);
+    EXPECT_EQ(hash.tiles[5], 0xf02030ff);
+    ASSERT_EQ(hash.ranges.size(), 6);
+    EXPECT_EQ(hash.ranges[0], 0);
+
+    // Brighter right side
+    EXPECT_NE(hash.hash, 0);
+    EXPECT_EQ(hash.hash & 1, 0);
+
+    // One unit off in a single pixel shouldn't change anything
+    image.pixels[(40*image.width + 100)*3] += 1;
+    image::PerceptualHash other = image::perceptualHash(image, 64);
+    EXPECT_EQ(other.hash, hash.hash);
+    EXPECT_EQ(other.tiles, hash.tiles);
+
+    // A single wrong pixel barely moves the tile average, but shows in the
+    // tile range
+    image.pixels[(10*image.width + 10)*3 + 1] = 0xa0;
+    other = image::perceptualHash(image, 64);
+    EXPECT_EQ(other.tiles[0], hash.tiles[0]);
+    EXPECT_EQ(other.ranges[0], 0x80);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
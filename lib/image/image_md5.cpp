@@ -36,24 +36,30 @@ namespace image {
 
 
 void
-Image::writeMD5(std::ostream &os) const {
+md5(const unsigned char *start, signed stride, unsigned rowSize, unsigned height, char digest[33]) {
     struct MD5Context md5c;
     MD5Init(&md5c);
-    const unsigned char *row;
-    unsigned len = width*bytesPerPixel;
-    for (row = start(); row != end(); row += stride()) {
-        MD5Update(&md5c, (unsigned char *)row, len);
+    const unsigned char *row = start;
+    for (unsigned y = 0; y < height; ++y) {
+        MD5Update(&md5c, (unsigned char *)row, rowSize);
+        row += stride;
     }
     unsigned char signature[16];
     MD5Final(signature, &md5c);
 
     const char hex[] = "0123456789ABCDEF";
-    char csig[33];
     for(int i = 0; i < sizeof signature; i++){
-        csig[2*i    ] = hex[signature[i] >> 4];
-        csig[2*i + 1] = hex[signature[i] & 0xf];
+        digest[2*i    ] = hex[signature[i] >> 4];
+        digest[2*i + 1] = hex[signature[i] & 0xf];
     }
-    csig[32] = '\0';
+    digest[32] = '\0';
+}
+
+
+void
+Image::writeMD5(std::ostream &os) const {
+    char csig[33];
+    md5(start(), stride(), width*bytesPerPixel, height, csig);
 
     os << csig;
     os << "\n";
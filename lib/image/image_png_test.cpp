@@ -0,0 +1,109 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <memory>
+#include <sstream>
+
+#include "image.hpp"
+
+#include "gtest/gtest.h"
+
+
+static image::Image *
+makeImage(unsigned width, unsigned height, unsigned channels)
+{
+    image::Image *image = new image::Image(width, height, channels);
+    uint32_t seed = 1;
+    for (unsigned i = 0; i < image->sizeInBytes(); ++i) {
+        // Mix of smooth gradients and noise, so that every filter gets picked
+        seed = seed * 1103515245 + 12345;
+        unsigned x = (i / channels) % width;
+        image->pixels[i] = (i % 7 == 0) ? (seed >> 16) : x + i / (width * channels);
+    }
+    return image;
+}
+
+
+static void
+roundTrip(unsigned width, unsigned height, unsigned channels,
+          bool strip_alpha, bool fast)
+{
+    std::unique_ptr<image::Image> src(makeImage(width, height, channels));
+
+    std::stringstream ss;
+    ASSERT_TRUE(src->writePNG(ss, strip_alpha, fast));
+
+    std::unique_ptr<image::Image> dst(image::readPNG(ss));
+    ASSERT_NE(dst, nullptr);
+    ASSERT_EQ(dst->width, width);
+    ASSERT_EQ(dst->height, height);
+
+    unsigned dstChannels = channels == 4 && strip_alpha ? 3 : channels;
+    ASSERT_EQ(dst->channels, dstChannels);
+    for (unsigned i = 0; i < width * height; ++i) {
+        for (unsigned c = 0; c < dstChannels; ++c) {
+            ASSERT_EQ(dst->pixels[i * dstChannels + c], src->pixels[i * channels + c])
+                << "pixel " << i << " channel " << c;
+        }
+    }
+}
+
+
+TEST(image_png, small)
+{
+    roundTrip(17, 3, 4, false, false);
+    roundTrip(17, 3, 1, false, true);
+}
+
+
+TEST(image_png, large)
+{
+    roundTrip(1031, 300, 4, false, false);
+    roundTrip(1031, 300, 3, false, true);
+    roundTrip(1031, 300, 4, true, true);
+    roundTrip(777, 500, 2, false, false);
+}
+
+
+TEST(image_png, file)
+{
+    std::unique_ptr<image::Image> src(makeImage(64, 64, 4));
+    std::string filename = ::testing::TempDir() + "image_png_test.png";
+    ASSERT_TRUE(src->writePNG(filename.c_str()));
+
+    std::unique_ptr<image::Image> dst(image::readPNG(filename.c_str()));
+    ASSERT_NE(dst, nullptr);
+    EXPECT_EQ(memcmp(dst->pixels, src->pixels, src->sizeInBytes()), 0);
+    remove(filename.c_str());
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
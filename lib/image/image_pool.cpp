@@ -0,0 +1,119 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <deque>
+#include <mutex>
+
+#include "image.hpp"
+
+
+namespace image {
+
+
+// Enough for a few 4K MRT snapshots in flight
+#define MAX_FREE_BYTES (256 * 1024 * 1024)
+
+
+static std::mutex freeImagesMutex;
+static std::deque<Image *> freeImages;
+static size_t freeBytes = 0;
+
+
+// Must be called with freeImagesMutex held
+static void
+evictFreeImages(size_t maxBytes, std::deque<Image *> &evicted)
+{
+    while (freeBytes > maxBytes) {
+        Image *image = freeImages.front();
+        freeImages.pop_front();
+        freeBytes -= image->sizeInBytes();
+        evicted.push_back(image);
+    }
+}
+
+
+Image *
+acquireImage(unsigned w, unsigned h, unsigned c, bool f, ChannelType t)
+{
+    {
+        std::lock_guard<std::mutex> lock(freeImagesMutex);
+        for (auto it = freeImages.begin(); it != freeImages.end(); ++it) {
+            Image *image = *it;
+            if (image->width == w &&
+                image->height == h &&
+                image->channels == c &&
+                image->channelType == t) {
+                freeImages.erase(it);
+                freeBytes -= image->sizeInBytes();
+                image->flipped = f;
+                image->label.clear();
+                return image;
+            }
+        }
+    }
+
+    return new Image(w, h, c, f, t);
+}
+
+
+void
+releaseImage(Image *image)
+{
+    if (!image) {
+        return;
+    }
+
+    std::deque<Image *> evicted;
+    {
+        std::lock_guard<std::mutex> lock(freeImagesMutex);
+        freeImages.push_back(image);
+        freeBytes += image->sizeInBytes();
+        evictFreeImages(MAX_FREE_BYTES, evicted);
+    }
+    for (Image *image : evicted) {
+        delete image;
+    }
+}
+
+
+size_t
+trimFreeImages(size_t maxBytes)
+{
+    std::deque<Image *> evicted;
+    size_t bytes;
+    {
+        std::lock_guard<std::mutex> lock(freeImagesMutex);
+        evictFreeImages(maxBytes, evicted);
+        bytes = freeBytes;
+    }
+    for (Image *image : evicted) {
+        delete image;
+    }
+    return bytes;
+}
+
+
+} /* namespace image */
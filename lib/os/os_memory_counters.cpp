@@ -0,0 +1,59 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "os_memory_counters.hpp"
+
+
+namespace os {
+
+
+std::atomic<long long> memoryCounters[NUM_MEMORY_COUNTERS];
+
+
+const char *
+getMemoryCounterName(MemoryCounter counter)
+{
+    switch (counter) {
+    case MEMORY_CALLS:
+        return "calls";
+    case MEMORY_BLOB_BYTES:
+        return "blob_bytes";
+    case MEMORY_SCOPED_BYTES:
+        return "scoped_alloc_bytes";
+    case MEMORY_REGIONS:
+        return "regions";
+    case MEMORY_HANDLES:
+        return "handles";
+    case MEMORY_SNAPSHOT_BYTES:
+        return "snapshot_queue_bytes";
+    case NUM_MEMORY_COUNTERS:
+        break;
+    }
+    return "unknown";
+}
+
+
+} /* namespace os */
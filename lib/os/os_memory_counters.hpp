@@ -0,0 +1,68 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Counters of the memory held by apitrace's own data structures, to tell it
+ * apart from the memory used by the driver or the application.
+ */
+
+#pragma once
+
+#include <atomic>
+
+
+namespace os {
+
+    enum MemoryCounter {
+        MEMORY_CALLS,           // live trace::Call objects
+        MEMORY_BLOB_BYTES,      // parsed blobs, including bound ones kept alive
+        MEMORY_SCOPED_BYTES,    // ScopedAllocator allocations
+        MEMORY_REGIONS,         // user memory regions
+        MEMORY_HANDLES,         // swizzled handle map entries
+        MEMORY_SNAPSHOT_BYTES,  // snapshots waiting to be encoded
+        NUM_MEMORY_COUNTERS
+    };
+
+    extern std::atomic<long long> memoryCounters[NUM_MEMORY_COUNTERS];
+
+    inline void
+    addMemoryCounter(MemoryCounter counter, long long delta) {
+        memoryCounters[counter].fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    inline void
+    setMemoryCounter(MemoryCounter counter, long long value) {
+        memoryCounters[counter].store(value, std::memory_order_relaxed);
+    }
+
+    inline long long
+    getMemoryCounter(MemoryCounter counter) {
+        return memoryCounters[counter].load(std::memory_order_relaxed);
+    }
+
+    const char *
+    getMemoryCounterName(MemoryCounter counter);
+
+} /* namespace os */
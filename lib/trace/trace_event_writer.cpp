@@ -0,0 +1,203 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "trace_event_writer.hpp"
+
+#include <algorithm>
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/* Process ids of the CPU and GPU timelines */
+#define CPU_PID 1
+#define GPU_PID 2
+
+/* Track holding the frame slices, in both timelines */
+#define FRAME_TID 0
+
+
+namespace trace {
+
+
+static void
+writeString(std::ostream &os, const char *s)
+{
+    os << '"';
+    for (; *s; ++s) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            os << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            os << buf;
+        } else {
+            os << c;
+        }
+    }
+    os << '"';
+}
+
+
+TraceEventWriter::TraceEventWriter(std::ostream &_os) :
+    os(_os),
+    first(true),
+    closed(false),
+    timeBase(0),
+    frameNo(0),
+    frameCpuStart(INT64_MAX),
+    frameCpuEnd(INT64_MIN),
+    frameGpuStart(INT64_MAX),
+    frameGpuEnd(INT64_MIN)
+{
+    os << "[\n";
+    writeMetadata("process_name", CPU_PID, FRAME_TID, "CPU");
+    writeMetadata("thread_name", CPU_PID, FRAME_TID, "Frames");
+    writeMetadata("process_name", GPU_PID, FRAME_TID, "GPU");
+    writeMetadata("thread_name", GPU_PID, FRAME_TID, "Frames");
+    writeMetadata("thread_name", GPU_PID, FRAME_TID + 1, "Draw calls");
+}
+
+TraceEventWriter::~TraceEventWriter()
+{
+    close();
+}
+
+void
+TraceEventWriter::setTimeBase(int64_t systemTime)
+{
+    timeBase = systemTime;
+}
+
+void
+TraceEventWriter::beginEvent(const char *name, char phase, unsigned pid, unsigned tid)
+{
+    os << (first ? "" : ",\n") << "{\"name\":";
+    writeString(os, name);
+    os << ",\"ph\":\"" << phase << "\",\"pid\":" << pid << ",\"tid\":" << tid;
+    first = false;
+}
+
+void
+TraceEventWriter::writeMetadata(const char *kind, unsigned pid, unsigned tid, const char *value)
+{
+    beginEvent(kind, 'M', pid, tid);
+    os << ",\"args\":{\"name\":";
+    writeString(os, value);
+    os << "}}";
+}
+
+void
+TraceEventWriter::writeTime(const char *key, int64_t ns)
+{
+    /* Timestamps are in microseconds */
+    char buf[32];
+    snprintf(buf, sizeof buf, "%.3f", ns / 1000.0);
+    os << ",\"" << key << "\":" << buf;
+}
+
+void
+TraceEventWriter::writeSlice(const char *name, unsigned pid, unsigned tid,
+                             int64_t start, int64_t duration)
+{
+    beginEvent(name, 'X', pid, tid);
+    writeTime("ts", timeBase + start);
+    writeTime("dur", duration);
+}
+
+void
+TraceEventWriter::writeCall(const Profile::Call &call, const char *name, unsigned thread)
+{
+    if (closed) {
+        return;
+    }
+
+    /* Times are zero when not profiled */
+    if (call.cpuStart || call.cpuDuration) {
+        unsigned tid = thread + 1;
+        if (threads.insert(tid).second) {
+            char threadName[32];
+            snprintf(threadName, sizeof threadName, "Thread %u", thread);
+            writeMetadata("thread_name", CPU_PID, tid, threadName);
+        }
+
+        writeSlice(name, CPU_PID, tid, call.cpuStart, call.cpuDuration);
+        os << ",\"args\":{\"call\":" << call.no << ",\"program\":" << call.program << "}}";
+
+        frameCpuStart = std::min(frameCpuStart, call.cpuStart);
+        frameCpuEnd = std::max(frameCpuEnd, call.cpuStart + call.cpuDuration);
+    }
+
+    if (call.gpuStart || call.gpuDuration) {
+        writeSlice(name, GPU_PID, FRAME_TID + 1, call.gpuStart, call.gpuDuration);
+        os << ",\"args\":{\"call\":" << call.no << ",\"program\":" << call.program;
+        if (call.pixels > 0) {
+            os << ",\"pixels\":" << call.pixels;
+        }
+        os << "}}";
+
+        frameGpuStart = std::min(frameGpuStart, call.gpuStart);
+        frameGpuEnd = std::max(frameGpuEnd, call.gpuStart + call.gpuDuration);
+    }
+}
+
+void
+TraceEventWriter::writeFrameEnd(void)
+{
+    if (closed) {
+        return;
+    }
+
+    char name[32];
+    snprintf(name, sizeof name, "Frame %u", frameNo);
+
+    if (frameCpuStart <= frameCpuEnd) {
+        writeSlice(name, CPU_PID, FRAME_TID, frameCpuStart, frameCpuEnd - frameCpuStart);
+        os << "}";
+    }
+    if (frameGpuStart <= frameGpuEnd) {
+        writeSlice(name, GPU_PID, FRAME_TID, frameGpuStart, frameGpuEnd - frameGpuStart);
+        os << "}";
+    }
+
+    ++frameNo;
+    frameCpuStart = frameGpuStart = INT64_MAX;
+    frameCpuEnd = frameGpuEnd = INT64_MIN;
+}
+
+void
+TraceEventWriter::close(void)
+{
+    if (closed) {
+        return;
+    }
+    os << "\n]\n";
+    os.flush();
+    closed = true;
+}
+
+
+} /* namespace trace */
@@ -0,0 +1,86 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Chrome trace event output of call profiles.
+ */
+
+#pragma once
+
+#include <ostream>
+#include <set>
+
+#include "trace_profiler.hpp"
+
+
+namespace trace {
+
+/**
+ * Writes profiled calls as Chrome trace events (JSON array format), as they
+ * are profiled, for viewing in chrome://tracing or the Perfetto UI.
+ *
+ * CPU times go to one track per traced thread, GPU times to a single GPU
+ * track, and each frame spans a slice of its own.  Viewers accept truncated
+ * arrays, so the output is usable even if never closed.
+ */
+class TraceEventWriter
+{
+public:
+    TraceEventWriter(std::ostream &os);
+    ~TraceEventWriter();
+
+    /* Offset the profile times by Profile::timeBase, so that events are
+     * placed at their system time and line up with other system traces */
+    void setTimeBase(int64_t systemTime);
+
+    void writeCall(const Profile::Call &call, const char *name, unsigned thread = 0);
+
+    void writeFrameEnd(void);
+
+    void close(void);
+
+private:
+    std::ostream &os;
+    bool first;
+    bool closed;
+
+    int64_t timeBase;
+
+    unsigned frameNo;
+    int64_t frameCpuStart;
+    int64_t frameCpuEnd;
+    int64_t frameGpuStart;
+    int64_t frameGpuEnd;
+
+    std::set<unsigned> threads;
+
+    void beginEvent(const char *name, char phase, unsigned pid, unsigned tid);
+    void writeMetadata(const char *kind, unsigned pid, unsigned tid, const char *value);
+    void writeSlice(const char *name, unsigned pid, unsigned tid,
+                    int64_t start, int64_t duration);
+    void writeTime(const char *key, int64_t ns);
+};
+
+} /* namespace trace */
@@ -27,6 +27,7 @@
 #pragma once
 
 #include <fstream>
+#include <string>
 #include <stdint.h>
 
 
@@ -48,6 +49,11 @@ public:
     static File *createBrotli(void);
     static File *createSnappy(void);
     static File *createForRead(const char *filename);
+
+    /**
+     * Read an uncompressed stream from memory, taking over the data.
+     */
+    static File *createMemory(std::string &data);
 public:
     File(void);
     virtual ~File();
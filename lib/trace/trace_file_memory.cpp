@@ -0,0 +1,127 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Read-only file over an uncompressed trace stream held in memory, e.g., as
+ * accumulated by a MemoryOutStream.
+ */
+
+
+#include <algorithm>
+#include <string>
+
+#include <assert.h>
+#include <string.h>
+
+#include "trace_file.hpp"
+
+
+#define MEMORY_CHUNK_SIZE (1 * 1024 * 1024)
+
+
+using namespace trace;
+
+
+namespace {
+
+
+class MemoryFile : public File {
+public:
+    MemoryFile(std::string &data) :
+        m_pos(0)
+    {
+        m_data.swap(data);
+    }
+
+    ~MemoryFile() {
+        close();
+    }
+
+    size_t containerSizeInBytes(void) const override {
+        return m_data.size();
+    }
+    size_t containerBytesRead(void) const override {
+        return m_pos;
+    }
+    size_t dataBytesRead(void) const override {
+        return m_pos;
+    }
+    const char *containerType() const override {
+        return "Memory";
+    }
+
+    bool supportsOffsets(void) const override {
+        return true;
+    }
+    File::Offset currentOffset(void) const override {
+        return File::Offset(m_pos / MEMORY_CHUNK_SIZE, m_pos % MEMORY_CHUNK_SIZE);
+    }
+    void setCurrentOffset(const File::Offset &offset) override {
+        m_pos = offset.chunk * MEMORY_CHUNK_SIZE + offset.offsetInChunk;
+        assert(m_pos <= m_data.size());
+    }
+
+protected:
+    bool rawOpen(const char *filename) override {
+        m_pos = 0;
+        return true;
+    }
+    size_t rawRead(void *buffer, size_t length) override {
+        length = std::min(length, m_data.size() - m_pos);
+        memcpy(buffer, m_data.data() + m_pos, length);
+        m_pos += length;
+        return length;
+    }
+    int rawGetc(void) override {
+        if (m_pos >= m_data.size()) {
+            return -1;
+        }
+        return (unsigned char)m_data[m_pos++];
+    }
+    void rawClose(void) override {
+    }
+    bool rawSkip(size_t length) override {
+        if (length > m_data.size() - m_pos) {
+            m_pos = m_data.size();
+            return false;
+        }
+        m_pos += length;
+        return true;
+    }
+
+private:
+    std::string m_data;
+    size_t m_pos;
+};
+
+
+} /* anonymous namespace */
+
+
+File *
+File::createMemory(std::string &data)
+{
+    return new MemoryFile(data);
+}
@@ -42,6 +42,8 @@ Call::~Call() {
     }
 
     delete ret;
+
+    os::addMemoryCounter(os::MEMORY_CALLS, -1);
 }
 
 Value &
@@ -104,6 +106,7 @@ public:
         assert(totalSize >= size);
         totalSize -= size;
         delete [] buf;
+        os::addMemoryCounter(os::MEMORY_BLOB_BYTES, -(long long)size);
     }
 
     // Move constructor
@@ -138,6 +141,7 @@ Blob::~Blob() {
 
     if (!bound) {
         delete [] buf;
+        os::addMemoryCounter(os::MEMORY_BLOB_BYTES, -(long long)size);
         return;
     }
 
@@ -37,6 +37,8 @@
 #include <vector>
 #include <ostream>
 
+#include "os_memory_counters.hpp"
+
 
 namespace trace {
 
@@ -334,6 +336,7 @@ public:
         size = _size;
         buf = new char[_size];
         bound = false;
+        os::addMemoryCounter(os::MEMORY_BLOB_BYTES, _size);
     }
 
     ~Blob();
@@ -568,6 +571,7 @@ public:
         sig(_sig), 
         args(_sig->num_args), 
         flags(_flags) {
+        os::addMemoryCounter(os::MEMORY_CALLS, 1);
     }
 
     ~Call();
@@ -29,6 +29,8 @@
 
 #include <stdlib.h>
 
+#include <string>
+
 
 namespace trace {
 
@@ -42,9 +44,62 @@ public:
 };
 
 
+/**
+ * Stream which accumulates the uncompressed data in memory.
+ */
+class MemoryOutStream : public OutStream {
+public:
+    std::string data;
+
+    bool write(const void *buffer, size_t length) override {
+        data.append(static_cast<const char *>(buffer), length);
+        return true;
+    }
+    void flush(void) override {}
+};
+
+
+/**
+ * Stream which keeps only the most recently written data in memory, as a
+ * ring of Snappy compressed segments, until it is dumped into a file.
+ *
+ * Each segment must start with its own trace header, so that it can be
+ * parsed independently of the segments evicted before it.  The state set by
+ * evicted segments is kept as a compacted checkpoint, which counts toward the
+ * maximum size.
+ */
+class RingOutStream : public OutStream {
+public:
+    /**
+     * Start a new segment, whose first call is numbered call_no.
+     */
+    virtual void beginSegment(unsigned call_no) = 0;
+
+    /**
+     * Compressed size of the current segment.
+     */
+    virtual size_t segmentSize(void) const = 0;
+
+    /**
+     * Write the checkpoint and all retained segments, as they are, into a
+     * dump file for convertRingDump.  Safe to call from signal handlers.
+     */
+    virtual bool dump(const char *filename) = 0;
+};
+
+
 OutStream *
 createSnappyStream(const char *filename);
 
+RingOutStream *
+createRingStream(size_t maxSize);
+
+/**
+ * Rewrite a dump of a RingOutStream into a regular trace file.
+ */
+bool
+convertRingDump(const char *dumpFilename, const char *traceFilename);
+
 OutStream *
 createZLibStream(const char *filename);
 
@@ -0,0 +1,607 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * In-memory "flight recorder" stream.
+ *
+ * Data is compressed with the same chunk framing used by SnappyOutStream, and
+ * grouped in segments, each starting with its own trace header.  When the
+ * ring grows beyond its maximum size the oldest segments are dropped, after
+ * folding the state they set into a checkpoint, so that the remaining
+ * segments can still be replayed.
+ *
+ * Evicted segments are parsed once, into a StateShadow which lives as long
+ * as the stream, and which is written out as the checkpoint after each round
+ * of evictions.  The checkpoint counts toward the maximum size, so it bounds
+ * the cost of rewriting it, while each round evicts at least one segment.
+ *
+ * Dumping happens from crash handlers, so it merely writes the checkpoint
+ * and segments as they are into a dump file, which convertRingDump() later
+ * parses and rewrites into a regular trace file, with consistent call
+ * numbers and signature definitions.
+ *
+ * Dump files start with RING_MAGIC, followed by records made of a type byte,
+ * the number of the first call as 32 bits, the data length as 64 bits, both
+ * little endian, and the data.  Checkpoint and segment data are compressed
+ * chunks, while the tail of the last segment is not compressed yet.
+ */
+
+
+#include "trace_ostream.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <snappy.h>
+
+#include "os.hpp"
+#include "trace_file.hpp"
+#include "trace_parser.hpp"
+#include "trace_state_shadow.hpp"
+#include "trace_writer.hpp"
+
+
+#define RING_CHUNK_SIZE (1 * 1024 * 1024)
+
+#define RING_MAGIC "APIRING1"
+
+enum {
+    RECORD_CHECKPOINT = 'C',
+    RECORD_SEGMENT = 'S',
+    RECORD_TAIL = 'T',
+};
+
+
+using namespace trace;
+
+
+namespace {
+
+
+/*
+ * Append a compressed chunk.
+ */
+void
+compressChunk(std::string &data, const char *src, size_t length, std::vector<char> &buffer)
+{
+    size_t compressedLength;
+    ::snappy::RawCompress(src, length, &buffer[0], &compressedLength);
+
+    unsigned char buf[4];
+    length = compressedLength;
+    buf[0] = length & 0xff; length >>= 8;
+    buf[1] = length & 0xff; length >>= 8;
+    buf[2] = length & 0xff; length >>= 8;
+    buf[3] = length & 0xff; length >>= 8;
+    assert(length == 0);
+
+    data.append((const char *)buf, sizeof buf);
+    data.append(&buffer[0], compressedLength);
+}
+
+
+bool
+uncompressChunks(const std::string &chunks, std::string &data)
+{
+    const char *src = chunks.data();
+    const char *end = src + chunks.size();
+
+    while (src + 4 <= end) {
+        const unsigned char *buf = (const unsigned char *)src;
+        size_t compressedLength = buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((size_t)buf[3] << 24);
+        src += 4;
+        if (compressedLength > size_t(end - src)) {
+            return false;
+        }
+
+        size_t length;
+        if (!::snappy::GetUncompressedLength(src, compressedLength, &length)) {
+            return false;
+        }
+        size_t offset = data.size();
+        data.resize(offset + length);
+        if (!::snappy::RawUncompress(src, compressedLength, &data[offset])) {
+            return false;
+        }
+        src += compressedLength;
+    }
+
+    return src == end;
+}
+
+
+/*
+ * Whether a call sets state, and so belongs in checkpoints.  Same rule as
+ * for the prologue of capture windows.
+ */
+bool
+isStateCall(const Call *call, bool &inBeginEnd)
+{
+    const char *name = call->name();
+    if (strcmp(name, "glBegin") == 0) {
+        inBeginEnd = true;
+    } else if (strcmp(name, "glEnd") == 0) {
+        inBeginEnd = false;
+        return false;
+    }
+    if (inBeginEnd ||
+        (call->flags & (CALL_FLAG_RENDER | CALL_FLAG_END_FRAME | CALL_FLAG_INCOMPLETE))) {
+        return false;
+    }
+    return !(call->flags & CALL_FLAG_NO_SIDE_EFFECTS) || isRemappedQuery(name);
+}
+
+
+bool
+openParser(Parser &parser, std::string &data, unsigned call_no)
+{
+    File *file = File::createMemory(data);
+    file->open("ring");
+    if (!parser.open(file)) {
+        return false;
+    }
+
+    // Keep the call numbers of leave events matching
+    ParseBookmark bookmark;
+    parser.getBookmark(bookmark);
+    bookmark.next_call_no = call_no;
+    parser.setBookmark(bookmark);
+    return true;
+}
+
+
+/*
+ * Parser of an evicted segment, which outlives its data so that the calls
+ * it parsed can keep referring to its signatures.
+ */
+class SegmentParser : public Parser
+{
+public:
+    void releaseFile(void) {
+        if (file) {
+            file->close();
+            delete file;
+            file = nullptr;
+        }
+    }
+
+    bool referenced(const std::set<const FunctionSig *> &sigs) const {
+        for (auto sig : functions) {
+            if (sig && sigs.count(sig)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+
+/*
+ * Write, retrying after signal interruptions and partial writes.
+ */
+bool
+writeAll(int fd, const void *buffer, size_t length)
+{
+    const char *src = static_cast<const char *>(buffer);
+    while (length) {
+#ifdef _WIN32
+        int written = _write(fd, src, unsigned(std::min<size_t>(length, 1 << 30)));
+#else
+        ssize_t written = write(fd, src, length);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        src += written;
+        length -= written;
+    }
+    return true;
+}
+
+
+bool
+writeRecord(int fd, char type, unsigned call_no, const void *data, size_t length)
+{
+    unsigned char header[13];
+    header[0] = type;
+    for (unsigned i = 0; i < 4; ++i) {
+        header[1 + i] = (call_no >> (8 * i)) & 0xff;
+    }
+    unsigned long long size = length;
+    for (unsigned i = 0; i < 8; ++i) {
+        header[5 + i] = (size >> (8 * i)) & 0xff;
+    }
+    return writeAll(fd, header, sizeof header) &&
+           writeAll(fd, data, length);
+}
+
+
+class SnappyRingOutStream : public RingOutStream {
+public:
+    SnappyRingOutStream(size_t maxSize);
+    ~SnappyRingOutStream();
+
+    bool write(const void *buffer, size_t length) override;
+    void flush(void) override;
+
+    void beginSegment(unsigned call_no) override;
+    size_t segmentSize(void) const override;
+    bool dump(const char *filename) override;
+
+private:
+    struct Segment {
+        unsigned call_no;
+        // compressed_length + compressed_data chunks
+        std::string data;
+    };
+
+    void flushWriteCache(void);
+    void evictSegment(void);
+    void writeCheckpoint(void);
+
+    size_t m_maxSize;
+    size_t m_totalSize;
+    std::deque<Segment> m_segments;
+
+    // State set by the evicted segments, and the parsers owning the
+    // signatures of its calls
+    StateShadow m_shadow;
+    std::vector<SegmentParser *> m_parsers;
+    bool m_inBeginEnd;
+    unsigned long long m_version;
+    Properties m_properties;
+
+    // Compressed stream recreating the state at the start of the oldest
+    // segment
+    std::string m_checkpoint;
+
+    // Size the checkpoint counts for, including the shadow it was written
+    // from, which holds about as much as its uncompressed data
+    size_t m_checkpointSize;
+
+    std::vector<char> m_cache;
+    size_t m_cacheUsed;
+    std::vector<char> m_compressedCache;
+};
+
+
+SnappyRingOutStream::SnappyRingOutStream(size_t maxSize) :
+    m_maxSize(maxSize),
+    m_totalSize(0),
+    m_inBeginEnd(false),
+    m_version(0),
+    m_checkpointSize(0),
+    m_cache(RING_CHUNK_SIZE),
+    m_cacheUsed(0),
+    m_compressedCache(snappy::MaxCompressedLength(RING_CHUNK_SIZE))
+{
+    m_segments.emplace_back();
+    m_segments.back().call_no = 0;
+}
+
+SnappyRingOutStream::~SnappyRingOutStream()
+{
+    std::vector<Call *> calls;
+    m_shadow.takeCalls(calls);
+    for (auto call : calls) {
+        delete call;
+    }
+    for (auto parser : m_parsers) {
+        delete parser;
+    }
+}
+
+bool SnappyRingOutStream::write(const void *buffer, size_t length)
+{
+    const char *src = static_cast<const char *>(buffer);
+    while (length) {
+        size_t size = std::min(length, m_cache.size() - m_cacheUsed);
+        memcpy(&m_cache[m_cacheUsed], src, size);
+        m_cacheUsed += size;
+        src += size;
+        length -= size;
+        if (m_cacheUsed == m_cache.size()) {
+            flushWriteCache();
+        }
+    }
+    return true;
+}
+
+void SnappyRingOutStream::flush(void)
+{
+    flushWriteCache();
+}
+
+void SnappyRingOutStream::flushWriteCache(void)
+{
+    if (!m_cacheUsed) {
+        return;
+    }
+
+    std::string &data = m_segments.back().data;
+    size_t size = data.size();
+    compressChunk(data, &m_cache[0], m_cacheUsed, m_compressedCache);
+    m_totalSize += data.size() - size;
+    m_cacheUsed = 0;
+
+    // Evict the oldest segments, but never the one being written.  The
+    // checkpoint grows with what they leave behind, possibly beyond the
+    // space they freed.
+    while (m_totalSize > m_maxSize && m_segments.size() > 1) {
+        do {
+            evictSegment();
+        } while (m_totalSize > m_maxSize && m_segments.size() > 1);
+        writeCheckpoint();
+    }
+}
+
+/*
+ * Fold the state set by the oldest segment into the shadow, and drop it.
+ */
+void SnappyRingOutStream::evictSegment(void)
+{
+    Segment &segment = m_segments.front();
+    m_totalSize -= segment.data.size();
+
+    SegmentParser *parser = new SegmentParser;
+    std::string data;
+    if (uncompressChunks(segment.data, data) &&
+        openParser(*parser, data, segment.call_no)) {
+        m_version = parser->getVersion();
+        m_properties = parser->getProperties();
+
+        Call *call;
+        while ((call = parser->parse_call())) {
+            if (isStateCall(call, m_inBeginEnd)) {
+                m_shadow.addCall(call);
+            } else {
+                delete call;
+            }
+        }
+        parser->releaseFile();
+    }
+    m_parsers.push_back(parser);
+
+    m_segments.pop_front();
+}
+
+/*
+ * Write the surviving calls of the shadow as the checkpoint, and release
+ * the parsers none of them refers to anymore.
+ */
+void SnappyRingOutStream::writeCheckpoint(void)
+{
+    m_totalSize -= m_checkpointSize;
+    m_checkpointSize = 0;
+    m_checkpoint.clear();
+
+    std::vector<Call *> calls;
+    m_shadow.getCalls(calls);
+
+    // Values refer to signatures of the same parser as their call
+    std::set<const FunctionSig *> sigs;
+    for (auto call : calls) {
+        sigs.insert(call->sig);
+    }
+    size_t count = 0;
+    for (auto parser : m_parsers) {
+        if (parser->referenced(sigs)) {
+            m_parsers[count++] = parser;
+        } else {
+            delete parser;
+        }
+    }
+    m_parsers.resize(count);
+
+    if (calls.empty()) {
+        return;
+    }
+
+    MemoryOutStream *stream = new MemoryOutStream;
+    Writer writer;
+    writer.open(stream, m_version, m_properties);
+    for (auto call : calls) {
+        writer.writeCall(call);
+    }
+
+    const std::string &data = stream->data;
+    for (size_t offset = 0; offset < data.size(); offset += RING_CHUNK_SIZE) {
+        compressChunk(m_checkpoint, data.data() + offset,
+                      std::min<size_t>(RING_CHUNK_SIZE, data.size() - offset),
+                      m_compressedCache);
+    }
+
+    m_checkpointSize = m_checkpoint.size() + data.size();
+    m_totalSize += m_checkpointSize;
+}
+
+void SnappyRingOutStream::beginSegment(unsigned call_no)
+{
+    flushWriteCache();
+
+    if (!m_segments.back().data.empty()) {
+        m_segments.emplace_back();
+    }
+    m_segments.back().call_no = call_no;
+}
+
+size_t SnappyRingOutStream::segmentSize(void) const
+{
+    return m_segments.back().data.size() + m_cacheUsed;
+}
+
+/*
+ * Only uses async-signal-safe calls, and does not allocate.
+ */
+bool SnappyRingOutStream::dump(const char *filename)
+{
+#ifdef _WIN32
+    int fd = _open(filename, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+#endif
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = writeAll(fd, RING_MAGIC, strlen(RING_MAGIC));
+    if (ok && !m_checkpoint.empty()) {
+        ok = writeRecord(fd, RECORD_CHECKPOINT, 0, m_checkpoint.data(), m_checkpoint.size());
+    }
+    for (auto & segment : m_segments) {
+        if (ok) {
+            ok = writeRecord(fd, RECORD_SEGMENT, segment.call_no, segment.data.data(), segment.data.size());
+        }
+    }
+    if (ok && m_cacheUsed) {
+        ok = writeRecord(fd, RECORD_TAIL, m_segments.back().call_no, &m_cache[0], m_cacheUsed);
+    }
+
+#ifdef _WIN32
+    _close(fd);
+#else
+    close(fd);
+#endif
+
+    return ok;
+}
+
+
+} /* anonymous namespace */
+
+
+RingOutStream *
+trace::createRingStream(size_t maxSize)
+{
+    return new SnappyRingOutStream(maxSize);
+}
+
+
+bool
+trace::convertRingDump(const char *dumpFilename, const char *traceFilename)
+{
+    std::ifstream stream(dumpFilename, std::ifstream::binary);
+    if (!stream.is_open()) {
+        os::log("error: failed to open %s\n", dumpFilename);
+        return false;
+    }
+    std::string dump((std::istreambuf_iterator<char>(stream)),
+                     std::istreambuf_iterator<char>());
+
+    size_t magicLength = strlen(RING_MAGIC);
+    if (dump.compare(0, magicLength, RING_MAGIC) != 0) {
+        os::log("error: %s is not a ring dump\n", dumpFilename);
+        return false;
+    }
+
+    struct Segment {
+        unsigned call_no;
+        std::string data;
+    };
+    std::vector<Segment> segments;
+
+    size_t pos = magicLength;
+    while (pos + 13 <= dump.size()) {
+        const unsigned char *header = (const unsigned char *)&dump[pos];
+        char type = header[0];
+        unsigned call_no = 0;
+        for (unsigned i = 0; i < 4; ++i) {
+            call_no |= unsigned(header[1 + i]) << (8 * i);
+        }
+        unsigned long long length = 0;
+        for (unsigned i = 0; i < 8; ++i) {
+            length |= (unsigned long long)header[5 + i] << (8 * i);
+        }
+        pos += 13;
+        if (length > dump.size() - pos) {
+            os::log("warning: truncated ring dump\n");
+            break;
+        }
+        std::string chunks = dump.substr(pos, length);
+        pos += length;
+
+        if (type == RECORD_TAIL) {
+            if (!segments.empty()) {
+                segments.back().data.append(chunks);
+            }
+            continue;
+        }
+
+        segments.push_back(Segment{call_no, std::string()});
+        if (!uncompressChunks(chunks, segments.back().data)) {
+            os::log("warning: corrupted segment at call %u\n", call_no);
+            segments.pop_back();
+        }
+    }
+
+    Writer writer;
+    bool opened = false;
+
+    for (auto & segment : segments) {
+        if (segment.data.empty()) {
+            continue;
+        }
+
+        Parser parser;
+        if (!openParser(parser, segment.data, segment.call_no)) {
+            continue;
+        }
+
+        if (!opened) {
+            if (!writer.open(traceFilename, parser.getVersion(), parser.getProperties())) {
+                return false;
+            }
+            opened = true;
+        }
+
+        Call *call;
+        while ((call = parser.parse_call())) {
+            writer.writeCall(call);
+            delete call;
+        }
+    }
+
+    return opened;
+}
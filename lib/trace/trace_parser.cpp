@@ -52,12 +52,19 @@ Parser::~Parser() {
 
 
 bool Parser::open(const char *filename) {
-    assert(!file);
-    file = File::createForRead(filename);
-    if (!file) {
+    File *_file = File::createForRead(filename);
+    if (!_file) {
         return false;
     }
 
+    return open(_file);
+}
+
+
+bool Parser::open(File *_file) {
+    assert(!file);
+    file = _file;
+
     version = read_uint();
     if (version > TRACE_VERSION) {
         std::cerr << "error: unsupported trace format version " << version << "\n";
@@ -457,6 +464,10 @@ void Parser::parse_enter(Mode mode) {
 
     FunctionSigFlags *sig = parse_function_sig();
 
+    if (mode == SCAN && parseFully && parseFully(sig->name)) {
+        mode = FULL;
+    }
+
     Call *call = new Call(sig, sig->flags, thread_id);
 
     call->no = next_call_no++;
@@ -491,6 +502,10 @@ Call *Parser::parse_leave(Mode mode) {
         return NULL;
     }
 
+    if (mode == SCAN && parseFully && parseFully(call->sig->name)) {
+        mode = FULL;
+    }
+
     if (parse_call_details(call, mode)) {
         return call;
     } else {
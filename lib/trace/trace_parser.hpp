@@ -116,6 +116,9 @@ protected:
     int next_event_type = -1;
     unsigned next_call_no = 0;
 
+    /* Calls scan_call() still parses fully, if any */
+    bool (*parseFully)(const char *name) = nullptr;
+
     unsigned long long version = 0;
     unsigned long long semanticVersion = 0;
 
@@ -128,6 +131,11 @@ public:
 
     bool open(const char *filename) override;
 
+    /**
+     * Parse from an already opened file, taking ownership of it.
+     */
+    bool open(File *file);
+
     void close(void) override;
 
     Call *parse_call(void) override {
@@ -176,6 +184,17 @@ public:
         return parse_call(SCAN);
     }
 
+    /**
+     * Like scan_call(), but still parse the arguments of the calls whose
+     * name the given predicate accepts.
+     */
+    Call *scan_call(bool (*filter)(const char *name)) {
+        parseFully = filter;
+        Call *call = parse_call(SCAN);
+        parseFully = nullptr;
+        return call;
+    }
+
 protected:
     Call *parse_call(Mode mode);
 
@@ -274,6 +293,14 @@ protected:
 AbstractParser *
 lastFrameLoopParser(AbstractParser *parser, int loopCount);
 
+/**
+ * Keep the calls of frameCount frames starting at firstFrame in memory, and
+ * replay them loopCount more times after parsing them.  Nothing is replayed
+ * again if the trace ends before the range does.
+ */
+AbstractParser *
+frameRangeLoopParser(AbstractParser *parser, unsigned firstFrame, unsigned frameCount, unsigned loopCount);
+
 
 } /* namespace trace */
 
@@ -497,12 +497,15 @@ Parser::lookupCallFlags(const char *name)
 {
     using namespace std;
 
+    // Regular expressions are constructed on first use, and never destroyed,
+    // so that calls can still be classified from exit handlers.
+
     if (name[0] == 'g') {
-        static const regex draw(
+        static const regex &draw = *new regex(
             "^gl([A-Z][a-z]+)*Draw(Range|Mesh)?(Arrays|Elements)([A-Z][a-zA-Z]*)?$"
         );
 
-        static const regex miscDraw(
+        static const regex &miscDraw = *new regex(
             "^gl("
                 "CallLists?|"
                 "Clear|"
@@ -519,12 +522,12 @@ Parser::lookupCallFlags(const char *name)
             return CALL_FLAG_RENDER;
         }
 
-        static const regex fbo( "^glBindFramebuffer[0-9A-Z]*");
+        static const regex &fbo = *new regex("^glBindFramebuffer[0-9A-Z]*");
         if (regex_match(name, fbo)) {
             return CALL_FLAG_SWAP_RENDERTARGET;
         }
 
-        static const regex get(
+        static const regex &get = *new regex(
             "^gl("
                 "GetFloat|"
                 "GetInteger|"
@@ -538,10 +541,10 @@ Parser::lookupCallFlags(const char *name)
     }
 
     if (name[0] == 'I') {
-        static const regex present("^IDXGI(Decode)?SwapChain\\w*::Present\\w*$");
-        static const regex draw   ("^ID3D1(0Device|1DeviceContext)\\d*::(Draw\\w*|ExecuteCommandList)$");
-        static const regex srt    ("^ID3D1(0Device|1DeviceContext)\\d*::OMSetRenderTargets\\w*$");
-        static const regex cmql   ("^ID3D1[01]Device\\d*::(CheckFormatSupport|CheckMultisampleQualityLevels)$");
+        static const regex &present = *new regex("^IDXGI(Decode)?SwapChain\\w*::Present\\w*$");
+        static const regex &draw   = *new regex("^ID3D1(0Device|1DeviceContext)\\d*::(Draw\\w*|ExecuteCommandList)$");
+        static const regex &srt    = *new regex("^ID3D1(0Device|1DeviceContext)\\d*::OMSetRenderTargets\\w*$");
+        static const regex &cmql   = *new regex("^ID3D1[01]Device\\d*::(CheckFormatSupport|CheckMultisampleQualityLevels)$");
 
         if (regex_match(name, draw))    return CALL_FLAG_RENDER;
         if (regex_match(name, srt))     return CALL_FLAG_SWAP_RENDERTARGET;
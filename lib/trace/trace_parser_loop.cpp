@@ -116,4 +116,87 @@ lastFrameLoopParser(AbstractParser *parser, int loopCount)
 }
 
 
+// Decorator for parser which keeps the calls of a frame range in memory, and
+// replays them several times once parsed
+class FrameRangeLoopParser : public AbstractParser  {
+public:
+    FrameRangeLoopParser(AbstractParser *p, unsigned first, unsigned count, unsigned loops) {
+        parser = p;
+        firstFrame = first;
+        frameCount = count;
+        loopCount = loops;
+    }
+
+    ~FrameRangeLoopParser() {
+        for (auto c : rangeCalls)
+            delete c;
+        rangeCalls.clear();
+        delete parser;
+    }
+
+    Call *parse_call(void) override;
+
+    // Delegate to Parser
+    void getBookmark(ParseBookmark &bookmark) override { parser->getBookmark(bookmark); }
+    void setBookmark(const ParseBookmark &bookmark) override { parser->setBookmark(bookmark); }
+    bool open(const char *filename) override { return parser->open(filename); }
+    void close(void) override { parser->close(); }
+    unsigned long long getVersion(void) const override { return parser->getVersion(); }
+    const Properties & getProperties(void) const override { return parser->getProperties(); }
+private:
+    unsigned firstFrame;
+    unsigned frameCount;
+    unsigned loopCount;
+    unsigned frameNo = 0;
+    bool looping = false;
+    AbstractParser *parser;
+    std::vector<Call *> rangeCalls;
+    size_t rangeIndex = 0;
+};
+
+
+Call *
+FrameRangeLoopParser::parse_call(void)
+{
+    if (!looping) {
+        trace::Call *call = parser->parse_call();
+        if (call) {
+            if (frameNo >= firstFrame) {
+                call->reuse_call = true;
+                rangeCalls.push_back(call);
+            }
+            if (call->flags & trace::CALL_FLAG_END_FRAME) {
+                ++frameNo;
+                // Stop parsing once the whole range is cached
+                looping = frameNo >= firstFrame + frameCount;
+            }
+            return call;
+        }
+
+        // The trace ended before the range did, so there is no range to
+        // repeat
+        looping = true;
+        loopCount = 0;
+    }
+
+    if (!loopCount || rangeCalls.empty()) {
+        return nullptr;
+    }
+
+    trace::Call *call = rangeCalls[rangeIndex++];
+    if (rangeIndex == rangeCalls.size()) {
+        rangeIndex = 0;
+        --loopCount;
+    }
+    return call;
+}
+
+
+AbstractParser *
+frameRangeLoopParser(AbstractParser *parser, unsigned firstFrame, unsigned frameCount, unsigned loopCount)
+{
+    return new FrameRangeLoopParser(parser, firstFrame, frameCount, loopCount);
+}
+
+
 } /* namespace trace */
@@ -0,0 +1,117 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "trace_parser.hpp"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+
+using namespace trace;
+
+
+static const FunctionSig drawSig = {0, "glDraw", 0, nullptr};
+static const FunctionSig swapSig = {1, "glSwap", 0, nullptr};
+
+
+/**
+ * Parser returning FRAMES frames, each made of a draw and a swap call.
+ */
+class FakeParser : public AbstractParser
+{
+public:
+    FakeParser(unsigned frames) :
+        numCalls(frames * 2)
+    {}
+
+    Call *parse_call(void) override {
+        if (callNo >= numCalls) {
+            return nullptr;
+        }
+        bool swap = callNo % 2;
+        Call *call = new Call(swap ? &swapSig : &drawSig,
+                              swap ? CALL_FLAG_END_FRAME : 0, 0);
+        call->no = callNo++;
+        return call;
+    }
+
+    void getBookmark(ParseBookmark &bookmark) override {}
+    void setBookmark(const ParseBookmark &bookmark) override {}
+    bool open(const char *filename) override { return true; }
+    void close(void) override {}
+    unsigned long long getVersion(void) const override { return 0; }
+    const Properties & getProperties(void) const override { return properties; }
+
+private:
+    unsigned numCalls;
+    unsigned callNo = 0;
+    Properties properties;
+};
+
+
+static std::vector<unsigned>
+replay(AbstractParser *parser)
+{
+    std::vector<unsigned> callNos;
+    Call *call;
+    while ((call = parser->parse_call())) {
+        callNos.push_back(call->no);
+        if (!call->reuse_call) {
+            delete call;
+        }
+    }
+    delete parser;
+    return callNos;
+}
+
+
+TEST(trace_parser_loop, frame_range)
+{
+    // Frames 1-2 of 4, replayed twice more, and the rest of the trace skipped
+    std::vector<unsigned> expected = {0, 1, 2, 3, 4, 5, 2, 3, 4, 5, 2, 3, 4, 5};
+    EXPECT_EQ(replay(frameRangeLoopParser(new FakeParser(4), 1, 2, 2)), expected);
+}
+
+
+TEST(trace_parser_loop, frame_range_truncated)
+{
+    // The range extends past the end of the trace, so nothing is repeated
+    std::vector<unsigned> expected = {0, 1, 2, 3};
+    EXPECT_EQ(replay(frameRangeLoopParser(new FakeParser(2), 1, 5, 1)), expected);
+
+    // The range starts past the end of the trace
+    expected = {0, 1, 2, 3};
+    EXPECT_EQ(replay(frameRangeLoopParser(new FakeParser(2), 3, 1, 1)), expected);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
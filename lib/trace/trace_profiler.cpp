@@ -25,12 +25,222 @@
  **************************************************************************/
 
 #include "trace_profiler.hpp"
+#include "trace_event_writer.hpp"
+#include "os_memory_counters.hpp"
 #include "os_time.hpp"
+#include <algorithm>
 #include <iostream>
 #include <string.h>
 #include <sstream>
+#include <stdlib.h>
+
+/*
+ * Binary profile format
+ *
+ * After an 8 byte signature and a version byte, the profile is a sequence of
+ * records, each made of a tag byte, the payload size, and the payload:
+ *
+ * - 'N' defines the next call name, referred to by its index;
+ * - 'C' holds a batch of calls -- all the calls of a frame -- stored one
+ *   column at a time, with start times and call numbers delta encoded from
+ *   the previous call of the batch;
+ * - 'M' holds the memory counters sampled at the end of a frame, as name and
+ *   value pairs;
+ * - 'F' marks the end of a frame.
+ *
+ * Integers are LEB128 encoded, signed ones after zigzag encoding.  Batches
+ * don't depend on each other, so readers may skip whole frames by size.
+ * Parsing stops at the first unknown tag.
+ */
+
+#define PROFILE_SIGNATURE "APIPROF"
+#define PROFILE_VERSION 1
+
+/* Limit how many calls are buffered when frames are huge */
+#define MAX_PENDING_CALLS (64 * 1024)
 
 namespace trace {
+
+namespace {
+
+struct ParseState {
+    int64_t lastGpuTime;
+    int64_t lastCpuTime;
+    int64_t lastVsizeUsage;
+    int64_t lastRssUsage;
+    std::vector<int64_t> counters;
+};
+
+static ParseState parseState;
+
+static void
+beginParse(Profile* profile)
+{
+    if (profile->programs.size() == 0 && profile->calls.size() == 0 && profile->frames.size() == 0) {
+        parseState.lastGpuTime = 0;
+        parseState.lastCpuTime = 0;
+        parseState.lastVsizeUsage = 0;
+        parseState.lastRssUsage = 0;
+        parseState.counters.clear();
+    }
+}
+
+static void
+parsedCounter(Profile* profile, const std::string &name, int64_t value)
+{
+    auto it = std::find(profile->counterNames.begin(), profile->counterNames.end(), name);
+    size_t index = it - profile->counterNames.begin();
+    if (it == profile->counterNames.end()) {
+        profile->counterNames.push_back(name);
+    }
+    if (parseState.counters.size() <= index) {
+        parseState.counters.resize(index + 1);
+    }
+    parseState.counters[index] = value;
+}
+
+static void
+parsedCall(Profile* profile, const Profile::Call& call)
+{
+    if (parseState.lastGpuTime < call.gpuStart + call.gpuDuration) {
+        parseState.lastGpuTime = call.gpuStart + call.gpuDuration;
+    }
+
+    if (parseState.lastCpuTime < call.cpuStart + call.cpuDuration) {
+        parseState.lastCpuTime = call.cpuStart + call.cpuDuration;
+    }
+
+    if (parseState.lastVsizeUsage < call.vsizeStart + call.vsizeDuration) {
+        parseState.lastVsizeUsage = call.vsizeStart + call.vsizeDuration;
+    }
+
+    if (parseState.lastRssUsage < call.rssStart + call.rssDuration) {
+        parseState.lastRssUsage = call.rssStart + call.rssDuration;
+    }
+
+    profile->calls.push_back(call);
+
+    if (call.pixels >= 0) {
+        if (profile->programs.size() <= call.program) {
+            profile->programs.resize(call.program + 1);
+        }
+
+        Profile::Program& program = profile->programs[call.program];
+        program.cpuTotal += call.cpuDuration;
+        program.gpuTotal += call.gpuDuration;
+        program.pixelTotal += call.pixels;
+        program.vsizeTotal += call.vsizeDuration;
+        program.rssTotal += call.rssDuration;
+        program.calls.push_back((unsigned int)(profile->calls.size() - 1));
+    }
+}
+
+static void
+parsedFrameEnd(Profile* profile)
+{
+    Profile::Frame frame;
+    frame.no = unsigned(profile->frames.size());
+
+    if (frame.no == 0) {
+        frame.gpuStart = 0;
+        frame.cpuStart = 0;
+        frame.vsizeStart = 0;
+        frame.rssStart = 0;
+        frame.calls.begin = 0;
+    } else {
+        frame.gpuStart = profile->frames.back().gpuStart + profile->frames.back().gpuDuration;
+        frame.cpuStart = profile->frames.back().cpuStart + profile->frames.back().cpuDuration;
+        frame.vsizeStart = profile->frames.back().vsizeStart + profile->frames.back().vsizeDuration;
+        frame.rssStart = profile->frames.back().rssStart + profile->frames.back().rssDuration;
+        frame.calls.begin = profile->frames.back().calls.end + 1;
+    }
+
+    frame.gpuDuration = parseState.lastGpuTime - frame.gpuStart;
+    frame.cpuDuration = parseState.lastCpuTime - frame.cpuStart;
+    frame.vsizeDuration = parseState.lastVsizeUsage - frame.vsizeStart;
+    frame.rssDuration = parseState.lastRssUsage - frame.rssStart;
+    frame.calls.end = (unsigned int)(profile->calls.size() - 1);
+    frame.counters.swap(parseState.counters);
+
+    profile->frames.push_back(frame);
+}
+
+
+static inline void
+writeUInt(std::string &buf, uint64_t value)
+{
+    while (value >= 0x80) {
+        buf += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buf += char(value);
+}
+
+static inline void
+writeSInt(std::string &buf, int64_t value)
+{
+    writeUInt(buf, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+static void
+writeRecord(char tag, const std::string &payload)
+{
+    std::string header(1, tag);
+    writeUInt(header, payload.size());
+    std::cout.write(header.data(), header.size());
+    std::cout.write(payload.data(), payload.size());
+}
+
+
+class BinaryReader
+{
+public:
+    const unsigned char *ptr;
+    const unsigned char *end;
+    bool ok = true;
+
+    BinaryReader(const void *data, size_t size) :
+        ptr(static_cast<const unsigned char *>(data)),
+        end(ptr + size)
+    {}
+
+    uint64_t readUInt(void) {
+        uint64_t value = 0;
+        unsigned shift = 0;
+        while (ptr < end && shift < 64) {
+            unsigned char c = *ptr++;
+            value |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80)) {
+                return value;
+            }
+            shift += 7;
+        }
+        ok = false;
+        return 0;
+    }
+
+    int64_t readSInt(void) {
+        uint64_t value = readUInt();
+        return int64_t(value >> 1) ^ -int64_t(value & 1);
+    }
+};
+
+} /* anonymous namespace */
+
+
+unsigned Profile::addName(const std::string &name)
+{
+    auto it = nameIndices.find(name);
+    if (it != nameIndices.end()) {
+        return it->second;
+    }
+    unsigned index = unsigned(names.size());
+    names.push_back(name);
+    nameIndices[name] = index;
+    return index;
+}
+
+
 Profiler::Profiler()
     : baseGpuTime(0),
       baseCpuTime(0),
@@ -40,21 +250,30 @@ Profiler::Profiler()
       cpuTimes(false),
       gpuTimes(true),
       pixelsDrawn(false),
-      memoryUsage(false)
+      memoryUsage(false),
+      binary(false)
 {
 }
 
 Profiler::~Profiler()
 {
+    flush();
 }
 
-void Profiler::setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_, int64_t minCpuTime_)
+void Profiler::setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_, int64_t minCpuTime_, bool binary_)
 {
     cpuTimes = cpuTimes_;
     gpuTimes = gpuTimes_;
     pixelsDrawn = pixelsDrawn_;
     memoryUsage = memoryUsage_;
     minCpuTime = minCpuTime_;
+    binary = binary_;
+
+    if (binary) {
+        std::cout.write(PROFILE_SIGNATURE, sizeof PROFILE_SIGNATURE);
+        std::cout.put(PROFILE_VERSION);
+        return;
+    }
 
     std::cout << "# call no gpu_start gpu_dura cpu_start cpu_dura vsize_start vsize_dura rss_start rss_dura pixels program name" << std::endl;
 }
@@ -89,6 +308,22 @@ void Profiler::setBaseGpuTime(int64_t gpuStart)
     baseGpuTime = gpuStart;
 }
 
+void Profiler::setTimeBase(int64_t systemTime)
+{
+    if (traceEvents) {
+        traceEvents->setTimeBase(systemTime);
+    }
+
+    if (binary) {
+        std::string payload;
+        writeSInt(payload, systemTime);
+        writeRecord('T', payload);
+        return;
+    }
+
+    std::cout << "time_base " << systemTime << std::endl;
+}
+
 void Profiler::setBaseVsizeUsage(int64_t vsizeStart)
 {
     baseVsizeUsage = vsizeStart;
@@ -111,7 +346,8 @@ void Profiler::addCall(unsigned no,
                        int64_t gpuStart, int64_t gpuDuration,
                        int64_t cpuStart, int64_t cpuDuration,
                        int64_t vsizeStart, int64_t vsizeDuration,
-                       int64_t rssStart, int64_t rssDuration)
+                       int64_t rssStart, int64_t rssDuration,
+                       unsigned thread)
 {
     if (gpuTimes && gpuStart) {
         gpuStart -= baseGpuTime;
@@ -141,6 +377,40 @@ void Profiler::addCall(unsigned no,
         rssDuration = 0;
     }
 
+    Profile::Call call;
+    call.no = no;
+    call.program = program;
+    call.gpuStart = gpuStart;
+    call.gpuDuration = gpuDuration;
+    call.cpuStart = cpuStart;
+    call.cpuDuration = cpuDuration;
+    call.vsizeStart = vsizeStart;
+    call.vsizeDuration = vsizeDuration;
+    call.rssStart = rssStart;
+    call.rssDuration = rssDuration;
+    call.pixels = pixels;
+    call.name = 0;
+
+    if (traceEvents) {
+        traceEvents->writeCall(call, name, thread);
+    }
+
+    if (binary) {
+        auto it = nameIds.find(name);
+        if (it == nameIds.end()) {
+            it = nameIds.emplace(name, unsigned(nameIds.size())).first;
+            writeRecord('N', it->first);
+        }
+
+        call.name = it->second;
+        pendingCalls.push_back(call);
+
+        if (pendingCalls.size() >= MAX_PENDING_CALLS) {
+            writeCalls();
+        }
+        return;
+    }
+
     std::cout << "call"
               << " " << no
               << " " << gpuStart
@@ -159,32 +429,126 @@ void Profiler::addCall(unsigned no,
 
 void Profiler::addFrameEnd()
 {
+    if (traceEvents) {
+        traceEvents->writeFrameEnd();
+    }
+
+    if (binary) {
+        writeCalls();
+        if (memoryUsage) {
+            std::string payload;
+            writeUInt(payload, os::NUM_MEMORY_COUNTERS);
+            for (unsigned i = 0; i < os::NUM_MEMORY_COUNTERS; ++i) {
+                const char *name = os::getMemoryCounterName(os::MemoryCounter(i));
+                writeUInt(payload, strlen(name));
+                payload += name;
+                writeSInt(payload, os::getMemoryCounter(os::MemoryCounter(i)));
+            }
+            writeRecord('M', payload);
+        }
+        writeRecord('F', std::string());
+        return;
+    }
+
+    if (memoryUsage) {
+        std::cout << "frame_counters";
+        for (unsigned i = 0; i < os::NUM_MEMORY_COUNTERS; ++i) {
+            std::cout << " " << os::getMemoryCounterName(os::MemoryCounter(i))
+                      << "=" << os::getMemoryCounter(os::MemoryCounter(i));
+        }
+        std::cout << "\n";
+    }
+
     std::cout << "frame_end" << std::endl;
 }
 
+bool Profiler::openTraceEvents(const char *filename)
+{
+    traceEventStream.open(filename, std::ios::out | std::ios::binary);
+    if (!traceEventStream.is_open()) {
+        return false;
+    }
+    traceEvents.reset(new TraceEventWriter(traceEventStream));
+    return true;
+}
+
+void Profiler::flush()
+{
+    if (binary) {
+        writeCalls();
+    }
+    std::cout.flush();
+    if (traceEvents) {
+        traceEventStream.flush();
+    }
+}
+
+void Profiler::writeCalls()
+{
+    if (pendingCalls.empty()) {
+        return;
+    }
+
+    std::string payload;
+    writeUInt(payload, pendingCalls.size());
+
+    /* Delta encoded columns */
+    auto writeDeltas = [&] (int64_t Profile::Call::*member) {
+        int64_t last = 0;
+        for (auto & call : pendingCalls) {
+            writeSInt(payload, call.*member - last);
+            last = call.*member;
+        }
+    };
+
+    /* Plain columns */
+    auto writeValues = [&] (int64_t Profile::Call::*member) {
+        for (auto & call : pendingCalls) {
+            writeSInt(payload, call.*member);
+        }
+    };
+
+    unsigned lastNo = 0;
+    for (auto & call : pendingCalls) {
+        writeSInt(payload, int64_t(call.no) - int64_t(lastNo));
+        lastNo = call.no;
+    }
+    for (auto & call : pendingCalls) {
+        writeUInt(payload, call.name);
+    }
+    for (auto & call : pendingCalls) {
+        writeUInt(payload, call.program);
+    }
+    writeValues(&Profile::Call::pixels);
+    writeDeltas(&Profile::Call::gpuStart);
+    writeValues(&Profile::Call::gpuDuration);
+    writeDeltas(&Profile::Call::cpuStart);
+    writeValues(&Profile::Call::cpuDuration);
+    writeDeltas(&Profile::Call::vsizeStart);
+    writeValues(&Profile::Call::vsizeDuration);
+    writeDeltas(&Profile::Call::rssStart);
+    writeValues(&Profile::Call::rssDuration);
+
+    writeRecord('C', payload);
+
+    pendingCalls.clear();
+}
+
 void Profiler::parseLine(const char* in, Profile* profile)
 {
     std::stringstream line(in, std::ios_base::in);
     std::string type;
-    static int64_t lastGpuTime;
-    static int64_t lastCpuTime;
-    static int64_t lastVsizeUsage;
-    static int64_t lastRssUsage;
 
     if (in[0] == '#' || strlen(in) < 4)
         return;
 
-    if (profile->programs.size() == 0 && profile->calls.size() == 0 && profile->frames.size() == 0) {
-        lastGpuTime = 0;
-        lastCpuTime = 0;
-        lastVsizeUsage = 0;
-        lastRssUsage = 0;
-    }
+    beginParse(profile);
 
     line >> type;
 
     if (type.compare("call") == 0) {
         Profile::Call call;
+        std::string name;
 
         line >> call.no
              >> call.gpuStart
@@ -197,64 +561,281 @@ void Profiler::parseLine(const char* in, Profile* profile)
              >> call.rssDuration
              >> call.pixels
              >> call.program
-             >> call.name;
+             >> name;
+
+        call.name = profile->addName(name);
+
+        parsedCall(profile, call);
+    } else if (type.compare("frame_counters") == 0) {
+        std::string counter;
+        while (line >> counter) {
+            size_t equal = counter.find('=');
+            if (equal != std::string::npos) {
+                parsedCounter(profile, counter.substr(0, equal),
+                              strtoll(counter.c_str() + equal + 1, nullptr, 10));
+            }
+        }
+    } else if (type.compare("frame_end") == 0) {
+        parsedFrameEnd(profile);
+    } else if (type.compare("time_base") == 0) {
+        line >> profile->timeBase;
+    }
+}
+
+bool Profiler::isBinary(const void *data, size_t size)
+{
+    return size >= sizeof PROFILE_SIGNATURE + 1 &&
+           memcmp(data, PROFILE_SIGNATURE, sizeof PROFILE_SIGNATURE) == 0;
+}
+
+/* Parse a single binary record, mapping its names to the profile ones */
+static bool
+parseRecord(char tag, BinaryReader &record, Profile* profile, std::vector<unsigned> &names)
+{
+    size_t length = size_t(record.end - record.ptr);
+
+    switch (tag) {
+    case 'N':
+        names.push_back(profile->addName(std::string(reinterpret_cast<const char *>(record.ptr), length)));
+        break;
+    case 'C':
+        {
+            uint64_t count = record.readUInt();
+            /* Each call takes at least one byte per column */
+            if (!record.ok || count > length) {
+                return false;
+            }
+            std::vector<Profile::Call> calls(static_cast<size_t>(count));
+
+            auto readDeltas = [&] (int64_t Profile::Call::*member) {
+                int64_t last = 0;
+                for (auto & call : calls) {
+                    last += record.readSInt();
+                    call.*member = last;
+                }
+            };
+
+            auto readValues = [&] (int64_t Profile::Call::*member) {
+                for (auto & call : calls) {
+                    call.*member = record.readSInt();
+                }
+            };
+
+            int64_t no = 0;
+            for (auto & call : calls) {
+                no += record.readSInt();
+                call.no = unsigned(no);
+            }
+            for (auto & call : calls) {
+                uint64_t name = record.readUInt();
+                if (name >= names.size()) {
+                    return false;
+                }
+                call.name = names[name];
+            }
+            for (auto & call : calls) {
+                call.program = unsigned(record.readUInt());
+            }
+            readValues(&Profile::Call::pixels);
+            readDeltas(&Profile::Call::gpuStart);
+            readValues(&Profile::Call::gpuDuration);
+            readDeltas(&Profile::Call::cpuStart);
+            readValues(&Profile::Call::cpuDuration);
+            readDeltas(&Profile::Call::vsizeStart);
+            readValues(&Profile::Call::vsizeDuration);
+            readDeltas(&Profile::Call::rssStart);
+            readValues(&Profile::Call::rssDuration);
+
+            if (!record.ok) {
+                return false;
+            }
 
-        if (lastGpuTime < call.gpuStart + call.gpuDuration) {
-            lastGpuTime = call.gpuStart + call.gpuDuration;
+            profile->calls.reserve(profile->calls.size() + calls.size());
+            for (auto & call : calls) {
+                parsedCall(profile, call);
+            }
+        }
+        break;
+    case 'M':
+        {
+            uint64_t count = record.readUInt();
+            for (uint64_t i = 0; i < count && record.ok; ++i) {
+                uint64_t nameLength = record.readUInt();
+                if (!record.ok || nameLength > uint64_t(record.end - record.ptr)) {
+                    return false;
+                }
+                std::string name(reinterpret_cast<const char *>(record.ptr), size_t(nameLength));
+                record.ptr += nameLength;
+                parsedCounter(profile, name, record.readSInt());
+            }
+            if (!record.ok) {
+                return false;
+            }
+        }
+        break;
+    case 'F':
+        parsedFrameEnd(profile);
+        break;
+    case 'T':
+        profile->timeBase = record.readSInt();
+        if (!record.ok) {
+            return false;
         }
+        break;
+    }
 
-        if (lastCpuTime < call.cpuStart + call.cpuDuration) {
-            lastCpuTime = call.cpuStart + call.cpuDuration;
+    return true;
+}
+
+static inline bool
+isRecordTag(int tag)
+{
+    return tag == 'N' || tag == 'C' || tag == 'M' || tag == 'F' || tag == 'T';
+}
+
+bool Profiler::parseBinary(const void *data, size_t size, Profile* profile)
+{
+    if (!isBinary(data, size)) {
+        return false;
+    }
+
+    BinaryReader reader(data, size);
+    reader.ptr += sizeof PROFILE_SIGNATURE;
+    if (*reader.ptr++ != PROFILE_VERSION) {
+        return false;
+    }
+
+    beginParse(profile);
+
+    /* Map the names of this profile to the ones of the existing profile */
+    std::vector<unsigned> names;
+
+    while (reader.ptr < reader.end) {
+        char tag = *reader.ptr;
+        if (!isRecordTag(tag)) {
+            /* Trailing output, such as the retrace summary */
+            break;
         }
+        ++reader.ptr;
 
-        if (lastVsizeUsage < call.vsizeStart + call.vsizeDuration) {
-            lastVsizeUsage = call.vsizeStart + call.vsizeDuration;
+        uint64_t length = reader.readUInt();
+        if (!reader.ok || length > uint64_t(reader.end - reader.ptr)) {
+            return false;
         }
+        BinaryReader record(reader.ptr, size_t(length));
+        reader.ptr += length;
 
-        if (lastRssUsage < call.rssStart + call.rssDuration) {
-            lastRssUsage = call.rssStart + call.rssDuration;
+        if (!parseRecord(tag, record, profile, names)) {
+            return false;
         }
+    }
 
-        profile->calls.push_back(call);
+    return true;
+}
 
-        if (call.pixels >= 0) {
-            if (profile->programs.size() <= call.program) {
-                profile->programs.resize(call.program + 1);
-            }
 
-            Profile::Program& program = profile->programs[call.program];
-            program.cpuTotal += call.cpuDuration;
-            program.gpuTotal += call.gpuDuration;
-            program.pixelTotal += call.pixels;
-            program.vsizeTotal += call.vsizeDuration;
-            program.rssTotal += call.rssDuration;
-            program.calls.push_back((unsigned int)(profile->calls.size() - 1));
+ProfileReader::ProfileReader() :
+    binary(false),
+    frameNo(0)
+{
+}
+
+ProfileReader::~ProfileReader()
+{
+}
+
+bool ProfileReader::open(const char* filename)
+{
+    stream.open(filename, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        return false;
+    }
+
+    char header[sizeof PROFILE_SIGNATURE + 1];
+    stream.read(header, sizeof header);
+    binary = Profiler::isBinary(header, size_t(stream.gcount()));
+    if (binary) {
+        if (header[sizeof PROFILE_SIGNATURE] != PROFILE_VERSION) {
+            return false;
         }
-    } else if (type.compare("frame_end") == 0) {
-        Profile::Frame frame;
-        frame.no = unsigned(profile->frames.size());
-
-        if (frame.no == 0) {
-            frame.gpuStart = 0;
-            frame.cpuStart = 0;
-            frame.vsizeStart = 0;
-            frame.rssStart = 0;
-            frame.calls.begin = 0;
-        } else {
-            frame.gpuStart = profile->frames.back().gpuStart + profile->frames.back().gpuDuration;
-            frame.cpuStart = profile->frames.back().cpuStart + profile->frames.back().cpuDuration;
-            frame.vsizeStart = profile->frames.back().vsizeStart + profile->frames.back().vsizeDuration;
-            frame.rssStart = profile->frames.back().rssStart + profile->frames.back().rssDuration;
-            frame.calls.begin = profile->frames.back().calls.end + 1;
+    } else {
+        stream.clear();
+        stream.seekg(0);
+    }
+
+    beginParse(&profile);
+    return true;
+}
+
+bool ProfileReader::readRecord(void)
+{
+    int tag = stream.get();
+    if (!isRecordTag(tag)) {
+        return false;
+    }
+
+    uint64_t length = 0;
+    unsigned shift = 0;
+    int c;
+    do {
+        c = stream.get();
+        if (c == EOF || shift >= 64) {
+            return false;
         }
+        length |= uint64_t(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    buffer.resize(size_t(length));
+    stream.read(&buffer[0], std::streamsize(length));
+    if (uint64_t(stream.gcount()) != length) {
+        return false;
+    }
 
-        frame.gpuDuration = lastGpuTime - frame.gpuStart;
-        frame.cpuDuration = lastCpuTime - frame.cpuStart;
-        frame.vsizeDuration = lastVsizeUsage - frame.vsizeStart;
-        frame.rssDuration = lastRssUsage - frame.rssStart;
-        frame.calls.end = (unsigned int)(profile->calls.size() - 1);
+    BinaryReader record(buffer.data(), buffer.size());
+    return parseRecord(char(tag), record, &profile, names);
+}
 
-        profile->frames.push_back(frame);
+bool ProfileReader::readFrame(std::vector<Profile::Call> &calls, Profile::Frame &frame)
+{
+    /* Only keep the previous frame, which the next one starts from */
+    if (!profile.frames.empty()) {
+        Profile::Frame last = profile.frames.back();
+        last.calls.end = ~0U;
+        profile.frames.assign(1, last);
+        profile.calls.clear();
+        profile.programs.clear();
     }
+
+    size_t numFrames = profile.frames.size();
+    while (profile.frames.size() == numFrames) {
+        if (binary) {
+            if (!readRecord()) {
+                break;
+            }
+        } else {
+            std::string line;
+            if (!std::getline(stream, line)) {
+                break;
+            }
+            Profiler::parseLine(line.c_str(), &profile);
+        }
+    }
+
+    if (profile.frames.size() == numFrames) {
+        /* Calls after the last frame end, if any, make a frame of their own */
+        if (profile.calls.empty()) {
+            return false;
+        }
+        parsedFrameEnd(&profile);
+    }
+
+    frame = profile.frames.back();
+    frame.no = frameNo++;
+    calls.swap(profile.calls);
+    frame.calls.begin = 0;
+    frame.calls.end = unsigned(calls.size()) - 1;
+    profile.calls.clear();
+    return true;
 }
 }
@@ -26,14 +26,22 @@
 
 #pragma once
 
+#include <fstream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
+#include <stddef.h>
 #include <stdint.h>
 
 namespace trace
 {
 
+class TraceEventWriter;
+
 struct Profile {
+    Profile() : timeBase(0) {}
+
     struct Call {
         unsigned no;
 
@@ -52,7 +60,8 @@ struct Profile {
 
         int64_t pixels;
 
-        std::string name;
+        /* Index to profile->names array */
+        unsigned name;
     };
 
     struct Frame {
@@ -74,6 +83,9 @@ struct Profile {
             unsigned begin;
             unsigned end;
         } calls;
+
+        /* Memory counters at the end of the frame, matching profile->counterNames */
+        std::vector<int64_t> counters;
     };
 
     struct Program {
@@ -92,6 +104,19 @@ struct Profile {
     std::vector<Call> calls;
     std::vector<Frame> frames;
     std::vector<Program> programs;
+
+    /* Call names, each stored only once */
+    std::vector<std::string> names;
+    std::unordered_map<std::string, unsigned> nameIndices;
+
+    /* Names of the memory counters sampled for each frame */
+    std::vector<std::string> counterNames;
+
+    /* System time of the zero of the profile times, in nanoseconds of the
+     * os::getTime() clock (CLOCK_MONOTONIC on Linux), or zero if unknown */
+    int64_t timeBase;
+
+    unsigned addName(const std::string &name);
 };
 
 class Profiler
@@ -100,7 +125,7 @@ public:
     Profiler();
     ~Profiler();
 
-    void setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_, int64_t minCpuTime_);
+    void setup(bool cpuTimes_, bool gpuTimes_, bool pixelsDrawn_, bool memoryUsage_, int64_t minCpuTime_, bool binary_ = false);
 
     void addCall(unsigned no,
                  const char* name,
@@ -109,10 +134,17 @@ public:
                  int64_t gpuStart, int64_t gpuDuration,
                  int64_t cpuStart, int64_t cpuDuration,
                  int64_t vsizeStart, int64_t vsizeDuration,
-                 int64_t rssStart, int64_t rssDuration);
+                 int64_t rssStart, int64_t rssDuration,
+                 unsigned thread = 0);
 
     void addFrameEnd();
 
+    /* Also write the profile as Chrome trace events to filename */
+    bool openTraceEvents(const char *filename);
+
+    /* Write out the calls buffered for the binary format */
+    void flush();
+
     bool hasBaseTimes();
 
     void setBaseCpuTime(int64_t cpuStart);
@@ -120,6 +152,9 @@ public:
     void setBaseVsizeUsage(int64_t vsizeStart);
     void setBaseRssUsage(int64_t rssStart);
 
+    /* Record the system time matching the base times, see Profile::timeBase */
+    void setTimeBase(int64_t systemTime);
+
     int64_t getBaseCpuTime();
     int64_t getBaseGpuTime();
     int64_t getBaseVsizeUsage();
@@ -127,7 +162,15 @@ public:
 
     static void parseLine(const char* line, Profile* profile);
 
+    static bool isBinary(const void *data, size_t size);
+
+    /* Parse a whole binary profile, as written with setup(..., true) */
+    static bool parseBinary(const void *data, size_t size, Profile* profile);
+
 private:
+    void writeCalls();
+
+
     int64_t baseGpuTime;
     int64_t baseCpuTime;
     int64_t minCpuTime;
@@ -138,6 +181,62 @@ private:
     bool gpuTimes;
     bool pixelsDrawn;
     bool memoryUsage;
+
+    bool binary;
+    std::unordered_map<std::string, unsigned> nameIds;
+
+    /* Calls of the current frame, pending to be written as columns */
+    std::vector<Profile::Call> pendingCalls;
+
+    std::ofstream traceEventStream;
+    std::unique_ptr<TraceEventWriter> traceEvents;
+};
+
+/**
+ * Reads a text or binary profile one frame at a time, for profiles too large
+ * to be parsed whole.
+ */
+class ProfileReader
+{
+public:
+    ProfileReader();
+    ~ProfileReader();
+
+    bool open(const char* filename);
+
+    /* Read the calls of the next frame, with its start and durations
+     * computed as by Profiler::parseLine.  Returns false at the end. */
+    bool readFrame(std::vector<Profile::Call> &calls, Profile::Frame &frame);
+
+    /* Call names, as indexed by Profile::Call::name */
+    const std::vector<std::string> &getNames() const {
+        return profile.names;
+    }
+
+    /* Memory counter names, matching Profile::Frame::counters */
+    const std::vector<std::string> &getCounterNames() const {
+        return profile.counterNames;
+    }
+
+    /* See Profile::timeBase */
+    int64_t getTimeBase() const {
+        return profile.timeBase;
+    }
+
+private:
+    std::ifstream stream;
+    bool binary;
+    unsigned frameNo;
+
+    /* Calls of the frame being read, plus the previous frame */
+    Profile profile;
+
+    /* Map of the binary profile names to profile.names */
+    std::vector<unsigned> names;
+
+    std::string buffer;
+
+    bool readRecord(void);
 };
 }
 
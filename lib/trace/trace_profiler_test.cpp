@@ -0,0 +1,211 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "trace_profiler.hpp"
+#include "os_memory_counters.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <stdio.h>
+
+#include "gtest/gtest.h"
+
+
+static std::string
+writeProfile(bool binary, bool memoryUsage = false)
+{
+    std::ostringstream os;
+    std::streambuf *buf = std::cout.rdbuf(os.rdbuf());
+
+    {
+        trace::Profiler profiler;
+        profiler.setup(true, true, true, memoryUsage, 0, binary);
+        profiler.setBaseCpuTime(1000);
+        profiler.setBaseGpuTime(2000);
+        profiler.setTimeBase(123456789);
+
+        profiler.addCall(1, "glClear", 0, 100, 2100, 50, 1100, 20, 0, 0, 0, 0);
+        profiler.addCall(2, "glUseProgram", 3, -1, 0, 0, 1130, 5, 0, 0, 0, 0);
+        profiler.addCall(3, "glDrawArrays", 3, 4000, 2200, 900, 1140, 30, 0, 0, 0, 0);
+        profiler.addFrameEnd();
+        profiler.addCall(5, "glDrawArrays", 3, 10, 3000, 70, 2000, 10, 0, 0, 0, 0);
+        profiler.addCall(4, "glClear", 0, 100, 3100, 50, 2020, 20, 0, 0, 0, 0);
+        profiler.addFrameEnd();
+        profiler.addCall(6, "glFlush", 0, -1, 0, 0, 2100, 40, 0, 0, 0, 0);
+        profiler.flush();
+    }
+
+    std::cout.rdbuf(buf);
+    return os.str();
+}
+
+
+static void
+parseText(const std::string &text, trace::Profile *profile)
+{
+    std::istringstream is(text);
+    std::string line;
+    while (std::getline(is, line)) {
+        trace::Profiler::parseLine(line.c_str(), profile);
+    }
+}
+
+
+TEST(trace_profiler, binary)
+{
+    trace::Profile text;
+    parseText(writeProfile(false), &text);
+
+    std::string data = writeProfile(true);
+    // Trailing text output must be ignored
+    data += "Rendered 2 frames\n";
+    ASSERT_TRUE(trace::Profiler::isBinary(data.data(), data.size()));
+    EXPECT_FALSE(trace::Profiler::isBinary("call 1", 6));
+
+    trace::Profile binary;
+    ASSERT_TRUE(trace::Profiler::parseBinary(data.data(), data.size(), &binary));
+
+    ASSERT_EQ(text.calls.size(), 6);
+    ASSERT_EQ(binary.calls.size(), text.calls.size());
+    for (size_t i = 0; i < text.calls.size(); ++i) {
+        const trace::Profile::Call &a = text.calls[i];
+        const trace::Profile::Call &b = binary.calls[i];
+        EXPECT_EQ(a.no, b.no);
+        EXPECT_EQ(a.program, b.program);
+        EXPECT_EQ(a.gpuStart, b.gpuStart);
+        EXPECT_EQ(a.gpuDuration, b.gpuDuration);
+        EXPECT_EQ(a.cpuStart, b.cpuStart);
+        EXPECT_EQ(a.cpuDuration, b.cpuDuration);
+        EXPECT_EQ(a.pixels, b.pixels);
+        EXPECT_EQ(text.names[a.name], binary.names[b.name]);
+    }
+    EXPECT_EQ(binary.names.size(), 4);
+
+    EXPECT_EQ(text.timeBase, 123456789);
+    EXPECT_EQ(binary.timeBase, text.timeBase);
+
+    ASSERT_EQ(text.frames.size(), 2);
+    ASSERT_EQ(binary.frames.size(), text.frames.size());
+    for (size_t i = 0; i < text.frames.size(); ++i) {
+        EXPECT_EQ(text.frames[i].calls.begin, binary.frames[i].calls.begin);
+        EXPECT_EQ(text.frames[i].calls.end, binary.frames[i].calls.end);
+        EXPECT_EQ(text.frames[i].gpuDuration, binary.frames[i].gpuDuration);
+        EXPECT_EQ(text.frames[i].cpuDuration, binary.frames[i].cpuDuration);
+    }
+
+    ASSERT_EQ(binary.programs.size(), 4);
+    EXPECT_EQ(binary.programs[3].calls.size(), 2);
+    EXPECT_EQ(binary.programs[3].gpuTotal, 970);
+
+    // Truncated profiles are rejected
+    trace::Profile truncated;
+    EXPECT_FALSE(trace::Profiler::parseBinary(data.data(), data.size() - 30, &truncated));
+}
+
+
+TEST(trace_profiler, memory_counters)
+{
+    os::setMemoryCounter(os::MEMORY_REGIONS, 42);
+
+    trace::Profile text;
+    parseText(writeProfile(false, true), &text);
+
+    std::string data = writeProfile(true, true);
+    trace::Profile binary;
+    ASSERT_TRUE(trace::Profiler::parseBinary(data.data(), data.size(), &binary));
+
+    for (trace::Profile *profile : {&text, &binary}) {
+        ASSERT_EQ(profile->counterNames.size(), os::NUM_MEMORY_COUNTERS);
+        EXPECT_EQ(profile->counterNames[os::MEMORY_REGIONS], "regions");
+        ASSERT_EQ(profile->frames.size(), 2);
+        for (auto & frame : profile->frames) {
+            ASSERT_EQ(frame.counters.size(), os::NUM_MEMORY_COUNTERS);
+            EXPECT_EQ(frame.counters[os::MEMORY_REGIONS], 42);
+        }
+    }
+
+    os::setMemoryCounter(os::MEMORY_REGIONS, 0);
+}
+
+
+TEST(trace_profiler, reader)
+{
+    trace::Profile text;
+    parseText(writeProfile(false), &text);
+
+    for (bool binary : {false, true}) {
+        std::string filename = ::testing::TempDir() + "trace_profiler_test.txt";
+        {
+            std::ofstream os(filename, std::ios::binary);
+            os << writeProfile(binary);
+        }
+
+        trace::ProfileReader reader;
+        ASSERT_TRUE(reader.open(filename.c_str()));
+
+        std::vector<trace::Profile::Call> calls;
+        trace::Profile::Frame frame;
+        unsigned callNo = 0;
+        unsigned frameNo = 0;
+        while (reader.readFrame(calls, frame)) {
+            // The calls after the last frame end form a frame of their own
+            ASSERT_LT(frameNo, text.frames.size() + 1);
+            if (frameNo < text.frames.size()) {
+                const trace::Profile::Frame &expected = text.frames[frameNo];
+                EXPECT_EQ(frame.no, expected.no);
+                EXPECT_EQ(calls.size(), expected.calls.end - expected.calls.begin + 1);
+                EXPECT_EQ(frame.gpuStart, expected.gpuStart);
+                EXPECT_EQ(frame.gpuDuration, expected.gpuDuration);
+                EXPECT_EQ(frame.cpuStart, expected.cpuStart);
+                EXPECT_EQ(frame.cpuDuration, expected.cpuDuration);
+            }
+            for (auto & call : calls) {
+                ASSERT_LT(callNo, text.calls.size());
+                const trace::Profile::Call &expected = text.calls[callNo++];
+                EXPECT_EQ(call.no, expected.no);
+                EXPECT_EQ(call.gpuStart, expected.gpuStart);
+                EXPECT_EQ(call.cpuDuration, expected.cpuDuration);
+                EXPECT_EQ(reader.getNames()[call.name], text.names[expected.name]);
+            }
+            ++frameNo;
+        }
+        EXPECT_EQ(frameNo, text.frames.size() + 1);
+        EXPECT_EQ(callNo, text.calls.size());
+        EXPECT_EQ(reader.getTimeBase(), 123456789);
+
+        remove(filename.c_str());
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
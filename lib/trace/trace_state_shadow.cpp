@@ -0,0 +1,1058 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include <assert.h>
+#include <ctype.h>
+#include <string.h>
+
+#include "trace_state_shadow.hpp"
+
+
+using namespace trace;
+
+
+#define GL_TEXTURE_GEN_S                  0x0C60
+#define GL_TEXTURE_GEN_Q                  0x0C63
+#define GL_TEXTURE_1D                     0x0DE0
+#define GL_TEXTURE_2D                     0x0DE1
+#define GL_TEXTURE_3D                     0x806F
+#define GL_TEXTURE0                       0x84C0
+#define GL_TEXTURE_RECTANGLE              0x84F5
+#define GL_TEXTURE_CUBE_MAP               0x8513
+#define GL_TEXTURE_CUBE_MAP_POSITIVE_X    0x8515
+#define GL_TEXTURE_CUBE_MAP_NEGATIVE_Z    0x851A
+#define GL_ARRAY_BUFFER                   0x8892
+#define GL_ELEMENT_ARRAY_BUFFER           0x8893
+#define GL_PIXEL_UNPACK_BUFFER            0x88EC
+#define GL_READ_FRAMEBUFFER               0x8CA8
+#define GL_DRAW_FRAMEBUFFER               0x8CA9
+#define GL_FRAMEBUFFER                    0x8D40
+
+
+/*
+ * Stands for the object bound before the first call seen, distinct for each
+ * binding point.  GL names are only 32 bits wide.
+ */
+#define UNKNOWN_OBJECT (1ULL << 63)
+
+
+namespace {
+
+
+/*
+ * First element of every key.  Binding points come first, so that they can
+ * be told apart from other keys.  The second element is always the context.
+ */
+enum {
+    POINT_CONTEXT = 1,
+    POINT_ACTIVE_TEXTURE,
+    POINT_TEXTURE,
+    POINT_BUFFER,
+    POINT_BUFFER_INDEXED,
+    POINT_FRAMEBUFFER,
+    POINT_PROGRAM,
+    POINT_VERTEX_ARRAY,
+    POINT_PIXEL_STORE,
+    POINT_OTHER,
+
+    KEY_SET,
+    KEY_UNIFORM,
+    KEY_VERTEX_ATTRIB,
+    KEY_ATTRIB_ARRAY,
+    KEY_TEX_PARAMETER,
+    KEY_BUFFER_DATA,
+    KEY_BUFFER_SUB_DATA,
+    KEY_TEX_IMAGE,
+    KEY_TEX_SUB_IMAGE,
+    KEY_MIPMAP,
+
+    OBJECT_BUFFER,
+    OBJECT_TEXTURE,
+};
+
+
+enum {
+    // Calls nothing is known about, kept together with the bindings current
+    // at the time
+    KIND_OTHER,
+    // Always kept, but independent of any GL state
+    KIND_INDEPENDENT,
+    KIND_MAKE_CURRENT,
+    KIND_ACTIVE_TEXTURE,
+    KIND_BIND_TEXTURE,
+    KIND_BIND_BUFFER,
+    KIND_BIND_BUFFER_INDEXED,
+    KIND_BIND_FRAMEBUFFER,
+    KIND_BIND_PROGRAM,
+    KIND_BIND_VERTEX_ARRAY,
+    KIND_PIXEL_STORE,
+    KIND_BIND,
+    KIND_SET,
+    KIND_ENABLE,
+    KIND_UNIFORM,
+    KIND_VERTEX_ATTRIB,
+    KIND_ATTRIB_ARRAY,
+    KIND_TEX_PARAMETER,
+    KIND_BUFFER_DATA,
+    KIND_BUFFER_SUB_DATA,
+    KIND_TEX_IMAGE,
+    KIND_TEX_SUB_IMAGE,
+    KIND_GENERATE_MIPMAP,
+    KIND_COPY_BUFFER,
+    KIND_DELETE_BUFFERS,
+    KIND_DELETE_TEXTURES,
+};
+
+
+/*
+ * The meaning of param depends on the kind:
+ * - KIND_MAKE_CURRENT: index of the context argument
+ * - KIND_BIND, KIND_SET, KIND_ATTRIB_ARRAY: number of leading arguments
+ *   which, together with the family, identify the state being set
+ * - KIND_UNIFORM: index of the location argument
+ * - KIND_BUFFER_DATA, KIND_BUFFER_SUB_DATA: whether the buffer is named
+ *   rather than bound
+ * - KIND_TEX_SUB_IMAGE: number of dimensions
+ *
+ * Calls of the same family set the same state, so supersede each other.
+ */
+struct Rule {
+    const char *name;
+    unsigned char kind;
+    unsigned param;
+    const char *family;
+};
+
+
+const Rule rules[] = {
+    { "glXMakeCurrent",             KIND_MAKE_CURRENT,          2, nullptr },
+    { "glXMakeContextCurrent",      KIND_MAKE_CURRENT,          3, nullptr },
+    { "glXMakeCurrentReadSGI",      KIND_MAKE_CURRENT,          3, nullptr },
+    { "eglMakeCurrent",             KIND_MAKE_CURRENT,          3, nullptr },
+    { "wglMakeCurrent",             KIND_MAKE_CURRENT,          1, nullptr },
+    { "wglMakeContextCurrentARB",   KIND_MAKE_CURRENT,          3, nullptr },
+    { "CGLSetCurrentContext",       KIND_MAKE_CURRENT,          0, nullptr },
+
+    { "glActiveTexture",            KIND_ACTIVE_TEXTURE,        0, nullptr },
+    { "glActiveTextureARB",         KIND_ACTIVE_TEXTURE,        0, nullptr },
+    { "glBindTexture",              KIND_BIND_TEXTURE,          0, nullptr },
+    { "glBindTextureEXT",           KIND_BIND_TEXTURE,          0, nullptr },
+    { "glBindBuffer",               KIND_BIND_BUFFER,           0, nullptr },
+    { "glBindBufferARB",            KIND_BIND_BUFFER,           0, nullptr },
+    { "glBindBufferBase",           KIND_BIND_BUFFER_INDEXED,   0, nullptr },
+    { "glBindBufferRange",          KIND_BIND_BUFFER_INDEXED,   0, nullptr },
+    { "glBindFramebuffer",          KIND_BIND_FRAMEBUFFER,      0, nullptr },
+    { "glBindFramebufferEXT",       KIND_BIND_FRAMEBUFFER,      0, nullptr },
+    { "glBindFramebufferOES",       KIND_BIND_FRAMEBUFFER,      0, nullptr },
+    { "glUseProgram",               KIND_BIND_PROGRAM,          0, nullptr },
+    { "glUseProgramObjectARB",      KIND_BIND_PROGRAM,          0, nullptr },
+    { "glBindVertexArray",          KIND_BIND_VERTEX_ARRAY,     0, nullptr },
+    { "glBindVertexArrayAPPLE",     KIND_BIND_VERTEX_ARRAY,     0, nullptr },
+    { "glBindVertexArrayOES",       KIND_BIND_VERTEX_ARRAY,     0, nullptr },
+    { "glPixelStorei",              KIND_PIXEL_STORE,           0, nullptr },
+    { "glPixelStoref",              KIND_PIXEL_STORE,           0, nullptr },
+    { "glBindRenderbuffer",         KIND_BIND,                  1, "glBindRenderbuffer" },
+    { "glBindRenderbufferEXT",      KIND_BIND,                  1, "glBindRenderbuffer" },
+    { "glBindRenderbufferOES",      KIND_BIND,                  1, "glBindRenderbuffer" },
+    { "glBindSampler",              KIND_BIND,                  1, nullptr },
+    { "glBindProgramPipeline",      KIND_BIND,                  0, nullptr },
+    { "glBindTransformFeedback",    KIND_BIND,                  1, nullptr },
+
+    { "glEnable",                   KIND_ENABLE,                0, "glEnable" },
+    { "glDisable",                  KIND_ENABLE,                0, "glEnable" },
+    { "glEnablei",                  KIND_SET,                   2, "glEnablei" },
+    { "glDisablei",                 KIND_SET,                   2, "glEnablei" },
+    { "glBlendFunc",                KIND_SET,                   0, "glBlendFunc" },
+    { "glBlendFuncSeparate",        KIND_SET,                   0, "glBlendFunc" },
+    { "glBlendFunci",               KIND_SET,                   1, "glBlendFunci" },
+    { "glBlendFuncSeparatei",       KIND_SET,                   1, "glBlendFunci" },
+    { "glBlendEquation",            KIND_SET,                   0, "glBlendEquation" },
+    { "glBlendEquationSeparate",    KIND_SET,                   0, "glBlendEquation" },
+    { "glBlendEquationi",           KIND_SET,                   1, "glBlendEquationi" },
+    { "glBlendEquationSeparatei",   KIND_SET,                   1, "glBlendEquationi" },
+    { "glBlendColor",               KIND_SET,                   0, nullptr },
+    { "glColorMask",                KIND_SET,                   0, nullptr },
+    { "glColorMaski",               KIND_SET,                   1, nullptr },
+    { "glDepthFunc",                KIND_SET,                   0, nullptr },
+    { "glDepthMask",                KIND_SET,                   0, nullptr },
+    { "glDepthRange",               KIND_SET,                   0, "glDepthRange" },
+    { "glDepthRangef",              KIND_SET,                   0, "glDepthRange" },
+    { "glStencilFunc",              KIND_SET,                   0, nullptr },
+    { "glStencilFuncSeparate",      KIND_SET,                   1, nullptr },
+    { "glStencilOp",                KIND_SET,                   0, nullptr },
+    { "glStencilOpSeparate",        KIND_SET,                   1, nullptr },
+    { "glStencilMask",              KIND_SET,                   0, nullptr },
+    { "glStencilMaskSeparate",      KIND_SET,                   1, nullptr },
+    { "glCullFace",                 KIND_SET,                   0, nullptr },
+    { "glFrontFace",                KIND_SET,                   0, nullptr },
+    { "glPolygonMode",              KIND_SET,                   1, nullptr },
+    { "glPolygonOffset",            KIND_SET,                   0, nullptr },
+    { "glLineWidth",                KIND_SET,                   0, nullptr },
+    { "glPointSize",                KIND_SET,                   0, nullptr },
+    { "glSampleCoverage",           KIND_SET,                   0, nullptr },
+    { "glMinSampleShading",         KIND_SET,                   0, nullptr },
+    { "glLogicOp",                  KIND_SET,                   0, nullptr },
+    { "glProvokingVertex",          KIND_SET,                   0, nullptr },
+    { "glPrimitiveRestartIndex",    KIND_SET,                   0, nullptr },
+    { "glPatchParameteri",          KIND_SET,                   1, nullptr },
+    { "glPatchParameterfv",         KIND_SET,                   1, nullptr },
+    { "glHint",                     KIND_SET,                   1, nullptr },
+    { "glViewport",                 KIND_SET,                   0, nullptr },
+    { "glScissor",                  KIND_SET,                   0, nullptr },
+    { "glClearColor",               KIND_SET,                   0, nullptr },
+    { "glClearDepth",               KIND_SET,                   0, "glClearDepth" },
+    { "glClearDepthf",              KIND_SET,                   0, "glClearDepth" },
+    { "glClearStencil",             KIND_SET,                   0, nullptr },
+    { "glUniformBlockBinding",      KIND_SET,                   2, nullptr },
+
+    { "glEnableVertexAttribArray",      KIND_ATTRIB_ARRAY,      1, "glEnableVertexAttribArray" },
+    { "glEnableVertexAttribArrayARB",   KIND_ATTRIB_ARRAY,      1, "glEnableVertexAttribArray" },
+    { "glDisableVertexAttribArray",     KIND_ATTRIB_ARRAY,      1, "glEnableVertexAttribArray" },
+    { "glDisableVertexAttribArrayARB",  KIND_ATTRIB_ARRAY,      1, "glEnableVertexAttribArray" },
+    { "glVertexAttribDivisor",          KIND_ATTRIB_ARRAY,      1, "glVertexAttribDivisor" },
+    { "glVertexAttribDivisorARB",       KIND_ATTRIB_ARRAY,      1, "glVertexAttribDivisor" },
+    // Pointers also capture the GL_ARRAY_BUFFER binding
+    { "glVertexAttribPointer",          KIND_ATTRIB_ARRAY,      1, "glVertexAttribPointer" },
+    { "glVertexAttribPointerARB",       KIND_ATTRIB_ARRAY,      1, "glVertexAttribPointer" },
+    { "glVertexAttribIPointer",         KIND_ATTRIB_ARRAY,      1, "glVertexAttribPointer" },
+    { "glVertexAttribLPointer",         KIND_ATTRIB_ARRAY,      1, "glVertexAttribPointer" },
+
+    { "glBufferData",               KIND_BUFFER_DATA,           0, nullptr },
+    { "glBufferDataARB",            KIND_BUFFER_DATA,           0, nullptr },
+    { "glNamedBufferData",          KIND_BUFFER_DATA,           1, nullptr },
+    { "glNamedBufferDataEXT",       KIND_BUFFER_DATA,           1, nullptr },
+    { "glBufferSubData",            KIND_BUFFER_SUB_DATA,       0, nullptr },
+    { "glBufferSubDataARB",         KIND_BUFFER_SUB_DATA,       0, nullptr },
+    { "glNamedBufferSubData",       KIND_BUFFER_SUB_DATA,       1, nullptr },
+    { "glNamedBufferSubDataEXT",    KIND_BUFFER_SUB_DATA,       1, nullptr },
+    { "glTexImage1D",               KIND_TEX_IMAGE,             0, nullptr },
+    { "glTexImage2D",               KIND_TEX_IMAGE,             0, nullptr },
+    { "glTexImage3D",               KIND_TEX_IMAGE,             0, nullptr },
+    { "glTexImage3DEXT",            KIND_TEX_IMAGE,             0, nullptr },
+    { "glCompressedTexImage1D",     KIND_TEX_IMAGE,             0, nullptr },
+    { "glCompressedTexImage2D",     KIND_TEX_IMAGE,             0, nullptr },
+    { "glCompressedTexImage3D",     KIND_TEX_IMAGE,             0, nullptr },
+    { "glTexSubImage1D",            KIND_TEX_SUB_IMAGE,         1, nullptr },
+    { "glTexSubImage2D",            KIND_TEX_SUB_IMAGE,         2, nullptr },
+    { "glTexSubImage3D",            KIND_TEX_SUB_IMAGE,         3, nullptr },
+    { "glTexSubImage1DEXT",         KIND_TEX_SUB_IMAGE,         1, nullptr },
+    { "glTexSubImage2DEXT",         KIND_TEX_SUB_IMAGE,         2, nullptr },
+    { "glTexSubImage3DEXT",         KIND_TEX_SUB_IMAGE,         3, nullptr },
+    { "glCompressedTexSubImage1D",  KIND_TEX_SUB_IMAGE,         1, nullptr },
+    { "glCompressedTexSubImage2D",  KIND_TEX_SUB_IMAGE,         2, nullptr },
+    { "glCompressedTexSubImage3D",  KIND_TEX_SUB_IMAGE,         3, nullptr },
+    { "glGenerateMipmap",           KIND_GENERATE_MIPMAP,       0, nullptr },
+    { "glGenerateMipmapEXT",        KIND_GENERATE_MIPMAP,       0, nullptr },
+    { "glCopyBufferSubData",        KIND_COPY_BUFFER,           0, nullptr },
+    { "glDeleteBuffers",            KIND_DELETE_BUFFERS,        0, nullptr },
+    { "glDeleteBuffersARB",         KIND_DELETE_BUFFERS,        0, nullptr },
+    { "glDeleteTextures",           KIND_DELETE_TEXTURES,       0, nullptr },
+    { "glDeleteTexturesEXT",        KIND_DELETE_TEXTURES,       0, nullptr },
+};
+
+
+bool
+startsWith(const char *name, const char *prefix, const char **rest)
+{
+    size_t length = strlen(prefix);
+    if (strncmp(name, prefix, length) != 0) {
+        return false;
+    }
+    *rest = name + length;
+    return true;
+}
+
+
+/*
+ * Whether the function belongs to GL or its window system bindings.  Other
+ * calls, such as memcpy into mapped buffers, or those of Direct3D traces, are
+ * all kept as they are.
+ */
+bool
+isGLFunction(const char *name)
+{
+    const char *rest;
+    return startsWith(name, "gl", &rest) ||
+           ((startsWith(name, "egl", &rest) ||
+             startsWith(name, "wgl", &rest)) && isupper(rest[0])) ||
+           startsWith(name, "CGL", &rest);
+}
+
+
+/*
+ * Whether a capability is enabled per texture unit, as for fixed function
+ * texturing.
+ */
+bool
+isTextureUnitCap(unsigned long long cap)
+{
+    switch (cap) {
+    case GL_TEXTURE_1D:
+    case GL_TEXTURE_2D:
+    case GL_TEXTURE_3D:
+    case GL_TEXTURE_CUBE_MAP:
+    case GL_TEXTURE_RECTANGLE:
+        return true;
+    default:
+        return cap >= GL_TEXTURE_GEN_S && cap <= GL_TEXTURE_GEN_Q;
+    }
+}
+
+
+/*
+ * Whether the values are passed as an array, as in glUniform4fv.
+ */
+bool
+isVector(const char *name)
+{
+    size_t length = strlen(name);
+    if (length > 3 &&
+        (strcmp(name + length - 3, "ARB") == 0 ||
+         strcmp(name + length - 3, "EXT") == 0)) {
+        length -= 3;
+    }
+    return length && name[length - 1] == 'v';
+}
+
+
+/*
+ * Integer value, or zero for anything else.
+ */
+class IntegerVisitor : public Visitor
+{
+public:
+    unsigned long long value = 0;
+
+    void visit(Null *) override {}
+    void visit(Bool *node) override { value = node->value; }
+    void visit(SInt *node) override { value = static_cast<unsigned long long>(node->value); }
+    void visit(UInt *node) override { value = node->value; }
+    void visit(Float *) override {}
+    void visit(Double *) override {}
+    void visit(String *) override {}
+    void visit(WString *) override {}
+    void visit(Enum *node) override { value = static_cast<unsigned long long>(node->value); }
+    void visit(Struct *) override {}
+    void visit(Array *) override {}
+    void visit(Blob *) override {}
+    void visit(Pointer *node) override { value = node->value; }
+};
+
+
+unsigned long long
+intValue(Value *value)
+{
+    IntegerVisitor visitor;
+    if (value) {
+        value->visit(visitor);
+    }
+    return visitor.value;
+}
+
+
+unsigned long long
+argValue(Call *call, unsigned index)
+{
+    if (index >= call->args.size()) {
+        return 0;
+    }
+    return intValue(call->args[index].value);
+}
+
+
+} /* anonymous namespace */
+
+
+bool
+trace::isRemappedQuery(const char *name)
+{
+    static const char *names[] = {
+        "glGetUniformBlockIndex",
+        "glGetActiveUniformBlockName",
+        "glGetSubroutineIndex",
+        "glGetProgramResourceIndex",
+        "glGetProgramResourceName",
+        "glGetProgramResourceiv",
+    };
+
+    if (strstr(name, "Location")) {
+        return true;
+    }
+    for (auto & remapped : names) {
+        if (strcmp(name, remapped) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+StateShadow::StateShadow()
+{
+}
+
+
+StateShadow::~StateShadow()
+{
+    for (auto & entry : entries) {
+        delete entry.call;
+    }
+}
+
+
+const StateShadow::Kind &
+StateShadow::lookupKind(const FunctionSig *sig)
+{
+    const char *name = sig->name;
+    auto cached = kinds.find(name);
+    if (cached != kinds.end()) {
+        return cached->second;
+    }
+
+    Kind &kind = kinds[name];
+    const char *family = name;
+    const char *rest;
+    kind.kind = KIND_OTHER;
+    kind.param = 0;
+    kind.vector = isVector(name);
+
+    if (!isGLFunction(name)) {
+        kind.kind = KIND_INDEPENDENT;
+        kind.family = families.emplace(family, families.size()).first->second;
+        return kind;
+    }
+
+    bool found = false;
+    for (auto & rule : rules) {
+        if (strcmp(rule.name, name) == 0) {
+            kind.kind = rule.kind;
+            kind.param = rule.param;
+            if (rule.family) {
+                family = rule.family;
+            }
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        if ((startsWith(name, "glUniform", &rest) ||
+             startsWith(name, "glProgramUniform", &rest)) &&
+            (isdigit(rest[0]) || startsWith(rest, "Matrix", &rest))) {
+            kind.kind = KIND_UNIFORM;
+            kind.param = name[2] == 'P' ? 1 : 0;
+        } else if (startsWith(name, "glVertexAttrib", &rest) &&
+                   (isdigit(rest[0]) ||
+                    ((rest[0] == 'I' || rest[0] == 'L') && isdigit(rest[1])))) {
+            kind.kind = KIND_VERTEX_ATTRIB;
+        } else if (startsWith(name, "glTexParameter", &rest)) {
+            kind.kind = KIND_TEX_PARAMETER;
+        } else if (startsWith(name, "glSamplerParameter", &rest)) {
+            kind.kind = KIND_SET;
+            kind.param = 2;
+            family = "glSamplerParameter";
+        }
+    }
+
+    auto inserted = families.emplace(family, families.size());
+    kind.family = inserted.first->second;
+
+    return kind;
+}
+
+
+unsigned long long
+StateShadow::bound(const Key &point, unsigned long long defaultValue) const
+{
+    auto it = bindings.find(point);
+    return it == bindings.end() ? defaultValue : it->second.value;
+}
+
+
+/*
+ * Texture bound to the target of the active unit, which the call depends on.
+ */
+unsigned long long
+StateShadow::boundTexture(unsigned index, unsigned long long ctx, unsigned long long target)
+{
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+        target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+        target = GL_TEXTURE_CUBE_MAP;
+    }
+    Key active = {POINT_ACTIVE_TEXTURE, ctx};
+    depend(index, active);
+    unsigned long long unit = bound(active, GL_TEXTURE0);
+    Key point = {POINT_TEXTURE, ctx, unit, target};
+    depend(index, point);
+    return bound(point, UNKNOWN_OBJECT | (unit << 32) | target);
+}
+
+
+void
+StateShadow::bind(unsigned index, const Key &point, unsigned long long value)
+{
+    auto it = bindings.find(point);
+    if (it == bindings.end()) {
+        bindings.emplace(point, Binding{index, value});
+    } else {
+        unsigned previous = it->second.entry;
+        it->second = Binding{index, value};
+        release(previous);
+    }
+    ++entries[index].live;
+}
+
+
+/*
+ * Deleted objects are implicitly unbound.
+ */
+void
+StateShadow::unbind(unsigned long long ctx, unsigned long long point, unsigned long long value)
+{
+    for (auto & binding : bindings) {
+        const Key &key = binding.first;
+        if ((key[0] == point ||
+             (point == POINT_BUFFER && key[0] == POINT_BUFFER_INDEXED)) &&
+            key[1] == ctx &&
+            binding.second.value == value) {
+            binding.second.value = 0;
+        }
+    }
+}
+
+
+void
+StateShadow::set(unsigned index, const Key &key)
+{
+    auto it = latest.find(key);
+    if (it == latest.end()) {
+        latest.emplace(key, index);
+    } else {
+        unsigned previous = it->second;
+        it->second = index;
+        release(previous);
+    }
+    ++entries[index].live;
+}
+
+
+void
+StateShadow::setContents(unsigned index, const Key &object, const Key &key)
+{
+    if (latest.find(key) == latest.end()) {
+        contents[object].push_back(key);
+    }
+    set(index, key);
+}
+
+
+/*
+ * Forget the contents of an object, or just those of one texture image,
+ * identified by the target and level of its key.
+ */
+void
+StateShadow::invalidate(const Key &object, const Key *image)
+{
+    auto found = contents.find(object);
+    if (found == contents.end()) {
+        return;
+    }
+
+    std::vector<Key> &keys = found->second;
+    size_t count = 0;
+    for (auto & key : keys) {
+        if (image &&
+            (key.size() < 5 || key[3] != (*image)[3] || key[4] != (*image)[4])) {
+            keys[count++].swap(key);
+            continue;
+        }
+        auto it = latest.find(key);
+        assert(it != latest.end());
+        unsigned previous = it->second;
+        latest.erase(it);
+        release(previous);
+    }
+    keys.resize(count);
+}
+
+
+void
+StateShadow::depend(unsigned index, unsigned other)
+{
+    entries[index].deps.push_back(other);
+    ++entries[other].refs;
+}
+
+
+void
+StateShadow::depend(unsigned index, const Key &point)
+{
+    auto it = bindings.find(point);
+    if (it != bindings.end()) {
+        depend(index, it->second.entry);
+    }
+}
+
+
+/*
+ * Depend on all bindings of a context, or those of a kind of binding point.
+ */
+void
+StateShadow::dependOnBindings(unsigned index, unsigned long long ctx, unsigned long long point)
+{
+    for (auto & binding : bindings) {
+        const Key &key = binding.first;
+        if (key[0] != POINT_CONTEXT &&
+            (!point || key[0] == point) &&
+            key[1] == ctx) {
+            depend(index, binding.second.entry);
+        }
+    }
+}
+
+
+void
+StateShadow::dependOnContents(unsigned index, const Key &object)
+{
+    auto found = contents.find(object);
+    if (found == contents.end()) {
+        return;
+    }
+    for (auto & key : found->second) {
+        // Mipmaps are derived from the other contents
+        if (key[0] != KEY_MIPMAP) {
+            depend(index, latest[key]);
+        }
+    }
+}
+
+
+/*
+ * Texture uploads depend on the pixel store state and, when sourced from a
+ * pixel unpack buffer, on its contents.
+ */
+void
+StateShadow::dependOnUnpack(unsigned index, unsigned long long ctx)
+{
+    dependOnBindings(index, ctx, POINT_PIXEL_STORE);
+
+    Key point = {POINT_BUFFER, ctx, GL_PIXEL_UNPACK_BUFFER, 0};
+    depend(index, point);
+    unsigned long long buffer = bound(point, UNKNOWN_OBJECT | ((unsigned long long)GL_PIXEL_UNPACK_BUFFER << 32));
+    if (buffer) {
+        dependOnContents(index, {OBJECT_BUFFER, ctx, buffer});
+    }
+}
+
+
+/*
+ * Drop a call once it is neither the latest for any key, nor needed by any
+ * other call, together with any calls only it needed.
+ */
+void
+StateShadow::release(unsigned index)
+{
+    assert(entries[index].live);
+    --entries[index].live;
+
+    std::vector<unsigned> pending(1, index);
+    while (!pending.empty()) {
+        Entry &entry = entries[pending.back()];
+        pending.pop_back();
+        if (!entry.call || entry.live || entry.refs || entry.pinned) {
+            continue;
+        }
+        delete entry.call;
+        entry.call = nullptr;
+        for (unsigned dep : entry.deps) {
+            assert(entries[dep].refs);
+            --entries[dep].refs;
+            pending.push_back(dep);
+        }
+        std::vector<unsigned>().swap(entry.deps);
+    }
+}
+
+
+void
+StateShadow::addCall(Call *call)
+{
+    unsigned index = entries.size();
+    entries.push_back(Entry{call, {}, 0, 0, false});
+
+    const Kind &kind = lookupKind(call->sig);
+    unsigned long long ctx = contexts[call->thread_id];
+    Key contextPoint = {POINT_CONTEXT, call->thread_id};
+
+    if (kind.kind != KIND_INDEPENDENT &&
+        kind.kind != KIND_MAKE_CURRENT) {
+        depend(index, contextPoint);
+    }
+
+    switch (kind.kind) {
+    case KIND_INDEPENDENT:
+        entries[index].pinned = true;
+        break;
+
+    case KIND_MAKE_CURRENT:
+        ctx = argValue(call, kind.param);
+        contexts[call->thread_id] = ctx;
+        bind(index, contextPoint, ctx);
+        break;
+
+    case KIND_ACTIVE_TEXTURE:
+        bind(index, {POINT_ACTIVE_TEXTURE, ctx}, argValue(call, 0));
+        break;
+
+    case KIND_BIND_TEXTURE:
+        {
+            Key active = {POINT_ACTIVE_TEXTURE, ctx};
+            depend(index, active);
+            unsigned long long unit = bound(active, GL_TEXTURE0);
+            bind(index, {POINT_TEXTURE, ctx, unit, argValue(call, 0)}, argValue(call, 1));
+        }
+        break;
+
+    case KIND_BIND_BUFFER:
+        {
+            // The element array buffer binding is vertex array state
+            unsigned long long target = argValue(call, 0);
+            unsigned long long vao = 0;
+            if (target == GL_ELEMENT_ARRAY_BUFFER) {
+                Key vaoPoint = {POINT_VERTEX_ARRAY, ctx};
+                depend(index, vaoPoint);
+                vao = bound(vaoPoint);
+            }
+            bind(index, {POINT_BUFFER, ctx, target, vao}, argValue(call, 1));
+        }
+        break;
+
+    case KIND_BIND_BUFFER_INDEXED:
+        {
+            unsigned long long target = argValue(call, 0);
+            unsigned long long buffer = argValue(call, 2);
+            bind(index, {POINT_BUFFER, ctx, target, 0}, buffer);
+            bind(index, {POINT_BUFFER_INDEXED, ctx, target, argValue(call, 1)}, buffer);
+        }
+        break;
+
+    case KIND_BIND_FRAMEBUFFER:
+        {
+            unsigned long long target = argValue(call, 0);
+            unsigned long long framebuffer = argValue(call, 1);
+            if (target == GL_FRAMEBUFFER) {
+                bind(index, {POINT_FRAMEBUFFER, ctx, GL_READ_FRAMEBUFFER}, framebuffer);
+                bind(index, {POINT_FRAMEBUFFER, ctx, GL_DRAW_FRAMEBUFFER}, framebuffer);
+            } else {
+                bind(index, {POINT_FRAMEBUFFER, ctx, target}, framebuffer);
+            }
+        }
+        break;
+
+    case KIND_BIND_PROGRAM:
+        bind(index, {POINT_PROGRAM, ctx}, argValue(call, 0));
+        break;
+
+    case KIND_BIND_VERTEX_ARRAY:
+        bind(index, {POINT_VERTEX_ARRAY, ctx}, argValue(call, 0));
+        break;
+
+    case KIND_PIXEL_STORE:
+        bind(index, {POINT_PIXEL_STORE, ctx, argValue(call, 0)}, 0);
+        break;
+
+    case KIND_BIND:
+        {
+            Key point = {POINT_OTHER, ctx, kind.family};
+            for (unsigned i = 0; i < kind.param; ++i) {
+                point.push_back(argValue(call, i));
+            }
+            bind(index, point, argValue(call, kind.param));
+        }
+        break;
+
+    case KIND_SET:
+        {
+            Key key = {KEY_SET, ctx, kind.family};
+            for (unsigned i = 0; i < kind.param; ++i) {
+                key.push_back(argValue(call, i));
+            }
+            set(index, key);
+        }
+        break;
+
+    case KIND_ENABLE:
+        {
+            unsigned long long cap = argValue(call, 0);
+            Key key = {KEY_SET, ctx, kind.family, cap};
+            if (isTextureUnitCap(cap)) {
+                Key active = {POINT_ACTIVE_TEXTURE, ctx};
+                depend(index, active);
+                key.push_back(bound(active, GL_TEXTURE0));
+            }
+            set(index, key);
+        }
+        break;
+
+    case KIND_UNIFORM:
+        {
+            unsigned location = kind.param;
+            unsigned long long program;
+            if (location) {
+                program = argValue(call, 0);
+            } else {
+                Key programPoint = {POINT_PROGRAM, ctx};
+                depend(index, programPoint);
+                program = bound(programPoint);
+            }
+            unsigned long long count = kind.vector ? argValue(call, location + 1) : 1;
+            set(index, {KEY_UNIFORM, ctx, program, argValue(call, location), count});
+        }
+        break;
+
+    case KIND_VERTEX_ATTRIB:
+        set(index, {KEY_VERTEX_ATTRIB, ctx, argValue(call, 0)});
+        break;
+
+    case KIND_ATTRIB_ARRAY:
+        {
+            Key vaoPoint = {POINT_VERTEX_ARRAY, ctx};
+            depend(index, vaoPoint);
+            if (strstr(call->name(), "Pointer")) {
+                depend(index, {POINT_BUFFER, ctx, GL_ARRAY_BUFFER, 0});
+            }
+            set(index, {KEY_ATTRIB_ARRAY, ctx, kind.family, bound(vaoPoint), argValue(call, 0)});
+        }
+        break;
+
+    case KIND_TEX_PARAMETER:
+        {
+            unsigned long long texture = boundTexture(index, ctx, argValue(call, 0));
+            set(index, {KEY_TEX_PARAMETER, ctx, texture, argValue(call, 1)});
+        }
+        break;
+
+    case KIND_BUFFER_DATA:
+    case KIND_BUFFER_SUB_DATA:
+        {
+            unsigned long long buffer;
+            if (kind.param) {
+                buffer = argValue(call, 0);
+            } else {
+                unsigned long long target = argValue(call, 0);
+                unsigned long long vao = 0;
+                if (target == GL_ELEMENT_ARRAY_BUFFER) {
+                    Key vaoPoint = {POINT_VERTEX_ARRAY, ctx};
+                    depend(index, vaoPoint);
+                    vao = bound(vaoPoint);
+                }
+                Key point = {POINT_BUFFER, ctx, target, vao};
+                depend(index, point);
+                buffer = bound(point, UNKNOWN_OBJECT | (target << 32) | vao);
+            }
+            if (!buffer) {
+                entries[index].pinned = true;
+                dependOnBindings(index, ctx);
+                break;
+            }
+            Key object = {OBJECT_BUFFER, ctx, buffer};
+            if (kind.kind == KIND_BUFFER_DATA) {
+                invalidate(object);
+                setContents(index, object, {KEY_BUFFER_DATA, ctx, buffer});
+            } else {
+                setContents(index, object, {KEY_BUFFER_SUB_DATA, ctx, buffer,
+                                            argValue(call, 1), argValue(call, 2)});
+            }
+        }
+        break;
+
+    case KIND_TEX_IMAGE:
+    case KIND_TEX_SUB_IMAGE:
+        {
+            unsigned long long target = argValue(call, 0);
+            unsigned long long texture = boundTexture(index, ctx, target);
+            dependOnUnpack(index, ctx);
+            Key object = {OBJECT_TEXTURE, ctx, texture};
+            Key key = {KEY_TEX_IMAGE, ctx, texture, target, argValue(call, 1)};
+            if (kind.kind == KIND_TEX_IMAGE) {
+                invalidate(object, &key);
+            } else {
+                // Offsets followed by sizes
+                key[0] = KEY_TEX_SUB_IMAGE;
+                for (unsigned i = 0; i < 2 * kind.param; ++i) {
+                    key.push_back(argValue(call, 2 + i));
+                }
+            }
+            setContents(index, object, key);
+        }
+        break;
+
+    case KIND_GENERATE_MIPMAP:
+        {
+            unsigned long long target = argValue(call, 0);
+            unsigned long long texture = boundTexture(index, ctx, target);
+            Key object = {OBJECT_TEXTURE, ctx, texture};
+            dependOnContents(index, object);
+            setContents(index, object, {KEY_MIPMAP, ctx, texture, target});
+        }
+        break;
+
+    case KIND_COPY_BUFFER:
+        {
+            entries[index].pinned = true;
+            dependOnBindings(index, ctx);
+            unsigned long long target = argValue(call, 0);
+            unsigned long long buffer = bound({POINT_BUFFER, ctx, target, 0}, UNKNOWN_OBJECT | (target << 32));
+            dependOnContents(index, {OBJECT_BUFFER, ctx, buffer});
+        }
+        break;
+
+    case KIND_DELETE_BUFFERS:
+    case KIND_DELETE_TEXTURES:
+        {
+            entries[index].pinned = true;
+            unsigned long long object = kind.kind == KIND_DELETE_BUFFERS ? OBJECT_BUFFER : OBJECT_TEXTURE;
+            Array *names = nullptr;
+            if (call->args.size() > 1 && call->args[1].value) {
+                names = call->args[1].value->toArray();
+            }
+            if (names) {
+                for (auto & value : names->values) {
+                    Key key = {object, ctx, intValue(value)};
+                    invalidate(key);
+                    contents.erase(key);
+                    unbind(ctx, object == OBJECT_BUFFER ? POINT_BUFFER : POINT_TEXTURE, key[2]);
+                }
+            }
+        }
+        break;
+
+    default:
+        entries[index].pinned = true;
+        dependOnBindings(index, ctx);
+        break;
+    }
+}
+
+
+/*
+ * Calls survive when still the latest for some key, or never superseded, or
+ * needed by surviving calls.
+ */
+void
+StateShadow::markSurvivors(std::vector<bool> &keep) const
+{
+    keep.assign(entries.size(), false);
+    for (size_t i = entries.size(); i-- > 0; ) {
+        const Entry &entry = entries[i];
+        if (entry.call && (entry.pinned || entry.live)) {
+            keep[i] = true;
+        }
+        if (keep[i]) {
+            for (unsigned dep : entry.deps) {
+                keep[dep] = true;
+            }
+        }
+    }
+}
+
+
+void
+StateShadow::takeCalls(std::vector<Call *> &calls)
+{
+    std::vector<bool> keep;
+    markSurvivors(keep);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Call *call = entries[i].call;
+        if (keep[i]) {
+            assert(call);
+            calls.push_back(call);
+        } else {
+            delete call;
+        }
+    }
+
+    entries.clear();
+    bindings.clear();
+    latest.clear();
+    contents.clear();
+    contexts.clear();
+}
+
+
+/*
+ * Drops the calls which do not survive, and renumbers the others to forget
+ * the entries of dropped calls.
+ */
+void
+StateShadow::getCalls(std::vector<Call *> &calls)
+{
+    std::vector<bool> keep;
+    markSurvivors(keep);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Entry &entry = entries[i];
+        if (entry.call && !keep[i]) {
+            delete entry.call;
+            entry.call = nullptr;
+            for (unsigned dep : entry.deps) {
+                assert(entries[dep].refs);
+                --entries[dep].refs;
+            }
+            std::vector<unsigned>().swap(entry.deps);
+        }
+    }
+
+    std::vector<unsigned> remap(entries.size(), ~0U);
+    unsigned count = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (entries[i].call) {
+            remap[i] = count;
+            if (count != i) {
+                entries[count] = std::move(entries[i]);
+            }
+            calls.push_back(entries[count].call);
+            ++count;
+        }
+    }
+    entries.resize(count);
+
+    for (auto & entry : entries) {
+        for (auto & dep : entry.deps) {
+            assert(remap[dep] != ~0U);
+            dep = remap[dep];
+        }
+    }
+    for (auto & binding : bindings) {
+        assert(remap[binding.second.entry] != ~0U);
+        binding.second.entry = remap[binding.second.entry];
+    }
+    for (auto & key : latest) {
+        assert(remap[key.second] != ~0U);
+        key.second = remap[key.second];
+    }
+}
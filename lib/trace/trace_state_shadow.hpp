@@ -0,0 +1,155 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Compaction of state setting calls, for partial captures.
+ */
+
+#pragma once
+
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "trace_model.hpp"
+
+
+namespace trace {
+
+
+/**
+ * Whether glretrace needs the results of a side effect free call to remap
+ * locations, indices or names on replay, so it must be kept nevertheless.
+ */
+bool
+isRemappedQuery(const char *name);
+
+
+/**
+ * Shadow of the live GL object and context state set by a sequence of calls.
+ *
+ * Keeps only the calls needed to recreate the state at the end of the
+ * sequence: the last value of each uniform, parameter and binding point, the
+ * latest contents of each buffer range and texture level, plus the bindings
+ * which these calls, and any calls it does not know about, depend on.
+ * Surviving calls keep their original relative order.
+ *
+ * Calls which render or query state are expected to have been filtered out
+ * beforehand.  Calls of APIs other than GL are all kept as they are.
+ */
+class StateShadow
+{
+public:
+    StateShadow();
+    ~StateShadow();
+
+    /**
+     * Add the next call, taking ownership of it.
+     */
+    void addCall(Call *call);
+
+    /**
+     * Hand over the surviving calls, in order, and start afresh.
+     */
+    void takeCalls(std::vector<Call *> &calls);
+
+    /**
+     * List the surviving calls, in order, while keeping ownership of them
+     * and shadowing further calls.
+     */
+    void getCalls(std::vector<Call *> &calls);
+
+private:
+    typedef std::vector<unsigned long long> Key;
+
+    struct Kind {
+        unsigned char kind;
+        unsigned param;
+        unsigned long long family;
+        // Takes an array of values, preceded by their count
+        bool vector;
+    };
+
+    struct Entry {
+        Call *call;
+        // Earlier calls this one needs when replayed
+        std::vector<unsigned> deps;
+        // Number of keys this is still the latest call for
+        unsigned live;
+        // Number of later calls depending on this one
+        unsigned refs;
+        // Never superseded
+        bool pinned;
+    };
+
+    struct Binding {
+        unsigned entry;
+        unsigned long long value;
+    };
+
+    std::vector<Entry> entries;
+
+    /// Current binding per binding point
+    std::map<Key, Binding> bindings;
+
+    /// Latest call per state key
+    std::map<Key, unsigned> latest;
+
+    /// State keys of the current contents of each buffer and texture
+    std::map<Key, std::vector<Key>> contents;
+
+    /// Current context per thread
+    std::map<unsigned, unsigned long long> contexts;
+
+    /// Classification, by function name, as calls may come from several
+    /// parsers whose signature ids clash
+    std::map<std::string, Kind, std::less<>> kinds;
+    std::map<std::string, unsigned long long> families;
+
+    const Kind &lookupKind(const FunctionSig *sig);
+
+    unsigned long long bound(const Key &point, unsigned long long defaultValue = 0) const;
+    unsigned long long boundTexture(unsigned index, unsigned long long ctx, unsigned long long target);
+
+    void bind(unsigned index, const Key &point, unsigned long long value);
+    void unbind(unsigned long long ctx, unsigned long long point, unsigned long long value);
+    void set(unsigned index, const Key &key);
+    void setContents(unsigned index, const Key &object, const Key &key);
+    void invalidate(const Key &object, const Key *image = nullptr);
+
+    void depend(unsigned index, unsigned other);
+    void depend(unsigned index, const Key &point);
+    void dependOnBindings(unsigned index, unsigned long long ctx, unsigned long long point = 0);
+    void dependOnContents(unsigned index, const Key &object);
+    void dependOnUnpack(unsigned index, unsigned long long ctx);
+
+    void release(unsigned index);
+
+    void markSurvivors(std::vector<bool> &keep) const;
+};
+
+
+} /* namespace trace */
@@ -0,0 +1,213 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "trace_state_shadow.hpp"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+
+using namespace trace;
+
+
+#define GL_TEXTURE_2D           0x0DE1
+#define GL_TEXTURE0             0x84C0
+#define GL_ARRAY_BUFFER         0x8892
+
+
+static const FunctionSig bindTextureSig   = {0, "glBindTexture", 2, nullptr};
+static const FunctionSig texImageSig      = {1, "glTexImage2D", 9, nullptr};
+static const FunctionSig texSubImageSig   = {2, "glTexSubImage2D", 9, nullptr};
+static const FunctionSig generateMipmapSig = {3, "glGenerateMipmap", 1, nullptr};
+static const FunctionSig useProgramSig    = {4, "glUseProgram", 1, nullptr};
+static const FunctionSig uniformSig       = {5, "glUniform1f", 2, nullptr};
+static const FunctionSig bindBufferSig    = {6, "glBindBuffer", 2, nullptr};
+static const FunctionSig enableSig        = {7, "glEnable", 1, nullptr};
+static const FunctionSig disableSig       = {8, "glDisable", 1, nullptr};
+static const FunctionSig unknownSig       = {9, "glUnknown", 0, nullptr};
+static const FunctionSig activeTextureSig = {10, "glActiveTexture", 1, nullptr};
+static const FunctionSig setStateSig      = {11, "ID3D11DeviceContext::RSSetState", 2, nullptr};
+
+
+/**
+ * Feed calls with the given integer arguments, numbering them in order.
+ */
+class ShadowTest : public ::testing::Test
+{
+protected:
+    StateShadow shadow;
+    unsigned callNo = 0;
+
+    void add(const FunctionSig &sig, std::vector<unsigned long long> args = {}) {
+        Call *call = new Call(&sig, 0, 0);
+        call->no = callNo++;
+        for (unsigned i = 0; i < sig.num_args; ++i) {
+            call->args[i].value = i < args.size() ? static_cast<Value *>(new UInt(args[i]))
+                                                  : static_cast<Value *>(new Null);
+        }
+        shadow.addCall(call);
+    }
+
+    std::vector<unsigned> survivors(void) {
+        std::vector<Call *> calls;
+        shadow.takeCalls(calls);
+        std::vector<unsigned> callNos;
+        for (auto call : calls) {
+            callNos.push_back(call->no);
+            delete call;
+        }
+        return callNos;
+    }
+};
+
+
+TEST_F(ShadowTest, last_value)
+{
+    add(useProgramSig, {1});            // 0
+    add(uniformSig, {0});               // 1
+    add(enableSig, {0x0B71});           // 2
+    add(uniformSig, {1});               // 3
+    add(uniformSig, {0});               // 4
+    add(disableSig, {0x0B71});          // 5
+
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 3, 4, 5}));
+}
+
+
+TEST_F(ShadowTest, uniforms_per_program)
+{
+    add(useProgramSig, {1});            // 0
+    add(uniformSig, {0});               // 1
+    add(useProgramSig, {2});            // 2
+    add(uniformSig, {0});               // 3
+
+    // The first program binding is needed by its uniform
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 1, 2, 3}));
+}
+
+
+TEST_F(ShadowTest, texture_uploads)
+{
+    add(bindTextureSig, {GL_TEXTURE_2D, 1});                    // 0
+    add(texImageSig, {GL_TEXTURE_2D, 0});                       // 1
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 2
+    add(texSubImageSig, {GL_TEXTURE_2D, 1, 0, 0, 8, 8});        // 3
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 4
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 16, 0, 16, 16});     // 5
+    add(texImageSig, {GL_TEXTURE_2D, 0});                       // 6
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 7
+
+    // Respecifying level 0 discards its updates, but not those of level 1
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 3, 6, 7}));
+}
+
+
+TEST_F(ShadowTest, unknown_bindings)
+{
+    // Bound before the first call
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 0
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 1
+    add(bindTextureSig, {GL_TEXTURE_2D, 1});                    // 2
+    add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});      // 3
+
+    EXPECT_EQ(survivors(), std::vector<unsigned>({1, 2, 3}));
+}
+
+
+TEST_F(ShadowTest, generated_mipmaps)
+{
+    add(bindTextureSig, {GL_TEXTURE_2D, 1});
+    for (unsigned frame = 0; frame < 3; ++frame) {
+        add(texSubImageSig, {GL_TEXTURE_2D, 0, 0, 0, 16, 16});
+        add(generateMipmapSig, {GL_TEXTURE_2D});
+    }
+
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 5, 6}));
+}
+
+
+TEST_F(ShadowTest, unknown_calls)
+{
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 1});   // 0
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 2});   // 1
+    add(unknownSig);                            // 2
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 3});   // 3
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 4});   // 4
+
+    // Unknown calls are kept, together with the bindings they may use
+    EXPECT_EQ(survivors(), std::vector<unsigned>({1, 2, 4}));
+}
+
+
+TEST_F(ShadowTest, texture_units)
+{
+    add(activeTextureSig, {GL_TEXTURE0});       // 0
+    add(enableSig, {GL_TEXTURE_2D});            // 1
+    add(activeTextureSig, {GL_TEXTURE0 + 1});   // 2
+    add(enableSig, {GL_TEXTURE_2D});            // 3
+    add(disableSig, {GL_TEXTURE_2D});           // 4
+
+    // Fixed function texturing is enabled per texture unit
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 1, 2, 4}));
+}
+
+
+TEST_F(ShadowTest, other_apis)
+{
+    add(setStateSig, {0, 1});                   // 0
+    add(setStateSig, {0, 2});                   // 1
+    add(setStateSig, {0, 1});                   // 2
+
+    EXPECT_EQ(survivors(), std::vector<unsigned>({0, 1, 2}));
+}
+
+
+TEST_F(ShadowTest, listed_calls)
+{
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 1});   // 0
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 2});   // 1
+
+    std::vector<Call *> calls;
+    shadow.getCalls(calls);
+    ASSERT_EQ(calls.size(), 1U);
+    EXPECT_EQ(calls[0]->no, 1U);
+
+    // Listing does not start afresh
+    add(unknownSig);                            // 2
+    add(bindBufferSig, {GL_ARRAY_BUFFER, 3});   // 3
+
+    EXPECT_EQ(survivors(), std::vector<unsigned>({1, 2, 3}));
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
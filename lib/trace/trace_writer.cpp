@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
+#include <utility>
 #include <vector>
 
 #include "os.hpp"
@@ -41,7 +42,8 @@ namespace trace {
 
 
 Writer::Writer() :
-    call_no(0)
+    call_no(0),
+    discard(false)
 {
     m_file = nullptr;
 }
@@ -57,19 +59,49 @@ Writer::close(void) {
     m_file = nullptr;
 }
 
+void
+Writer::swap(Writer &other) {
+    std::swap(m_file, other.m_file);
+    std::swap(call_no, other.call_no);
+    functions.swap(other.functions);
+    structs.swap(other.structs);
+    enums.swap(other.enums);
+    bitmasks.swap(other.bitmasks);
+    frames.swap(other.frames);
+}
+
 bool
 Writer::open(const char *filename,
              unsigned semanticVersion,
              const Properties &properties)
 {
-    close();
-
-    m_file = createSnappyStream(filename);
-    if (!m_file) {
+    OutStream *stream = createSnappyStream(filename);
+    if (!stream) {
         return false;
     }
 
+    return open(stream, semanticVersion, properties);
+}
+
+bool
+Writer::open(OutStream *stream,
+             unsigned semanticVersion,
+             const Properties &properties)
+{
+    close();
+
+    m_file = stream;
+
     call_no = 0;
+    writeHeader(semanticVersion, properties);
+
+    return true;
+}
+
+void
+Writer::writeHeader(unsigned semanticVersion,
+                    const Properties &properties)
+{
     functions.clear();
     structs.clear();
     enums.clear();
@@ -86,12 +118,13 @@ Writer::open(const char *filename,
         writeProperty(kv.first.c_str(), kv.second.c_str());
     }
     endProperties();
-
-    return true;
 }
 
 void inline
 Writer::_write(const void *sBuffer, size_t dwBytesToWrite) {
+    if (discard) {
+        return;
+    }
     m_file->write(sBuffer, dwBytesToWrite);
 }
 
@@ -138,6 +171,11 @@ Writer::_writeString(const char *str) {
     _write(str, len);
 }
 
+/*
+ * Signatures are only marked as written when not discarding, so that their
+ * definition is emitted again by the next call that actually reaches the
+ * file.
+ */
 inline bool lookup(std::vector<bool> &map, size_t index) {
     if (index >= map.size()) {
         map.resize(index + 1);
@@ -178,7 +216,7 @@ void Writer::writeStackFrame(const RawStackFrame *frame) {
             _writeUInt(frame->offset);
         }
         _writeByte(trace::BACKTRACE_END);
-        frames[frame->id] = true;
+        frames[frame->id] = !discard;
     }
 }
 
@@ -216,7 +254,7 @@ unsigned Writer::beginEnter(const FunctionSig *sig, unsigned thread_id) {
         for (unsigned i = 0; i < sig->num_args; ++i) {
             _writeString(sig->arg_names[i]);
         }
-        functions[sig->id] = true;
+        functions[sig->id] = !discard;
     }
 
     return call_no++;
@@ -258,7 +296,7 @@ void Writer::beginStruct(const StructSig *sig) {
         for (unsigned i = 0; i < sig->num_members; ++i) {
             _writeString(sig->member_names[i]);
         }
-        structs[sig->id] = true;
+        structs[sig->id] = !discard;
     }
 }
 
@@ -356,7 +394,7 @@ void Writer::writeEnum(const EnumSig *sig, signed long long value) {
             _writeString(sig->values[i].name);
             writeSInt(sig->values[i].value);
         }
-        enums[sig->id] = true;
+        enums[sig->id] = !discard;
     }
     writeSInt(value);
 }
@@ -373,7 +411,7 @@ void Writer::writeBitmask(const BitmaskSig *sig, unsigned long long value) {
             _writeString(sig->flags[i].name);
             _writeUInt(sig->flags[i].value);
         }
-        bitmasks[sig->id] = true;
+        bitmasks[sig->id] = !discard;
     }
     _writeUInt(value);
 }
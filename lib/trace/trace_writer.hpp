@@ -50,6 +50,12 @@ namespace trace {
         std::vector<bool> bitmasks;
         std::vector<bool> frames;
 
+        /**
+         * When set, everything serialized is dropped on the floor instead of
+         * being written to the file.
+         */
+        bool discard;
+
     public:
         Writer();
         ~Writer();
@@ -57,8 +63,21 @@ namespace trace {
         bool open(const char *filename,
                   unsigned semanticVersion,
                   const Properties &properties);
+
+        /**
+         * Open for writing into an existing stream, taking ownership of it.
+         */
+        bool open(OutStream *stream,
+                  unsigned semanticVersion,
+                  const Properties &properties);
         void close(void);
 
+        /**
+         * Exchange streams, call numbering, and signatures written so far
+         * with another writer.
+         */
+        void swap(Writer &other);
+
         unsigned beginEnter(const FunctionSig *sig, unsigned thread_id);
         void endEnter(void);
 
@@ -112,6 +131,12 @@ namespace trace {
         void endProperties(void);
 
     protected:
+        /**
+         * Write the stream header, forgetting all signatures written so far.
+         */
+        void writeHeader(unsigned semanticVersion,
+                         const Properties &properties);
+
         void inline _write(const void *sBuffer, size_t dwBytesToWrite);
         void inline _writeByte(char c);
         void inline _writeUInt(unsigned long long value);
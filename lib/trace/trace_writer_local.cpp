@@ -24,6 +24,8 @@
  **************************************************************************/
 
 
+#include <algorithm>
+
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -34,14 +36,19 @@
 #include "os_thread.hpp"
 #include "os_string.hpp"
 #include "os_version.hpp"
+#include "trace_file.hpp"
 #include "trace_option.hpp"
 #include "trace_ostream.hpp"
 #include "trace_writer_local.hpp"
 #include "trace_format.hpp"
+#include "trace_parser.hpp"
+#include "trace_state_shadow.hpp"
 #include "os_backtrace.hpp"
 
 #ifdef _WIN32
 #include <shlobj.h>
+#else
+#include <signal.h>
 #endif
 
 
@@ -66,10 +73,58 @@ static void exceptionCallback(void)
     localWriter.flush();
 }
 
+static void exitCallback(void)
+{
+    localWriter.flush();
+}
+
+
+enum {
+    CAPTURE_FLAG_KNOWN     = (1 << 0),
+    CAPTURE_FLAG_DROP      = (1 << 1),
+    CAPTURE_FLAG_END_FRAME = (1 << 2),
+    CAPTURE_FLAG_BEGIN     = (1 << 3),
+    CAPTURE_FLAG_END       = (1 << 4),
+};
+
+// Buffered prologue size above which it gets compacted
+#define CAPTURE_COMPACT_SIZE (64 * 1024 * 1024)
+
+static volatile sig_atomic_t captureTriggered = 0;
+static volatile sig_atomic_t ringTriggered = 0;
+
+static void captureSignalHandler(int sig)
+{
+    captureTriggered = 1;
+}
+
+static void ringSignalHandler(int sig)
+{
+    ringTriggered = 1;
+}
+
+static void installTriggerHandler(void (*handler)(int))
+{
+#ifdef _WIN32
+    os::log("apitrace: warning: SIGUSR2 trigger is not supported on Windows\n");
+#else
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR2, &action, NULL);
+#endif
+}
+
 
 LocalWriter::LocalWriter() :
     acquired(0),
-    sharedPtrThis(std::make_shared<LocalWriter*>(this))
+    sharedPtrThis(std::make_shared<LocalWriter*>(this)),
+    captureState(CAPTURE_ALL),
+    captureInFlight(0),
+    capturePrologue(nullptr),
+    ring(nullptr)
 {
     os::String process = os::getProcessName();
     os::log("apitrace: loaded into %s\n", process.str());
@@ -172,7 +227,33 @@ LocalWriter::open(void) {
     os::String processCommandLine = os::getProcessCommandLine();
     properties["process.commandLine"] = processCommandLine;
 
-    if (!Writer::open(lpFileName, TRACE_VERSION, properties)) {
+    setupCapture(properties);
+    captureProperties = properties;
+
+    ring = nullptr;
+    const char *ringSizeStr = getenv("TRACE_RING_SIZE");
+    if (ringSizeStr) {
+        int ringSize = atoi(ringSizeStr);
+        if (ringSize <= 0) {
+            os::log("apitrace: error: invalid TRACE_RING_SIZE: %s\n", ringSizeStr);
+            os::abort();
+        }
+        if (captureState != CAPTURE_ALL) {
+            os::log("apitrace: error: TRACE_RING_SIZE can't be combined with TRACE_FRAMES or TRACE_TRIGGER_FRAMES\n");
+            os::abort();
+        }
+        ring = createRingStream(size_t(ringSize) << 20);
+        ringSegmentSize = (size_t(ringSize) << 20) / 8;
+        ringFrameEnded = false;
+        ringFileName = os::String::format("%s.ring", lpFileName);
+        ringProperties = properties;
+        Writer::open(ring, TRACE_VERSION, properties);
+        installTriggerHandler(ringSignalHandler);
+        atexit(exitCallback);
+
+        os::log("apitrace: keeping the last %i MB of calls in memory, to be dumped into %s\n",
+                ringSize, ringFileName.str());
+    } else if (!Writer::open(lpFileName, TRACE_VERSION, properties)) {
         os::log("apitrace: error: failed to open %s\n", lpFileName);
         os::abort();
     }
@@ -195,6 +276,215 @@ LocalWriter::open(void) {
 #endif
 }
 
+/*
+ * TRACE_FRAMES=first[-last] records full calls only for the given frame
+ * range, while TRACE_TRIGGER_FRAMES=count records `count` frames each time
+ * the process receives SIGUSR2.  Before the window only calls which create
+ * resources or change state are kept, which replay as a prologue.
+ */
+void
+LocalWriter::setupCapture(Properties &properties)
+{
+    captureState = CAPTURE_ALL;
+    captureFrame = 0;
+    captureInBeginEnd = false;
+    captureInFlight = 0;
+    capturePrologue = nullptr;
+
+    const char *frames = getenv("TRACE_FRAMES");
+    const char *triggerFrames = getenv("TRACE_TRIGGER_FRAMES");
+    if (frames) {
+        unsigned first = 0;
+        unsigned last = 0;
+        int n = sscanf(frames, "%u-%u", &first, &last);
+        if (n < 1 || (n == 2 && last < first)) {
+            os::log("apitrace: error: invalid TRACE_FRAMES: %s\n", frames);
+            os::abort();
+        }
+        if (n == 1) {
+            last = first;
+        }
+        captureFirst = first;
+        captureCount = last - first + 1;
+        properties["capture.frames"] = os::String::format("%u-%u", first, last).str();
+    } else if (triggerFrames) {
+        int count = atoi(triggerFrames);
+        if (count <= 0) {
+            os::log("apitrace: error: invalid TRACE_TRIGGER_FRAMES: %s\n", triggerFrames);
+            os::abort();
+        }
+        captureFirst = ~0U;
+        captureCount = count;
+        installTriggerHandler(captureSignalHandler);
+        os::log("apitrace: send SIGUSR2 to %lu to capture %u frames\n",
+                (unsigned long)os::getCurrentProcessId(), captureCount);
+    } else {
+        return;
+    }
+
+    captureLeft = captureCount;
+    captureState = captureFirst == 0 ? CAPTURE_WINDOW : CAPTURE_PROLOGUE;
+}
+
+unsigned char
+LocalWriter::lookupCaptureFlags(const FunctionSig *sig)
+{
+    if (sig->id >= captureFlags.size()) {
+        captureFlags.resize(sig->id + 1);
+    }
+    unsigned char flags = captureFlags[sig->id];
+    if (!flags) {
+        flags = CAPTURE_FLAG_KNOWN;
+        CallFlags callFlags = Parser::lookupCallFlags(sig->name);
+        if (callFlags & (CALL_FLAG_RENDER | CALL_FLAG_END_FRAME)) {
+            flags |= CAPTURE_FLAG_DROP;
+        }
+        if ((callFlags & CALL_FLAG_NO_SIDE_EFFECTS) &&
+            !isRemappedQuery(sig->name)) {
+            flags |= CAPTURE_FLAG_DROP;
+        }
+        if (callFlags & CALL_FLAG_END_FRAME) {
+            flags |= CAPTURE_FLAG_END_FRAME;
+        }
+        if (strcmp(sig->name, "glBegin") == 0) {
+            flags |= CAPTURE_FLAG_BEGIN;
+        } else if (strcmp(sig->name, "glEnd") == 0) {
+            flags |= CAPTURE_FLAG_END;
+        }
+        captureFlags[sig->id] = flags;
+    }
+    return flags;
+}
+
+/*
+ * Decide whether a call should be recorded, advancing the capture window on
+ * frame boundaries.  Must be called with the mutex held.
+ */
+bool
+LocalWriter::captureCall(const FunctionSig *sig)
+{
+    unsigned char flags = lookupCaptureFlags(sig);
+
+    bool record;
+    switch (captureState) {
+    case CAPTURE_WINDOW:
+        record = true;
+        break;
+    case CAPTURE_PROLOGUE:
+        // Immediate mode vertices are only meaningful with their draw
+        if (flags & CAPTURE_FLAG_BEGIN) {
+            captureInBeginEnd = true;
+        }
+        record = !(flags & CAPTURE_FLAG_DROP) && !captureInBeginEnd;
+        if (flags & CAPTURE_FLAG_END) {
+            captureInBeginEnd = false;
+        }
+        break;
+    default:
+        record = false;
+        break;
+    }
+
+    if (flags & CAPTURE_FLAG_END_FRAME) {
+        ++captureFrame;
+        if (captureState == CAPTURE_WINDOW) {
+            if (--captureLeft == 0) {
+                os::log("apitrace: finished capturing at frame %u\n", captureFrame);
+                captureLeft = captureCount;
+                // Fixed windows are done, triggered ones can be rearmed
+                captureState = captureFirst == ~0U ? CAPTURE_PROLOGUE : CAPTURE_DONE;
+                m_file->flush();
+            }
+        } else if (captureState == CAPTURE_PROLOGUE &&
+                   (captureFrame >= captureFirst || captureTriggered)) {
+            // Otherwise wait for the next frame
+            if (!captureInFlight) {
+                os::log("apitrace: capturing %u frames from frame %u\n", captureCount, captureFrame);
+                captureTriggered = 0;
+                captureState = CAPTURE_WINDOW;
+                if (capturePrologue) {
+                    writePrologue();
+                }
+            }
+        }
+    }
+
+    return record;
+}
+
+/*
+ * Start buffering the prologue in memory, setting the trace file aside.
+ */
+void
+LocalWriter::bufferPrologue(void)
+{
+    swap(captureWriter);
+    capturePrologue = new MemoryOutStream;
+    Writer::open(capturePrologue, TRACE_VERSION, captureProperties);
+    captureCompactSize = CAPTURE_COMPACT_SIZE;
+}
+
+void
+LocalWriter::compactPrologue(void)
+{
+    std::string data;
+    data.swap(capturePrologue->data);
+    size_t size = data.size();
+
+    capturePrologue = new MemoryOutStream;
+    Writer::open(capturePrologue, TRACE_VERSION, captureProperties);
+    replayPrologue(data);
+
+    size_t compactedSize = capturePrologue->data.size();
+    captureCompactSize = std::max<size_t>(CAPTURE_COMPACT_SIZE, 2 * compactedSize);
+    os::log("apitrace: compacted prologue from %zu to %zu bytes\n", size, compactedSize);
+}
+
+/*
+ * Write the compacted prologue into the trace file, and resume writing there.
+ */
+void
+LocalWriter::writePrologue(void)
+{
+    std::string data;
+    data.swap(capturePrologue->data);
+
+    Writer::close();
+    capturePrologue = nullptr;
+    swap(captureWriter);
+    replayPrologue(data);
+}
+
+void
+LocalWriter::replayPrologue(std::string &data)
+{
+    File *file = File::createMemory(data);
+    file->open("prologue");
+
+    Parser parser;
+    if (!parser.open(file)) {
+        os::log("apitrace: error: failed to parse prologue\n");
+        return;
+    }
+
+    StateShadow shadow;
+    Call *call;
+    unsigned count = 0;
+    while ((call = parser.parse_call())) {
+        shadow.addCall(call);
+        ++count;
+    }
+
+    std::vector<Call *> calls;
+    shadow.takeCalls(calls);
+    for (auto call : calls) {
+        Writer::writeCall(call);
+        delete call;
+    }
+
+    os::log("apitrace: kept %zu of %u prologue calls\n", calls.size(), count);
+}
+
 static uintptr_t next_thread_num = 1;
 
 static OS_THREAD_LOCAL uintptr_t thread_num;
@@ -207,6 +497,7 @@ void LocalWriter::checkProcessId(void) {
         // file, as it may cause it to flush and corrupt the parent's
         // trace, so we effectively leak the old file object.
         close();
+        captureWriter.close();
         // Don't want to open the same file again
         os::unsetEnvironment("TRACE_FILE");
         open();
@@ -222,6 +513,36 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
         open();
     }
 
+    if (ring) {
+        if (ringTriggered) {
+            ringTriggered = 0;
+            dumpRing();
+        }
+
+        // Prefer starting segments on frame boundaries
+        size_t size = ring->segmentSize();
+        if ((ringFrameEnded && size >= ringSegmentSize) ||
+            size >= 2 * ringSegmentSize) {
+            ring->beginSegment(call_no);
+            writeHeader(TRACE_VERSION, ringProperties);
+        }
+        ringFrameEnded = lookupCaptureFlags(sig) & CAPTURE_FLAG_END_FRAME;
+    }
+
+    if (captureState == CAPTURE_PROLOGUE && !ring && !captureInFlight) {
+        if (!capturePrologue) {
+            bufferPrologue();
+        } else if (capturePrologue->data.size() >= captureCompactSize) {
+            compactPrologue();
+        }
+    }
+
+    if (captureState != CAPTURE_ALL && !captureCall(sig)) {
+        discard = true;
+        return DISCARDED_CALL;
+    }
+    ++captureInFlight;
+
     uintptr_t this_thread_num = thread_num;
     if (!this_thread_num) {
         this_thread_num = next_thread_num++;
@@ -245,7 +566,11 @@ unsigned LocalWriter::beginEnter(const FunctionSig *sig, bool fake) {
 }
 
 void LocalWriter::endEnter(void) {
-    Writer::endEnter();
+    if (discard) {
+        discard = false;
+    } else {
+        Writer::endEnter();
+    }
     --acquired;
     mutex.unlock();
 }
@@ -253,11 +578,20 @@ void LocalWriter::endEnter(void) {
 void LocalWriter::beginLeave(unsigned call) {
     mutex.lock();
     ++acquired;
-    Writer::beginLeave(call);
+    if (call == DISCARDED_CALL) {
+        discard = true;
+    } else {
+        Writer::beginLeave(call);
+    }
 }
 
 void LocalWriter::endLeave(void) {
-    Writer::endLeave();
+    if (discard) {
+        discard = false;
+    } else {
+        Writer::endLeave();
+        --captureInFlight;
+    }
     --acquired;
     mutex.unlock();
 }
@@ -277,6 +611,8 @@ void LocalWriter::flush(void) {
         if (m_file) {
             if (os::getCurrentProcessId() != pid) {
                 os::log("apitrace: ignoring flush in child process\n");
+            } else if (ring) {
+                dumpRing();
             } else {
                 os::log("apitrace: flushing trace\n");
                 m_file->flush();
@@ -287,6 +623,17 @@ void LocalWriter::flush(void) {
     mutex.unlock();
 }
 
+/*
+ * Must be called with the mutex held.  Also called from the exception
+ * handler, so the ring is written out raw, to be converted offline.
+ */
+void LocalWriter::dumpRing(void) {
+    os::log("apitrace: dumping recent calls to %s\n", ringFileName.str());
+    if (!ring->dump(ringFileName)) {
+        os::log("apitrace: error: failed to write %s\n", ringFileName.str());
+    }
+}
+
 
 LocalWriter localWriter;
 
@@ -32,9 +32,13 @@
 
 #include <stdint.h>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "os_thread.hpp"
 #include "os_process.hpp"
+#include "os_string.hpp"
+#include "trace_ostream.hpp"
 #include "trace_writer.hpp"
 
 
@@ -81,6 +85,62 @@ namespace trace {
 
         void checkProcessId();
 
+        /**
+         * Capture window state, for TRACE_FRAMES and TRACE_TRIGGER_FRAMES.
+         *
+         * Outside the window only calls which create resources or change
+         * state are recorded, so that the calls recorded before the window
+         * act as a prologue which recreates the state at its start.
+         *
+         * Prologue calls are buffered in memory, and periodically compacted
+         * down to the calls needed to recreate the current state, while
+         * captureWriter holds the trace file aside.  Switching streams is
+         * only possible when no recorded call is in flight.
+         */
+        enum CaptureState {
+            CAPTURE_ALL = 0,
+            CAPTURE_PROLOGUE,
+            CAPTURE_WINDOW,
+            CAPTURE_DONE,
+        };
+        CaptureState captureState;
+        unsigned captureFrame;
+        unsigned captureFirst;
+        unsigned captureCount;
+        unsigned captureLeft;
+        bool captureInBeginEnd;
+        unsigned captureInFlight;
+        MemoryOutStream *capturePrologue;
+        size_t captureCompactSize;
+        Writer captureWriter;
+        Properties captureProperties;
+
+        /// Cached capture classification, indexed by FunctionSig::id
+        std::vector<unsigned char> captureFlags;
+
+        unsigned char lookupCaptureFlags(const FunctionSig *sig);
+        void setupCapture(Properties &properties);
+        bool captureCall(const FunctionSig *sig);
+        void bufferPrologue(void);
+        void compactPrologue(void);
+        void writePrologue(void);
+        void replayPrologue(std::string &data);
+
+        /**
+         * In-memory ring of the most recent calls, for TRACE_RING_SIZE.
+         *
+         * Only written out when flushed, e.g., on crashes, SIGUSR2, or exit,
+         * into a dump file for `apitrace ring-convert`.  Same object as
+         * m_file.
+         */
+        RingOutStream *ring;
+        size_t ringSegmentSize;
+        bool ringFrameEnded;
+        os::String ringFileName;
+        Properties ringProperties;
+
+        void dumpRing(void);
+
     public:
         /**
          * Should never called directly -- use localWriter singleton below
@@ -91,6 +151,12 @@ namespace trace {
 
         void open(void);
 
+        /**
+         * Call number returned by beginEnter for calls which are not being
+         * recorded.  It must still be passed to beginLeave.
+         */
+        static const unsigned DISCARDED_CALL = ~0U;
+
         /**
          * It will acquire the mutex.
          */
@@ -0,0 +1,303 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "call_sampler.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+
+namespace retrace {
+
+
+/* Two-sided 95% quantile of the normal distribution */
+static const double
+confidenceZ = 1.96;
+
+
+void
+CallSampler::sampleEvery(unsigned n)
+{
+    mode = SAMPLE_EVERY;
+    period = std::max(n, 1U);
+}
+
+
+void
+CallSampler::sampleRandom(unsigned n)
+{
+    mode = SAMPLE_RANDOM;
+    period = std::max(n, 1U);
+    /* Fixed seed, so that replays sample the same calls */
+    random.seed(std::minstd_rand::default_seed);
+}
+
+
+void
+CallSampler::sampleCalls(const char *spec)
+{
+    mode = SAMPLE_CALLS;
+    calls.merge(spec);
+}
+
+
+bool
+CallSampler::sample(const trace::Call &call, unsigned program, bool isDraw)
+{
+    bool sampled;
+    switch (mode) {
+    case SAMPLE_EVERY:
+        /* Draws are sampled on their own, so that they keep the period */
+        sampled = (isDraw ? drawCount : callCount) % period == 0;
+        break;
+    case SAMPLE_RANDOM:
+        sampled = random() % period == 0;
+        break;
+    case SAMPLE_CALLS:
+        sampled = calls.contains(call);
+        break;
+    default:
+        sampled = true;
+        break;
+    }
+
+    if (isDraw) {
+        ++drawCount;
+        ++programs[program].population;
+    } else {
+        ++callCount;
+    }
+    ++names[call.sig->name].population;
+
+    return sampled;
+}
+
+
+void
+CallSampler::addSample(const char *name, unsigned program,
+                       int64_t gpuDuration, int64_t cpuDuration, int64_t pixels)
+{
+    auto add = [&] (Stratum &stratum) {
+        ++stratum.samples;
+        stratum.gpu.add(double(gpuDuration));
+        stratum.cpu.add(double(cpuDuration));
+        stratum.pixels.add(double(std::max<int64_t>(pixels, 0)));
+    };
+
+    add(names[name]);
+    if (pixels >= 0) {
+        add(programs[program]);
+    }
+}
+
+
+double
+Estimate::interval(void) const
+{
+    return confidenceZ * std::sqrt(variance);
+}
+
+
+Estimate
+estimate(uint64_t population, uint64_t samples, double sum, double sumSquares)
+{
+    Estimate result;
+    if (!samples) {
+        return result;
+    }
+
+    double n = double(samples);
+    double N = double(population);
+    double mean = sum / n;
+    result.total = N * mean;
+    result.known = samples >= std::min<uint64_t>(population, 2);
+
+    if (samples > 1 && population > samples) {
+        double variance = std::max((sumSquares - n * mean * mean) / (n - 1), 0.0);
+        result.variance = N * N * variance / n * (1.0 - n / N);
+    }
+
+    return result;
+}
+
+
+struct Row {
+    std::string label;
+    uint64_t population;
+    uint64_t samples;
+    Estimate gpu;
+    Estimate cpu;
+    Estimate pixels;
+};
+
+
+static void
+writeEstimate(std::ostream &os, const Estimate &estimate, bool intervals)
+{
+    if (estimate.total <= 0.0 && !estimate.known) {
+        os << std::setw(intervals ? 33 : 16) << "-";
+        return;
+    }
+
+    std::string total = std::to_string(std::llround(estimate.total));
+    if (estimate.lowerBound) {
+        total = ">=" + total;
+    }
+    os << std::setw(16) << total;
+
+    if (!intervals) {
+        return;
+    }
+    if (estimate.known && !estimate.lowerBound) {
+        os << " +/-" << std::setw(13) << std::llround(estimate.interval());
+    } else {
+        /* A single sample gives no spread, and unsampled strata any */
+        os << " +/-" << std::setw(13) << "?";
+    }
+}
+
+
+static void
+writeTable(std::ostream &os, const char *title, const char *labelTitle,
+           std::vector<Row> &rows, bool intervals)
+{
+    if (rows.empty()) {
+        return;
+    }
+
+    std::stable_sort(rows.begin(), rows.end(), [] (const Row &a, const Row &b) {
+        if (a.gpu.total != b.gpu.total) {
+            return a.gpu.total > b.gpu.total;
+        }
+        return a.cpu.total > b.cpu.total;
+    });
+
+    Row total = {"total", 0, 0};
+    uint64_t unsampledPopulation = 0;
+    for (auto member : {&Row::gpu, &Row::cpu, &Row::pixels}) {
+        (total.*member).known = true;
+    }
+    for (auto & row : rows) {
+        total.population += row.population;
+        total.samples += row.samples;
+        if (!row.samples) {
+            unsampledPopulation += row.population;
+        }
+        for (auto member : {&Row::gpu, &Row::cpu, &Row::pixels}) {
+            (total.*member).total += (row.*member).total;
+            (total.*member).variance += (row.*member).variance;
+            (total.*member).known = (total.*member).known && (row.*member).known;
+            (total.*member).lowerBound = (total.*member).lowerBound || !row.samples;
+        }
+    }
+    rows.push_back(total);
+
+    size_t labelWidth = strlen(labelTitle);
+    for (auto & row : rows) {
+        labelWidth = std::max(labelWidth, row.label.size());
+    }
+
+    int estimateWidth = intervals ? 33 : 16;
+    os << title << ":\n"
+       << "  " << std::left << std::setw(int(labelWidth)) << labelTitle << std::right
+       << std::setw(12) << "calls"
+       << std::setw(10) << "sampled"
+       << std::setw(estimateWidth) << "GPU [ns]"
+       << std::setw(estimateWidth) << "CPU [ns]"
+       << std::setw(estimateWidth) << "pixels" << "\n";
+
+    for (auto & row : rows) {
+        os << "  " << std::left << std::setw(int(labelWidth)) << row.label << std::right
+           << std::setw(12) << row.population
+           << std::setw(10) << row.samples;
+        writeEstimate(os, row.gpu, intervals);
+        writeEstimate(os, row.cpu, intervals);
+        writeEstimate(os, row.pixels, intervals);
+        os << "\n";
+    }
+
+    if (unsampledPopulation) {
+        os << "  totals leave out " << unsampledPopulation << " calls of "
+           << labelTitle << "s never sampled\n";
+    }
+}
+
+
+void
+CallSampler::writeReport(std::ostream &os) const
+{
+    auto makeRow = [] (const std::string &label, const Stratum &stratum) {
+        Row row = {label, stratum.population, stratum.samples};
+        row.gpu = estimate(stratum.population, stratum.samples,
+                           stratum.gpu.sum, stratum.gpu.sumSquares);
+        row.cpu = estimate(stratum.population, stratum.samples,
+                           stratum.cpu.sum, stratum.cpu.sumSquares);
+        row.pixels = estimate(stratum.population, stratum.samples,
+                              stratum.pixels.sum, stratum.pixels.sumSquares);
+        return row;
+    };
+
+    uint64_t population = 0;
+    uint64_t samples = 0;
+
+    std::vector<Row> rows;
+    for (auto & it : names) {
+        const Stratum &stratum = it.second;
+        population += stratum.population;
+        samples += stratum.samples;
+        rows.push_back(makeRow(it.first, stratum));
+    }
+
+    os << "Sampled " << samples << " of " << population << " calls";
+    if (population) {
+        os << std::fixed << std::setprecision(1)
+           << " (" << 100.0 * double(samples) / double(population) << "%)"
+           << std::defaultfloat << std::setprecision(6);
+    }
+    /* Only random samples give meaningful confidence intervals */
+    bool intervals = mode == SAMPLE_RANDOM;
+    if (intervals) {
+        os << ", estimated totals with 95% confidence intervals:\n";
+    } else {
+        os << ", estimated totals (confidence intervals need --psample-random):\n";
+    }
+
+    writeTable(os, "By call name", "name", rows, intervals);
+
+    rows.clear();
+    for (auto & it : programs) {
+        rows.push_back(makeRow(std::to_string(it.first), it.second));
+    }
+    writeTable(os, "By program (draw calls)", "program", rows, intervals);
+}
+
+
+} /* namespace retrace */
@@ -0,0 +1,154 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#pragma once
+
+
+#include <stdint.h>
+
+#include <map>
+#include <ostream>
+#include <random>
+#include <unordered_map>
+
+#include "trace_callset.hpp"
+#include "trace_model.hpp"
+
+
+namespace retrace {
+
+
+/* Estimated population total of a stratum */
+struct Estimate {
+    double total = 0.0;
+    /* Variance of the total, to add up across strata */
+    double variance = 0.0;
+    /* Whether the variance is known, which takes two samples */
+    bool known = false;
+    /* Whether strata without any samples were left out of the total */
+    bool lowerBound = false;
+
+    /* Half width of the 95% confidence interval */
+    double
+    interval(void) const;
+};
+
+
+/**
+ * Population total of a stratum from its sample mean, with the finite
+ * population correction, as sampled calls are never sampled twice.
+ *
+ * The variance assumes simple random sampling, as --psample-random does.
+ */
+Estimate
+estimate(uint64_t population, uint64_t samples, double sum, double sumSquares);
+
+
+/**
+ * Selects the calls to instrument when profiling, so that timer queries only
+ * perturb a subset of the workload, and extrapolates the totals of each call
+ * name and program from the sampled calls.
+ *
+ * Every call is counted, sampled or not, so each call name and program is a
+ * stratum whose total is estimated as its call count times its sample mean.
+ * Confidence intervals are only reported for random sampling, since neither
+ * every Nth call nor a fixed set of calls is a random sample.
+ */
+class CallSampler
+{
+public:
+    /* Sample every Nth draw call, and every Nth other call */
+    void
+    sampleEvery(unsigned n);
+
+    /* Sample each call with a probability of 1/N */
+    void
+    sampleRandom(unsigned n);
+
+    /* Sample the calls in the set */
+    void
+    sampleCalls(const char *calls);
+
+    bool
+    enabled(void) const {
+        return mode != SAMPLE_ALL;
+    }
+
+    /* Count the call, and tell whether it should be instrumented */
+    bool
+    sample(const trace::Call &call, unsigned program, bool isDraw);
+
+    /* Add the measurements of a sampled call; pixels is -1 for non-draws */
+    void
+    addSample(const char *name, unsigned program,
+              int64_t gpuDuration, int64_t cpuDuration, int64_t pixels);
+
+    void
+    writeReport(std::ostream &os) const;
+
+private:
+    enum Mode {
+        SAMPLE_ALL,
+        SAMPLE_EVERY,
+        SAMPLE_RANDOM,
+        SAMPLE_CALLS,
+    };
+
+    struct Moments {
+        double sum = 0.0;
+        double sumSquares = 0.0;
+
+        void
+        add(double value) {
+            sum += value;
+            sumSquares += value * value;
+        }
+    };
+
+    struct Stratum {
+        uint64_t population = 0;
+        uint64_t samples = 0;
+        Moments gpu;
+        Moments cpu;
+        Moments pixels;
+    };
+
+    Mode mode = SAMPLE_ALL;
+    unsigned period = 1;
+    trace::CallSet calls;
+    std::minstd_rand random;
+
+    uint64_t drawCount = 0;
+    uint64_t callCount = 0;
+
+    /* Signature names outlive the replay, so they can be keyed by address */
+    std::unordered_map<const char *, Stratum> names;
+    /* Draw calls only, as in trace::Profile::Program */
+    std::map<unsigned, Stratum> programs;
+};
+
+
+} /* namespace retrace */
@@ -0,0 +1,169 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include "call_sampler.hpp"
+
+#include <cmath>
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+
+using retrace::CallSampler;
+using retrace::Estimate;
+
+
+static const trace::FunctionSig drawSig = {0, "glDrawArrays", 0, nullptr};
+static const trace::FunctionSig clearSig = {1, "glClear", 0, nullptr};
+
+
+TEST(call_sampler, estimateNoSamples)
+{
+    Estimate estimate = retrace::estimate(10, 0, 0.0, 0.0);
+    EXPECT_EQ(estimate.total, 0.0);
+    EXPECT_FALSE(estimate.known);
+}
+
+
+TEST(call_sampler, estimateCensus)
+{
+    // All calls sampled, so the total is exact
+    Estimate estimate = retrace::estimate(3, 3, 6.0, 14.0);
+    EXPECT_DOUBLE_EQ(estimate.total, 6.0);
+    EXPECT_EQ(estimate.variance, 0.0);
+    EXPECT_TRUE(estimate.known);
+
+    estimate = retrace::estimate(1, 1, 5.0, 25.0);
+    EXPECT_DOUBLE_EQ(estimate.total, 5.0);
+    EXPECT_TRUE(estimate.known);
+}
+
+
+TEST(call_sampler, estimateSingleSample)
+{
+    // One sample of many gives a total, but no spread
+    Estimate estimate = retrace::estimate(10, 1, 4.0, 16.0);
+    EXPECT_DOUBLE_EQ(estimate.total, 40.0);
+    EXPECT_FALSE(estimate.known);
+}
+
+
+TEST(call_sampler, estimateVariance)
+{
+    // Samples 1, 2, 3, 4 of 8 calls: mean 2.5, sample variance 5/3, and half
+    // the population sampled
+    Estimate estimate = retrace::estimate(8, 4, 10.0, 30.0);
+    EXPECT_DOUBLE_EQ(estimate.total, 20.0);
+    EXPECT_DOUBLE_EQ(estimate.variance, 64.0 * (5.0 / 3.0) / 4.0 * 0.5);
+    EXPECT_TRUE(estimate.known);
+    EXPECT_DOUBLE_EQ(estimate.interval(), 1.96 * std::sqrt(estimate.variance));
+
+    // Identical samples have no spread
+    estimate = retrace::estimate(8, 4, 8.0, 16.0);
+    EXPECT_DOUBLE_EQ(estimate.total, 16.0);
+    EXPECT_EQ(estimate.variance, 0.0);
+}
+
+
+TEST(call_sampler, sampleEvery)
+{
+    CallSampler sampler;
+    sampler.sampleEvery(3);
+
+    // Draws and other calls are sampled on their own
+    std::vector<bool> draws;
+    std::vector<bool> clears;
+    for (unsigned i = 0; i < 6; ++i) {
+        trace::Call draw(&drawSig, 0, 0);
+        draws.push_back(sampler.sample(draw, 1, true));
+        trace::Call clear(&clearSig, 0, 0);
+        clears.push_back(sampler.sample(clear, 0, false));
+    }
+    std::vector<bool> expected = {true, false, false, true, false, false};
+    EXPECT_EQ(draws, expected);
+    EXPECT_EQ(clears, expected);
+}
+
+
+static std::string
+writeReport(CallSampler &sampler, bool sampleClears)
+{
+    for (unsigned i = 0; i < 100; ++i) {
+        trace::Call draw(&drawSig, 0, 0);
+        if (sampler.sample(draw, 1, true)) {
+            sampler.addSample(drawSig.name, 1, 1000 + i % 7, 10, 100);
+        }
+        trace::Call clear(&clearSig, 0, 0);
+        if (sampler.sample(clear, 0, false) && sampleClears) {
+            sampler.addSample(clearSig.name, 0, 50, 5, -1);
+        }
+    }
+
+    std::ostringstream os;
+    sampler.writeReport(os);
+    return os.str();
+}
+
+
+TEST(call_sampler, reportIntervals)
+{
+    // Only random samples have confidence intervals
+    CallSampler random;
+    random.sampleRandom(4);
+    EXPECT_NE(writeReport(random, true).find("+/-"), std::string::npos);
+
+    CallSampler every;
+    every.sampleEvery(4);
+    EXPECT_EQ(writeReport(every, true).find("+/-"), std::string::npos);
+
+    CallSampler calls;
+    calls.sampleCalls("0-100/2");
+    EXPECT_EQ(writeReport(calls, true).find("+/-"), std::string::npos);
+}
+
+
+TEST(call_sampler, reportLowerBound)
+{
+    CallSampler sampler;
+    sampler.sampleRandom(4);
+    std::string report = writeReport(sampler, true);
+    EXPECT_EQ(report.find(">="), std::string::npos);
+    EXPECT_EQ(report.find("never sampled"), std::string::npos);
+
+    // The clears are counted but have no samples
+    CallSampler unsampled;
+    unsampled.sampleRandom(4);
+    report = writeReport(unsampled, false);
+    EXPECT_NE(report.find(">="), std::string::npos);
+    EXPECT_NE(report.find("leave out 100 calls of names never sampled"), std::string::npos);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
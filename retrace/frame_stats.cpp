@@ -0,0 +1,296 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+#include "json.hpp"
+
+
+namespace retrace {
+
+
+/* In milliseconds, chosen around common refresh intervals */
+const double
+FrameStats::histogramBounds[] = {
+    4.0, 8.0, 11.1, 16.7, 33.3, 50.0, 100.0, 250.0,
+};
+
+const size_t
+FrameStats::numHistogramBuckets = sizeof histogramBounds / sizeof histogramBounds[0] + 1;
+
+
+std::vector<size_t>
+FrameStats::histogram(const std::vector<double> &times)
+{
+    std::vector<size_t> counts(numHistogramBuckets);
+    for (double time : times) {
+        size_t bucket = std::upper_bound(histogramBounds,
+                                         histogramBounds + numHistogramBuckets - 1,
+                                         time) - histogramBounds;
+        ++counts[bucket];
+    }
+    return counts;
+}
+
+
+/**
+ * Nearest-rank percentile of sorted values.
+ */
+static double
+percentile(const std::vector<double> &sorted, double p)
+{
+    size_t rank = size_t(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+void
+FrameStats::clear(void)
+{
+    clearFrameTimes();
+    iterationTimes.clear();
+}
+
+
+void
+FrameStats::clearFrameTimes(void)
+{
+    cpuTimes.clear();
+    gpuTimes.clear();
+}
+
+
+FrameStats::Summary
+FrameStats::summarize(const std::vector<double> &times)
+{
+    Summary summary;
+    if (times.empty()) {
+        return summary;
+    }
+
+    std::vector<double> sorted(times);
+    std::sort(sorted.begin(), sorted.end());
+
+    double total = 0.0;
+    for (double time : sorted) {
+        total += time;
+    }
+
+    summary.count = sorted.size();
+    summary.min = sorted.front();
+    summary.mean = total / sorted.size();
+    summary.median = percentile(sorted, 50.0);
+    summary.p95 = percentile(sorted, 95.0);
+    summary.p99 = percentile(sorted, 99.0);
+    summary.max = sorted.back();
+
+    double variance = 0.0;
+    for (double time : sorted) {
+        variance += (time - summary.mean) * (time - summary.mean);
+    }
+    if (sorted.size() > 1) {
+        variance /= sorted.size() - 1;
+    }
+    summary.stddev = std::sqrt(variance);
+
+    return summary;
+}
+
+
+static void
+writeTextReport(std::ostream &os, const char *name, const std::vector<double> &times)
+{
+    if (times.empty()) {
+        return;
+    }
+
+    FrameStats::Summary summary = FrameStats::summarize(times);
+
+    os << std::fixed << std::setprecision(3)
+       << name << " frame times (ms) over " << summary.count << " frames:\n"
+       << "  min " << summary.min
+       << "  median " << summary.median
+       << "  p95 " << summary.p95
+       << "  p99 " << summary.p99
+       << "  max " << summary.max
+       << "  mean " << summary.mean << "\n";
+
+    std::vector<size_t> counts = FrameStats::histogram(times);
+    size_t maxCount = *std::max_element(counts.begin(), counts.end());
+    const unsigned barWidth = 40;
+    for (size_t i = 0; i < FrameStats::numHistogramBuckets; ++i) {
+        os << "  ";
+        if (i < FrameStats::numHistogramBuckets - 1) {
+            os << "<" << std::setw(7) << std::setprecision(1) << FrameStats::histogramBounds[i];
+        } else {
+            os << ">=" << std::setw(6) << std::setprecision(1) << FrameStats::histogramBounds[i - 1];
+        }
+        os << " " << std::setw(8) << counts[i];
+        size_t bar = maxCount ? (counts[i] * barWidth + maxCount - 1) / maxCount : 0;
+        if (bar) {
+            os << " " << std::string(bar, '#');
+        }
+        os << "\n";
+    }
+
+    os << std::defaultfloat << std::setprecision(6);
+}
+
+
+/**
+ * Coefficient of variation, as a percentage.
+ */
+static double
+variation(const FrameStats::Summary &summary)
+{
+    return summary.mean > 0.0 ? summary.stddev / summary.mean * 100.0 : 0.0;
+}
+
+
+void
+FrameStats::writeReport(std::ostream &os) const
+{
+    writeTextReport(os, "CPU", cpuTimes);
+    writeTextReport(os, "GPU", gpuTimes);
+
+    if (!iterationTimes.empty()) {
+        Summary summary = summarize(iterationTimes);
+
+        os << std::fixed << std::setprecision(3)
+           << "Iteration times (ms) over " << summary.count << " iterations:\n";
+        for (size_t i = 0; i < iterationTimes.size(); ++i) {
+            os << "  " << i << ": " << iterationTimes[i] << "\n";
+        }
+        os << "  min " << summary.min
+           << "  median " << summary.median
+           << "  max " << summary.max
+           << "  mean " << summary.mean
+           << "  stddev " << summary.stddev
+           << "  cv " << std::setprecision(2) << variation(summary) << "%\n";
+        os << std::defaultfloat << std::setprecision(6);
+    }
+}
+
+
+static void
+writeIntMember(JSONWriter &json, const char *name, size_t n)
+{
+    json.beginMember(name);
+    json.writeInt(n);
+    json.endMember();
+}
+
+
+static void
+writeFloatMember(JSONWriter &json, const char *name, double n)
+{
+    json.beginMember(name);
+    json.writeFloat(n);
+    json.endMember();
+}
+
+
+static void
+writeJSONStats(JSONWriter &json, const char *name, const std::vector<double> &times)
+{
+    if (times.empty()) {
+        return;
+    }
+
+    FrameStats::Summary summary = FrameStats::summarize(times);
+
+    json.beginMember(name);
+    json.beginObject();
+    writeIntMember(json, "count", summary.count);
+    writeFloatMember(json, "min", summary.min);
+    writeFloatMember(json, "mean", summary.mean);
+    writeFloatMember(json, "median", summary.median);
+    writeFloatMember(json, "p95", summary.p95);
+    writeFloatMember(json, "p99", summary.p99);
+    writeFloatMember(json, "max", summary.max);
+
+    json.beginMember("histogram");
+    json.beginArray();
+    std::vector<size_t> counts = FrameStats::histogram(times);
+    for (size_t i = 0; i < FrameStats::numHistogramBuckets; ++i) {
+        json.beginObject();
+        json.beginMember("below");
+        if (i < FrameStats::numHistogramBuckets - 1) {
+            json.writeFloat(FrameStats::histogramBounds[i]);
+        } else {
+            json.writeNull();
+        }
+        json.endMember();
+        writeIntMember(json, "count", counts[i]);
+        json.endObject();
+    }
+    json.endArray();
+    json.endMember();
+
+    json.endObject();
+    json.endMember();
+}
+
+
+void
+FrameStats::writeJSON(std::ostream &os, unsigned frames, double seconds) const
+{
+    JSONWriter json(os);
+    writeIntMember(json, "frames", frames);
+    writeFloatMember(json, "seconds", seconds);
+    writeJSONStats(json, "cpu", cpuTimes);
+    writeJSONStats(json, "gpu", gpuTimes);
+
+    if (!iterationTimes.empty()) {
+        Summary summary = summarize(iterationTimes);
+
+        json.beginMember("iterations");
+        json.beginObject();
+        writeIntMember(json, "count", summary.count);
+        writeFloatMember(json, "min", summary.min);
+        writeFloatMember(json, "mean", summary.mean);
+        writeFloatMember(json, "median", summary.median);
+        writeFloatMember(json, "max", summary.max);
+        writeFloatMember(json, "stddev", summary.stddev);
+        writeFloatMember(json, "cv", variation(summary));
+        json.beginMember("times");
+        json.beginArray();
+        for (double time : iterationTimes) {
+            json.writeFloat(time);
+        }
+        json.endArray();
+        json.endMember();
+        json.endObject();
+        json.endMember();
+    }
+}
+
+
+} /* namespace retrace */
@@ -0,0 +1,100 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#pragma once
+
+
+#include <ostream>
+#include <vector>
+
+
+namespace retrace {
+
+
+/**
+ * Per-frame CPU and GPU times, and their distribution, plus the durations of
+ * benchmark iterations.
+ */
+class FrameStats
+{
+public:
+    struct Summary {
+        size_t count = 0;
+        double min = 0.0;
+        double mean = 0.0;
+        double median = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+        double stddev = 0.0;
+    };
+
+    void
+    clear(void);
+
+    void
+    clearFrameTimes(void);
+
+    /* Times are in milliseconds */
+    void
+    addCpuTime(double ms) {
+        cpuTimes.push_back(ms);
+    }
+
+    void
+    addGpuTime(double ms) {
+        gpuTimes.push_back(ms);
+    }
+
+    void
+    addIterationTime(double ms) {
+        iterationTimes.push_back(ms);
+    }
+
+    static Summary
+    summarize(const std::vector<double> &times);
+
+    /* Upper bounds of the histogram buckets, but for the last one */
+    static const double histogramBounds[];
+    static const size_t numHistogramBuckets;
+
+    static std::vector<size_t>
+    histogram(const std::vector<double> &times);
+
+    void
+    writeReport(std::ostream &os) const;
+
+    void
+    writeJSON(std::ostream &os, unsigned frames, double seconds) const;
+
+private:
+    std::vector<double> cpuTimes;
+    std::vector<double> gpuTimes;
+    std::vector<double> iterationTimes;
+};
+
+
+} /* namespace retrace */
@@ -0,0 +1,159 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "frame_stats.hpp"
+
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+
+using retrace::FrameStats;
+
+
+TEST(frame_stats, summarizeEmpty)
+{
+    FrameStats::Summary summary = FrameStats::summarize({});
+    EXPECT_EQ(summary.count, 0);
+    EXPECT_EQ(summary.max, 0.0);
+}
+
+
+TEST(frame_stats, summarizeSingle)
+{
+    FrameStats::Summary summary = FrameStats::summarize({7.5});
+    EXPECT_EQ(summary.count, 1);
+    EXPECT_EQ(summary.min, 7.5);
+    EXPECT_EQ(summary.median, 7.5);
+    EXPECT_EQ(summary.p99, 7.5);
+    EXPECT_EQ(summary.max, 7.5);
+    EXPECT_EQ(summary.stddev, 0.0);
+}
+
+
+TEST(frame_stats, summarizePercentiles)
+{
+    // Reversed, to check it doesn't rely on the order
+    std::vector<double> times;
+    for (int i = 100; i >= 1; --i) {
+        times.push_back(i);
+    }
+
+    FrameStats::Summary summary = FrameStats::summarize(times);
+    EXPECT_EQ(summary.count, 100);
+    EXPECT_EQ(summary.min, 1.0);
+    EXPECT_EQ(summary.max, 100.0);
+    EXPECT_DOUBLE_EQ(summary.mean, 50.5);
+
+    // Nearest rank
+    EXPECT_EQ(summary.median, 50.0);
+    EXPECT_EQ(summary.p95, 95.0);
+    EXPECT_EQ(summary.p99, 99.0);
+
+    // Sample standard deviation
+    EXPECT_NEAR(summary.stddev, 29.0115, 1e-4);
+}
+
+
+TEST(frame_stats, percentileRoundsUp)
+{
+    FrameStats::Summary summary = FrameStats::summarize({1.0, 2.0, 3.0});
+    EXPECT_EQ(summary.median, 2.0);
+    EXPECT_EQ(summary.p95, 3.0);
+}
+
+
+TEST(frame_stats, histogram)
+{
+    std::vector<size_t> counts = FrameStats::histogram({
+        0.5, 3.9,   // < 4
+        4.0,        // bounds belong to the bucket above
+        16.6, 16.7, // just below and at a 60Hz frame
+        250.0, 1000.0,
+    });
+
+    ASSERT_EQ(counts.size(), FrameStats::numHistogramBuckets);
+    EXPECT_EQ(counts[0], 2);
+    EXPECT_EQ(counts[1], 1);
+    EXPECT_EQ(counts[3], 1);
+    EXPECT_EQ(counts[4], 1);
+    EXPECT_EQ(counts[FrameStats::numHistogramBuckets - 1], 2);
+
+    size_t total = 0;
+    for (size_t count : counts) {
+        total += count;
+    }
+    EXPECT_EQ(total, 7);
+}
+
+
+TEST(frame_stats, writeReport)
+{
+    FrameStats stats;
+    stats.addCpuTime(10.0);
+    stats.addCpuTime(20.0);
+    stats.addCpuTime(30.0);
+
+    std::stringstream ss;
+    stats.writeReport(ss);
+    std::string report = ss.str();
+    EXPECT_NE(report.find("CPU frame times (ms) over 3 frames"), std::string::npos);
+    EXPECT_NE(report.find("median 20.000"), std::string::npos);
+    EXPECT_EQ(report.find("GPU"), std::string::npos);
+    EXPECT_EQ(report.find("Iteration"), std::string::npos);
+
+    stats.clearFrameTimes();
+    stats.addIterationTime(100.0);
+    ss.str("");
+    stats.writeReport(ss);
+    report = ss.str();
+    EXPECT_EQ(report.find("CPU"), std::string::npos);
+    EXPECT_NE(report.find("Iteration times (ms) over 1 iterations"), std::string::npos);
+}
+
+
+TEST(frame_stats, writeJSON)
+{
+    FrameStats stats;
+    stats.addGpuTime(5.0);
+    stats.addGpuTime(15.0);
+
+    std::stringstream ss;
+    stats.writeJSON(ss, 2, 0.5);
+    std::string json = ss.str();
+    EXPECT_NE(json.find("\"frames\": 2"), std::string::npos);
+    EXPECT_NE(json.find("\"gpu\""), std::string::npos);
+    EXPECT_EQ(json.find("\"cpu\""), std::string::npos);
+    EXPECT_NE(json.find("\"histogram\""), std::string::npos);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
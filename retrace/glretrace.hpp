@@ -83,9 +83,15 @@ public:
 
     bool used = false;
 
+    // Non-zero once numbered for incremental state dumps
+    unsigned serial = 0;
+
     bool KHR_debug = false;
     GLsizei maxDebugMessageLength = 0;
 
+    // Recycled query objects for profiling
+    std::vector<GLuint> freeQueries;
+
     inline glfeatures::Profile
     profile(void) const {
         return wsContext->profile;
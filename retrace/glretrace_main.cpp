@@ -28,6 +28,8 @@
 
 #include <string.h>
 
+#include <atomic>
+#include <deque>
 #include <map>
 #include <sstream>
 
@@ -61,11 +63,20 @@ enum {
     NUM_QUERIES,
 };
 
+/* Number of frames whose queries may still be in flight before we block on
+ * the oldest one. */
+#define MAX_PENDING_FRAMES 3
+
+/* Number of query objects to generate at once when the pool runs dry. */
+#define QUERY_POOL_GROW 64
+
 struct CallQuery
 {
     GLuint ids[NUM_QUERIES];
     unsigned call;
+    unsigned thread;
     bool isDraw;
+    bool frameEnd;
     GLuint program;
     const trace::FunctionSig *sig;
     int64_t cpuStart;
@@ -81,7 +92,16 @@ static bool supportsElapsed = true;
 static bool supportsTimestamp = true;
 static bool supportsOcclusion = true;
 
-static std::list<CallQuery> callQueries;
+/* Pending call queries and frame ends, in call order */
+static std::deque<CallQuery> callQueries;
+
+/* Whether the current call is instrumented, when sampling */
+static bool profilingCall = true;
+static unsigned pendingFrames = 0;
+
+/* Pending timestamps of frame ends, for frame statistics */
+static std::deque<GLuint> frameTimestamps;
+static GLint64 lastFrameTimestamp = 0;
 
 static void APIENTRY
 debugOutputCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
@@ -214,6 +234,50 @@ getCurrentRss(int64_t& rss) {
     rss = os::getRss();
 }
 
+static GLuint
+allocQuery(Context *currentContext) {
+    if (!currentContext) {
+        GLuint id = 0;
+        glGenQueries(1, &id);
+        return id;
+    }
+
+    std::vector<GLuint> &freeQueries = currentContext->freeQueries;
+    if (freeQueries.empty()) {
+        freeQueries.resize(QUERY_POOL_GROW);
+        glGenQueries(QUERY_POOL_GROW, freeQueries.data());
+    }
+    GLuint id = freeQueries.back();
+    freeQueries.pop_back();
+    return id;
+}
+
+/**
+ * Return a query object to the pool.
+ *
+ * Queries are always completed before switching contexts, so they belong to
+ * the current context.
+ */
+static void
+releaseQuery(GLuint &id) {
+    Context *currentContext = getCurrentContext();
+    if (currentContext) {
+        currentContext->freeQueries.push_back(id);
+    } else {
+        glDeleteQueries(1, &id);
+    }
+    id = 0;
+}
+
+static void
+releaseQueries(CallQuery& query) {
+    for (unsigned i = 0; i < NUM_QUERIES; ++i) {
+        if (query.ids[i]) {
+            releaseQuery(query.ids[i]);
+        }
+    }
+}
+
 static void
 completeCallQuery(CallQuery& query) {
     /* Get call start and duration */
@@ -258,21 +322,93 @@ completeCallQuery(CallQuery& query) {
         rssDuration = query.rssEnd - query.rssStart;
     }
 
-    glDeleteQueries(NUM_QUERIES, query.ids);
+    releaseQueries(query);
+
+    if (retrace::callSampler.enabled()) {
+        retrace::callSampler.addSample(query.sig->name, query.program,
+                                       gpuDuration, cpuDuration, pixels);
+    }
 
     /* Add call to profile */
-    retrace::profiler.addCall(query.call, query.sig->name, query.program, pixels, gpuStart, gpuDuration, query.cpuStart, cpuDuration, query.vsizeStart, vsizeDuration, query.rssStart, rssDuration);
+    retrace::profiler.addCall(query.call, query.sig->name, query.program, pixels, gpuStart, gpuDuration, query.cpuStart, cpuDuration, query.vsizeStart, vsizeDuration, query.rssStart, rssDuration, query.thread);
 }
 
-void
-flushQueries() {
-    for (auto & callQuerie : callQueries) {
-        completeCallQuery(callQuerie);
+/**
+ * Whether the results of all queries of a call can be fetched without
+ * stalling.
+ */
+static bool
+isCallQueryAvailable(const CallQuery& query) {
+    for (unsigned i = 0; i < NUM_QUERIES; ++i) {
+        if (query.ids[i]) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(query.ids[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Report the pending calls, in order, whose results are already available.
+ *
+ * Only block when too many frames are in flight, or when draining.
+ */
+static void
+completeQueries(bool drain) {
+    while (!callQueries.empty()) {
+        CallQuery& query = callQueries.front();
+        if (query.frameEnd) {
+            assert(pendingFrames > 0);
+            --pendingFrames;
+            retrace::profiler.addFrameEnd();
+        } else {
+            bool wait = drain || pendingFrames > MAX_PENDING_FRAMES;
+            if (!wait && !isCallQueryAvailable(query)) {
+                break;
+            }
+            completeCallQuery(query);
+        }
+        callQueries.pop_front();
+    }
+}
+
+/**
+ * Turn the timestamps of completed frames into GPU frame times.
+ */
+static void
+completeFrameTimestamps(bool drain) {
+    while (!frameTimestamps.empty()) {
+        GLuint &query = frameTimestamps.front();
+        if (!drain && frameTimestamps.size() <= MAX_PENDING_FRAMES) {
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                break;
+            }
+        }
+
+        GLint64 timestamp = 0;
+        glGetQueryObjecti64v(query, GL_QUERY_RESULT, &timestamp);
+        if (lastFrameTimestamp) {
+            retrace::frameStats.addGpuTime((timestamp - lastFrameTimestamp) * 1.0E-6);
+        }
+        lastFrameTimestamp = timestamp;
+
+        releaseQuery(query);
+        frameTimestamps.pop_front();
     }
+}
 
-    callQueries.clear();
+void
+flushQueries() {
+    completeQueries(true);
+    completeFrameTimestamps(true);
 }
 
+
 void
 beginProfile(trace::Call &call, bool isDraw) {
     if (retrace::profilingWithBackends) {
@@ -285,7 +421,7 @@ beginProfile(trace::Call &call, bool isDraw) {
                 Context *currentContext = getCurrentContext();
                 GLuint program = currentContext ? currentContext->currentUserProgram : 0;
                 unsigned eventId = profilingBoundariesIndex[QUERY_BOUNDARY_CALL]++;
-                ProfilerCall::data callData = {false,
+                MetricWriter::CallData callData = {false,
                                                call.no,
                                                program,
                                                call.sig->name};
@@ -302,27 +438,38 @@ beginProfile(trace::Call &call, bool isDraw) {
     }
 
     glretrace::Context *currentContext = glretrace::getCurrentContext();
+    GLuint program = currentContext ? currentContext->currentUserProgram : 0;
+
+    /* Leave the calls not sampled alone, only counting them */
+    if (retrace::callSampler.enabled()) {
+        profilingCall = retrace::callSampler.sample(call, program, isDraw);
+        if (!profilingCall) {
+            return;
+        }
+    }
 
     /* Create call query */
-    CallQuery query;
+    CallQuery query = {};
     query.isDraw = isDraw;
     query.call = call.no;
+    query.thread = call.thread_id;
     query.sig = call.sig;
-    query.program = currentContext ? currentContext->currentUserProgram : 0;
-
-    glGenQueries(NUM_QUERIES, query.ids);
+    query.program = program;
 
     /* GPU profiling only for draw calls */
     if (isDraw) {
         if (retrace::profilingGpuTimes) {
             if (supportsTimestamp) {
+                query.ids[GPU_START] = allocQuery(currentContext);
                 glQueryCounter(query.ids[GPU_START], GL_TIMESTAMP);
             }
 
+            query.ids[GPU_DURATION] = allocQuery(currentContext);
             glBeginQuery(GL_TIME_ELAPSED, query.ids[GPU_DURATION]);
         }
 
         if (retrace::profilingPixelsDrawn) {
+            query.ids[OCCLUSION] = allocQuery(currentContext);
             glBeginQuery(GL_SAMPLES_PASSED, query.ids[OCCLUSION]);
         }
     }
@@ -354,6 +501,10 @@ endProfile(trace::Call &call, bool isDraw) {
         return;
     }
 
+    if (!profilingCall) {
+        return;
+    }
+
     /* CPU profiling for all calls */
     if (retrace::profilingCpuTimes) {
         CallQuery& query = callQueries.back();
@@ -512,6 +663,11 @@ initContext() {
             GLint64 currentTime = getCurrentTime() * cpuTimeScale;
             retrace::profiler.setBaseCpuTime(currentTime);
             retrace::profiler.setBaseGpuTime(currentTime);
+
+            /* The GPU clock is not necessarily the system one, so record the
+             * system time too for lining up with other traces */
+            int64_t systemTime = os::getTime();
+            retrace::profiler.setTimeBase(systemTime * (1.0E9 / os::timeFrequency));
         }
     }
 
@@ -526,13 +682,23 @@ initContext() {
 
 void
 frame_complete(trace::Call &call) {
+    if (retrace::recordFrameStats && supportsTimestamp) {
+        Context *currentContext = getCurrentContext();
+        if (currentContext) {
+            GLuint query = allocQuery(currentContext);
+            glQueryCounter(query, GL_TIMESTAMP);
+            frameTimestamps.push_back(query);
+            completeFrameTimestamps(false);
+        }
+    }
+
     if (retrace::profilingWithBackends) {
         if (profilingBoundaries[QUERY_BOUNDARY_CALL] ||
             profilingBoundaries[QUERY_BOUNDARY_DRAWCALL])
         {
             if (isLastPass() && curMetricBackend) {
                 // frame end indicator
-                ProfilerCall::data callData = {true, 0, 0, ""};
+                MetricWriter::CallData callData = {true, 0, 0, ""};
                 if (profilingBoundaries[QUERY_BOUNDARY_CALL]) {
                     profiler().addQuery(QUERY_BOUNDARY_CALL, 0, &callData);
                 }
@@ -550,13 +716,19 @@ frame_complete(trace::Call &call) {
                         profilingBoundariesIndex[QUERY_BOUNDARY_FRAME]++);
             }
         }
+        if (isLastPass() && curMetricBackend) {
+            profiler().flush();
+        }
     }
     else if (retrace::profiling) {
-        /* Complete any remaining queries */
-        flushQueries();
-
-        /* Indicate end of current frame */
-        retrace::profiler.addFrameEnd();
+        /* Indicate end of current frame, once its calls are reported */
+        CallQuery frameEnd = {};
+        frameEnd.frameEnd = true;
+        callQueries.push_back(frameEnd);
+        ++pendingFrames;
+
+        /* Report the queries that completed meanwhile */
+        completeQueries(false);
     }
 
     retrace::frameComplete(call);
@@ -825,6 +997,31 @@ public:
         return glstate::getDrawBufferImage(n, backBuffer);
     }
 
+    void
+    getSnapshotAsync(int n, bool backBuffer, SnapshotCallback callback) override {
+        if (!glretrace::getCurrentContext()) {
+            callback(NULL);
+            return;
+        }
+        glstate::getDrawBufferImageAsync(n, backBuffer, callback);
+    }
+
+    void
+    getSnapshotDigestAsync(int n, bool backBuffer, SnapshotDigestCallback callback) override {
+        if (!glretrace::getCurrentContext()) {
+            callback(NULL);
+            return;
+        }
+        glstate::getDrawBufferDigestAsync(n, backBuffer, callback);
+    }
+
+    void
+    flushSnapshots(void) override {
+        if (glretrace::getCurrentContext()) {
+            glstate::flushDrawBufferImages();
+        }
+    }
+
     bool
     canDump(void) override {
         glretrace::Context *currentContext = glretrace::getCurrentContext();
@@ -840,6 +1037,28 @@ public:
     dumpState(StateWriter &writer) override {
         glstate::dumpCurrentContext(writer);
     }
+
+    void
+    trackCall(trace::Call &call) override {
+        glretrace::Context *currentContext = glretrace::getCurrentContext();
+        if (currentContext && currentContext->insideBeginEnd) {
+            // Can't write textures, nor query GL
+            return;
+        }
+
+        // Number contexts in the order they're first made current, so that
+        // fingerprints are the same across retraces of the same trace
+        static std::atomic<unsigned> contextCount(0);
+        unsigned context = 0;
+        if (currentContext) {
+            if (!currentContext->serial) {
+                currentContext->serial = ++contextCount;
+            }
+            context = currentContext->serial;
+        }
+
+        glstate::trackTextureWrites(call, context);
+    }
 };
 
 static GLDumper glDumper;
@@ -875,6 +1094,7 @@ retrace::flushRendering(void) {
     glretrace::Context *currentContext = glretrace::getCurrentContext();
     if (currentContext) {
         glretrace::flushQueries();
+        glstate::flushDrawBufferImages();
         if (currentContext->needsFlush) {
             glFlush();
             currentContext->needsFlush = false;
@@ -906,15 +1126,7 @@ retrace::finishRendering(void) {
         }
 
         if (glretrace::isLastPass()) {
-            if (glretrace::profilingBoundaries[QUERY_BOUNDARY_FRAME]) {
-                glretrace::profiler().writeAll(QUERY_BOUNDARY_FRAME);
-            }
-            if (glretrace::profilingBoundaries[QUERY_BOUNDARY_CALL]) {
-                glretrace::profiler().writeAll(QUERY_BOUNDARY_CALL);
-            }
-            if (glretrace::profilingBoundaries[QUERY_BOUNDARY_DRAWCALL]) {
-                glretrace::profiler().writeAll(QUERY_BOUNDARY_DRAWCALL);
-            }
+            glretrace::profiler().finish();
         }
     }
 }
@@ -181,6 +181,11 @@ makeCurrent(trace::Call &call, glws::Drawable *drawable,
 
     flushQueries();
 
+    // Pending snapshot read backs belong to the current context
+    if (currentContext) {
+        retrace::dumper->flushSnapshots();
+    }
+
     beforeContextSwitch();
 
     bool success = glws::makeCurrent(drawable, readable, context ? context->wsContext : NULL);
@@ -26,7 +26,9 @@
 #pragma once
 
 
+#include <functional>
 #include <ostream>
+#include <string>
 
 #include "glimports.hpp"
 
@@ -40,6 +42,10 @@ namespace image {
     class Image;
 }
 
+namespace trace {
+    class Call;
+}
+
 class StateWriter;
 
 
@@ -70,6 +76,48 @@ getDrawBufferImageCount(void);
 image::Image *
 getDrawBufferImage(int n, bool backBuffer);
 
+typedef std::function<void (image::Image *)> ImageCallback;
+
+/**
+ * Like getDrawBufferImage, but the read back may complete later, through a
+ * pixel pack buffer.  Callbacks are invoked in request order, and take
+ * ownership of the image, which is NULL on failure.
+ */
+void
+getDrawBufferImageAsync(int n, bool backBuffer, ImageCallback callback);
+
+typedef std::function<void (const char *digest)> DigestCallback;
+
+/**
+ * Like getDrawBufferImageAsync, but only computes the MD5 digest of the
+ * pixels, straight from the mapped pixel pack buffer.
+ */
+void
+getDrawBufferDigestAsync(int n, bool backBuffer, DigestCallback callback);
+
+/**
+ * Complete all pending getDrawBuffer*Async requests.  Must be called
+ * before the current context changes.
+ */
+void
+flushDrawBufferImages(void);
+
+/**
+ * Note which textures the call just retraced may have written, so that
+ * incremental state dumps can skip reading back unchanged ones.  Must be
+ * called for every call from the start.  context identifies the current
+ * context, or is 0 when none is.
+ */
+void
+trackTextureWrites(trace::Call &call, unsigned context);
+
+/**
+ * Identify the texture's contents by the current context and the last call
+ * which may have written it.  Empty when writes aren't tracked.
+ */
+std::string
+getTextureWriteFingerprint(GLuint texture);
+
 
 } /* namespace glstate */
 
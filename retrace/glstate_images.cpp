@@ -28,12 +28,16 @@
 #include <string.h>
 
 #include <algorithm>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <memory>
 #include <sstream>
 #include <vector>
 
 #include "image.hpp"
 #include "state_writer.hpp"
+#include "thread_pool.hpp"
 #include "retrace.hpp"
 #include "glproc.hpp"
 #include "glsize.hpp"
@@ -690,9 +694,206 @@ exit_clean:
     return;
 }
 
+/*
+ * Images read back for a state dump, but not written yet.
+ *
+ * Readbacks are issued into pixel pack buffers where possible, so that the
+ * GL thread doesn't stall on each one.  On flush the buffers are mapped in
+ * order, and the images encoded on worker threads while the following ones
+ * are still being mapped or written.  Images are always written in the order
+ * they were added, so the output doesn't depend on the timing.
+ */
+
+// Flush early instead of holding more images than this in memory
+#define MAX_PENDING_IMAGE_BYTES (256 * 1024 * 1024)
+
+
+// Shared by all dumps, rather than starting threads for every one
+static ThreadPool &
+getEncodePool(void)
+{
+    static ThreadPool *pool = new ThreadPool(std::max(std::thread::hardware_concurrency(), 1U));
+    return *pool;
+}
+
+class ImageQueue
+{
+private:
+    struct Entry {
+        std::string label;
+        image::Image *image;  // null if unchanged
+        unsigned width;
+        unsigned height;
+        StateWriter::ImageDesc desc;
+        GLuint buffer;
+        std::future<std::string> data;
+    };
+
+    StateWriter &writer;
+    bool pixelBuffers;
+
+    std::vector<Entry> entries;
+    GLuint pendingBuffer = 0;
+    size_t pendingBytes = 0;
+
+    void
+    encode(Entry &entry) {
+        // Don't bother encoding images which incremental dumps won't write
+        if (writer.isUnchangedImage(entry.label, entry.image, entry.desc)) {
+            entry.width = entry.image->width;
+            entry.height = entry.image->height;
+            delete entry.image;
+            entry.image = nullptr;
+            return;
+        }
+
+        const image::Image *image = entry.image;
+        auto task = std::make_shared<std::packaged_task<std::string()>>(
+            [this, image] { return writer.encodeImage(image); });
+        entry.data = task->get_future();
+        getEncodePool().enqueue([task] { (*task)(); });
+    }
+
+    void
+    mapBuffer(Entry &entry) {
+        image::Image *image = entry.image;
+
+        GLint pack_buffer = 0;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, entry.buffer);
+        const void *map = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, image->sizeInBytes(), GL_MAP_READ_BIT);
+        if (map) {
+            memcpy(image->pixels, map, image->sizeInBytes());
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        } else {
+            std::cerr << "warning: failed to map pixel pack buffer\n";
+            memset(image->pixels, 0, image->sizeInBytes());
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+
+        glDeleteBuffers(1, &entry.buffer);
+        entry.buffer = 0;
+    }
+
+public:
+    ImageQueue(StateWriter &_writer, const Context &context) :
+        writer(_writer),
+        pixelBuffers(context.pixel_buffer_object && context.map_buffer_range)
+    {
+    }
+
+    ~ImageQueue() {
+        assert(entries.empty());
+        assert(!pendingBuffer);
+    }
+
+    /**
+     * Bind a pixel pack buffer for reading back the image, and return the
+     * pointer to read it into.  It must be called with the pixel pack state
+     * reset (i.e., within a PixelPackState's scope), and followed by add or
+     * discard.
+     */
+    GLvoid *
+    beginReadback(image::Image *image) {
+        assert(!pendingBuffer);
+        if (!pixelBuffers) {
+            return image->pixels;
+        }
+
+        glGenBuffers(1, &pendingBuffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pendingBuffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, image->sizeInBytes(), NULL, GL_STREAM_READ);
+        return NULL;
+    }
+
+    /**
+     * Queue the image to be written as the given member, taking ownership of
+     * it.
+     */
+    void
+    add(const std::string &label, image::Image *image, const StateWriter::ImageDesc &desc) {
+        entries.emplace_back();
+        Entry &entry = entries.back();
+        entry.label = label;
+        entry.image = image;
+        entry.desc = desc;
+        entry.buffer = pendingBuffer;
+        pendingBuffer = 0;
+
+        // Images read straight into memory can be encoded right away
+        if (!entry.buffer) {
+            encode(entry);
+        }
+
+        pendingBytes += entry.image ? entry.image->sizeInBytes() : 0;
+        if (pendingBytes > MAX_PENDING_IMAGE_BYTES) {
+            flush();
+        }
+    }
+
+    /**
+     * Whether the image about to be added as the given member matches the
+     * previous incremental dump's, in which case it should be added with
+     * addUnchanged instead of being read back.
+     */
+    bool
+    isUnchanged(const std::string &label, const std::string &fingerprint) {
+        return writer.isUnchanged(label, fingerprint);
+    }
+
+    void
+    addUnchanged(const std::string &label, unsigned width, unsigned height,
+                 const StateWriter::ImageDesc &desc) {
+        assert(!pendingBuffer);
+        entries.emplace_back();
+        Entry &entry = entries.back();
+        entry.label = label;
+        entry.image = nullptr;
+        entry.width = width;
+        entry.height = height;
+        entry.desc = desc;
+        entry.buffer = 0;
+    }
+
+    void
+    discard(image::Image *image) {
+        if (pendingBuffer) {
+            glDeleteBuffers(1, &pendingBuffer);
+            pendingBuffer = 0;
+        }
+        delete image;
+    }
+
+    void
+    flush(void) {
+        for (auto & entry : entries) {
+            if (entry.buffer) {
+                mapBuffer(entry);
+                encode(entry);
+            }
+        }
+
+        for (auto & entry : entries) {
+            writer.beginMember(entry.label);
+            if (entry.image) {
+                std::string data = entry.data.get();
+                writer.writeEncodedImage(entry.image, entry.desc, data);
+            } else {
+                writer.writeUnchangedImage(entry.width, entry.height, entry.desc);
+            }
+            writer.endMember();
+            delete entry.image;
+        }
+
+        entries.clear();
+        pendingBytes = 0;
+    }
+};
+
+
 static inline void
-dumpActiveTextureLevel(StateWriter &writer, Context &context,
-                       GLenum target, GLint level,
+dumpActiveTextureLevel(ImageQueue &queue, Context &context,
+                       GLuint texture, GLenum target, GLint level,
                        const std::string & label,
                        const char *userLabel)
 {
@@ -723,8 +924,6 @@ dumpActiveTextureLevel(StateWriter &writer, Context &context,
         chooseReadBackFormat(formatDesc, format, type);
     }
 
-    writer.beginMember(label);
-
     if (context.ES && format == GL_DEPTH_COMPONENT) {
         format = GL_RED;
     }
@@ -741,6 +940,36 @@ dumpActiveTextureLevel(StateWriter &writer, Context &context,
                   << "channels: " << channels << ", channelType: " << channelType << std::endl;
     }
 
+    StateWriter::ImageDesc imageDesc;
+    imageDesc.depth = desc.depth;
+    imageDesc.format = formatToString(desc.internalFormat);
+
+    // Texture buffers can be written through their buffer object, which
+    // isn't tracked
+    std::string writes;
+    if (target != GL_TEXTURE_BUFFER) {
+        writes = getTextureWriteFingerprint(texture);
+    }
+    if (!writes.empty()) {
+        bool unresolved = multiSample && !retrace::resolveMSAA;
+        GLuint samples = std::max(desc.samples, 1);
+
+        std::stringstream fingerprint;
+        fingerprint << writes << ", " << enumToString(target) << ", level " << level
+                    << ", " << desc.width << "x" << desc.height << "x" << desc.depth
+                    << ", " << imageDesc.format << ", " << enumToString(format)
+                    << ", " << enumToString(type) << ", samples " << samples
+                    << (unresolved ? " unresolved" : "")
+                    << ", label " << (userLabel ? userLabel : "");
+
+        if (queue.isUnchanged(label, fingerprint.str())) {
+            unsigned height = unresolved ? desc.height * samples
+                                         : desc.height * desc.depth;
+            queue.addUnchanged(label, desc.width, height, imageDesc);
+            return;
+        }
+    }
+
     image::Image *image;
     PixelPackState pps(context);
 
@@ -790,7 +1019,7 @@ dumpActiveTextureLevel(StateWriter &writer, Context &context,
         if (context.ES) {
             getTexImageOES(target, level, format, type, desc, image->pixels);
         } else {
-            glGetTexImage(target, level, format, type, image->pixels);
+            glGetTexImage(target, level, format, type, queue.beginReadback(image));
         }
     }
 
@@ -798,19 +1027,12 @@ dumpActiveTextureLevel(StateWriter &writer, Context &context,
         image->label = userLabel;
     }
 
-    StateWriter::ImageDesc imageDesc;
-    imageDesc.depth = desc.depth;
-    imageDesc.format = formatToString(desc.internalFormat);
-    writer.writeImage(image, imageDesc);
-
-    delete image;
-
-    writer.endMember(); // label
+    queue.add(label, image, imageDesc);
 }
 
 
 static inline void
-dumpActiveTexture(StateWriter &writer, Context &context, GLenum target, GLuint texture)
+dumpActiveTexture(ImageQueue &queue, Context &context, GLenum target, GLuint texture)
 {
     char *object_label = getObjectLabel(context, GL_TEXTURE, texture);
 
@@ -848,7 +1070,7 @@ dumpActiveTexture(StateWriter &writer, Context &context, GLenum target, GLuint t
             if (!getActiveTextureLevelDesc(context, subtarget, level, desc)) {
                 goto finished;
             }
-            dumpActiveTextureLevel(writer, context, subtarget, level, label.str(), object_label);
+            dumpActiveTextureLevel(queue, context, texture, subtarget, level, label.str(), object_label);
         }
 
         if (!allowMipmaps) {
@@ -864,7 +1086,7 @@ finished:
 }
 
 static void
-dumpTextureImages(StateWriter &writer, Context &context)
+dumpTextureImages(ImageQueue &queue, Context &context)
 {
     if (!context.ARB_shader_image_load_store) {
         return;
@@ -898,7 +1120,7 @@ dumpTextureImages(StateWriter &writer, Context &context)
 
             glBindTexture(target, texture);
             char *object_label = getObjectLabel(context, GL_TEXTURE, texture);
-            dumpActiveTextureLevel(writer, context, target, level, label.str(),
+            dumpActiveTextureLevel(queue, context, texture, target, level, label.str(),
                                    object_label);
             free(object_label);
             glBindTexture(target, previousTexture);
@@ -933,6 +1155,8 @@ dumpTextures(StateWriter &writer, Context &context)
     GLint active_texture = GL_TEXTURE0;
     glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
 
+    ImageQueue queue(writer, context);
+
     for (GLint unit = 0; unit < max_units; ++unit) {
         GLenum texture = GL_TEXTURE0 + unit;
         glActiveTexture(texture);
@@ -958,14 +1182,16 @@ dumpTextures(StateWriter &writer, Context &context)
             }
 
             if (enabled || texture) {
-                dumpActiveTexture(writer, context, target, texture);
+                dumpActiveTexture(queue, context, target, texture);
             }
         }
     }
 
     glActiveTexture(active_texture);
 
-    dumpTextureImages(writer, context);
+    dumpTextureImages(queue, context);
+
+    queue.flush();
 
     writer.endObject();
     writer.endMember(); // textures
@@ -1241,17 +1467,32 @@ getDrawBufferImageCount()
 }
 
 
-image::Image *
-getDrawBufferImage(int n, bool backBuffer)
+/**
+ * Where and how to read back a draw buffer.
+ */
+struct DrawBufferReadback
 {
-    Context context;
-
+    GLint draw_framebuffer = 0;
+    GLint draw_buffer = GL_NONE;
     GLenum format = GL_RGB;
     GLenum type = GL_UNSIGNED_BYTE;
+    GLint channels = 0;
+    image::ChannelType channelType = image::TYPE_UNORM8;
+    ImageDesc desc;
+
+    // Size of the draw buffer, when desc is smaller and it must be downscaled
+    GLint src_width = 0;
+    GLint src_height = 0;
+};
+
+
+static bool
+getDrawBufferReadback(Context &context, int n, bool backBuffer, DrawBufferReadback &rb)
+{
     if (context.ES) {
-        format = GL_RGBA;
+        rb.format = GL_RGBA;
         if (n < 0 && !context.NV_read_depth_stencil) {
-            return nullptr;
+            return false;
         }
     }
 
@@ -1264,44 +1505,41 @@ getDrawBufferImage(int n, bool backBuffer)
         framebuffer_binding = GL_FRAMEBUFFER_BINDING;
         framebuffer_target = GL_FRAMEBUFFER;
     }
-    GLint draw_framebuffer = 0;
     if (context.framebuffer_object && !backBuffer) {
-        glGetIntegerv(framebuffer_binding, &draw_framebuffer);
+        glGetIntegerv(framebuffer_binding, &rb.draw_framebuffer);
     }
 
     /*
      * TODO: Use alpha for non-FBOs once we are able to match the traced
      * visuals.
      */
-    if (draw_framebuffer) {
-        format = GL_RGBA;
+    if (rb.draw_framebuffer) {
+        rb.format = GL_RGBA;
     }
 
     if (n == -2) {
         /* read stencil */
-        format = GL_STENCIL_INDEX;
+        rb.format = GL_STENCIL_INDEX;
         n = 0;
     } else if (n == -1) {
         /* read depth */
-        format = GL_DEPTH_COMPONENT;
+        rb.format = GL_DEPTH_COMPONENT;
         n = 0;
     }
 
-    GLint draw_buffer = GL_NONE;
-    ImageDesc desc;
-    if (draw_framebuffer && !backBuffer) {
+    if (rb.draw_framebuffer && !backBuffer) {
         if (context.ARB_draw_buffers) {
-            glGetIntegerv(GL_DRAW_BUFFER0 + n, &draw_buffer);
-            if (draw_buffer == GL_NONE) {
-                return NULL;
+            glGetIntegerv(GL_DRAW_BUFFER0 + n, &rb.draw_buffer);
+            if (rb.draw_buffer == GL_NONE) {
+                return false;
             }
         } else {
             // GL_COLOR_ATTACHMENT0 is implied
-            draw_buffer = GL_COLOR_ATTACHMENT0 + n;
+            rb.draw_buffer = GL_COLOR_ATTACHMENT0 + n;
         }
 
-        if (!getFramebufferAttachmentDesc(context, framebuffer_target, draw_buffer, desc)) {
-            return NULL;
+        if (!getFramebufferAttachmentDesc(context, framebuffer_target, rb.draw_buffer, rb.desc)) {
+            return false;
         }
     } else if (n == 0) {
         if (context.ES || backBuffer) {
@@ -1309,59 +1547,258 @@ getDrawBufferImage(int n, bool backBuffer)
             // for double buffered contexts. There is no way to know which (as
             // GL_DOUBLEBUFFER state is also unavailable), so always assume
             // double-buffering.
-            draw_buffer = GL_BACK;
+            rb.draw_buffer = GL_BACK;
         } else {
-            glGetIntegerv(GL_DRAW_BUFFER, &draw_buffer);
-            if (draw_buffer == GL_NONE) {
-                return NULL;
+            glGetIntegerv(GL_DRAW_BUFFER, &rb.draw_buffer);
+            if (rb.draw_buffer == GL_NONE) {
+                return false;
             }
         }
 
-        if (!getDrawableBounds(&desc.width, &desc.height)) {
-            return NULL;
+        if (!getDrawableBounds(&rb.desc.width, &rb.desc.height)) {
+            return false;
         }
 
-        desc.depth = 1;
+        rb.desc.depth = 1;
     } else {
-        return NULL;
+        return false;
     }
 
-    GLint channels = _gl_format_channels(format);
-    if (channels > 4) {
-        return NULL;
+    rb.channels = _gl_format_channels(rb.format);
+    if (rb.channels > 4) {
+        return false;
     }
 
-    image::ChannelType channelType = image::TYPE_UNORM8;
+    if (rb.format == GL_DEPTH_COMPONENT) {
+        rb.type = GL_FLOAT;
+        rb.channels = 1;
+        rb.channelType = image::TYPE_FLOAT;
+    }
+
+    GLint maxSize = retrace::snapshotMaxSize;
+    if (maxSize > 0 &&
+        (rb.desc.width > maxSize || rb.desc.height > maxSize) &&
+        rb.channelType == image::TYPE_UNORM8 &&
+        rb.format != GL_STENCIL_INDEX &&
+        context.read_framebuffer_object) {
+        // Integer buffers can't be blitted with linear filtering
+        GLint component_type = GL_UNSIGNED_NORMALIZED;
+        if (rb.draw_framebuffer) {
+            glGetFramebufferAttachmentParameteriv(framebuffer_target, rb.draw_buffer,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_COMPONENT_TYPE,
+                                                  &component_type);
+        }
+        if (component_type != GL_INT && component_type != GL_UNSIGNED_INT) {
+            rb.src_width = rb.desc.width;
+            rb.src_height = rb.desc.height;
+            if (rb.desc.width >= rb.desc.height) {
+                rb.desc.width = maxSize;
+                rb.desc.height = std::max<GLint>((long long)rb.src_height * maxSize / rb.src_width, 1);
+            } else {
+                rb.desc.width = std::max<GLint>((long long)rb.src_width * maxSize / rb.src_height, 1);
+                rb.desc.height = maxSize;
+            }
+        }
+    }
 
-    if (format == GL_DEPTH_COMPONENT) {
-        type = GL_FLOAT;
-        channels = 1;
-        channelType = image::TYPE_FLOAT;
+    return true;
+}
+
+
+/**
+ * Create a renderbuffer of the given format and size, attach it to the bound
+ * draw framebuffer, and blit the bound read framebuffer into it.
+ */
+static GLuint
+blitToRenderbuffer(GLenum attachment, GLenum internalFormat,
+                   GLint srcWidth, GLint srcHeight,
+                   GLint dstWidth, GLint dstHeight,
+                   GLbitfield mask, GLenum filter)
+{
+    GLuint renderbuffer = 0;
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, dstWidth, dstHeight);
+    glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, attachment,
+                              GL_RENDERBUFFER, renderbuffer);
+
+    glBlitFramebuffer(0, 0, srcWidth, srcHeight, 0, 0, dstWidth, dstHeight,
+                      mask, filter);
+    return renderbuffer;
+}
+
+
+/**
+ * Scale the draw buffer bound for reading down to rb.desc's size on the GPU,
+ * so that only the reduced image needs to be read back.
+ *
+ * It's halved with linear blits, which amount to a box filter, until within
+ * a factor of two of the final size, to avoid the aliasing of a single blit.
+ * The result is left bound for reading, and the temporary objects are
+ * appended to framebuffers and renderbuffers.  Returns false if the blits
+ * failed, in which case the image must be downscaled on the CPU instead.
+ */
+static bool
+downscaleDrawBuffer(const DrawBufferReadback &rb,
+                    std::vector<GLuint> &framebuffers,
+                    std::vector<GLuint> &renderbuffers)
+{
+    GLint draw_framebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_framebuffer);
+    GLint bound_renderbuffer = 0;
+    glGetIntegerv(GL_RENDERBUFFER_BINDING, &bound_renderbuffer);
+
+    GLboolean scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+    if (scissor_test) {
+        glDisable(GL_SCISSOR_TEST);
     }
 
-    image::Image *image = new image::Image(desc.width, desc.height, channels, true, channelType);
-    if (!image) {
-        return NULL;
+    // Multisample buffers can only be blitted without scaling
+    GLint samples = 0;
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, rb.draw_framebuffer);
+    glGetIntegerv(GL_SAMPLES, &samples);
+
+    GLint width = rb.src_width;
+    GLint height = rb.src_height;
+    do {
+        GLint dst_width = width;
+        GLint dst_height = height;
+        if (samples == 0) {
+            dst_width = std::max(width / 2, rb.desc.width);
+            dst_height = std::max(height / 2, rb.desc.height);
+            if (dst_width < rb.desc.width * 2 &&
+                dst_height < rb.desc.height * 2) {
+                dst_width = rb.desc.width;
+                dst_height = rb.desc.height;
+            }
+        }
+        samples = 0;
+
+        GLuint framebuffer = 0;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        framebuffers.push_back(framebuffer);
+
+        renderbuffers.push_back(
+            blitToRenderbuffer(GL_COLOR_ATTACHMENT0, GL_RGBA8,
+                               width, height, dst_width, dst_height,
+                               GL_COLOR_BUFFER_BIT, GL_LINEAR));
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        width = dst_width;
+        height = dst_height;
+    } while (width != rb.desc.width || height != rb.desc.height);
+
+    // E.g., formats which can't be blitted with linear filtering
+    bool succeeded = true;
+    while (glGetError() != GL_NO_ERROR) {
+        succeeded = false;
     }
 
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, draw_framebuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, bound_renderbuffer);
+
+    if (scissor_test) {
+        glEnable(GL_SCISSOR_TEST);
+    }
+
+    return succeeded;
+}
+
+
+/**
+ * Read the whole draw buffer bound for reading and downscale it to
+ * rb.desc's size on the CPU, for when downscaleDrawBuffer fails.
+ */
+static void
+readDrawBufferDownscaled(const DrawBufferReadback &rb, GLvoid *pixels, GLuint pack_buffer)
+{
+    image::Image full(rb.src_width, rb.src_height, rb.channels);
+    glReadPixels(0, 0, rb.src_width, rb.src_height, rb.format, rb.type, full.pixels);
+
+    // Rows stay in the order GL returned them
+    image::Image *thumb = image::thumbnail(full, std::max(rb.desc.width, rb.desc.height));
+    assert(thumb->width == (unsigned)rb.desc.width);
+    assert(thumb->height == (unsigned)rb.desc.height);
+
+    size_t numPixels = (size_t)rb.desc.width * rb.desc.height;
+    std::vector<unsigned char> data(numPixels * rb.channels);
+    for (size_t i = 0; i < numPixels; ++i) {
+        const unsigned char *src = thumb->pixels + i*4;
+        unsigned char *dst = &data[i * rb.channels];
+        if (rb.channels <= 2) {
+            // thumbnail expands luminance (alpha) to RGBA
+            dst[0] = src[0];
+            if (rb.channels == 2) {
+                dst[1] = src[3];
+            }
+        } else {
+            memcpy(dst, src, rb.channels);
+        }
+    }
+    delete thumb;
+
+    if (pack_buffer) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+        glBufferSubData(GL_PIXEL_PACK_BUFFER, (GLintptr)pixels, data.size(), data.data());
+    } else {
+        memcpy(pixels, data.data(), data.size());
+    }
+}
+
+
+/**
+ * Read the draw buffer into pixels, which is either client memory or an
+ * offset into the currently bound pixel pack buffer.
+ */
+static bool
+readDrawBuffer(Context &context, const DrawBufferReadback &rb, GLvoid *pixels, GLuint pack_buffer = 0)
+{
     flushErrors();
 
     GLint read_framebuffer = 0;
     GLint read_buffer = GL_NONE;
     if (context.read_framebuffer_object) {
         glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_framebuffer);
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, draw_framebuffer);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, rb.draw_framebuffer);
     }
 
     if (context.read_buffer) {
         glGetIntegerv(GL_READ_BUFFER, &read_buffer);
-        glReadBuffer(draw_buffer);
+        glReadBuffer(rb.draw_buffer);
+    }
+
+    std::vector<GLuint> framebuffers;
+    std::vector<GLuint> renderbuffers;
+    bool downscaleOnCPU = false;
+    if (rb.src_width &&
+        !downscaleDrawBuffer(rb, framebuffers, renderbuffers)) {
+        static bool warned = false;
+        if (!warned) {
+            std::cerr << "warning: failed to downscale snapshots on the GPU, doing it on the CPU\n";
+            warned = true;
+        }
+        downscaleOnCPU = true;
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, rb.draw_framebuffer);
     }
 
     {
         // TODO: reset imaging state too
         PixelPackState pps(context);
-        glReadPixels(0, 0, desc.width, desc.height, format, type, image->pixels);
+        if (downscaleOnCPU) {
+            readDrawBufferDownscaled(rb, pixels, pack_buffer);
+        } else {
+            if (pack_buffer) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+            }
+            glReadPixels(0, 0, rb.desc.width, rb.desc.height, rb.format, rb.type, pixels);
+        }
+    }
+
+    if (!framebuffers.empty()) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, rb.draw_framebuffer);
+        glDeleteFramebuffers(framebuffers.size(), framebuffers.data());
+        glDeleteRenderbuffers(renderbuffers.size(), renderbuffers.data());
     }
 
 
@@ -1378,7 +1815,30 @@ getDrawBufferImage(int n, bool backBuffer)
             std::cerr << "warning: " << enumToString(error) << " while getting snapshot\n";
             error = glGetError();
         } while(error != GL_NO_ERROR);
-        delete image;
+        return false;
+    }
+
+    return true;
+}
+
+
+image::Image *
+getDrawBufferImage(int n, bool backBuffer)
+{
+    Context context;
+
+    DrawBufferReadback rb;
+    if (!getDrawBufferReadback(context, n, backBuffer, rb)) {
+        return NULL;
+    }
+
+    image::Image *image = image::acquireImage(rb.desc.width, rb.desc.height, rb.channels, true, rb.channelType);
+    if (!image) {
+        return NULL;
+    }
+
+    if (!readDrawBuffer(context, rb, image->pixels)) {
+        image::releaseImage(image);
         return NULL;
     }
 
@@ -1386,11 +1846,204 @@ getDrawBufferImage(int n, bool backBuffer)
 }
 
 
+/*
+ * Asynchronous draw buffer readback.
+ *
+ * glReadPixels is issued into a pixel pack buffer followed by a fence, and
+ * the buffer is only mapped once the fence signals, a few snapshots later,
+ * so that the pipeline doesn't stall on every snapshot.
+ */
+
+#define MAX_PENDING_READBACKS 3
+
+struct PendingReadback
+{
+    GLuint buffer = 0;
+    GLsync fence = 0;
+    unsigned width = 0;
+    unsigned height = 0;
+    unsigned channels = 0;
+    image::ChannelType channelType = image::TYPE_UNORM8;
+
+    // Exactly one of these is set
+    ImageCallback callback;
+    DigestCallback digestCallback;
+};
+
+static std::deque<PendingReadback> pendingReadbacks;
+static std::vector<GLuint> freeReadbackBuffers;
+
+
+static void
+completeReadback(PendingReadback &readback)
+{
+    image::Image *image = nullptr;
+    char digest[33];
+    bool success = false;
+
+    if (readback.fence) {
+        glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        glDeleteSync(readback.fence);
+
+        unsigned rowSize = readback.width * readback.channels *
+                           (readback.channelType == image::TYPE_FLOAT ? 4 : 1);
+        GLsizeiptr size = rowSize * readback.height;
+
+        GLint pack_buffer = 0;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const unsigned char *map = (const unsigned char *)
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+        if (map) {
+            if (readback.digestCallback) {
+                // Rows are read back bottom-up
+                image::md5(map + (readback.height - 1) * rowSize, -(signed)rowSize,
+                           rowSize, readback.height, digest);
+            } else {
+                image = image::acquireImage(readback.width, readback.height,
+                                            readback.channels, true, readback.channelType);
+                memcpy(image->pixels, map, size);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            success = true;
+        } else {
+            std::cerr << "warning: failed to map snapshot pixel pack buffer\n";
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+    }
+
+    if (readback.buffer) {
+        freeReadbackBuffers.push_back(readback.buffer);
+    }
+
+    if (readback.digestCallback) {
+        readback.digestCallback(success ? digest : nullptr);
+    } else {
+        readback.callback(image);
+    }
+}
+
+
+static void
+requestReadback(Context &context, int n, bool backBuffer, PendingReadback &readback)
+{
+    // Hand over whatever already finished, oldest first
+    while (!pendingReadbacks.empty()) {
+        PendingReadback &front = pendingReadbacks.front();
+        if (front.fence &&
+            pendingReadbacks.size() < MAX_PENDING_READBACKS) {
+            GLenum status = glClientWaitSync(front.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED &&
+                status != GL_CONDITION_SATISFIED) {
+                break;
+            }
+        }
+        completeReadback(front);
+        pendingReadbacks.pop_front();
+    }
+
+    DrawBufferReadback rb;
+    if (getDrawBufferReadback(context, n, backBuffer, rb)) {
+        readback.width = rb.desc.width;
+        readback.height = rb.desc.height;
+        readback.channels = rb.channels;
+        readback.channelType = rb.channelType;
+
+        GLsizeiptr size = readback.width * readback.height * readback.channels *
+                          (readback.channelType == image::TYPE_FLOAT ? 4 : 1);
+
+        if (freeReadbackBuffers.empty()) {
+            glGenBuffers(1, &readback.buffer);
+        } else {
+            readback.buffer = freeReadbackBuffers.back();
+            freeReadbackBuffers.pop_back();
+        }
+
+        GLint pack_buffer = 0;
+        glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack_buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pack_buffer);
+
+        if (readDrawBuffer(context, rb, NULL, readback.buffer)) {
+            readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+
+    // Even failures are queued, so that callbacks are called in order
+    pendingReadbacks.push_back(std::move(readback));
+}
+
+
+static inline bool
+supportsAsyncReadback(const Context &context)
+{
+    return context.pixel_buffer_object &&
+           context.map_buffer_range &&
+           context.sync;
+}
+
+
+void
+getDrawBufferImageAsync(int n, bool backBuffer, ImageCallback callback)
+{
+    Context context;
+
+    if (!supportsAsyncReadback(context)) {
+        callback(getDrawBufferImage(n, backBuffer));
+        return;
+    }
+
+    PendingReadback readback;
+    readback.callback = callback;
+    requestReadback(context, n, backBuffer, readback);
+}
+
+
+void
+getDrawBufferDigestAsync(int n, bool backBuffer, DigestCallback callback)
+{
+    Context context;
+
+    if (!supportsAsyncReadback(context)) {
+        image::Image *image = getDrawBufferImage(n, backBuffer);
+        if (!image) {
+            callback(nullptr);
+            return;
+        }
+        char digest[33];
+        image::md5(image->start(), image->stride(), image->width*image->bytesPerPixel, image->height, digest);
+        delete image;
+        callback(digest);
+        return;
+    }
+
+    PendingReadback readback;
+    readback.digestCallback = callback;
+    requestReadback(context, n, backBuffer, readback);
+}
+
+
+void
+flushDrawBufferImages(void)
+{
+    while (!pendingReadbacks.empty()) {
+        completeReadback(pendingReadbacks.front());
+        pendingReadbacks.pop_front();
+    }
+
+    if (!freeReadbackBuffers.empty()) {
+        glDeleteBuffers(freeReadbackBuffers.size(), freeReadbackBuffers.data());
+        freeReadbackBuffers.clear();
+    }
+}
+
+
 /**
  * Dump the image of the currently bound read buffer.
  */
 static inline void
-dumpReadBufferImage(StateWriter &writer,
+dumpReadBufferImage(ImageQueue &queue,
                     Context & context,
                     const char *label,
                     const char *userLabel,
@@ -1449,28 +2102,26 @@ dumpReadBufferImage(StateWriter &writer,
         // TODO: reset imaging state too
         PixelPackState pps(context);
 
-        glReadPixels(0, 0, width, height, format, type, image->pixels);
-    }
+        glReadPixels(0, 0, width, height, format, type, queue.beginReadback(image));
 
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        do {
-            std::cerr << "warning: " << enumToString(error) << " while reading framebuffer\n";
-            error = glGetError();
-        } while(error != GL_NO_ERROR);
-    } else {
-        if (userLabel) {
-            image->label = userLabel;
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR) {
+            do {
+                std::cerr << "warning: " << enumToString(error) << " while reading framebuffer\n";
+                error = glGetError();
+            } while(error != GL_NO_ERROR);
+            queue.discard(image);
+            return;
         }
+    }
 
-        StateWriter::ImageDesc imageDesc;
-        imageDesc.format = formatToString(internalFormat);
-        writer.beginMember(label);
-        writer.writeImage(image, imageDesc);
-        writer.endMember();
+    if (userLabel) {
+        image->label = userLabel;
     }
 
-    delete image;
+    StateWriter::ImageDesc imageDesc;
+    imageDesc.format = formatToString(internalFormat);
+    queue.add(label, image, imageDesc);
 }
 
 
@@ -1508,20 +2159,14 @@ downsampledFramebuffer(Context &context,
             glGetFramebufferAttachmentParameteriv(GL_READ_FRAMEBUFFER, colorAtt,
                                                   GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &objType);
             if (objType != GL_NONE) {
-               glGenRenderbuffers(1, &rbs[*numRbs]);
-
-               glBindRenderbuffer(GL_RENDERBUFFER, rbs[*numRbs]);
-               glRenderbufferStorage(GL_RENDERBUFFER, colorDesc.internalFormat, colorDesc.width, colorDesc.height);
-               glFramebufferRenderbuffer(GL_FRAMEBUFFER, colorAtt,
-                                         GL_RENDERBUFFER, rbs[*numRbs]);
-
-               glBindFramebuffer(GL_READ_FRAMEBUFFER, oldFbo);
                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
                glReadBuffer(colorAtt);
                glDrawBuffer(colorAtt);
 
-               glBlitFramebuffer(0, 0, colorDesc.width, colorDesc.height, 0, 0, colorDesc.width, colorDesc.height,
-                                 GL_COLOR_BUFFER_BIT, GL_NEAREST);
+               rbs[*numRbs] = blitToRenderbuffer(colorAtt, colorDesc.internalFormat,
+                                                 colorDesc.width, colorDesc.height,
+                                                 colorDesc.width, colorDesc.height,
+                                                 GL_COLOR_BUFFER_BIT, GL_NEAREST);
                glBindFramebuffer(GL_FRAMEBUFFER, fbo);
                ++*numRbs;
             }
@@ -1533,49 +2178,38 @@ downsampledFramebuffer(Context &context,
     if (stencilDesc == depthDesc &&
         depthDesc.valid()) {
         //combined depth and stencil buffer
-        glGenRenderbuffers(1, &rbs[*numRbs]);
-        glBindRenderbuffer(GL_RENDERBUFFER, rbs[*numRbs]);
-        glRenderbufferStorage(GL_RENDERBUFFER, depthDesc.internalFormat, depthDesc.width, depthDesc.height);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
-                                  GL_RENDERBUFFER, rbs[*numRbs]);
         glBindFramebuffer(GL_READ_FRAMEBUFFER, oldFbo);
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
         glDrawBuffer(drawbuffer);
         glReadBuffer(drawbuffer);
-        glBlitFramebuffer(0, 0, depthDesc.width, depthDesc.height, 0, 0, depthDesc.width, depthDesc.height,
-                          GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+        rbs[*numRbs] = blitToRenderbuffer(GL_DEPTH_STENCIL_ATTACHMENT, depthDesc.internalFormat,
+                                          depthDesc.width, depthDesc.height,
+                                          depthDesc.width, depthDesc.height,
+                                          GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
         ++*numRbs;
     } else {
         if (depthDesc.valid()) {
-            glGenRenderbuffers(1, &rbs[*numRbs]);
-            glBindRenderbuffer(GL_RENDERBUFFER, rbs[*numRbs]);
-            glRenderbufferStorage(GL_RENDERBUFFER, depthDesc.internalFormat, depthDesc.width, depthDesc.height);
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER,
-                                      GL_DEPTH_ATTACHMENT,
-                                      GL_RENDERBUFFER, rbs[*numRbs]);
             glBindFramebuffer(GL_READ_FRAMEBUFFER, oldFbo);
             glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
             glDrawBuffer(drawbuffer);
             glReadBuffer(drawbuffer);
-            glBlitFramebuffer(0, 0, depthDesc.width, depthDesc.height, 0, 0, depthDesc.width, depthDesc.height,
-                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+            rbs[*numRbs] = blitToRenderbuffer(GL_DEPTH_ATTACHMENT, depthDesc.internalFormat,
+                                              depthDesc.width, depthDesc.height,
+                                              depthDesc.width, depthDesc.height,
+                                              GL_DEPTH_BUFFER_BIT, GL_NEAREST);
             glBindFramebuffer(GL_FRAMEBUFFER, fbo);
             ++*numRbs;
         }
         if (stencilDesc.valid()) {
-            glGenRenderbuffers(1, &rbs[*numRbs]);
-            glBindRenderbuffer(GL_RENDERBUFFER, rbs[*numRbs]);
-            glRenderbufferStorage(GL_RENDERBUFFER, stencilDesc.internalFormat, stencilDesc.width, stencilDesc.height);
-            glFramebufferRenderbuffer(GL_FRAMEBUFFER,
-                                      GL_STENCIL_ATTACHMENT,
-                                      GL_RENDERBUFFER, rbs[*numRbs]);
             glBindFramebuffer(GL_READ_FRAMEBUFFER, oldFbo);
             glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo);
             glDrawBuffer(drawbuffer);
             glReadBuffer(drawbuffer);
-            glBlitFramebuffer(0, 0, stencilDesc.width, stencilDesc.height, 0, 0, stencilDesc.width, stencilDesc.height,
-                              GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+            rbs[*numRbs] = blitToRenderbuffer(GL_STENCIL_ATTACHMENT, stencilDesc.internalFormat,
+                                              stencilDesc.width, stencilDesc.height,
+                                              stencilDesc.width, stencilDesc.height,
+                                              GL_STENCIL_BUFFER_BIT, GL_NEAREST);
             glBindFramebuffer(GL_FRAMEBUFFER, fbo);
             ++*numRbs;
         }
@@ -1593,7 +2227,7 @@ downsampledFramebuffer(Context &context,
  * Dump images of current draw drawable/window.
  */
 static void
-dumpDrawableImages(StateWriter &writer, Context &context)
+dumpDrawableImages(ImageQueue &queue, Context &context)
 {
     GLint width, height;
 
@@ -1638,7 +2272,7 @@ dumpDrawableImages(StateWriter &writer, Context &context)
         GLenum format = alpha_bits ? GL_RGBA : GL_RGB;
         GLenum type = GL_UNSIGNED_BYTE;
 
-        dumpReadBufferImage(writer, context, enumToString(draw_buffer), NULL, width, height, format, type);
+        dumpReadBufferImage(queue, context, enumToString(draw_buffer), NULL, width, height, format, type);
 
         // Restore original read buffer
         if (context.read_buffer) {
@@ -1654,7 +2288,7 @@ dumpDrawableImages(StateWriter &writer, Context &context)
             glGetIntegerv(GL_DEPTH_BITS, &depth_bits);
         }
         if (depth_bits) {
-            dumpReadBufferImage(writer, context, "GL_DEPTH_COMPONENT", NULL, width, height, GL_DEPTH_COMPONENT, GL_FLOAT);
+            dumpReadBufferImage(queue, context, "GL_DEPTH_COMPONENT", NULL, width, height, GL_DEPTH_COMPONENT, GL_FLOAT);
         }
 
         GLint stencil_bits = 0;
@@ -1665,7 +2299,7 @@ dumpDrawableImages(StateWriter &writer, Context &context)
         }
         if (stencil_bits) {
             assert(stencil_bits <= 8);
-            dumpReadBufferImage(writer, context, "GL_STENCIL_INDEX", NULL, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE);
+            dumpReadBufferImage(queue, context, "GL_STENCIL_INDEX", NULL, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE);
         }
     }
 
@@ -1684,7 +2318,7 @@ dumpDrawableImages(StateWriter &writer, Context &context)
  * In the case of a color attachment, it assumes it is already bound for read.
  */
 static void
-dumpFramebufferAttachment(StateWriter &writer, Context &context, GLenum target, GLenum attachment)
+dumpFramebufferAttachment(ImageQueue &queue, Context &context, GLenum target, GLenum attachment)
 {
     ImageDesc desc;
     if (!getFramebufferAttachmentDesc(context, target, attachment, desc)) {
@@ -1747,7 +2381,7 @@ dumpFramebufferAttachment(StateWriter &writer, Context &context, GLenum target,
             glGetIntegerv(texture_binding, &bound_texture);
             glBindTexture(texture_target, object_name);
 
-            dumpActiveTextureLevel(writer, context, texture_target, level, label, object_label);
+            dumpActiveTextureLevel(queue, context, object_name, texture_target, level, label, object_label);
 
             glBindTexture(texture_target, bound_texture);
 
@@ -1757,7 +2391,7 @@ dumpFramebufferAttachment(StateWriter &writer, Context &context, GLenum target,
     }
 
 
-    dumpReadBufferImage(writer, context,
+    dumpReadBufferImage(queue, context,
                         label, object_label,
                         desc.width, desc.height,
                         format, type, desc.internalFormat);
@@ -1766,7 +2400,7 @@ dumpFramebufferAttachment(StateWriter &writer, Context &context, GLenum target,
 
 
 static void
-dumpFramebufferAttachments(StateWriter &writer, Context &context, GLenum target)
+dumpFramebufferAttachments(ImageQueue &queue, Context &context, GLenum target)
 {
     GLenum status = glCheckFramebufferStatus(target);
     if (status != GL_FRAMEBUFFER_COMPLETE) {
@@ -1799,15 +2433,15 @@ dumpFramebufferAttachments(StateWriter &writer, Context &context, GLenum target)
                 std::cerr << "warning: unexpected GL_DRAW_BUFFER" << i << " = " << draw_buffer << "\n";
                 attachment = GL_COLOR_ATTACHMENT0;
             }
-            dumpFramebufferAttachment(writer, context, target, attachment);
+            dumpFramebufferAttachment(queue, context, target, attachment);
         }
     }
 
     glReadBuffer(read_buffer);
 
     if (!context.ES || context.NV_read_depth_stencil) {
-        dumpFramebufferAttachment(writer, context, target, GL_DEPTH_ATTACHMENT);
-        dumpFramebufferAttachment(writer, context, target, GL_STENCIL_ATTACHMENT);
+        dumpFramebufferAttachment(queue, context, target, GL_DEPTH_ATTACHMENT);
+        dumpFramebufferAttachment(queue, context, target, GL_STENCIL_ATTACHMENT);
     }
 
     glBindFramebuffer(GL_READ_FRAMEBUFFER, read_framebuffer);
@@ -1823,10 +2457,13 @@ dumpFramebuffer(StateWriter &writer, Context &context)
     GLint boundDrawFbo = 0, boundReadFbo = 0;
     glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &boundDrawFbo);
     glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &boundReadFbo);
+
+    ImageQueue queue(writer, context);
+
     if (!boundDrawFbo) {
-        dumpDrawableImages(writer, context);
+        dumpDrawableImages(queue, context);
     } else if (context.ES) {
-        dumpFramebufferAttachments(writer, context, GL_FRAMEBUFFER);
+        dumpFramebufferAttachments(queue, context, GL_FRAMEBUFFER);
     } else {
         GLint draw_buffer0 = GL_NONE;
         glGetIntegerv(GL_DRAW_BUFFER0, &draw_buffer0);
@@ -1874,7 +2511,7 @@ dumpFramebuffer(StateWriter &writer, Context &context)
             glBindFramebuffer(GL_READ_FRAMEBUFFER, boundDrawFbo);
         }
 
-        dumpFramebufferAttachments(writer, context, GL_READ_FRAMEBUFFER);
+        dumpFramebufferAttachments(queue, context, GL_READ_FRAMEBUFFER);
 
         if (multisample) {
             glBindRenderbuffer(GL_RENDERBUFFER, boundRb);
@@ -1887,6 +2524,8 @@ dumpFramebuffer(StateWriter &writer, Context &context)
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, boundDrawFbo);
     }
 
+    queue.flush();
+
     writer.endObject();
     writer.endMember(); // framebuffer
 }
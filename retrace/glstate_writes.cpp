@@ -0,0 +1,335 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Tracking of the calls which may write texture contents, so that
+ * incremental state dumps can tell that a texture didn't change without
+ * reading it back.
+ *
+ * It errs on the side of caution: calls which write a texture that can't be
+ * identified cheaply (direct state access, copies between images, compute,
+ * image stores, ...) count as writing every texture.  So do all writes once
+ * textures share their storage with others, through views or EGLImages.
+ */
+
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include "trace_model.hpp"
+#include "glproc.hpp"
+#include "glstate.hpp"
+
+
+namespace glstate {
+
+
+enum WriteKind {
+    WRITE_NONE,
+    WRITE_BOUND_TEXTURE,   // the texture bound to the target in the first argument
+    WRITE_DRAW_FRAMEBUFFER,  // the textures attached to the draw framebuffer
+    WRITE_ANY_TEXTURE,
+    BIND_IMAGE_TEXTURE,
+    CHANGE_FRAMEBUFFER,
+    ALIAS_TEXTURE,  // creates a texture view or an EGLImage sibling
+};
+
+
+static std::mutex writesMutex;
+static bool trackingWrites = false;
+
+// Number of the last call which may have written each texture, and any
+static std::map<GLuint, unsigned> textureWrites;
+static unsigned anyTextureWrite = 0;
+
+// Once shaders may store to images, any draw may write any texture
+static bool imageStores = false;
+
+// Once textures may share storage, writing one may write others
+static bool aliasedTextures = false;
+
+// Textures attached to each framebuffer, by context
+static std::map<std::pair<unsigned, GLuint>, std::vector<GLuint>> framebufferTextures;
+
+static thread_local unsigned currentContext = 0;
+
+
+static inline bool
+startsWith(const char *name, const char *prefix)
+{
+    return strncmp(name, prefix, strlen(prefix)) == 0;
+}
+
+
+static bool
+startsWithAny(const char *name, const char * const *prefixes)
+{
+    for (; *prefixes; ++prefixes) {
+        if (startsWith(name, *prefixes)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static WriteKind
+classifyCall(const char *name)
+{
+    static const char * const queries[] = {
+        "glGet", "glIs", "glCheck", "glMake",
+        nullptr
+    };
+    static const char * const boundTextureWrites[] = {
+        "glTexImage", "glTexSubImage", "glTexStorage", "glTexBuffer",
+        "glCompressedTexImage", "glCompressedTexSubImage",
+        "glCopyTexImage", "glCopyTexSubImage",
+        "glGenerateMipmap",
+        nullptr
+    };
+    static const char * const textureStateChanges[] = {
+        "glGenTextures", "glCreateTextures", "glDeleteTextures",
+        "glBindTexture", "glActiveTexture", "glClientActiveTexture", "glTexParameter", "glTextureParameter",
+        "glMultiTexParameter", "glTexEnv", "glMultiTexEnv", "glTexGen",
+        "glMultiTexGen", "glTexCoord", "glMultiTexCoord", "glTexBumpParameter",
+        "glTextureBarrier", "glPrioritizeTextures", "glAreTexturesResident",
+        nullptr
+    };
+    static const char * const clearState[] = {
+        "glClearColor", "glClearDepth", "glClearStencil", "glClearIndex",
+        "glClearAccum",
+        nullptr
+    };
+    static const char * const draws[] = {
+        "glDraw", "glMultiDraw", "glClear", "glBlit", "glCallList", "glRect",
+        "glCopyPixels", "glBitmap", "glAccum", "glEvalMesh", "glEvalPoint",
+        nullptr
+    };
+
+    if (startsWithAny(name, queries)) {
+        return WRITE_NONE;
+    }
+
+    if (startsWith(name, "glBindImageTexture")) {
+        return BIND_IMAGE_TEXTURE;
+    }
+
+    if (startsWith(name, "glTextureView") ||
+        startsWith(name, "glEGLImageTarget") ||
+        startsWith(name, "eglCreateImage")) {
+        return ALIAS_TEXTURE;
+    }
+
+    // Contents become undefined
+    if (startsWith(name, "glInvalidate") ||
+        startsWith(name, "glDiscardFramebuffer")) {
+        return WRITE_ANY_TEXTURE;
+    }
+
+    if (strstr(name, "Framebuffer") &&
+        !startsWith(name, "glBindFramebuffer") &&
+        !startsWith(name, "glBlit")) {
+        return CHANGE_FRAMEBUFFER;
+    }
+
+    if (startsWithAny(name, boundTextureWrites)) {
+        return WRITE_BOUND_TEXTURE;
+    }
+
+    if (startsWithAny(name, textureStateChanges)) {
+        return WRITE_NONE;
+    }
+
+    if (startsWith(name, "glDispatchCompute")) {
+        return WRITE_ANY_TEXTURE;
+    }
+
+    if (!startsWithAny(name, clearState) &&
+        !startsWith(name, "glDrawBuffer") &&
+        !startsWith(name, "glClearTex") &&
+        (startsWithAny(name, draws) || strcmp(name, "glEnd") == 0)) {
+        return WRITE_DRAW_FRAMEBUFFER;
+    }
+
+    // Anything else dealing with textures or images, be it through direct
+    // state access, copies, views, or the window system
+    if (strstr(name, "Tex") || strstr(name, "Image")) {
+        return WRITE_ANY_TEXTURE;
+    }
+
+    return WRITE_NONE;
+}
+
+
+static bool
+isTextureTarget(GLenum target)
+{
+    if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+        target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+        return true;
+    }
+    for (unsigned i = 0; i < numTextureTargets; ++i) {
+        if (textureTargets[i] == target) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static const std::vector<GLuint> &
+getFramebufferTextures(GLuint framebuffer)
+{
+    auto key = std::make_pair(currentContext, framebuffer);
+    auto it = framebufferTextures.find(key);
+    if (it != framebufferTextures.end()) {
+        return it->second;
+    }
+
+    std::vector<GLenum> attachments;
+    GLint maxColorAttachments = 1;
+    glGetIntegerv(GL_MAX_COLOR_ATTACHMENTS, &maxColorAttachments);
+    for (GLint i = 0; i < maxColorAttachments; ++i) {
+        attachments.push_back(GL_COLOR_ATTACHMENT0 + i);
+    }
+    attachments.push_back(GL_DEPTH_ATTACHMENT);
+    attachments.push_back(GL_STENCIL_ATTACHMENT);
+
+    std::vector<GLuint> &textures = framebufferTextures[key];
+    for (GLenum attachment : attachments) {
+        GLint type = GL_NONE;
+        glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment,
+                                              GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type);
+        if (type == GL_TEXTURE) {
+            GLint texture = 0;
+            glGetFramebufferAttachmentParameteriv(GL_FRAMEBUFFER, attachment,
+                                                  GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &texture);
+            textures.push_back(texture);
+        }
+    }
+
+    // Not every implementation knows every attachment (e.g., ES 2.0), and
+    // the errors must not be blamed on the next call
+    for (unsigned i = 0; i < 8 && glGetError() != GL_NO_ERROR; ++i) {
+    }
+
+    return textures;
+}
+
+
+void
+trackTextureWrites(trace::Call &call, unsigned context)
+{
+    std::lock_guard<std::mutex> lock(writesMutex);
+
+    trackingWrites = true;
+    currentContext = context;
+
+    // EGLImages may be created without any current context
+    WriteKind kind = classifyCall(call.sig->name);
+    if (kind == ALIAS_TEXTURE) {
+        aliasedTextures = true;
+        anyTextureWrite = call.no;
+    }
+
+    if (!context) {
+        return;
+    }
+
+    switch (kind) {
+    case WRITE_NONE:
+        break;
+    case WRITE_BOUND_TEXTURE:
+        if (aliasedTextures) {
+            anyTextureWrite = call.no;
+        } else {
+            GLenum target = call.arg(0).toUInt();
+            if (isTextureTarget(target)) {
+                GLint texture = 0;
+                glGetIntegerv(getTextureBinding(target), &texture);
+                textureWrites[texture] = call.no;
+            } else {
+                // Proxy or external textures
+                anyTextureWrite = call.no;
+            }
+        }
+        break;
+    case WRITE_DRAW_FRAMEBUFFER:
+        if (imageStores || aliasedTextures) {
+            anyTextureWrite = call.no;
+        } else {
+            GLint framebuffer = 0;
+            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &framebuffer);
+            if (framebuffer) {
+                for (GLuint texture : getFramebufferTextures(framebuffer)) {
+                    textureWrites[texture] = call.no;
+                }
+            }
+        }
+        break;
+    case WRITE_ANY_TEXTURE:
+        anyTextureWrite = call.no;
+        break;
+    case BIND_IMAGE_TEXTURE:
+        imageStores = true;
+        break;
+    case CHANGE_FRAMEBUFFER:
+        framebufferTextures.clear();
+        break;
+    case ALIAS_TEXTURE:
+        break;
+    }
+}
+
+
+std::string
+getTextureWriteFingerprint(GLuint texture)
+{
+    std::lock_guard<std::mutex> lock(writesMutex);
+
+    if (!trackingWrites || !currentContext) {
+        return std::string();
+    }
+
+    unsigned lastWrite = anyTextureWrite;
+    auto it = textureWrites.find(texture);
+    if (it != textureWrites.end()) {
+        lastWrite = std::max(lastWrite, it->second);
+    }
+
+    std::stringstream ss;
+    ss << "context " << currentContext << ", texture " << texture
+       << ", written at " << lastWrite;
+    return ss.str();
+}
+
+
+} /* namespace glstate */
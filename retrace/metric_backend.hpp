@@ -276,6 +276,14 @@ public:
                                  QueryBoundary boundary,
                                  void* userData = nullptr) = 0;
 
+    /**
+     * Releases collected metrics data for the queries with ids lower than
+     * the given id, for given type of boundary.
+     * To be called once that data was written; enumDataQueryId(...) passes
+     * nullptr data for released queries.
+     */
+    virtual void releaseDataQueryId(unsigned id, QueryBoundary boundary) = 0;
+
     /**
      * Returns number of passes generated by generatePasses(...).
      * If generatePasses(...) was not called returns 1.
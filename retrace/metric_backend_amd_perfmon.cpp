@@ -23,6 +23,8 @@
  *
  **************************************************************************/
 
+#include <algorithm>
+
 #include "metric_backend_amd_perfmon.hpp"
 
 void Metric_AMD_perfmon::precache() {
@@ -96,6 +98,11 @@ unsigned*
 MetricBackend_AMD_perfmon::DataCollector::newDataBuffer(unsigned event,
                                                         size_t size)
 {
+    if (event < released[curPass]) {
+        discarded.resize(size);
+        return discarded.data();
+    }
+    event -= released[curPass];
     // in case there is no data for previous events fill with nullptr
     data[curPass].resize(event, nullptr);
     data[curPass].push_back(alloc.allocate(size));
@@ -105,17 +112,32 @@ MetricBackend_AMD_perfmon::DataCollector::newDataBuffer(unsigned event,
 void MetricBackend_AMD_perfmon::DataCollector::endPass() {
     curPass++;
     data.push_back(mmapdeque<unsigned*>(alloc));
+    released.push_back(0);
 }
 
 unsigned*
 MetricBackend_AMD_perfmon::DataCollector::getDataBuffer(unsigned pass,
                                                         unsigned event)
 {
+    if (event < released[pass]) return nullptr;
+    event -= released[pass];
     if (event < data[pass].size()) {
         return data[pass][event];
     } else return nullptr;
 }
 
+void MetricBackend_AMD_perfmon::DataCollector::releaseData(unsigned pass, unsigned event)
+{
+    if (event <= released[pass]) return;
+    unsigned count = std::min<size_t>(event - released[pass], data[pass].size());
+    for (unsigned k = 0; k < count; k++) {
+        alloc.deallocate(data[pass].front(), 1);
+        data[pass].pop_front();
+    }
+    // data of the remaining events is discarded as it is collected
+    released[pass] = event;
+}
+
 
 MetricBackend_AMD_perfmon::MetricBackend_AMD_perfmon(glretrace::Context* context,
                                                      MmapAllocator<char> &alloc)
@@ -434,6 +456,21 @@ MetricBackend_AMD_perfmon::enumDataQueryId(unsigned id,
     }
 }
 
+void MetricBackend_AMD_perfmon::releaseDataQueryId(unsigned id,
+                                                   QueryBoundary boundary)
+{
+    if (boundary == QUERY_BOUNDARY_CALL) return;
+    unsigned j = 0;
+    unsigned nPasses = numFramePasses;
+    if (boundary == QUERY_BOUNDARY_DRAWCALL) {
+        j = numFramePasses;
+        nPasses = numPasses;
+    }
+    for (; j < nPasses; j++) {
+        collector.releaseData(j, id);
+    }
+}
+
 unsigned MetricBackend_AMD_perfmon::getNumPasses() {
     return numPasses;
 }
@@ -82,12 +82,16 @@ private:
             using mmapdeque = std::deque<T, MmapAllocator<T>>;
             // data storage
             mmapdeque<mmapdeque<unsigned*>> data;
+            // number of released events of each pass
+            std::vector<unsigned> released;
+            // buffer for data of events released before it was collected
+            std::vector<unsigned> discarded;
             unsigned curPass;
 
         public:
             DataCollector(MmapAllocator<char> &alloc)
                 : alloc(alloc), data(1, mmapdeque<unsigned*>(alloc), alloc),
-                  curPass(0) {}
+                  released(1, 0), curPass(0) {}
 
             ~DataCollector();
 
@@ -96,6 +100,8 @@ private:
             void endPass();
 
             unsigned* getDataBuffer(unsigned pass, unsigned event);
+
+            void releaseData(unsigned pass, unsigned event);
     };
 
 private:
@@ -171,6 +177,8 @@ public:
                          QueryBoundary boundary,
                          void* userData = nullptr) override;
 
+    void releaseDataQueryId(unsigned id, QueryBoundary boundary) override;
+
     unsigned getNumPasses() override;
 
     static MetricBackend_AMD_perfmon& getInstance(glretrace::Context* context,
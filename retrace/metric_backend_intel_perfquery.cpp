@@ -23,6 +23,8 @@
  *
  **************************************************************************/
 
+#include <algorithm>
+
 #include "metric_backend_intel_perfquery.hpp"
 
 void Metric_INTEL_perfquery::precache() {
@@ -104,6 +106,11 @@ unsigned char*
 MetricBackend_INTEL_perfquery::DataCollector::newDataBuffer(unsigned event,
                                                             size_t size)
 {
+    if (event < released[curPass]) {
+        discarded.resize(size);
+        return discarded.data();
+    }
+    event -= released[curPass];
     // in case there is no data for previous events fill with nullptr
     data[curPass].resize(event, nullptr);
     data[curPass].push_back(alloc.allocate(size));
@@ -113,17 +120,32 @@ MetricBackend_INTEL_perfquery::DataCollector::newDataBuffer(unsigned event,
 void MetricBackend_INTEL_perfquery::DataCollector::endPass() {
     curPass++;
     data.push_back(mmapdeque<unsigned char*>(alloc));
+    released.push_back(0);
 }
 
 unsigned char*
 MetricBackend_INTEL_perfquery::DataCollector::getDataBuffer(unsigned pass,
                                                             unsigned event)
 {
+    if (event < released[pass]) return nullptr;
+    event -= released[pass];
     if (event < data[pass].size()) {
         return data[pass][event];
     } else return nullptr;
 }
 
+void MetricBackend_INTEL_perfquery::DataCollector::releaseData(unsigned pass, unsigned event)
+{
+    if (event <= released[pass]) return;
+    unsigned count = std::min<size_t>(event - released[pass], data[pass].size());
+    for (unsigned k = 0; k < count; k++) {
+        alloc.deallocate(data[pass].front(), 1);
+        data[pass].pop_front();
+    }
+    // data of the remaining events is discarded as it is collected
+    released[pass] = event;
+}
+
 MetricBackend_INTEL_perfquery::MetricBackend_INTEL_perfquery(glretrace::Context* context,
                                                              MmapAllocator<char> &alloc)
     : numPasses(1), curPass(0), curEvent(0), collector(alloc) {
@@ -346,6 +368,21 @@ void MetricBackend_INTEL_perfquery::enumDataQueryId(unsigned id,
     }
 }
 
+void MetricBackend_INTEL_perfquery::releaseDataQueryId(unsigned id,
+                                                       QueryBoundary boundary)
+{
+    if (boundary == QUERY_BOUNDARY_CALL) return;
+    unsigned j = 0;
+    unsigned nPasses = numFramePasses;
+    if (boundary == QUERY_BOUNDARY_DRAWCALL) {
+        j = numFramePasses;
+        nPasses = numPasses;
+    }
+    for (; j < nPasses; j++) {
+        collector.releaseData(j, id);
+    }
+}
+
 unsigned MetricBackend_INTEL_perfquery::getNumPasses() {
     return numPasses;
 }
@@ -85,12 +85,16 @@ private:
             using mmapdeque = std::deque<T, MmapAllocator<T>>;
             // data storage
             mmapdeque<mmapdeque<unsigned char*>> data;
+            // number of released events of each pass
+            std::vector<unsigned> released;
+            // buffer for data of events released before it was collected
+            std::vector<unsigned char> discarded;
             unsigned curPass;
 
         public:
             DataCollector(MmapAllocator<char> &alloc)
                 : alloc(alloc), data(1, mmapdeque<unsigned char*>(alloc), alloc),
-                  curPass(0) {}
+                  released(1, 0), curPass(0) {}
 
             ~DataCollector();
 
@@ -99,6 +103,8 @@ private:
             void endPass();
 
             unsigned char* getDataBuffer(unsigned pass, unsigned event);
+
+            void releaseData(unsigned pass, unsigned event);
     };
 
 private:
@@ -164,6 +170,8 @@ public:
                          QueryBoundary boundary,
                          void* userData = nullptr) override;
 
+    void releaseDataQueryId(unsigned id, QueryBoundary boundary) override;
+
     unsigned getNumPasses() override;
 
     static MetricBackend_INTEL_perfquery& getInstance(glretrace::Context* context,
@@ -37,7 +37,21 @@ MetricBackend_opengl::Storage::addData(QueryBoundary boundary, int64_t data) {
 int64_t* MetricBackend_opengl::Storage::getData(QueryBoundary boundary,
                                                  unsigned eventId)
 {
-    return &(data[boundary][eventId]);
+    if (eventId < released[boundary] ||
+        eventId - released[boundary] >= data[boundary].size()) {
+        return nullptr;
+    }
+    return &(data[boundary][eventId - released[boundary]]);
+}
+
+void MetricBackend_opengl::Storage::releaseData(QueryBoundary boundary,
+                                                unsigned eventId)
+{
+    auto &d = data[boundary];
+    while (released[boundary] < eventId && !d.empty()) {
+        d.pop_front();
+        released[boundary]++;
+    }
 }
 
 Metric_opengl::Metric_opengl(unsigned gId, unsigned id, const std::string &name,
@@ -514,6 +528,15 @@ void MetricBackend_opengl::enumDataQueryId(unsigned id, enumDataCallback callbac
     }
 }
 
+void MetricBackend_opengl::releaseDataQueryId(unsigned id,
+                                              QueryBoundary boundary) {
+    for (int i = 0; i < METRIC_LIST_END; i++) {
+        if (metrics[i].enabled[boundary]) {
+            data[i][boundary]->releaseData(boundary, id);
+        }
+    }
+}
+
 unsigned MetricBackend_opengl::getNumPasses() {
     return twoPasses ? 2 : 1;
 }
@@ -75,10 +75,11 @@ private:
     {
     private:
         std::deque<int64_t, MmapAllocator<int64_t>> data[QUERY_BOUNDARY_LIST_END];
+        unsigned released[QUERY_BOUNDARY_LIST_END]; // id of data.front()
 
     public:
 #ifdef _WIN32
-        Storage(MmapAllocator<char> &alloc) {
+        Storage(MmapAllocator<char> &alloc) : released{} {
             for (auto &d : data) {
                 d = std::deque<int64_t, MmapAllocator<int64_t>>(alloc);
             }
@@ -87,10 +88,12 @@ private:
         Storage(MmapAllocator<char> &alloc)
             : data{ std::deque<int64_t, MmapAllocator<int64_t>>(alloc),
                     std::deque<int64_t, MmapAllocator<int64_t>>(alloc),
-                    std::deque<int64_t, MmapAllocator<int64_t>>(alloc) } {};
+                    std::deque<int64_t, MmapAllocator<int64_t>>(alloc) },
+              released{} {};
 #endif
         void addData(QueryBoundary boundary, int64_t data);
         int64_t* getData(QueryBoundary boundary, unsigned eventId);
+        void releaseData(QueryBoundary boundary, unsigned eventId);
     };
 
     // indexes into metrics vector
@@ -187,6 +190,8 @@ public:
     void enumDataQueryId(unsigned id, enumDataCallback callback,
                          QueryBoundary boundary, void* userData = nullptr) override;
 
+    void releaseDataQueryId(unsigned id, QueryBoundary boundary) override;
+
     unsigned getNumPasses() override;
 
     static MetricBackend_opengl& getInstance(glretrace::Context* context,
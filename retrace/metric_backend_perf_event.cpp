@@ -0,0 +1,371 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "metric_backend_perf_event.hpp"
+
+
+Metric_perf_event::Metric_perf_event(unsigned gId, unsigned id, const std::string &name,
+                                     const std::string &desc, uint32_t type, uint64_t config)
+    : m_gId(gId), m_id(id), m_name(name), m_desc(desc),
+      eventType(type), eventConfig(config), available(false),
+      excludeKernel(false), groupIndex(0), fd(-1)
+{
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        enabled[i] = false;
+    }
+}
+
+unsigned Metric_perf_event::id() {
+    return m_id;
+}
+
+unsigned Metric_perf_event::groupId() {
+    return m_gId;
+}
+
+std::string Metric_perf_event::name() {
+    return m_name;
+}
+
+std::string Metric_perf_event::description() {
+    if (available && excludeKernel) {
+        return m_desc + " (user space only)";
+    }
+    return m_desc;
+}
+
+MetricNumType Metric_perf_event::numType() {
+    return CNT_NUM_UINT64;
+}
+
+MetricType Metric_perf_event::type() {
+    return CNT_TYPE_GENERIC;
+}
+
+
+MetricBackend_perf_event::MetricBackend_perf_event(glretrace::Context* context,
+                                                   MmapAllocator<char> &alloc)
+    : alloc(alloc), warnedNotCounting(false), groupFd(-1), numEnabled(0)
+{
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        profiled[i] = false;
+        queryInProgress[i] = false;
+        released[i] = 0;
+    }
+
+#ifdef __linux__
+    // Add metrics below
+    metrics.emplace_back(0, 0, "CPU Cycles", "CPU cycles spent by the retracing thread",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    metrics.emplace_back(0, 1, "Instructions", "Instructions retired by the retracing thread",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    metrics.emplace_back(0, 2, "Cache Misses", "Last level cache misses",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    metrics.emplace_back(0, 3, "Branch Misses", "Mispredicted branches",
+                         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    metrics.emplace_back(1, 0, "Context Switches", "Context switches of the retracing thread",
+                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES);
+    metrics.emplace_back(1, 1, "Page Faults", "Page faults of the retracing thread",
+                         PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+#endif
+
+    // probe which events can be opened, falling back to user space only
+    // counting when perf_event_paranoid forbids kernel counting
+    for (auto &m : metrics) {
+        int fd = openEvent(m, -1, true);
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+            m.excludeKernel = true;
+            fd = openEvent(m, -1, true);
+        }
+        if (fd >= 0) {
+            m.available = true;
+#ifdef __linux__
+            close(fd);
+#endif
+        }
+    }
+
+    // populate lookups
+    for (auto &m : metrics) {
+        idLookup[std::make_pair(m.groupId(), m.id())] = &m;
+        nameLookup[m.name()] = &m;
+    }
+}
+
+MetricBackend_perf_event::~MetricBackend_perf_event() {
+    endPass();
+}
+
+int MetricBackend_perf_event::openEvent(const Metric_perf_event &metric,
+                                        int group, bool disabled) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = metric.eventType;
+    attr.config = metric.eventConfig;
+    attr.disabled = disabled;
+    attr.exclude_kernel = metric.excludeKernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP |
+                       PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // count this thread only, on whichever CPU it runs
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, group, 0));
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+bool MetricBackend_perf_event::readCounters(std::vector<uint64_t> &values) {
+#ifdef __linux__
+    // { nr, time_enabled, time_running, value[nr] }
+    size_t size = (3 + numEnabled) * sizeof(uint64_t);
+    if (read(groupFd, readBuffer.data(), size) != static_cast<ssize_t>(size)) {
+        return false;
+    }
+    if (readBuffer[2] != readBuffer[1] && !warnedNotCounting) {
+        std::cerr << "Warning: perf_event counters are multiplexed or not running,"
+                     " enable fewer metrics." << std::endl;
+        warnedNotCounting = true;
+    }
+    values.assign(readBuffer.begin() + 3, readBuffer.begin() + 3 + numEnabled);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool MetricBackend_perf_event::isSupported() {
+    for (auto &m : metrics) {
+        if (m.available) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void MetricBackend_perf_event::enumGroups(enumGroupsCallback callback, void* userData) {
+    callback(0, 0, userData); // hardware group
+    callback(1, 0, userData); // software group
+}
+
+std::string MetricBackend_perf_event::getGroupName(unsigned group) {
+    switch(group) {
+        case 0:
+            return "Hardware";
+        case 1:
+            return "Software";
+        default:
+            return "";
+    }
+}
+
+void MetricBackend_perf_event::enumMetrics(unsigned group, enumMetricsCallback callback, void* userData) {
+    for (auto &m : metrics) {
+        if (m.groupId() == group && m.available) {
+            callback(&m, 0, userData);
+        }
+    }
+}
+
+std::unique_ptr<Metric>
+MetricBackend_perf_event::getMetricById(unsigned groupId, unsigned metricId) {
+    auto entryToCopy = idLookup.find(std::make_pair(groupId, metricId));
+    if (entryToCopy != idLookup.end()) {
+        return std::unique_ptr<Metric>(new Metric_perf_event(*entryToCopy->second));
+    } else {
+        return nullptr;
+    }
+}
+
+std::unique_ptr<Metric>
+MetricBackend_perf_event::getMetricByName(std::string metricName) {
+    auto entryToCopy = nameLookup.find(metricName);
+    if (entryToCopy != nameLookup.end()) {
+        return std::unique_ptr<Metric>(new Metric_perf_event(*entryToCopy->second));
+    } else {
+        return nullptr;
+    }
+}
+
+int MetricBackend_perf_event::enableMetric(Metric* metric, QueryBoundary pollingRule) {
+    // metric is not necessarily the same object as in metrics[]
+    auto entry = idLookup.find(std::make_pair(metric->groupId(), metric->id()));
+    if ((entry != idLookup.end()) && entry->second->available) {
+        entry->second->enabled[pollingRule] = true;
+        return 0;
+    }
+    return 1;
+}
+
+unsigned MetricBackend_perf_event::generatePasses() {
+    // every enabled event is read at every profiled boundary, in group order
+    numEnabled = 0;
+    for (auto &m : metrics) {
+        bool any = false;
+        for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+            any = any || m.enabled[i];
+            profiled[i] = profiled[i] || m.enabled[i];
+        }
+        if (any) {
+            m.groupIndex = numEnabled++;
+        }
+    }
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        if (profiled[i]) {
+            data[i] = std::unique_ptr<Storage>(new Storage(MmapAllocator<uint64_t>(alloc)));
+        }
+    }
+    readBuffer.resize(3 + numEnabled);
+    // a single group counts all the events at once
+    return 1;
+}
+
+void MetricBackend_perf_event::beginPass() {
+    for (auto &m : metrics) {
+        bool any = false;
+        for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+            any = any || m.enabled[i];
+        }
+        if (!any) {
+            continue;
+        }
+        m.fd = openEvent(m, groupFd, groupFd < 0);
+        if (m.fd < 0) {
+            std::cerr << "Warning: could not open perf event \"" << m.name()
+                      << "\": " << strerror(errno) << "." << std::endl;
+            endPass();
+            return;
+        }
+        if (groupFd < 0) {
+            groupFd = m.fd;
+        }
+    }
+#ifdef __linux__
+    if (groupFd >= 0) {
+        ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+void MetricBackend_perf_event::endPass() {
+    for (auto &m : metrics) {
+        if (m.fd >= 0) {
+#ifdef __linux__
+            close(m.fd);
+#endif
+            m.fd = -1;
+        }
+    }
+    groupFd = -1;
+}
+
+void MetricBackend_perf_event::pausePass() {
+    // counters follow the thread, not the GL context
+}
+
+void MetricBackend_perf_event::continuePass() {
+}
+
+void MetricBackend_perf_event::beginQuery(QueryBoundary boundary) {
+    if (profiled[boundary]) {
+        if (groupFd < 0 || !readCounters(counts[boundary])) {
+            counts[boundary].assign(numEnabled, 0);
+        }
+    }
+    queryInProgress[boundary] = true;
+    // DRAWCALL is a CALL
+    if (boundary == QUERY_BOUNDARY_DRAWCALL) beginQuery(QUERY_BOUNDARY_CALL);
+}
+
+void MetricBackend_perf_event::endQuery(QueryBoundary boundary) {
+    if (queryInProgress[boundary] && profiled[boundary]) {
+        std::vector<uint64_t> &start = counts[boundary];
+        std::vector<uint64_t> end;
+        if (groupFd < 0 || !readCounters(end)) {
+            end = start;
+        }
+        // always store a value per event, to keep query ids in step
+        for (unsigned i = 0; i < numEnabled; i++) {
+            data[boundary]->push_back(end[i] - start[i]);
+        }
+    }
+    queryInProgress[boundary] = false;
+    // DRAWCALL is a CALL
+    if (boundary == QUERY_BOUNDARY_DRAWCALL) endQuery(QUERY_BOUNDARY_CALL);
+}
+
+void MetricBackend_perf_event::enumDataQueryId(unsigned id, enumDataCallback callback,
+                                               QueryBoundary boundary, void* userData) {
+    for (auto &m : metrics) {
+        if (m.enabled[boundary]) {
+            void *value = nullptr;
+            if (id >= released[boundary]) {
+                size_t index = static_cast<size_t>(id - released[boundary]) * numEnabled +
+                               m.groupIndex;
+                if (index < data[boundary]->size()) {
+                    value = &(*data[boundary])[index];
+                }
+            }
+            callback(&m, id, value, 0, userData);
+        }
+    }
+}
+
+void MetricBackend_perf_event::releaseDataQueryId(unsigned id, QueryBoundary boundary) {
+    if (!data[boundary] || id <= released[boundary]) {
+        return;
+    }
+    Storage &storage = *data[boundary];
+    size_t count = std::min(static_cast<size_t>(id - released[boundary]) * numEnabled,
+                            storage.size());
+    storage.erase(storage.begin(), storage.begin() + count);
+    released[boundary] += count / numEnabled;
+}
+
+unsigned MetricBackend_perf_event::getNumPasses() {
+    return 1;
+}
+
+MetricBackend_perf_event&
+MetricBackend_perf_event::getInstance(glretrace::Context* context, MmapAllocator<char> &alloc) {
+    static MetricBackend_perf_event backend(context, alloc);
+    return backend;
+}
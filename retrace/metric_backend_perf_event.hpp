@@ -0,0 +1,157 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "glproc.hpp"
+#include "metric_backend.hpp"
+#include "glretrace.hpp"
+#include "mmap_allocator.hpp"
+
+class Metric_perf_event : public Metric
+{
+private:
+    unsigned m_gId, m_id;
+    std::string m_name, m_desc;
+
+public:
+    Metric_perf_event(unsigned gId, unsigned id, const std::string &name,
+                      const std::string &desc, uint32_t type, uint64_t config);
+
+    unsigned id() override;
+
+    unsigned groupId() override;
+
+    std::string name() override;
+
+    std::string description() override;
+
+    MetricNumType numType() override;
+
+    MetricType type() override;
+
+    // perf_event_attr type and config of the event
+    uint32_t eventType;
+    uint64_t eventConfig;
+
+    // should be set by backend
+    bool available;
+    bool excludeKernel; // kernel counting not permitted
+    bool enabled[QUERY_BOUNDARY_LIST_END]; // enabled for profiling
+    unsigned groupIndex; // position in the event group read
+    int fd;
+};
+
+/**
+ * CPU side counters of the retracing thread, read with Linux perf_event_open.
+ *
+ * All enabled events are opened as a single group, which is read in one
+ * system call at every query boundary.  Only the retracing thread is
+ * counted, so work done by driver worker threads is not accounted for.
+ */
+class MetricBackend_perf_event : public MetricBackend
+{
+private:
+    typedef std::deque<uint64_t, MmapAllocator<uint64_t>> Storage;
+
+    MmapAllocator<char> alloc;
+
+    std::map<std::pair<unsigned,unsigned>, Metric_perf_event*> idLookup;
+    std::map<std::string, Metric_perf_event*> nameLookup;
+
+    std::vector<Metric_perf_event> metrics;
+    // storage for metrics
+    std::unique_ptr<Storage> data[QUERY_BOUNDARY_LIST_END];
+    unsigned released[QUERY_BOUNDARY_LIST_END]; // query id of data front
+
+    bool profiled[QUERY_BOUNDARY_LIST_END];
+    bool queryInProgress[QUERY_BOUNDARY_LIST_END];
+    bool warnedNotCounting;
+
+    int groupFd;
+    unsigned numEnabled;
+    std::vector<uint64_t> counts[QUERY_BOUNDARY_LIST_END];
+    std::vector<uint64_t> readBuffer;
+
+    MetricBackend_perf_event(glretrace::Context* context, MmapAllocator<char> &alloc);
+
+    MetricBackend_perf_event(MetricBackend_perf_event const&) = delete;
+
+    void operator=(MetricBackend_perf_event const&)           = delete;
+
+    int openEvent(const Metric_perf_event &metric, int group, bool disabled);
+
+    bool readCounters(std::vector<uint64_t> &values);
+
+public:
+    ~MetricBackend_perf_event();
+
+    bool isSupported() override;
+
+    void enumGroups(enumGroupsCallback callback, void* userData = nullptr) override;
+
+    void enumMetrics(unsigned group, enumMetricsCallback callback, void* userData = nullptr) override;
+
+    std::unique_ptr<Metric> getMetricById(unsigned groupId, unsigned metricId) override;
+
+    std::unique_ptr<Metric> getMetricByName(std::string metricName) override;
+
+    std::string getGroupName(unsigned group) override;
+
+    int enableMetric(Metric* metric, QueryBoundary pollingRule = QUERY_BOUNDARY_DRAWCALL) override;
+
+    unsigned generatePasses() override;
+
+    void beginPass() override;
+
+    void endPass() override;
+
+    void pausePass() override;
+
+    void continuePass() override;
+
+    void beginQuery(QueryBoundary boundary = QUERY_BOUNDARY_DRAWCALL) override;
+
+    void endQuery(QueryBoundary boundary = QUERY_BOUNDARY_DRAWCALL) override;
+
+    void enumDataQueryId(unsigned id, enumDataCallback callback,
+                         QueryBoundary boundary, void* userData = nullptr) override;
+
+    void releaseDataQueryId(unsigned id, QueryBoundary boundary) override;
+
+    unsigned getNumPasses() override;
+
+    static MetricBackend_perf_event& getInstance(glretrace::Context* context,
+                                                 MmapAllocator<char> &alloc);
+};
+
@@ -35,6 +35,7 @@
 #include "metric_backend_amd_perfmon.hpp"
 #include "metric_backend_intel_perfquery.hpp"
 #include "metric_backend_opengl.hpp"
+#include "metric_backend_perf_event.hpp"
 #include "mmap_allocator.hpp"
 
 namespace glretrace {
@@ -47,7 +48,8 @@ std::vector<MetricBackend*> metricBackends; // to be populated in initContext()
 MetricBackend* curMetricBackend = nullptr; // backend active in the current pass
 
 MetricWriter& profiler() {
-    static MetricWriter writer(metricBackends, MmapAllocator<char>());
+    static MetricWriter writer(metricBackends, profilingBoundaries,
+                               retrace::profilingBinary);
     return writer;
 }
 
@@ -59,6 +61,7 @@ MetricBackend* getBackend(std::string backendName) {
     if (backendName == "GL_AMD_performance_monitor") return &MetricBackend_AMD_perfmon::getInstance(currentContext, alloc);
     else if (backendName == "GL_INTEL_performance_query") return &MetricBackend_INTEL_perfquery::getInstance(currentContext, alloc);
     else if (backendName == "opengl") return &MetricBackend_opengl::getInstance(currentContext, alloc);
+    else if (backendName == "perf_event") return &MetricBackend_perf_event::getInstance(currentContext, alloc);
     else return nullptr;
 }
 
@@ -92,7 +95,8 @@ void listMetricsCLI() {
     // backends is to be populated with backend names
     std::string backends[] = {"GL_AMD_performance_monitor",
                               "GL_INTEL_performance_query",
-                              "opengl"};
+                              "opengl",
+                              "perf_event"};
     std::cout << "Available metrics: \n";
     for (auto s : backends) {
         auto b = getBackend(s);
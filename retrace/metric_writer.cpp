@@ -23,202 +23,422 @@
  *
  **************************************************************************/
 
+#include <string.h>
+
+#include <algorithm>
 #include <iostream>
 
 #include "metric_writer.hpp"
 
-void ProfilerQuery::writeMetricHeaderCallback(Metric* metric, int event, void* data, int error,
-                                      void* userData) {
-    std::cout << "\t" << metric->name();
+/*
+ * Binary metrics format
+ *
+ * After an 8 byte signature and a version byte, the output is a sequence of
+ * records, each made of a tag byte, the payload size, and the payload:
+ *
+ * - 'N' defines the next call name, referred to by its index;
+ * - 'H' lists the metrics of a boundary, as numeric type and name pairs;
+ * - 'B' holds a block of queries of a boundary, stored one column at a time:
+ *   for calls and draw calls, frame end flags, call numbers (delta encoded),
+ *   programs and names, then for each metric a presence bitmap followed by
+ *   the values present.
+ *
+ * Integers are LEB128 encoded, signed ones after zigzag encoding, while
+ * floats and doubles are stored as little-endian IEEE 754 values.
+ */
+
+#define METRIC_SIGNATURE "APIMETR"
+#define METRIC_VERSION 1
+
+/* Queries written at a time */
+#define METRIC_BLOCK_SIZE 4096
+
+/* Order of the text sections */
+static const QueryBoundary textSections[] = {
+    QUERY_BOUNDARY_FRAME,
+    QUERY_BOUNDARY_CALL,
+    QUERY_BOUNDARY_DRAWCALL,
+};
+
+
+static inline void
+writeUInt(std::string &buf, uint64_t value)
+{
+    while (value >= 0x80) {
+        buf += char((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    buf += char(value);
 }
 
-void ProfilerQuery::writeMetricEntryCallback(Metric* metric, int event, void* data, int error,
-                                     void* userData) {
-    if (error) {
-        std::cout << "\t" << "#ERR" << error;
-        return;
+static inline void
+writeSInt(std::string &buf, int64_t value)
+{
+    writeUInt(buf, (uint64_t(value) << 1) ^ uint64_t(value >> 63));
+}
+
+static inline void
+writeBytes(std::string &buf, uint64_t value, unsigned size)
+{
+    for (unsigned i = 0; i < size; ++i) {
+        buf += char(value & 0xff);
+        value >>= 8;
     }
-    if (!data) {
-        std::cout << "\t" << "-";
-        return;
+}
+
+static void
+writeRecord(char tag, const std::string &payload)
+{
+    std::string header(1, tag);
+    writeUInt(header, payload.size());
+    std::cout.write(header.data(), header.size());
+    std::cout.write(payload.data(), payload.size());
+}
+
+
+MetricWriter::MetricWriter(std::vector<MetricBackend*> &metricBackends,
+                           const bool (&enabledBoundaries)[QUERY_BOUNDARY_LIST_END],
+                           bool binary)
+    : metricBackends(metricBackends),
+      enabledBoundaries(enabledBoundaries),
+      binary(binary),
+      headerWritten{},
+      namesWritten(0),
+      started(false)
+{
+}
+
+unsigned MetricWriter::getNameId(const char* name) {
+    auto res = nameLookup.find(name);
+    if (res != nameLookup.end()) {
+        return res->second;
     }
-    switch(metric->numType()) {
-        case CNT_NUM_UINT: std::cout << "\t" << *(reinterpret_cast<unsigned*>(data)); break;
-        case CNT_NUM_FLOAT: std::cout << "\t" << *(reinterpret_cast<float*>(data)); break;
-        case CNT_NUM_DOUBLE: std::cout << "\t" << *(reinterpret_cast<double*>(data)); break;
-        case CNT_NUM_BOOL: std::cout << "\t" << *(reinterpret_cast<bool*>(data)); break;
-        case CNT_NUM_UINT64: std::cout << "\t" << *(reinterpret_cast<uint64_t*>(data)); break;
-        case CNT_NUM_INT64: std::cout << "\t" << *(reinterpret_cast<int64_t*>(data)); break;
+    unsigned id = names.size();
+    names.push_back(name);
+    nameLookup[name] = id;
+    return id;
+}
+
+void MetricWriter::addQuery(QueryBoundary boundary, unsigned eventId,
+                            const CallData* callData)
+{
+    Entry entry = {};
+    entry.eventId = eventId;
+    if (callData) {
+        entry.isFrameEnd = callData->isFrameEnd;
+        entry.no = callData->no;
+        entry.program = callData->program;
+        if (!entry.isFrameEnd) {
+            entry.name = getNameId(callData->name);
+        }
     }
+    pending[boundary].push_back(entry);
 }
 
-void ProfilerQuery::writeMetricHeader(QueryBoundary qb) const {
-    for (auto &a : *metricBackends) {
-        a->enumDataQueryId(eventId, &writeMetricHeaderCallback, qb);
+void MetricWriter::flush(void) {
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        QueryBoundary boundary = static_cast<QueryBoundary>(i);
+        std::deque<Entry> &queue = pending[boundary];
+        if (queue.size() < METRIC_BLOCK_SIZE) {
+            continue;
+        }
+        // backends may only collect the data of the last query when the next
+        // one begins, so hold it back along with the frame ends that follow
+        size_t count = queue.size();
+        while (count > 0 && queue[count - 1].isFrameEnd) {
+            --count;
+        }
+        if (count > 0) {
+            --count;
+        }
+        writeQueries(boundary, count);
     }
-    std::cout << std::endl;
 }
 
-void ProfilerQuery::writeMetricEntry(QueryBoundary qb) const {
-    for (auto &a : *metricBackends) {
-        a->enumDataQueryId(eventId, &writeMetricEntryCallback, qb);
+void MetricWriter::finish(void) {
+    for (int i = 0; i < QUERY_BOUNDARY_LIST_END; i++) {
+        QueryBoundary boundary = static_cast<QueryBoundary>(i);
+        writeQueries(boundary, pending[boundary].size());
     }
-    std::cout << std::endl;
+    if (!binary) {
+        for (QueryBoundary boundary : textSections) {
+            if (!headerWritten[boundary]) {
+                continue;
+            }
+            std::ostream &os = getTextStream(boundary);
+            if (&os != &std::cout) {
+                std::cout << os.rdbuf();
+                sections[boundary].str(std::string());
+            }
+            std::cout << std::endl;
+        }
+    }
+    std::cout.flush();
 }
 
-template<typename T>
-T ProfilerCall::StringTable<T>::getId(const std::string &str) {
-    auto res = stringLookupTable.find(str);
-    T index;
-    if (res == stringLookupTable.end()) {
-        index = static_cast<T>(strings.size());
-        strings.push_back(str);
-        stringLookupTable[str] = index;
-    } else {
-        index = res->second;
+void MetricWriter::writeQueries(QueryBoundary boundary, size_t count) {
+    std::deque<Entry> &queue = pending[boundary];
+    if (!count) {
+        return;
+    }
+
+    // written queries are never enumerated again, so their data is released
+    unsigned releaseId = 0;
+    for (size_t i = count; i > 0; i--) {
+        if (!queue[i - 1].isFrameEnd) {
+            releaseId = queue[i - 1].eventId + 1;
+            break;
+        }
+    }
+
+    if (!headerWritten[boundary]) {
+        if (binary) {
+            writeBinaryHeader(boundary, queue.front());
+        } else {
+            writeTextHeader(getTextStream(boundary), boundary, queue.front());
+        }
+        headerWritten[boundary] = true;
+    }
+
+    if (binary) {
+        while (count) {
+            size_t blockSize = std::min<size_t>(count, METRIC_BLOCK_SIZE);
+            writeBinaryBlock(boundary, blockSize);
+            queue.erase(queue.begin(), queue.begin() + blockSize);
+            count -= blockSize;
+        }
+        releaseQueries(boundary, releaseId);
+        return;
     }
-    return index;
+
+    std::ostream &os = getTextStream(boundary);
+    for (size_t i = 0; i < count; i++) {
+        writeTextEntry(os, boundary, queue[i]);
+    }
+    queue.erase(queue.begin(), queue.begin() + count);
+    releaseQueries(boundary, releaseId);
 }
 
-template<typename T>
-std::string ProfilerCall::StringTable<T>::getString(T id) {
-    return strings[static_cast<typename decltype(stringLookupTable)::size_type>(id)];
+void MetricWriter::releaseQueries(QueryBoundary boundary, unsigned id) {
+    if (!id) {
+        return;
+    }
+    for (auto &b : metricBackends) {
+        b->releaseDataQueryId(id, boundary);
+    }
 }
 
 
-ProfilerCall::ProfilerCall(unsigned eventId, const data* queryData)
-    : ProfilerQuery(QUERY_BOUNDARY_CALL, eventId)
-{
-    if (queryData) {
-        isFrameEnd = queryData->isFrameEnd;
-        no = queryData->no;
-        program = queryData->program;
-        nameTableEntry = nameTable.getId(queryData->name);
+/*
+ * Sections are written straight to stdout when no section before them is
+ * enabled.
+ */
+std::ostream &MetricWriter::getTextStream(QueryBoundary boundary) {
+    for (QueryBoundary section : textSections) {
+        if (section == boundary) {
+            return std::cout;
+        }
+        if (enabledBoundaries[section]) {
+            break;
+        }
     }
+    return sections[boundary];
 }
 
-
-void ProfilerCall::writeHeader() const {
-    std::cout << "#\tcall no\tprogram\tname";
-    ProfilerQuery::writeMetricHeader(QUERY_BOUNDARY_CALL);
+void MetricWriter::writeTextHeaderCallback(Metric* metric, int event, void* data,
+                                           int error, void* userData) {
+    std::ostream &os = *reinterpret_cast<std::ostream*>(userData);
+    os << "\t" << metric->name();
 }
 
-void ProfilerCall::writeEntry() const {
-    if (isFrameEnd) {
-        std::cout << "frame_end" << std::endl;
-    } else {
-        std::cout << "call"
-            << "\t" << no
-            << "\t" << program
-            << "\t" << nameTable.getString(nameTableEntry);
-        ProfilerQuery::writeMetricEntry(QUERY_BOUNDARY_CALL);
+void MetricWriter::writeTextEntryCallback(Metric* metric, int event, void* data,
+                                          int error, void* userData) {
+    std::ostream &os = *reinterpret_cast<std::ostream*>(userData);
+    if (error) {
+        os << "\t" << "#ERR" << error;
+        return;
+    }
+    if (!data) {
+        os << "\t" << "-";
+        return;
+    }
+    switch(metric->numType()) {
+        case CNT_NUM_UINT: os << "\t" << *(reinterpret_cast<unsigned*>(data)); break;
+        case CNT_NUM_FLOAT: os << "\t" << *(reinterpret_cast<float*>(data)); break;
+        case CNT_NUM_DOUBLE: os << "\t" << *(reinterpret_cast<double*>(data)); break;
+        case CNT_NUM_BOOL: os << "\t" << *(reinterpret_cast<bool*>(data)); break;
+        case CNT_NUM_UINT64: os << "\t" << *(reinterpret_cast<uint64_t*>(data)); break;
+        case CNT_NUM_INT64: os << "\t" << *(reinterpret_cast<int64_t*>(data)); break;
     }
 }
 
-
-void ProfilerDrawcall::writeHeader() const {
-    std::cout << "#\tcall no\tprogram\tname";
-    ProfilerQuery::writeMetricHeader(QUERY_BOUNDARY_DRAWCALL);
+void MetricWriter::writeTextHeader(std::ostream &os, QueryBoundary boundary, const Entry &entry) {
+    if (boundary == QUERY_BOUNDARY_FRAME) {
+        os << "#";
+    } else {
+        os << "#\tcall no\tprogram\tname";
+    }
+    for (auto &b : metricBackends) {
+        b->enumDataQueryId(entry.eventId, &writeTextHeaderCallback, boundary, &os);
+    }
+    os << "\n";
 }
 
-void ProfilerDrawcall::writeEntry() const {
-    if (isFrameEnd) {
-        std::cout << "frame_end" << std::endl;
+void MetricWriter::writeTextEntry(std::ostream &os, QueryBoundary boundary, const Entry &entry) {
+    if (boundary == QUERY_BOUNDARY_FRAME) {
+        os << "frame";
+    } else if (entry.isFrameEnd) {
+        os << "frame_end\n";
+        return;
     } else {
-        std::cout << "call"
-            << "\t" << no
-            << "\t" << program
-            << "\t" << nameTable.getString(nameTableEntry);
-        ProfilerQuery::writeMetricEntry(QUERY_BOUNDARY_DRAWCALL);
+        os << "call"
+            << "\t" << entry.no
+            << "\t" << entry.program
+            << "\t" << names[entry.name];
+    }
+    for (auto &b : metricBackends) {
+        b->enumDataQueryId(entry.eventId, &writeTextEntryCallback, boundary, &os);
     }
+    os << "\n";
 }
 
 
-void ProfilerFrame::writeHeader() const {
-    std::cout << "#";
-    ProfilerQuery::writeMetricHeader(QUERY_BOUNDARY_FRAME);
-}
+struct MetricWriter::BinaryHeaderState {
+    std::string payload;
+    std::vector<MetricNumType> *numTypes;
+};
 
-void ProfilerFrame::writeEntry() const {
-    std::cout << "frame";
-    ProfilerQuery::writeMetricEntry(QUERY_BOUNDARY_FRAME);
+void MetricWriter::binaryHeaderCallback(Metric* metric, int event, void* data,
+                                        int error, void* userData) {
+    BinaryHeaderState *state = reinterpret_cast<BinaryHeaderState*>(userData);
+    std::string name = metric->name();
+    state->payload += char(metric->numType());
+    writeUInt(state->payload, name.size());
+    state->payload += name;
+    state->numTypes->push_back(metric->numType());
 }
 
+void MetricWriter::writeBinaryHeader(QueryBoundary boundary, const Entry &entry) {
+    if (!started) {
+        std::cout.write(METRIC_SIGNATURE, sizeof METRIC_SIGNATURE);
+        std::cout.put(char(METRIC_VERSION));
+        started = true;
+    }
 
-MetricWriter::MetricWriter(std::vector<MetricBackend*> &metricBackends,
-                           const MmapAllocator<char> &alloc)
-    : frameQueue(MmapAllocator<ProfilerCall>(alloc)),
-      callQueue(MmapAllocator<ProfilerCall>(alloc)),
-      drawcallQueue(MmapAllocator<ProfilerCall>(alloc))
-{
-    ProfilerQuery::metricBackends = &metricBackends;
+    BinaryHeaderState state;
+    state.numTypes = &numTypes[boundary];
+    numTypes[boundary].clear();
+    for (auto &b : metricBackends) {
+        b->enumDataQueryId(entry.eventId, &binaryHeaderCallback, boundary, &state);
+    }
+
+    std::string payload(1, char(boundary));
+    writeUInt(payload, numTypes[boundary].size());
+    payload += state.payload;
+    writeRecord('H', payload);
 }
 
-void MetricWriter::addQuery(QueryBoundary boundary, unsigned eventId,
-                            const void* queryData)
-{
-    switch (boundary) {
-        case QUERY_BOUNDARY_FRAME:
-            frameQueue.emplace_back(eventId);
-            break;
-        case QUERY_BOUNDARY_CALL:
-            callQueue.emplace_back(eventId,
-                    reinterpret_cast<const ProfilerCall::data*>(queryData));
-            break;
-        case QUERY_BOUNDARY_DRAWCALL:
-            drawcallQueue.emplace_back(eventId,
-                    reinterpret_cast<const ProfilerCall::data*>(queryData));
-            break;
-        default:
-            break;
+
+struct MetricWriter::BinaryEntryState {
+    std::vector<Column> *columns;
+    size_t column;
+};
+
+void MetricWriter::binaryEntryCallback(Metric* metric, int event, void* data,
+                                       int error, void* userData) {
+    BinaryEntryState *state = reinterpret_cast<BinaryEntryState*>(userData);
+    if (state->column >= state->columns->size()) {
+        return;
+    }
+    Column &column = (*state->columns)[state->column++];
+    if (error || !data) {
+        column.present.push_back(false);
+        return;
     }
-}
 
-void MetricWriter::writeQuery(QueryBoundary boundary) {
-    switch (boundary) {
-        case QUERY_BOUNDARY_FRAME:
-            frameQueue.front().writeEntry();
-            frameQueue.pop_front();
-            break;
-        case QUERY_BOUNDARY_CALL:
-            callQueue.front().writeEntry();
-            callQueue.pop_front();
-            break;
-        case QUERY_BOUNDARY_DRAWCALL:
-            drawcallQueue.front().writeEntry();
-            drawcallQueue.pop_front();
-            break;
-        default:
+    uint64_t value = 0;
+    switch (column.numType) {
+        case CNT_NUM_UINT: value = *(reinterpret_cast<unsigned*>(data)); break;
+        case CNT_NUM_FLOAT: {
+            uint32_t bits;
+            memcpy(&bits, data, sizeof bits);
+            value = bits;
             break;
+        }
+        case CNT_NUM_DOUBLE: memcpy(&value, data, sizeof value); break;
+        case CNT_NUM_BOOL: value = *(reinterpret_cast<bool*>(data)); break;
+        case CNT_NUM_UINT64: value = *(reinterpret_cast<uint64_t*>(data)); break;
+        case CNT_NUM_INT64: value = *(reinterpret_cast<int64_t*>(data)); break;
     }
+    column.present.push_back(true);
+    column.values.push_back(value);
 }
 
-void MetricWriter::writeAll(QueryBoundary boundary) {
-    switch (boundary) {
-        case QUERY_BOUNDARY_FRAME:
-            frameQueue.front().writeHeader();
-            while (!frameQueue.empty()) {
-                writeQuery(boundary);
+void MetricWriter::writeBinaryBlock(QueryBoundary boundary, size_t count) {
+    std::deque<Entry> &queue = pending[boundary];
+
+    // define the names first used by this block
+    for (; namesWritten < names.size(); ++namesWritten) {
+        const std::string &name = names[namesWritten];
+        std::string payload;
+        writeUInt(payload, name.size());
+        payload += name;
+        writeRecord('N', payload);
+    }
+
+    columns.assign(numTypes[boundary].size(), Column());
+    for (size_t k = 0; k < columns.size(); ++k) {
+        columns[k].numType = numTypes[boundary][k];
+    }
+    for (size_t i = 0; i < count; ++i) {
+        BinaryEntryState state = { &columns, 0 };
+        if (!queue[i].isFrameEnd) {
+            for (auto &b : metricBackends) {
+                b->enumDataQueryId(queue[i].eventId, &binaryEntryCallback, boundary, &state);
             }
-            break;
-        case QUERY_BOUNDARY_CALL:
-            callQueue.front().writeHeader();
-            while (!callQueue.empty()) {
-                writeQuery(boundary);
+        }
+        for (; state.column < columns.size(); ++state.column) {
+            columns[state.column].present.push_back(false);
+        }
+    }
+
+    std::string payload(1, char(boundary));
+    writeUInt(payload, count);
+
+    if (boundary != QUERY_BOUNDARY_FRAME) {
+        for (size_t i = 0; i < count; ++i) {
+            payload += char(queue[i].isFrameEnd);
+        }
+        unsigned lastNo = 0;
+        for (size_t i = 0; i < count; ++i) {
+            writeSInt(payload, int64_t(queue[i].no) - int64_t(lastNo));
+            lastNo = queue[i].no;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            writeUInt(payload, queue[i].program);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            writeUInt(payload, queue[i].name);
+        }
+    }
+
+    for (auto &column : columns) {
+        for (size_t i = 0; i < count; i += 8) {
+            unsigned char bits = 0;
+            for (size_t j = i; j < count && j < i + 8; ++j) {
+                bits |= column.present[j] << (j - i);
             }
-            break;
-        case QUERY_BOUNDARY_DRAWCALL:
-            drawcallQueue.front().writeHeader();
-            while (!drawcallQueue.empty()) {
-                writeQuery(boundary);
+            payload += char(bits);
+        }
+        for (uint64_t value : column.values) {
+            switch (column.numType) {
+                case CNT_NUM_FLOAT: writeBytes(payload, value, 4); break;
+                case CNT_NUM_DOUBLE: writeBytes(payload, value, 8); break;
+                case CNT_NUM_INT64: writeSInt(payload, int64_t(value)); break;
+                default: writeUInt(payload, value); break;
             }
-            break;
-        default:
-            break;
+        }
     }
-    std::cout << std::endl;
-}
-
-std::vector<MetricBackend*>* ProfilerQuery::metricBackends = nullptr;
 
-ProfilerCall::StringTable<int16_t> ProfilerCall::nameTable;
+    writeRecord('B', payload);
+}
@@ -25,100 +25,107 @@
 
 #pragma once
 
-#include <queue>
+#include <deque>
+#include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "metric_backend.hpp"
-#include "mmap_allocator.hpp"
 
-class ProfilerQuery
+/**
+ * Writes the metrics collected by the backends to stdout.
+ *
+ * Queries are written a block at a time as frames complete, so memory use
+ * doesn't grow with the length of the trace.  Output is either tab separated
+ * text, with one section per boundary, or a compact binary stream.
+ *
+ * Text sections follow each other, in frame, call, draw call order, so only
+ * the first enabled one is written as it goes, while the others are held as
+ * text until the end.
+ */
+class MetricWriter
 {
-private:
-    unsigned eventId;
-    static void writeMetricHeaderCallback(Metric* metric, int event, void* data, int error,
-                                  void* userData);
-    static void writeMetricEntryCallback(Metric* metric, int event, void* data, int error,
-                                 void* userData);
-
 public:
-    static std::vector<MetricBackend*>* metricBackends;
+    struct CallData {
+        bool isFrameEnd;
+        unsigned no;
+        unsigned program;
+        const char* name;
+    };
 
-    ProfilerQuery(QueryBoundary qb, unsigned eventId)
-        : eventId(eventId) {};
-    void writeMetricHeader(QueryBoundary qb) const;
-    void writeMetricEntry(QueryBoundary qb) const;
-};
+    MetricWriter(std::vector<MetricBackend*> &metricBackends,
+                 const bool (&enabledBoundaries)[QUERY_BOUNDARY_LIST_END],
+                 bool binary);
 
-class ProfilerCall : public ProfilerQuery
-{
-public:
-    struct data {
+    void addQuery(QueryBoundary boundary, unsigned eventId,
+                  const CallData* callData = nullptr);
+
+    /**
+     * Writes the complete queries of boundaries with at least a block of
+     * them pending.  To be called at frame boundaries.
+     */
+    void flush(void);
+
+    /**
+     * Writes all the pending queries.  To be called once all passes ended.
+     */
+    void finish(void);
+
+private:
+    struct Entry {
+        unsigned eventId;
         bool isFrameEnd;
         unsigned no;
         unsigned program;
-        const char* name;
+        unsigned name;
     };
 
-protected:
-    template<typename T>
-    class StringTable
-    {
-    private:
-        std::deque<std::string> strings;
-        std::unordered_map<std::string, T> stringLookupTable;
-
-    public:
-        T getId(const std::string &str);
-        std::string getString(T id);
+    struct Column {
+        MetricNumType numType;
+        std::vector<bool> present;
+        std::vector<uint64_t> values;
     };
 
-    static StringTable<int16_t> nameTable;
+    struct BinaryHeaderState;
+    struct BinaryEntryState;
 
-    int16_t nameTableEntry;
-    bool isFrameEnd;
-    unsigned no;
-    unsigned program;
+    std::vector<MetricBackend*> &metricBackends;
+    const bool (&enabledBoundaries)[QUERY_BOUNDARY_LIST_END];
+    bool binary;
 
-public:
-    ProfilerCall(unsigned eventId, const data* queryData = nullptr);
-    void writeHeader() const;
-    void writeEntry() const;
-};
+    std::deque<Entry> pending[QUERY_BOUNDARY_LIST_END];
+    bool headerWritten[QUERY_BOUNDARY_LIST_END];
 
-class ProfilerDrawcall : public ProfilerCall
-{
-public:
-    ProfilerDrawcall(unsigned eventId, const data* queryData)
-        : ProfilerCall( eventId, queryData) {};
-    void writeHeader() const;
-    void writeEntry() const;
-};
+    // Text of the sections which can't be written yet
+    std::stringstream sections[QUERY_BOUNDARY_LIST_END];
 
-class ProfilerFrame : public ProfilerQuery
-{
-public:
-    ProfilerFrame(unsigned eventId)
-        : ProfilerQuery(QUERY_BOUNDARY_FRAME, eventId) {};
-    void writeHeader() const;
-    void writeEntry() const;
-};
+    std::vector<std::string> names;
+    std::unordered_map<std::string, unsigned> nameLookup;
+    size_t namesWritten;
 
-class MetricWriter
-{
-private:
-    std::deque<ProfilerFrame, MmapAllocator<ProfilerFrame>> frameQueue;
-    std::deque<ProfilerCall, MmapAllocator<ProfilerCall>> callQueue;
-    std::deque<ProfilerDrawcall, MmapAllocator<ProfilerDrawcall>> drawcallQueue;
+    std::vector<MetricNumType> numTypes[QUERY_BOUNDARY_LIST_END];
+    std::vector<Column> columns;
+    bool started;
 
-public:
-    MetricWriter(std::vector<MetricBackend*> &metricBackends,
-                 const MmapAllocator<char> &alloc);
+    unsigned getNameId(const char* name);
 
-    void addQuery(QueryBoundary boundary, unsigned eventId,
-                  const void* queryData = nullptr);
+    void writeQueries(QueryBoundary boundary, size_t count);
+    void releaseQueries(QueryBoundary boundary, unsigned id);
+
+    std::ostream &getTextStream(QueryBoundary boundary);
+    void writeTextHeader(std::ostream &os, QueryBoundary boundary, const Entry &entry);
+    void writeTextEntry(std::ostream &os, QueryBoundary boundary, const Entry &entry);
 
-    void writeQuery(QueryBoundary boundary);
+    void writeBinaryHeader(QueryBoundary boundary, const Entry &entry);
+    void writeBinaryBlock(QueryBoundary boundary, size_t count);
 
-    void writeAll(QueryBoundary boundary);
+    static void writeTextHeaderCallback(Metric* metric, int event, void* data,
+                                        int error, void* userData);
+    static void writeTextEntryCallback(Metric* metric, int event, void* data,
+                                       int error, void* userData);
+    static void binaryHeaderCallback(Metric* metric, int event, void* data,
+                                     int error, void* userData);
+    static void binaryEntryCallback(Metric* metric, int event, void* data,
+                                    int error, void* userData);
 };
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <memory>
 #include <list>
+#include <functional>
 
 #ifdef __unix__
 
@@ -45,16 +46,24 @@
 /*
  * Allocator that backs up memory with mmaped file
  * File is grown by ALLOC_CHUNK_SIZE, this new region is mmaped then
- * Nothing is deallocated
+ * Individual allocations are not reused, but a chunk is unmapped (and its
+ * file region punched out) once everything allocated from it was deallocated
 */
 
 class MmapedFileBuffer
 {
 private:
+    struct Chunk {
+        void* base;
+        off_t offset;
+        size_t allocations;
+    };
+
     int fd;
     off_t curChunkSize;
     const size_t chunkSize;
-    std::list<void*> mmaps;
+    off_t fileSize;
+    std::list<Chunk> mmaps;
     void* vptr;
 
     MmapedFileBuffer(MmapedFileBuffer const&) = delete;
@@ -62,20 +71,31 @@ private:
     void operator=(MmapedFileBuffer const&) = delete;
 
     void newMmap() {
-        int ret = ftruncate(fd, chunkSize * (mmaps.size() + 1));
+        int ret = ftruncate(fd, fileSize + chunkSize);
         if (ret < 0) {
             abort();
         }
         vptr = mmap(NULL, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
-                    chunkSize * mmaps.size());
-        mmaps.push_front(vptr);
+                    fileSize);
+        mmaps.push_front({vptr, fileSize, 0});
+        fileSize += chunkSize;
         curChunkSize = 0;
     }
 
+    void releaseChunk(std::list<Chunk>::iterator chunk) {
+        munmap(chunk->base, chunkSize);
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+        fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  chunk->offset, chunkSize);
+#endif
+        mmaps.erase(chunk);
+    }
+
 public:
     MmapedFileBuffer()
         : curChunkSize(0),
-          chunkSize(ALLOC_CHUNK_SIZE & ~(sysconf(_SC_PAGE_SIZE) - 1))
+          chunkSize(ALLOC_CHUNK_SIZE & ~(sysconf(_SC_PAGE_SIZE) - 1)),
+          fileSize(0)
     {
         char templ[] = ".pbtmpXXXXXX";
         fd = mkstemp(templ);
@@ -86,7 +106,7 @@ public:
     ~MmapedFileBuffer() {
         close(fd);
         for (auto &m : mmaps) {
-            munmap(m, chunkSize);
+            munmap(m.base, chunkSize);
         }
     }
 
@@ -96,8 +116,24 @@ public:
         }
         void* addr = static_cast<char*>(vptr) + curChunkSize;
         curChunkSize += size;
+        mmaps.front().allocations++;
         return addr;
     }
+
+    void deallocate(void* p) {
+        for (auto it = mmaps.begin(); it != mmaps.end(); ++it) {
+            char* base = static_cast<char*>(it->base);
+            if (std::less<char*>()(static_cast<char*>(p), base) ||
+                !std::less<char*>()(static_cast<char*>(p), base + chunkSize)) {
+                continue;
+            }
+            // the chunk being filled is kept mapped
+            if (--it->allocations == 0 && it != mmaps.begin()) {
+                releaseChunk(it);
+            }
+            return;
+        }
+    }
 };
 
 template <class T>
@@ -134,7 +170,9 @@ public:
         return reinterpret_cast<T*>(file->allocate(n * sizeof(T)));
     };
 
-    void deallocate(T* p, std::size_t n) {};
+    void deallocate(T* p, std::size_t n) {
+        file->deallocate(p);
+    };
 
     template <typename U, typename... Args>
     void construct(U* p, Args&&... args) {::new (static_cast<void*>(p) ) U (std::forward<Args> (args)...);}
@@ -30,6 +30,7 @@
 #include <assert.h>
 #include <string.h>
 
+#include <functional>
 #include <list>
 #include <map>
 #include <ostream>
@@ -44,6 +45,8 @@
 #include "trace_dump.hpp"
 
 #include "scoped_allocator.hpp"
+#include "call_sampler.hpp"
+#include "frame_stats.hpp"
 
 
 namespace image {
@@ -139,6 +142,17 @@ extern bool snapshotMRT;
  */
 extern bool snapshotAlpha;
 
+/**
+ * Whether to favor encoding speed over size when writing PNG snapshots.
+ */
+extern bool snapshotFastPNG;
+
+/**
+ * Maximum width and height of color snapshots, which are downscaled on the
+ * GPU to fit, or zero for full size.
+ */
+extern unsigned snapshotMaxSize;
+
 /**
  * Whether to force windowed. Recommeded, as there is no guarantee that the
  * original display mode is available.
@@ -166,6 +180,7 @@ extern char* profilingFramesMetricsString;
 extern char* profilingDrawCallsMetricsString;
 extern bool profilingListMetrics;
 extern bool profilingNumPasses;
+extern bool profilingBinary;
 
 extern bool profiling;
 extern bool profilingFrameTimes;
@@ -174,6 +189,17 @@ extern bool profilingGpuTimes;
 extern bool profilingPixelsDrawn;
 extern bool profilingMemoryUsage;
 
+/**
+ * Subset of the calls instrumented when profiling.
+ */
+extern CallSampler callSampler;
+
+/**
+ * Per-frame time statistics.
+ */
+extern bool recordFrameStats;
+extern FrameStats frameStats;
+
 /**
  * State dumping.
  */
@@ -263,11 +289,50 @@ public:
     virtual image::Image *
     getSnapshot(int n, bool backBuffer) = 0;
 
+    typedef std::function<void (image::Image *)> SnapshotCallback;
+
+    /**
+     * Request a snapshot without waiting for it.  The callback takes
+     * ownership of the image (NULL on failure) and may be invoked later, but
+     * always in request order.
+     */
+    virtual void
+    getSnapshotAsync(int n, bool backBuffer, SnapshotCallback callback) {
+        callback(getSnapshot(n, backBuffer));
+    }
+
+    typedef std::function<void (const char *digest)> SnapshotDigestCallback;
+
+    /**
+     * Like getSnapshotAsync, but only the MD5 digest of the pixels is
+     * needed, which implementations may compute straight from mapped
+     * memory.  The digest is NULL on failure.
+     */
+    virtual void
+    getSnapshotDigestAsync(int n, bool backBuffer, SnapshotDigestCallback callback);
+
+    /**
+     * Wait for all snapshots requested with getSnapshotAsync or
+     * getSnapshotDigestAsync.
+     */
+    virtual void
+    flushSnapshots(void) {
+    }
+
     virtual bool
     canDump(void) = 0;
 
     virtual void
     dumpState(StateWriter &) = 0;
+
+    /**
+     * Called after every call is retraced when dumping states incrementally,
+     * so that implementations can tell which objects may have changed since
+     * the previous dump without reading them back.
+     */
+    virtual void
+    trackCall(trace::Call &call) {
+    }
 };
 
 
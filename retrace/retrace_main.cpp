@@ -30,6 +30,7 @@
 #include <atomic>
 #include <limits.h> // for CHAR_MAX
 #include <memory> // for unique_ptr
+#include <fstream>
 #include <iostream>
 #include <regex>
 #include <getopt.h>
@@ -66,13 +67,30 @@ static const char *snapshotPrefix = "";
 static enum {
     PNM_FMT,
     RAW_RGB,
-    RAW_MD5
+    RAW_MD5,
+    PNG_FMT,
+    PHASH_FMT
 } snapshotFormat = PNM_FMT;
 
 static trace::CallSet snapshotFrequency;
 static unsigned snapshotInterval = 0;
 
-static unsigned dumpStateCallNo = ~0;
+static trace::CallSet dumpStateCalls;
+static bool dumpDefaultState = false;
+static bool dumpStateIncremental = false;
+static StateDigests stateDigests;
+static const char *stateDigestsFilename = nullptr;
+
+static bool reportFrameStats = false;
+static const char *frameStatsFilename = nullptr;
+static const char *traceEventsFilename = nullptr;
+
+/* Frame range replayed repeatedly in benchmark mode */
+static unsigned benchmarkFirstFrame = 0;
+static unsigned benchmarkFrameCount = 0;
+static unsigned benchmarkWarmup = 1;
+static unsigned benchmarkIterations = 5;
+static long long iterationStartTime = 0;
 
 retrace::Retracer retracer;
 
@@ -89,6 +107,8 @@ int debug = 1;
 bool markers = false;
 bool snapshotMRT = false;
 bool snapshotAlpha = false;
+bool snapshotFastPNG = false;
+unsigned snapshotMaxSize = 0;
 bool forceWindowed = true;
 bool dumpingState = false;
 bool dumpingSnapshots = false;
@@ -113,6 +133,7 @@ char* profilingFramesMetricsString;
 char* profilingDrawCallsMetricsString;
 bool profilingListMetrics = false;
 bool profilingNumPasses = false;
+bool profilingBinary = false;
 
 bool profiling = false;
 bool profilingFrameTimes = false;
@@ -120,6 +141,9 @@ bool profilingGpuTimes = false;
 bool profilingCpuTimes = false;
 bool profilingPixelsDrawn = false;
 bool profilingMemoryUsage = false;
+CallSampler callSampler;
+bool recordFrameStats = false;
+FrameStats frameStats;
 bool useCallNos = true;
 bool singleThread = false;
 bool ignoreRetvals = false;
@@ -133,6 +157,7 @@ unsigned frameNo = 0;
 unsigned callNo = 0;
 
 long long lastFrameTime = 0;
+static long long frameStartTime = 0;
 long long perFrameDelayUsec = 0;
 long long minFrameDurationUsec = 0;
 
@@ -230,6 +255,27 @@ void
 frameComplete(trace::Call &call)
 {
     ++frameNo;
+
+    if (recordFrameStats) {
+        long long frameEndTime = os::getTime();
+        frameStats.addCpuTime((frameEndTime - frameStartTime) * 1.0E3 / os::timeFrequency);
+    }
+
+    if (benchmarkFrameCount &&
+        frameNo >= benchmarkFirstFrame &&
+        (frameNo - benchmarkFirstFrame) % benchmarkFrameCount == 0) {
+        // The first iteration parses and caches the calls, and is followed
+        // by the warm-up ones
+        unsigned iteration = (frameNo - benchmarkFirstFrame) / benchmarkFrameCount;
+        long long iterationEndTime = os::getTime();
+        if (iteration > benchmarkWarmup + 1) {
+            frameStats.addIterationTime((iterationEndTime - iterationStartTime) * 1.0E3 / os::timeFrequency);
+        } else if (iteration == benchmarkWarmup + 1) {
+            frameStats.clearFrameTimes();
+        }
+        iterationStartTime = iterationEndTime;
+    }
+
     bool bNeedFrameDelay = perFrameDelayUsec || minFrameDurationUsec;
     if (bNeedFrameDelay) {
         long long startTime = os::getTime();
@@ -254,6 +300,7 @@ frameComplete(trace::Call &call)
     if (snapshotFrequency.contains(call)) {
         takeSnapshot(call.no, snapshotForceBackbuffer);
         if (call.no >= snapshotFrequency.getLast()) {
+            dumper->flushSnapshots();
             exit(0);
         }
     }
@@ -261,6 +308,11 @@ frameComplete(trace::Call &call)
     if (bNeedFrameDelay) {
         lastFrameTime = os::getTime();
     }
+
+    // Exclude delays and snapshots from the next frame time
+    if (recordFrameStats) {
+        frameStartTime = os::getTime();
+    }
 }
 
 
@@ -301,68 +353,114 @@ static StateWriterFactory stateWriterFactory = createJSONStateWriter;
 static Snapshotter *snapshotter;
 
 
+void
+Dumper::getSnapshotDigestAsync(int n, bool backBuffer, SnapshotDigestCallback callback)
+{
+    getSnapshotAsync(n, backBuffer, [callback] (image::Image *image) {
+        if (!image) {
+            callback(nullptr);
+            return;
+        }
+        char digest[33];
+        image::md5(image->start(), image->stride(), image->width*image->bytesPerPixel, image->height, digest);
+        delete image;
+        callback(digest);
+    });
+}
+
+
+static void
+warnSnapshotFailed(unsigned call_no, int mrt) {
+    /* TODO for mrt>0 we probably don't want to treat this as an error: */
+    if (mrt == 0)
+        std::cerr << call_no << ": warning: failed to get snapshot\n";
+}
+
+
 /**
- * Take snapshots.
+ * Write out a snapshot, once its pixels have been read back.
  */
 static void
-takeSnapshot(unsigned call_no, int mrt, unsigned snapshot_no, bool backBuffer) {
+writeSnapshot(unsigned call_no, int mrt, unsigned snapshot_no, image::Image *image) {
 
-    assert(dumpingSnapshots);
-    assert(snapshotPrefix);
-
-    std::unique_ptr<image::Image> src(dumper->getSnapshot(mrt, backBuffer));
+    std::unique_ptr<image::Image> src(image);
     if (!src) {
-        /* TODO for mrt>0 we probably don't want to treat this as an error: */
-        if (mrt == 0)
-            std::cerr << call_no << ": warning: failed to get snapshot\n";
+        warnSnapshotFailed(call_no, mrt);
         return;
     }
 
-    if ((snapshotInterval == 0 ||
-        (snapshot_no % snapshotInterval) == 0)) {
-
-        if (snapshotPrefix[0] == '-' && snapshotPrefix[1] == 0) {
-            char comment[21];
-            snprintf(comment, sizeof comment, "%u",
-                     useCallNos ? call_no : snapshot_no);
-            switch (snapshotFormat) {
-            case PNM_FMT:
-                src->writePNM(std::cout, comment);
-                break;
-            case RAW_RGB:
-                src->writeRAW(std::cout);
-                break;
-            case RAW_MD5:
-                src->writeMD5(std::cout);
-                break;
-            default:
-                assert(0);
-                break;
-            }
+    if (snapshotPrefix[0] == '-' && snapshotPrefix[1] == 0) {
+        char comment[21];
+        snprintf(comment, sizeof comment, "%u",
+                 useCallNos ? call_no : snapshot_no);
+        switch (snapshotFormat) {
+        case PNM_FMT:
+            src->writePNM(std::cout, comment);
+            break;
+        case RAW_RGB:
+            src->writeRAW(std::cout);
+            break;
+        case RAW_MD5:
+            src->writeMD5(std::cout);
+            break;
+        case PNG_FMT:
+            src->writePNG(std::cout, !retrace::snapshotAlpha, retrace::snapshotFastPNG);
+            break;
+        case PHASH_FMT:
+            src->writePerceptualHash(std::cout, comment);
+            break;
+        default:
+            assert(0);
+            break;
+        }
+    } else {
+        os::String filename;
+        unsigned no = useCallNos ? call_no : snapshot_no;
+
+        if (!retrace::snapshotMRT) {
+            assert(mrt == 0);
+            filename = os::String::format("%s%010u.png", snapshotPrefix, no);
+        } else if (mrt == -2) {
+            /* stencil */
+            filename = os::String::format("%s%010u-s.png", snapshotPrefix, no);
+        } else if (mrt == -1) {
+            /* depth */
+            filename = os::String::format("%s%010u-z.png", snapshotPrefix, no);
         } else {
-            os::String filename;
-            unsigned no = useCallNos ? call_no : snapshot_no;
-
-            if (!retrace::snapshotMRT) {
-                assert(mrt == 0);
-                filename = os::String::format("%s%010u.png", snapshotPrefix, no);
-            } else if (mrt == -2) {
-                /* stencil */
-                filename = os::String::format("%s%010u-s.png", snapshotPrefix, no);
-            } else if (mrt == -1) {
-                /* depth */
-                filename = os::String::format("%s%010u-z.png", snapshotPrefix, no);
-            } else {
-                filename = os::String::format("%s%010u-mrt%u.png", snapshotPrefix, no, mrt);
-            }
-
-            // Here we release our ownership on the Image, it is now the
-            // responsibility of the snapshotter to delete it.
-            snapshotter->writePNG(filename, src.release());
+            filename = os::String::format("%s%010u-mrt%u.png", snapshotPrefix, no, mrt);
         }
+
+        // Here we release our ownership on the Image, it is now the
+        // responsibility of the snapshotter to delete it.
+        snapshotter->writePNG(filename, src.release());
     }
+}
 
-    return;
+/**
+ * Take snapshots.
+ */
+static void
+takeSnapshot(unsigned call_no, int mrt, unsigned snapshot_no, bool backBuffer) {
+
+    assert(dumpingSnapshots);
+    assert(snapshotPrefix);
+
+    if (snapshotFormat == RAW_MD5 &&
+        snapshotPrefix[0] == '-' && snapshotPrefix[1] == 0) {
+        // Only the digest is output, so don't bother materializing an image
+        dumper->getSnapshotDigestAsync(mrt, backBuffer, [=] (const char *digest) {
+            if (!digest) {
+                warnSnapshotFailed(call_no, mrt);
+                return;
+            }
+            std::cout << digest << "\n";
+        });
+        return;
+    }
+
+    dumper->getSnapshotAsync(mrt, backBuffer, [=] (image::Image *image) {
+        writeSnapshot(call_no, mrt, snapshot_no, image);
+    });
 }
 
 static void
@@ -375,9 +473,16 @@ takeSnapshot(unsigned call_no, bool backBuffer)
     last_call_no = call_no;
 
     static unsigned snapshot_no = 0;
-    int cnt = dumper->getSnapshotCount();
+
+    // Decide before any read back whether this snapshot is kept at all
+    if (snapshotInterval != 0 &&
+        (snapshot_no % snapshotInterval) != 0) {
+        snapshot_no++;
+        return;
+    }
 
     if (retrace::snapshotMRT) {
+        int cnt = dumper->getSnapshotCount();
         for (int mrt = -2; mrt < cnt; mrt++) {
             takeSnapshot(call_no, mrt, snapshot_no, backBuffer);
         }
@@ -389,6 +494,22 @@ takeSnapshot(unsigned call_no, bool backBuffer)
 }
 
 
+static void
+dumpState(void) {
+    StateWriter *writer = stateWriterFactory(std::cout);
+    if (dumpStateIncremental) {
+        writer = createIncrementalStateWriter(writer, stateDigests);
+    }
+    dumper->dumpState(*writer);
+    delete writer;
+    std::cout.flush();
+
+    if (stateDigestsFilename &&
+        !saveStateDigests(stateDigestsFilename, stateDigests)) {
+        std::cerr << "warning: failed to write " << stateDigestsFilename << "\n";
+    }
+}
+
 /**
  * Retrace one call.
  *
@@ -405,23 +526,33 @@ retraceCall(trace::Call *call) {
 
     retracer.retrace(*call);
 
+    if (dumpStateIncremental) {
+        dumper->trackCall(*call);
+    }
+
     if (snapshotFrequency.contains(*call)) {
         takeSnapshot(call->no, snapshotForceBackbuffer);
         if (call->no >= snapshotFrequency.getLast()) {
+            dumper->flushSnapshots();
             exit(0);
         }
     }
 
-    // dumpStateCallNo is 0 when fetching default state
-    if (call->no == dumpStateCallNo || dumpStateCallNo == 0) {
+    // The default state is dumped at the first call where it's possible
+    if (dumpDefaultState || dumpStateCalls.contains(*call)) {
+        bool last = dumpDefaultState || call->no >= dumpStateCalls.getLast();
         if (dumper->canDump()) {
-            StateWriter *writer = stateWriterFactory(std::cout);
-            dumper->dumpState(*writer);
-            delete writer;
-            exit(0);
-        } else if (dumpStateCallNo != 0) {
-            std::cerr << call->no << ": error: failed to dump state\n";
-            exit(1);
+            dumpState();
+            if (last) {
+                dumper->flushSnapshots();
+                exit(0);
+            }
+        } else if (!dumpDefaultState) {
+            std::cerr << call->no << ": " << (last ? "error" : "warning") << ": failed to dump state\n";
+            if (last) {
+                dumper->flushSnapshots();
+                exit(1);
+            }
         }
     }
 }
@@ -730,6 +861,8 @@ mainLoop() {
     frameNo = 0;
 
     startTime = os::getTime();
+    frameStartTime = startTime;
+    frameStats.clear();
 
     if (singleThread) {
         trace::Call *call;
@@ -744,8 +877,20 @@ mainLoop() {
         RelayRace race;
         race.run();
     }
+    dumper->flushSnapshots();
     finishRendering();
 
+    if (retrace::profiling) {
+        profiler.flush();
+    }
+
+    // Iterations wouldn't match the range, so their times would be wrong
+    if (benchmarkFrameCount &&
+        frameNo < benchmarkFirstFrame + benchmarkFrameCount) {
+        std::cerr << "error: trace ended after " << frameNo << " frames, within the --benchmark-frames range\n";
+        exit(1);
+    }
+
     long long endTime = os::getTime();
     float timeInterval = (endTime - startTime) * (1.0 / os::timeFrequency);
 
@@ -756,6 +901,24 @@ mainLoop() {
             " average of " << (frameNo/timeInterval) << " fps\n";
     }
 
+    if (reportFrameStats) {
+        frameStats.writeReport(std::cout);
+    }
+
+    if (retrace::profiling && !retrace::profilingWithBackends &&
+        callSampler.enabled()) {
+        callSampler.writeReport(std::cout);
+    }
+
+    if (frameStatsFilename) {
+        std::ofstream os(frameStatsFilename);
+        if (os) {
+            frameStats.writeJSON(os, frameNo, timeInterval);
+        } else {
+            std::cerr << "error: failed to open " << frameStatsFilename << "\n";
+        }
+    }
+
     if (waitOnFinish) {
         waitForInput();
     } else {
@@ -780,7 +943,19 @@ usage(const char *argv0) {
         "      --pcpu              cpu profiling (cpu times per call)\n"
         "      --pgpu              gpu profiling (gpu times per draw call)\n"
         "      --ppd               pixels drawn profiling (pixels drawn per draw call)\n"
-        "      --pmem              memory usage profiling (vsize rss per call)\n"
+        "      --pmem              memory usage profiling (vsize rss per call, retracer memory counters per frame)\n"
+        "      --psample=N         only profile every Nth draw call and Nth other call, and extrapolate totals\n"
+        "      --psample-random=N  only profile a random 1 in N calls, and extrapolate totals\n"
+        "      --psample-calls=CALLSET  only profile the calls in CALLSET, and extrapolate totals\n"
+        "      --profile-format=FORMAT  call and metrics profile output format (`text` or `binary`; default is text)\n"
+        "      --frame-stats       report min/median/p95/p99/max frame times and their histogram\n"
+        "      --frame-stats-json=FILE  write frame time statistics to FILE as JSON\n"
+        "      --trace-events=FILE write the call profile to FILE as Chrome trace events, for\n"
+        "                          chrome://tracing or Perfetto (implies --pcpu --pgpu by default)\n"
+        "      --benchmark-frames=FIRST[-LAST]  cache the calls of these frames in memory, and\n"
+        "                          replay them repeatedly, reporting the time of each iteration\n"
+        "      --benchmark-warmup=N     number of iterations to exclude from the statistics (default is 1)\n"
+        "      --benchmark-iterations=N number of measured iterations (default is 5)\n"
         "      --pcalls            call profiling metrics selection\n"
         "      --pframes           frame profiling metrics selection\n"
         "      --pdrawcalls        draw call profiling metrics selection\n"
@@ -800,14 +975,20 @@ usage(const char *argv0) {
         "      --msaa-no-resolve   dump raw sample images of multisampled texture instead of resolved texture\n"
         "  -s, --snapshot-prefix=PREFIX    take snapshots; `-` for PNM stdout output\n"
         "      --snapshot-alpha    Include alpha channel in snapshots.\n"
-        "      --snapshot-format=FMT       use (PNM, RGB, or MD5; default is PNM) when writing to stdout output\n"
+        "      --snapshot-format=FMT       use (PNM, RGB, MD5, PHASH, PNG, or PNG-FAST; default is PNM) when writing to stdout output;\n"
+        "                                  PNG-FAST also selects faster, larger PNG encoding for snapshot files\n"
         "  -S, --snapshot=CALLSET  calls to snapshot (default is every frame)\n"
         "      --snapshot-interval=N    specify a frame interval when generating snaphots (default is 0)\n"
+        "      --snapshot-max-size=N    downscale color snapshots on the GPU to fit in NxN pixels\n"
         "  -t, --snapshot-threaded encode screenshots on multiple threads\n"
         "      --snapshot-force-backbuffer always read from the backbuffer when taking a snapshot (default read from the current draw buffer)\n"
         "  -v, --verbose           increase output verbosity\n"
-        "  -D, --dump-state=CALL   dump state at specific call no\n"
-        "      --dump-format=FORMAT dump state format (`json` or `ubjson`)\n"
+        "  -D, --dump-state=CALLSET    dump state at specific calls (0 for the default state)\n"
+        "      --dump-format=FORMAT dump state format (`json`, `ubjson`, `binary` or `binary-zlib`)\n"
+        "      --dump-incremental  when dumping several states, mark images and buffers\n"
+        "                          unchanged since the previous dump instead of writing them\n"
+        "      --dump-digests=FILE like --dump-incremental, but compare with (and update) the\n"
+        "                          dump whose digests are in FILE, possibly from another retrace\n"
         "      --min-frame-duration=MICROSECONDS   specify minimum frame rendering duration\n"
         "      --per-frame-delay=MICROSECONDS   add extra delay after each frame (in addition to min-frame-duration)\n"
         "  -w, --wait              waitOnFinish on final frame\n"
@@ -835,6 +1016,16 @@ enum {
     PGPU_OPT,
     PPD_OPT,
     PMEM_OPT,
+    PSAMPLE_OPT,
+    PSAMPLE_RANDOM_OPT,
+    PSAMPLE_CALLS_OPT,
+    PROFILE_FORMAT_OPT,
+    FRAME_STATS_OPT,
+    FRAME_STATS_JSON_OPT,
+    TRACE_EVENTS_OPT,
+    BENCHMARK_FRAMES_OPT,
+    BENCHMARK_WARMUP_OPT,
+    BENCHMARK_ITERATIONS_OPT,
     PCALLS_OPT,
     PFRAMES_OPT,
     PDRAWCALLS_OPT,
@@ -852,8 +1043,11 @@ enum {
     SNAPSHOT_ALPHA_OPT,
     SNAPSHOT_FORMAT_OPT,
     SNAPSHOT_INTERVAL_OPT,
+    SNAPSHOT_MAX_SIZE_OPT,
     SNAPSHOT_FORCE_BACKBUFFER_OPT,
     DUMP_FORMAT_OPT,
+    DUMP_INCREMENTAL_OPT,
+    DUMP_DIGESTS_OPT,
     MARKERS_OPT,
     MIN_CPU_TIME_OPT,
     QUERY_HANDLING_OPT,
@@ -877,6 +1071,8 @@ longOptions[] = {
     {"driver", required_argument, 0, DRIVER_OPT},
     {"dump-state", required_argument, 0, 'D'},
     {"dump-format", required_argument, 0, DUMP_FORMAT_OPT},
+    {"dump-incremental", no_argument, 0, DUMP_INCREMENTAL_OPT},
+    {"dump-digests", required_argument, 0, DUMP_DIGESTS_OPT},
     {"fullscreen", no_argument, 0, FULLSCREEN_OPT},
     {"headless", no_argument, 0, HEADLESS_OPT},
     {"help", no_argument, 0, 'h'},
@@ -887,6 +1083,16 @@ longOptions[] = {
     {"pgpu", no_argument, 0, PGPU_OPT},
     {"ppd", no_argument, 0, PPD_OPT},
     {"pmem", no_argument, 0, PMEM_OPT},
+    {"psample", required_argument, 0, PSAMPLE_OPT},
+    {"psample-random", required_argument, 0, PSAMPLE_RANDOM_OPT},
+    {"psample-calls", required_argument, 0, PSAMPLE_CALLS_OPT},
+    {"profile-format", required_argument, 0, PROFILE_FORMAT_OPT},
+    {"frame-stats", no_argument, 0, FRAME_STATS_OPT},
+    {"frame-stats-json", required_argument, 0, FRAME_STATS_JSON_OPT},
+    {"trace-events", required_argument, 0, TRACE_EVENTS_OPT},
+    {"benchmark-frames", required_argument, 0, BENCHMARK_FRAMES_OPT},
+    {"benchmark-warmup", required_argument, 0, BENCHMARK_WARMUP_OPT},
+    {"benchmark-iterations", required_argument, 0, BENCHMARK_ITERATIONS_OPT},
     {"pcalls", required_argument, 0, PCALLS_OPT},
     {"pframes", required_argument, 0, PFRAMES_OPT},
     {"pdrawcalls", required_argument, 0, PDRAWCALLS_OPT},
@@ -899,6 +1105,7 @@ longOptions[] = {
     {"snapshot-alpha", no_argument, 0, SNAPSHOT_ALPHA_OPT},
     {"snapshot-format", required_argument, 0, SNAPSHOT_FORMAT_OPT},
     {"snapshot-interval", required_argument, 0, SNAPSHOT_INTERVAL_OPT},
+    {"snapshot-max-size", required_argument, 0, SNAPSHOT_MAX_SIZE_OPT},
     {"snapshot-force-backbuffer", no_argument, 0, SNAPSHOT_FORCE_BACKBUFFER_OPT},
     {"snapshot-prefix", required_argument, 0, 's'},
     {"snapshot-threaded", no_argument, 0, 't'},
@@ -1162,7 +1369,11 @@ int main(int argc, char **argv)
             useCallNos = trace::boolOption(optarg);
             break;
         case 'D':
-            dumpStateCallNo = atoi(optarg);
+            if (strcmp(optarg, "0") == 0) {
+                dumpDefaultState = true;
+            } else {
+                dumpStateCalls.merge(optarg);
+            }
             dumpingState = true;
             retrace::verbosity = -2;
             break;
@@ -1172,11 +1383,29 @@ int main(int argc, char **argv)
             } else if (strcasecmp(optarg, "ubjson") == 0) {
                 os::setBinaryMode(stdout);
                 stateWriterFactory = &createUBJSONStateWriter;
+            } else if (strcasecmp(optarg, "binary") == 0) {
+                os::setBinaryMode(stdout);
+                stateWriterFactory = [](std::ostream &os) {
+                    return createBinaryStateWriter(os);
+                };
+            } else if (strcasecmp(optarg, "binary-zlib") == 0) {
+                os::setBinaryMode(stdout);
+                stateWriterFactory = [](std::ostream &os) {
+                    return createBinaryStateWriter(os, true);
+                };
             } else {
                 std::cerr << "error: unsupported dump format `" << optarg << "`\n";
                 return EXIT_FAILURE;
             }
             break;
+        case DUMP_INCREMENTAL_OPT:
+            dumpStateIncremental = true;
+            break;
+        case DUMP_DIGESTS_OPT:
+            dumpStateIncremental = true;
+            stateDigestsFilename = optarg;
+            loadStateDigests(stateDigestsFilename, stateDigests);
+            break;
         case CORE_OPT:
             retrace::setFeatureLevel("3_2_core");
             break;
@@ -1264,7 +1493,14 @@ int main(int argc, char **argv)
                 snapshotFormat = RAW_RGB;
             else if (strcmp(optarg, "MD5") == 0)
                 snapshotFormat = RAW_MD5;
-            else
+            else if (strcmp(optarg, "PHASH") == 0)
+                snapshotFormat = PHASH_FMT;
+            else if (strcmp(optarg, "PNG") == 0)
+                snapshotFormat = PNG_FMT;
+            else if (strcmp(optarg, "PNG-FAST") == 0) {
+                snapshotFormat = PNG_FMT;
+                retrace::snapshotFastPNG = true;
+            } else
                 snapshotFormat = PNM_FMT;
             break;
         case 'S':
@@ -1274,6 +1510,9 @@ int main(int argc, char **argv)
         case SNAPSHOT_INTERVAL_OPT:
             snapshotInterval = atoi(optarg);
             break;
+        case SNAPSHOT_MAX_SIZE_OPT:
+            retrace::snapshotMaxSize = trace::intOption(optarg, 0);
+            break;
         case SNAPSHOT_FORCE_BACKBUFFER_OPT:
             snapshotForceBackbuffer = true;
             break;
@@ -1333,6 +1572,57 @@ int main(int argc, char **argv)
 
             retrace::profilingMemoryUsage = true;
             break;
+        case PSAMPLE_OPT:
+            retrace::callSampler.sampleEvery(trace::intOption(optarg, 1));
+            break;
+        case PSAMPLE_RANDOM_OPT:
+            retrace::callSampler.sampleRandom(trace::intOption(optarg, 1));
+            break;
+        case PSAMPLE_CALLS_OPT:
+            retrace::callSampler.sampleCalls(optarg);
+            break;
+        case PROFILE_FORMAT_OPT:
+            if (strcasecmp(optarg, "text") == 0) {
+                retrace::profilingBinary = false;
+            } else if (strcasecmp(optarg, "binary") == 0) {
+                os::setBinaryMode(stdout);
+                retrace::profilingBinary = true;
+            } else {
+                std::cerr << "error: unsupported profile format `" << optarg << "`\n";
+                return EXIT_FAILURE;
+            }
+            break;
+        case FRAME_STATS_OPT:
+            retrace::recordFrameStats = true;
+            reportFrameStats = true;
+            break;
+        case FRAME_STATS_JSON_OPT:
+            retrace::recordFrameStats = true;
+            frameStatsFilename = optarg;
+            break;
+        case TRACE_EVENTS_OPT:
+            traceEventsFilename = optarg;
+            break;
+        case BENCHMARK_FRAMES_OPT:
+            {
+                unsigned first = 0, last = 0;
+                int n = sscanf(optarg, "%u-%u", &first, &last);
+                if (n < 1 || (n == 2 && last < first)) {
+                    std::cerr << "error: invalid frame range `" << optarg << "`\n";
+                    return EXIT_FAILURE;
+                }
+                benchmarkFirstFrame = first;
+                benchmarkFrameCount = n == 2 ? last - first + 1 : 1;
+                retrace::recordFrameStats = true;
+                reportFrameStats = true;
+            }
+            break;
+        case BENCHMARK_WARMUP_OPT:
+            benchmarkWarmup = trace::intOption(optarg, 1);
+            break;
+        case BENCHMARK_ITERATIONS_OPT:
+            benchmarkIterations = trace::intOption(optarg, 5);
+            break;
         case PCALLS_OPT:
             retrace::debug = 0;
             retrace::profiling = true;
@@ -1401,6 +1691,16 @@ int main(int argc, char **argv)
         }
     }
 
+    if (loopCount && benchmarkFrameCount) {
+        std::cerr << "error: --loop can't be combined with --benchmark-frames\n";
+        return EXIT_FAILURE;
+    }
+
+    if (traceEventsFilename && retrace::profilingWithBackends) {
+        std::cerr << "error: --trace-events can't be combined with --pcalls, --pframes or --pdrawcalls\n";
+        return EXIT_FAILURE;
+    }
+
     if (loopCount) {
         std::cerr << "warning: --loop blindly repeats the last frame calls, therefore frames might not necessarily render correctly (https://github.com/apitrace/apitrace/issues/800)" << std::endl;
     }
@@ -1427,13 +1727,35 @@ int main(int argc, char **argv)
         snapshotter = new Snapshotter();
     }
 
+    if (traceEventsFilename && !retrace::profiling) {
+        retrace::debug = 0;
+        retrace::profiling = true;
+        retrace::verbosity = -1;
+
+        retrace::profilingCpuTimes = true;
+        retrace::profilingGpuTimes = true;
+    }
+
+    if (retrace::callSampler.enabled() &&
+        (retrace::profilingWithBackends ||
+         !(retrace::profilingCpuTimes || retrace::profilingGpuTimes ||
+           retrace::profilingPixelsDrawn))) {
+        std::cerr << "warning: --psample, --psample-random and --psample-calls only apply to --pcpu, --pgpu and --ppd profiling\n";
+    }
+
     retrace::setUp();
     if (retrace::profiling && !retrace::profilingWithBackends) {
         retrace::profiler.setup(retrace::profilingCpuTimes,
                                 retrace::profilingGpuTimes,
                                 retrace::profilingPixelsDrawn,
                                 retrace::profilingMemoryUsage,
-                                retrace::minCpuTime);
+                                retrace::minCpuTime,
+                                retrace::profilingBinary);
+        if (traceEventsFilename &&
+            !retrace::profiler.openTraceEvents(traceEventsFilename)) {
+            std::cerr << "error: failed to open " << traceEventsFilename << "\n";
+            return EXIT_FAILURE;
+        }
     }
 
     os::setExceptionCallback(exceptionCallback);
@@ -1445,6 +1767,9 @@ int main(int argc, char **argv)
             parser = new trace::Parser;
             if (loopCount) {
                 parser = lastFrameLoopParser(parser, loopCount);
+            } else if (benchmarkFrameCount) {
+                parser = trace::frameRangeLoopParser(parser, benchmarkFirstFrame, benchmarkFrameCount,
+                                                     benchmarkWarmup + benchmarkIterations);
             }
 
             if (!parser->open(argv[i])) {
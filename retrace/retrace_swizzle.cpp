@@ -151,6 +151,7 @@ addRegion(trace::Call &call, unsigned long long address, void *buffer, unsigned
     region.size = size;
 
     regionMap[address] = region;
+    os::setMemoryCounter(os::MEMORY_REGIONS, regionMap.size());
 }
 
 static RegionMap::iterator
@@ -188,6 +189,7 @@ delRegion(unsigned long long address) {
     RegionMap::iterator it = lookupRegion(address);
     if (it != regionMap.end()) {
         regionMap.erase(it);
+        os::setMemoryCounter(os::MEMORY_REGIONS, regionMap.size());
     } else {
         assert(0);
     }
@@ -199,6 +201,7 @@ delRegionByPointer(void *ptr) {
     for (RegionMap::iterator it = regionMap.begin(); it != regionMap.end(); ++it) {
         if (it->second.buffer == ptr) {
             regionMap.erase(it);
+            os::setMemoryCounter(os::MEMORY_REGIONS, regionMap.size());
             return;
         }
     }
@@ -28,6 +28,7 @@
 
 #include <map>
 
+#include "os_memory_counters.hpp"
 #include "trace_model.hpp"
 
 
@@ -69,6 +70,7 @@ public:
         typename base_type::iterator it;
         it = base.find(key);
         if (it == base.end()) {
+            os::addMemoryCounter(os::MEMORY_HANDLES, 1);
             return (base[key] = key);
         }
         return it->second;
@@ -78,6 +80,7 @@ public:
         typename base_type::const_iterator it;
         it = base.find(key);
         if (it == base.end()) {
+            os::addMemoryCounter(os::MEMORY_HANDLES, 1);
             return (base[key] = key);
         }
         return it->second;
@@ -98,6 +101,7 @@ public:
         if (it != base.begin()) {
             --it;
         } else {
+            os::addMemoryCounter(os::MEMORY_HANDLES, 1);
             return (base[key] = key);
         }
         T t = it->second + (key - it->first);
@@ -31,6 +31,8 @@
 #include <stdlib.h>
 #include <algorithm>
 
+#include "os_memory_counters.hpp"
+
 /**
  * Similar to alloca(), but implemented with malloc.
  */
@@ -50,16 +52,20 @@ public:
         /* Always return valid address, even when size is zero */
         size = std::max(size, sizeof(uintptr_t));
 
-        uintptr_t * buf = static_cast<uintptr_t *>(malloc(sizeof(uintptr_t) + size));
+        /* Each allocation is prefixed by its size and the link to the next */
+        uintptr_t * buf = static_cast<uintptr_t *>(malloc(2 * sizeof(uintptr_t) + size));
         if (!buf) {
             return NULL;
         }
 
-        *buf = next;
-        next = reinterpret_cast<uintptr_t>(buf);
+        os::addMemoryCounter(os::MEMORY_SCOPED_BYTES, size);
+
+        buf[0] = size;
+        buf[1] = next;
+        next = reinterpret_cast<uintptr_t>(&buf[1]);
         assert((next & 1) == 0);
 
-        return static_cast<void *>(&buf[1]);
+        return static_cast<void *>(&buf[2]);
     }
     
     /* XXX: See comment in retrace::ScopedAllocator::allocArray template. */
@@ -83,13 +89,17 @@ public:
     inline
     ~ScopedAllocator() {
         while (next) {
-            uintptr_t temp = *reinterpret_cast<uintptr_t *>(next);
+            uintptr_t *link = reinterpret_cast<uintptr_t *>(next);
+            uintptr_t temp = *link;
 
             bool bind = temp & 1;
             temp &= ~1;
 
+            // Bound allocations are no longer ours to account for
+            os::addMemoryCounter(os::MEMORY_SCOPED_BYTES, -(long long)link[-1]);
+
             if (!bind) {
-                free(reinterpret_cast<void *>(next));
+                free(&link[-1]);
             }
 
             next = temp;
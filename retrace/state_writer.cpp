@@ -49,6 +49,30 @@ StateWriter::writeImage(image::Image *image,
         return;
     }
 
+    writeEncodedImage(image, desc, encodeImage(image));
+}
+
+
+std::string
+StateWriter::encodeImage(const image::Image *image)
+{
+    std::stringstream ss;
+
+    if (image->channelType == image::TYPE_UNORM8) {
+        image->writePNG(ss);
+    } else {
+        image->writePNM(ss);
+    }
+
+    return ss.str();
+}
+
+
+void
+StateWriter::writeEncodedImage(const image::Image *image,
+                               const ImageDesc & desc,
+                               const std::string & data)
+{
     beginObject();
 
     // Tell the GUI this is no ordinary object, but an image
@@ -65,17 +89,47 @@ StateWriter::writeImage(image::Image *image,
     }
 
     beginMember("__data__");
-    std::stringstream ss;
+    writeBlob(data.data(), data.size());
+    endMember(); // __data__
 
-    if (image->channelType == image::TYPE_UNORM8) {
-        image->writePNG(ss);
-    } else {
-        image->writePNM(ss);
-    }
+    endObject();
+}
+
+
+bool
+StateWriter::isUnchanged(const char *member, const std::string &fingerprint)
+{
+    return false;
+}
+
+
+bool
+StateWriter::isUnchangedImage(const char *member, const image::Image *image,
+                              const ImageDesc & desc)
+{
+    return false;
+}
+
+
+void
+StateWriter::writeUnchanged(void)
+{
+    beginObject();
+    writeBoolMember("__unchanged__", true);
+    endObject();
+}
 
-    const std::string & s = ss.str();
-    writeBlob(s.data(), s.size());
-    endMember(); // __data__
 
+void
+StateWriter::writeUnchangedImage(unsigned width, unsigned height,
+                                 const ImageDesc & desc)
+{
+    beginObject();
+    writeStringMember("__class__", "image");
+    writeIntMember("__width__", width);
+    writeIntMember("__height__", height / desc.depth);
+    writeIntMember("__depth__", desc.depth);
+    writeStringMember("__format__", desc.format.c_str());
+    writeBoolMember("__unchanged__", true);
     endObject();
 }
@@ -31,6 +31,7 @@
 #include <stddef.h>
 #include <wchar.h>
 
+#include <map>
 #include <ostream>
 #include <type_traits>
 #include <string>
@@ -162,15 +163,59 @@ public:
         {}
     };
 
-    void
+    virtual void
     writeImage(image::Image *image, const ImageDesc & desc);
 
+    /*
+     * Encode the image data as writeImage does.  It doesn't touch the writer
+     * state, so several images can be encoded concurrently, and then written
+     * in order with writeEncodedImage.
+     */
+    virtual std::string
+    encodeImage(const image::Image *image);
+
+    virtual void
+    writeEncodedImage(const image::Image *image, const ImageDesc & desc,
+                      const std::string & data);
+
     inline void
     writeImage(image::Image *image) {
         ImageDesc desc;
         writeImage(image, desc);
     }
 
+    /*
+     * Incremental dumps.
+     *
+     * Record the fingerprint of the value about to be written as the given
+     * member of the current object, and return true if it matches the one
+     * recorded at the same place by the previous dump.  The value should then
+     * be written with writeUnchanged or writeUnchangedImage, which spares
+     * reading it back or encoding it.  Other writers always return false.
+     */
+    virtual bool
+    isUnchanged(const char *member, const std::string &fingerprint);
+
+    inline bool
+    isUnchanged(const std::string &member, const std::string &fingerprint) {
+        return isUnchanged(member.c_str(), fingerprint);
+    }
+
+    // Same, with the image contents as the fingerprint, unless the member
+    // was already checked
+    virtual bool
+    isUnchangedImage(const char *member, const image::Image *image, const ImageDesc & desc);
+
+    inline bool
+    isUnchangedImage(const std::string &member, const image::Image *image, const ImageDesc & desc) {
+        return isUnchangedImage(member.c_str(), image, desc);
+    }
+
+    void
+    writeUnchanged(void);
+
+    void
+    writeUnchangedImage(unsigned width, unsigned height, const ImageDesc & desc);
 };
 
 
@@ -180,3 +225,40 @@ createJSONStateWriter(std::ostream &os);
 
 StateWriter *
 createUBJSONStateWriter(std::ostream &os);
+
+
+/*
+ * Chunked binary format, where blobs and image pixels are written raw (or
+ * zlib compressed) and indexed by a table of contents.
+ */
+StateWriter *
+createBinaryStateWriter(std::ostream &os, bool compress = false);
+
+
+/*
+ * Digests of the images and blobs written by the previous state dump, indexed
+ * by their path in the state.
+ */
+typedef std::map<std::string, std::string> StateDigests;
+
+
+/*
+ * Wrap a state writer (taking ownership of it) so that images and large blobs
+ * identical to those at the same path in the previous dump are written as
+ * {"__unchanged__": true}.  digests is updated when the returned writer is
+ * destroyed.
+ */
+StateWriter *
+createIncrementalStateWriter(StateWriter *writer, StateDigests &digests);
+
+
+/*
+ * Keep digests in a file between retraces, so that consecutive processes can
+ * dump states incrementally (which is what the GUI does).  Loading a missing
+ * file yields no digests.
+ */
+void
+loadStateDigests(const char *filename, StateDigests &digests);
+
+bool
+saveStateDigests(const char *filename, const StateDigests &digests);
@@ -0,0 +1,327 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Chunked binary state format.
+ *
+ * The state tree is written as JSON, but blobs and image pixels are
+ * written out of line as raw (optionally zlib compressed) chunks, referenced
+ * from the tree as {"__chunk__": index}.  A table of contents at the end
+ * lists every chunk with its path in the state and its offset, so that
+ * consumers can seek straight to the object they need.
+ *
+ * All integers are little-endian.  A dump consists of:
+ *
+ *   header:   "APISTATE" u32 version u32 reserved
+ *   chunks:   u32 tag u32 compression u64 stored_size u64 size data...
+ *               'BLOB' one per blob or image, in order of appearance
+ *               'TREE' the state tree
+ *               'TOC ' the table of contents, as JSON
+ *   trailer:  u64 toc_offset u64 dump_size "APISTOC\0"
+ *
+ * Offsets are relative to the start of the dump, and the dump size lets
+ * readers walk back through several dumps concatenated in the same file.
+ * Image chunks contain the rows top to bottom, without padding.
+ */
+
+
+#include "state_writer_path.hpp"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <sstream>
+#include <vector>
+
+#include <zlib.h>
+
+#include "image.hpp"
+
+
+#define BINARY_STATE_VERSION 1
+
+#define CHUNK_COMPRESSION_NONE 0
+#define CHUNK_COMPRESSION_ZLIB 1
+
+
+namespace {
+
+
+class BinaryStateWriter : public PathStateWriter
+{
+private:
+    struct Chunk {
+        std::string path;
+        uint64_t offset;
+        uint64_t size;
+        uint64_t storedSize;
+        unsigned compression;
+
+        // Layout of image chunks, so they can be extracted on their own
+        unsigned width = 0;
+        unsigned height = 0;
+        unsigned channels = 0;
+        bool floating = false;
+    };
+
+    std::ostream &os;
+    bool compress;
+    uint64_t offset = 0;
+
+    std::stringstream tree;
+
+    std::vector<Chunk> chunks;
+    std::vector<unsigned char> compressed;
+
+    void
+    write(const void *data, size_t size) {
+        os.write((const char *)data, size);
+        offset += size;
+    }
+
+    void
+    writeUInt32(uint32_t u) {
+        unsigned char buf[4];
+        for (unsigned i = 0; i < sizeof buf; ++i) {
+            buf[i] = u & 0xff;
+            u >>= 8;
+        }
+        write(buf, sizeof buf);
+    }
+
+    void
+    writeUInt64(uint64_t u) {
+        unsigned char buf[8];
+        for (unsigned i = 0; i < sizeof buf; ++i) {
+            buf[i] = u & 0xff;
+            u >>= 8;
+        }
+        write(buf, sizeof buf);
+    }
+
+    void
+    writeChunkHeader(const char *tag, unsigned compression,
+                     uint64_t storedSize, uint64_t size) {
+        write(tag, 4);
+        writeUInt32(compression);
+        writeUInt64(storedSize);
+        writeUInt64(size);
+    }
+
+    bool
+    deflateRows(const unsigned char *rows, ptrdiff_t stride,
+                size_t rowSize, size_t numRows) {
+        size_t size = rowSize * numRows;
+        compressed.resize(compressBound(size));
+
+        z_stream strm;
+        memset(&strm, 0, sizeof strm);
+        if (deflateInit(&strm, Z_BEST_SPEED) != Z_OK) {
+            return false;
+        }
+        strm.next_out = compressed.data();
+        strm.avail_out = compressed.size();
+
+        int ret = Z_OK;
+        const unsigned char *row = rows;
+        for (size_t y = 0; y < numRows && ret == Z_OK; ++y, row += stride) {
+            strm.next_in = const_cast<unsigned char *>(row);
+            strm.avail_in = rowSize;
+            ret = deflate(&strm, y + 1 == numRows ? Z_FINISH : Z_NO_FLUSH);
+        }
+        if (numRows == 0) {
+            ret = deflate(&strm, Z_FINISH);
+        }
+
+        compressed.resize(strm.total_out);
+        deflateEnd(&strm);
+        if (ret != Z_STREAM_END) {
+            return false;
+        }
+
+        // Not worth decompressing unless it saves at least 1/8
+        return compressed.size() < size - size/8;
+    }
+
+    /*
+     * Write numRows rows of rowSize bytes each, stride bytes apart, as a
+     * chunk, and return its index.
+     */
+    unsigned
+    writeDataChunk(Chunk &chunk, const unsigned char *rows, ptrdiff_t stride,
+                   size_t rowSize, size_t numRows) {
+        chunk.offset = offset;
+        chunk.size = rowSize * numRows;
+
+        if (compress && deflateRows(rows, stride, rowSize, numRows)) {
+            chunk.compression = CHUNK_COMPRESSION_ZLIB;
+            chunk.storedSize = compressed.size();
+            writeChunkHeader("BLOB", chunk.compression, chunk.storedSize, chunk.size);
+            write(compressed.data(), compressed.size());
+        } else {
+            chunk.compression = CHUNK_COMPRESSION_NONE;
+            chunk.storedSize = chunk.size;
+            writeChunkHeader("BLOB", chunk.compression, chunk.storedSize, chunk.size);
+            const unsigned char *row = rows;
+            for (size_t y = 0; y < numRows; ++y, row += stride) {
+                write(row, rowSize);
+            }
+        }
+
+        chunks.push_back(chunk);
+        return chunks.size() - 1;
+    }
+
+    void
+    writeChunkReference(unsigned index) {
+        writer->beginObject();
+        writer->writeIntMember("__chunk__", index);
+        writer->endObject();
+    }
+
+    void
+    writeTableOfContents(uint64_t treeOffset) {
+        std::stringstream ss;
+        {
+            StateWriter *toc = createJSONStateWriter(ss);
+            toc->writeIntMember("version", BINARY_STATE_VERSION);
+            toc->writeIntMember("tree", treeOffset);
+            toc->beginMember("chunks");
+            toc->beginArray();
+            for (auto & chunk : chunks) {
+                toc->beginObject();
+                toc->writeStringMember("path", chunk.path.c_str());
+                toc->writeIntMember("offset", chunk.offset);
+                toc->writeIntMember("size", chunk.size);
+                toc->writeIntMember("stored_size", chunk.storedSize);
+                toc->writeStringMember("compression",
+                    chunk.compression == CHUNK_COMPRESSION_ZLIB ? "zlib" : "none");
+                if (chunk.channels) {
+                    toc->writeIntMember("width", chunk.width);
+                    toc->writeIntMember("height", chunk.height);
+                    toc->writeIntMember("channels", chunk.channels);
+                    toc->writeStringMember("type", chunk.floating ? "FLOAT" : "UNORM8");
+                }
+                toc->endObject();
+            }
+            toc->endArray();
+            toc->endMember(); // chunks
+            delete toc;
+        }
+
+        const std::string & s = ss.str();
+        writeChunkHeader("TOC ", CHUNK_COMPRESSION_NONE, s.size(), s.size());
+        write(s.data(), s.size());
+    }
+
+public:
+    BinaryStateWriter(std::ostream &_os, bool _compress) :
+        os(_os),
+        compress(_compress)
+    {
+        write("APISTATE", 8);
+        writeUInt32(BINARY_STATE_VERSION);
+        writeUInt32(0);
+
+        // The top level object is begun by the JSON writer itself, and
+        // everything but the data goes into it
+        writer = createJSONStateWriter(tree);
+    }
+
+    ~BinaryStateWriter() {
+        delete writer;
+
+        uint64_t treeOffset = offset;
+        const std::string & s = tree.str();
+        writeChunkHeader("TREE", CHUNK_COMPRESSION_NONE, s.size(), s.size());
+        write(s.data(), s.size());
+
+        uint64_t tocOffset = offset;
+        writeTableOfContents(treeOffset);
+
+        writeUInt64(tocOffset);
+        writeUInt64(offset + 16);
+        os.write("APISTOC", 8);
+    }
+
+    void
+    writeBlob(const void *bytes, size_t size) override {
+        Chunk chunk;
+        chunk.path = valuePath();
+        unsigned index = writeDataChunk(chunk, (const unsigned char *)bytes,
+                                        size, size, 1);
+        beginValue();
+        writeChunkReference(index);
+        endValue();
+    }
+
+    std::string
+    encodeImage(const image::Image *image) override {
+        // Pixels are written as they are
+        return std::string();
+    }
+
+    void
+    writeEncodedImage(const image::Image *image, const ImageDesc & desc,
+                      const std::string & data) override {
+        Chunk chunk;
+        chunk.path = valuePath() + "/__data__";
+        chunk.width = image->width;
+        chunk.height = image->height;
+        chunk.channels = image->channels;
+        chunk.floating = image->channelType == image::TYPE_FLOAT;
+        unsigned index = writeDataChunk(chunk, image->start(), image->stride(),
+                                        image->width * image->bytesPerPixel,
+                                        image->height);
+
+        beginValue();
+        writer->beginObject();
+        writer->writeStringMember("__class__", "image");
+        writer->writeIntMember("__width__", image->width);
+        writer->writeIntMember("__height__", image->height / desc.depth);
+        writer->writeIntMember("__depth__", desc.depth);
+        writer->writeStringMember("__format__", desc.format.c_str());
+        if (!image->label.empty()) {
+            writer->writeStringMember("__label__", image->label.c_str());
+        }
+        writer->writeIntMember("__channels__", image->channels);
+        writer->writeStringMember("__type__", chunk.floating ? "FLOAT" : "UNORM8");
+        writer->beginMember("__data__");
+        writeChunkReference(index);
+        writer->endMember(); // __data__
+        writer->endObject();
+        endValue();
+    }
+};
+
+
+}
+
+
+StateWriter *
+createBinaryStateWriter(std::ostream &os, bool compress)
+{
+    return new BinaryStateWriter(os, compress);
+}
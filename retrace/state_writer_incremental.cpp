@@ -0,0 +1,219 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * State writer decorator for incremental state dumps.
+ *
+ * It tracks the path of every value, and for images and large blobs compares an MD5 digest of their contents with
+ * the one written at the same path by the previous dump.  Identical ones
+ * are replaced by {"__unchanged__": true}, which spares encoding and
+ * transferring them again; consumers take the value from the previous state.
+ *
+ * Dumpers which can tell whether an object changed without reading it back
+ * check their own fingerprint with isUnchanged first.
+ */
+
+
+#include "state_writer_path.hpp"
+
+#include <assert.h>
+
+#include <fstream>
+#include <sstream>
+
+#include "image.hpp"
+
+
+// Blobs smaller than this are cheaper to write than to look up
+#define MIN_DIGEST_SIZE 1024
+
+
+namespace {
+
+
+class IncrementalStateWriter : public PathStateWriter
+{
+private:
+    StateDigests &previous;
+    StateDigests current;
+
+    // Returns true if the fingerprint matches the previous dump's.  Only
+    // its digest is kept, so that digests can be saved to a file.
+    bool
+    checkDigest(const std::string &key, const std::string &fingerprint) {
+        char digest[33];
+        image::md5((const unsigned char *)fingerprint.data(), fingerprint.size(),
+                   fingerprint.size(), 1, digest);
+        current[key] = digest;
+        auto it = previous.find(key);
+        return it != previous.end() && it->second == digest;
+    }
+
+    // Whether the caller already checked the value with isUnchanged
+    bool
+    isChecked(const std::string &key) const {
+        return current.find(key) != current.end();
+    }
+
+public:
+    IncrementalStateWriter(StateWriter *_writer, StateDigests &digests) :
+        PathStateWriter(_writer),
+        previous(digests)
+    {
+    }
+
+    ~IncrementalStateWriter() {
+        delete writer;
+        previous.swap(current);
+    }
+
+    void
+    writeBlob(const void *bytes, size_t size) override {
+        std::string key = valuePath();
+        if (size >= MIN_DIGEST_SIZE && !isChecked(key)) {
+            char digest[33];
+            image::md5((const unsigned char *)bytes, size, size, 1, digest);
+            if (checkDigest(key, digest)) {
+                writeUnchanged();
+                return;
+            }
+        }
+
+        PathStateWriter::writeBlob(bytes, size);
+    }
+
+    // Hash the raw pixels, which is much cheaper than encoding them
+    static std::string
+    imageFingerprint(const image::Image *image, const ImageDesc & desc) {
+        char digest[33];
+        image::md5(image->start(), image->stride(),
+                   image->width * image->bytesPerPixel, image->height, digest);
+
+        std::stringstream ss;
+        ss << image->width << 'x' << image->height << 'x' << image->channels
+           << ':' << image->channelType << ':' << desc.depth << ':' << desc.format
+           << ':' << image->label << ':' << digest;
+        return ss.str();
+    }
+
+    // Returns true if the image was written as unchanged
+    bool
+    writeUnchangedImage(const image::Image *image, const ImageDesc & desc) {
+        std::string key = valuePath();
+        if (isChecked(key) ||
+            !checkDigest(key, imageFingerprint(image, desc))) {
+            return false;
+        }
+
+        StateWriter::writeUnchangedImage(image->width, image->height, desc);
+        return true;
+    }
+
+    bool
+    isUnchanged(const char *member, const std::string &fingerprint) override {
+        assert(!inArray());
+        return checkDigest(memberPath(member), fingerprint);
+    }
+
+    bool
+    isUnchangedImage(const char *member, const image::Image *image,
+                     const ImageDesc & desc) override {
+        assert(!inArray());
+        std::string key = memberPath(member);
+        return !isChecked(key) &&
+               checkDigest(key, imageFingerprint(image, desc));
+    }
+
+    void
+    writeImage(image::Image *image, const ImageDesc & desc) override {
+        if (!image) {
+            StateWriter::writeImage(image, desc);
+            return;
+        }
+
+        if (!writeUnchangedImage(image, desc)) {
+            // Let the underlying writer encode it as it sees fit
+            beginValue();
+            writer->writeImage(image, desc);
+            endValue();
+        }
+    }
+
+    std::string
+    encodeImage(const image::Image *image) override {
+        return writer->encodeImage(image);
+    }
+
+    void
+    writeEncodedImage(const image::Image *image, const ImageDesc & desc,
+                      const std::string & data) override {
+        if (!writeUnchangedImage(image, desc)) {
+            beginValue();
+            writer->writeEncodedImage(image, desc, data);
+            endValue();
+        }
+    }
+};
+
+
+} /* anonymous namespace */
+
+
+StateWriter *
+createIncrementalStateWriter(StateWriter *writer, StateDigests &digests)
+{
+    return new IncrementalStateWriter(writer, digests);
+}
+
+
+void
+loadStateDigests(const char *filename, StateDigests &digests)
+{
+    digests.clear();
+
+    std::ifstream is(filename);
+    std::string line;
+    while (std::getline(is, line)) {
+        // Each line is the digest followed by the path
+        if (line.size() > 33 && line[32] == ' ') {
+            digests[line.substr(33)] = line.substr(0, 32);
+        }
+    }
+}
+
+
+bool
+saveStateDigests(const char *filename, const StateDigests &digests)
+{
+    std::ofstream os(filename);
+    for (auto & digest : digests) {
+        if (digest.first.find('\n') == std::string::npos) {
+            os << digest.second << ' ' << digest.first << '\n';
+        }
+    }
+    os.close();
+    return !os.fail();
+}
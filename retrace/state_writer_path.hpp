@@ -0,0 +1,212 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/*
+ * Base for state writers which pass the state on to another writer, while
+ * keeping track of the path (member names and array indices) of every value,
+ * e.g. "/textures/GL_TEXTURE0, GL_TEXTURE_2D, level = 0".
+ *
+ * Subclasses override the methods for the values they handle themselves, and
+ * bracket whatever they write in their place with beginValue and endValue.
+ */
+
+
+#pragma once
+
+
+#include <string>
+#include <vector>
+
+#include "state_writer.hpp"
+
+
+class PathStateWriter : public StateWriter
+{
+private:
+    struct Scope {
+        bool array;
+        unsigned nextIndex;
+    };
+
+    std::vector<std::string> path;
+    std::vector<Scope> scopes;
+
+protected:
+    // Where values are passed on to, deleted by the subclasses
+    StateWriter *writer;
+
+    PathStateWriter(StateWriter *_writer = nullptr) :
+        writer(_writer)
+    {
+        // The top level object is begun by the underlying writer itself
+        scopes.push_back(Scope{false, 0});
+    }
+
+    // Path of the value about to be written
+    std::string
+    valuePath(void) const {
+        std::string s = objectPath();
+        if (scopes.back().array) {
+            s += '/';
+            s += std::to_string(scopes.back().nextIndex);
+        }
+        return s;
+    }
+
+    // Path of the given member of the current object
+    std::string
+    memberPath(const char *member) const {
+        return objectPath() + '/' + member;
+    }
+
+    bool
+    inArray(void) const {
+        return scopes.back().array;
+    }
+
+    void
+    beginValue(void) {
+        Scope &scope = scopes.back();
+        if (scope.array) {
+            path.push_back(std::to_string(scope.nextIndex++));
+        }
+    }
+
+    void
+    endValue(void) {
+        if (scopes.back().array) {
+            path.pop_back();
+        }
+    }
+
+private:
+    std::string
+    objectPath(void) const {
+        std::string s;
+        for (auto & component : path) {
+            s += '/';
+            s += component;
+        }
+        return s;
+    }
+
+public:
+    void
+    beginObject(void) override {
+        beginValue();
+        scopes.push_back(Scope{false, 0});
+        writer->beginObject();
+    }
+
+    void
+    endObject(void) override {
+        writer->endObject();
+        scopes.pop_back();
+        endValue();
+    }
+
+    void
+    beginMember(const char * name) override {
+        path.push_back(name);
+        writer->beginMember(name);
+    }
+
+    void
+    endMember(void) override {
+        writer->endMember();
+        path.pop_back();
+    }
+
+    void
+    beginArray(void) override {
+        beginValue();
+        scopes.push_back(Scope{true, 0});
+        writer->beginArray();
+    }
+
+    void
+    endArray(void) override {
+        writer->endArray();
+        scopes.pop_back();
+        endValue();
+    }
+
+    void
+    writeString(const char *s) override {
+        beginValue();
+        writer->writeString(s);
+        endValue();
+    }
+
+    void
+    writeBlob(const void *bytes, size_t size) override {
+        beginValue();
+        writer->writeBlob(bytes, size);
+        endValue();
+    }
+
+    void
+    writeNull(void) override {
+        beginValue();
+        writer->writeNull();
+        endValue();
+    }
+
+    void
+    writeBool(bool b) override {
+        beginValue();
+        writer->writeBool(b);
+        endValue();
+    }
+
+    void
+    writeSInt(signed long long i) override {
+        beginValue();
+        writer->writeSInt(i);
+        endValue();
+    }
+
+    void
+    writeUInt(unsigned long long u) override {
+        beginValue();
+        writer->writeUInt(u);
+        endValue();
+    }
+
+    void
+    writeFloat(float f) override {
+        beginValue();
+        writer->writeFloat(f);
+        endValue();
+    }
+
+    void
+    writeFloat(double f) override {
+        beginValue();
+        writer->writeFloat(f);
+        endValue();
+    }
+};
@@ -25,9 +25,12 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 
 #include "image.hpp"
+#include "os_memory_counters.hpp"
 #include "os_string.hpp"
 #include "thread_pool.hpp"
 #include "retrace.hpp"
@@ -40,12 +43,12 @@ namespace image {
 static void
 actuallyWritePNG(const os::String& filename, image::Image *image)
 {
-    if (image->writePNG(filename, !retrace::snapshotAlpha) &&
+    if (image->writePNG(filename, !retrace::snapshotAlpha, retrace::snapshotFastPNG) &&
         retrace::verbosity >= 0) {
         std::cout << "Wrote " << filename << "\n";
     }
 
-    delete image;
+    image::releaseImage(image);
 }
 
 
@@ -67,18 +70,62 @@ public:
 
 /**
  * Write nb_thread snapshots at a time, to better use the available CPU resources.
+ *
+ * The images waiting to be encoded are limited to max_pending_bytes, so that
+ * retracing blocks instead of exhausting memory when encoding falls behind.
+ * Encoded images kept by the image pool for reuse count against the same
+ * budget.
  */
 class ThreadedSnapshotter : public Snapshotter
 {
 private:
+    std::mutex mutex;
+    std::condition_variable drained;
+    size_t pendingBytes = 0;
+    size_t maxPendingBytes;
+
+    // Must be destroyed first, as queued tasks refer to the members above
     ThreadPool pool;
+
     ThreadedSnapshotter() = delete;
 
+    void
+    encode(const os::String& filename, image::Image *image, size_t size) {
+        actuallyWritePNG(filename, image);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pendingBytes -= size;
+        }
+        os::addMemoryCounter(os::MEMORY_SNAPSHOT_BYTES, -(long long)size);
+        drained.notify_one();
+    }
+
 public:
-    ThreadedSnapshotter(size_t nb_threads) : pool(nb_threads) {}
+    static const size_t defaultMaxPendingBytes = 1024 * 1024 * 1024;
+
+    ThreadedSnapshotter(size_t nb_threads, size_t max_pending_bytes = defaultMaxPendingBytes) :
+        maxPendingBytes(max_pending_bytes),
+        pool(nb_threads)
+    {}
 
     virtual void
     writePNG(const os::String& filename, image::Image *image) override {
-        pool.enqueue(actuallyWritePNG, filename, image);
+        size_t size = image->sizeInBytes();
+
+        size_t idleBudget;
+        {
+            // Always let at least one image through, no matter how big
+            std::unique_lock<std::mutex> lock(mutex);
+            drained.wait(lock, [&] {
+                return pendingBytes == 0 || pendingBytes + size <= maxPendingBytes;
+            });
+            pendingBytes += size;
+            idleBudget = pendingBytes < maxPendingBytes ? maxPendingBytes - pendingBytes : 0;
+        }
+        image::trimFreeImages(idleBudget);
+        os::addMemoryCounter(os::MEMORY_SNAPSHOT_BYTES, size);
+
+        pool.enqueue(&ThreadedSnapshotter::encode, this, filename, image, size);
     }
 };
@@ -0,0 +1,249 @@
+#!/usr/bin/env python3
+##########################################################################
+#
+# Copyright 2026 apitrace contributors
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+
+'''Read the chunked binary state dumps.
+
+The input is the output of `glretrace --dump-format=binary -D ...`.  The
+table of contents at the end of each dump is used to list its chunks, or to
+extract a single blob or image without reading anything else; the whole
+state can also be converted to the same JSON `--dump-format=json` produces.
+'''
+
+
+import base64
+import json
+import optparse
+import struct
+import sys
+import zlib
+
+
+MAGIC = b'APISTATE'
+TRAILER_MAGIC = b'APISTOC\0'
+
+_chunkHeader = struct.Struct('<4sIQQ')
+_trailer = struct.Struct('<QQ8s')
+
+
+class Dump:
+
+    def __init__(self, start, toc):
+        self.start = start
+        self.toc = toc
+        self.chunks = toc['chunks']
+
+    def find(self, path):
+        for chunk in self.chunks:
+            if chunk['path'] == path:
+                return chunk
+        return None
+
+
+def is_binary_state(stream):
+    magic = stream.read(len(MAGIC))
+    stream.seek(-len(magic), 1)
+    return magic == MAGIC
+
+
+def _read_chunk_at(stream, offset):
+    stream.seek(offset)
+    tag, compression, storedSize, size = _chunkHeader.unpack(stream.read(_chunkHeader.size))
+    data = stream.read(storedSize)
+    if compression == 1:
+        data = zlib.decompress(data)
+    elif compression != 0:
+        raise ValueError('unsupported chunk compression %u' % compression)
+    assert len(data) == size
+    return tag, data
+
+
+def read_dumps(stream):
+    '''Locate all the dumps in the file, walking back from its end.'''
+    dumps = []
+    stream.seek(0, 2)
+    end = stream.tell()
+    while end > 0:
+        stream.seek(end - _trailer.size)
+        tocOffset, dumpSize, magic = _trailer.unpack(stream.read(_trailer.size))
+        if magic != TRAILER_MAGIC or dumpSize > end:
+            raise ValueError('not a binary state dump, or truncated')
+        start = end - dumpSize
+        tag, data = _read_chunk_at(stream, start + tocOffset)
+        assert tag == b'TOC '
+        dumps.append(Dump(start, json.loads(data.decode('utf-8'), strict=False)))
+        end = start
+    dumps.reverse()
+    return dumps
+
+
+def read_chunk(stream, dump, chunk):
+    tag, data = _read_chunk_at(stream, dump.start + chunk['offset'])
+    assert tag == b'BLOB'
+    return data
+
+
+def encode_png(data, width, height, channels):
+    colorType = {1: 0, 2: 4, 3: 2, 4: 6}[channels]
+    rowSize = width * channels
+    raw = b''.join(b'\0' + data[y*rowSize:(y + 1)*rowSize] for y in range(height))
+
+    def chunk(tag, payload):
+        crc = zlib.crc32(tag + payload) & 0xffffffff
+        return struct.pack('>I', len(payload)) + tag + payload + struct.pack('>I', crc)
+
+    return b'\x89PNG\r\n\x1a\n' + \
+        chunk(b'IHDR', struct.pack('>IIBBBBB', width, height, 8, colorType, 0, 0, 0)) + \
+        chunk(b'IDAT', zlib.compress(raw, 1)) + \
+        chunk(b'IEND', b'')
+
+
+def encode_pfm(data, width, height, channels):
+    '''Same layout Image::writePNM uses for floating point images.'''
+    if channels == 1:
+        identifier, outChannels = 'Pf', 1
+    elif channels <= 3:
+        identifier, outChannels = 'PF', 3
+    else:
+        identifier, outChannels = 'PX', 4
+    if outChannels != channels:
+        pixels = [data[i:i + 4*channels] for i in range(0, len(data), 4*channels)]
+        padding = b'\0' * 4 * (outChannels - channels)
+        data = b''.join(pixel + padding for pixel in pixels)
+    header = '%s\n%u %u\n1\n' % (identifier, width, height)
+    return header.encode('ascii') + data
+
+
+def encode_image(data, chunk):
+    if chunk['type'] == 'FLOAT':
+        return encode_pfm(data, chunk['width'], chunk['height'], chunk['channels'])
+    else:
+        return encode_png(data, chunk['width'], chunk['height'], chunk['channels'])
+
+
+def load_state(stream, dump, images=True):
+    '''Read the state tree, replacing chunk references with the base64
+    encoded data, as in JSON state dumps.  Images are encoded as PNG (or
+    PFM), unless images is false, in which case their data is omitted.'''
+
+    tag, data = _read_chunk_at(stream, dump.start + dump.toc['tree'])
+    assert tag == b'TREE'
+    state = json.loads(data.decode('utf-8'), strict=False)
+
+    def resolve(node):
+        if isinstance(node, dict):
+            if list(node.keys()) == ['__chunk__']:
+                chunk = dump.chunks[node['__chunk__']]
+                return base64.b64encode(read_chunk(stream, dump, chunk)).decode('ascii')
+            if node.get('__class__', None) == 'image' and '__data__' in node:
+                chunk = dump.chunks[node['__data__']['__chunk__']]
+                if images:
+                    data = encode_image(read_chunk(stream, dump, chunk), chunk)
+                    node['__data__'] = base64.b64encode(data).decode('ascii')
+                else:
+                    del node['__data__']
+                node.pop('__channels__', None)
+                node.pop('__type__', None)
+                return node
+            for name in list(node.keys()):
+                node[name] = resolve(node[name])
+        elif isinstance(node, list):
+            for i in range(len(node)):
+                node[i] = resolve(node[i])
+        return node
+
+    return resolve(state)
+
+
+def main():
+    optparser = optparse.OptionParser(
+        usage="\n\t%prog [options] <state_bin>")
+    optparser.add_option(
+        '-l', '--list',
+        action="store_true", dest="list", default=False,
+        help="list the chunks")
+    optparser.add_option(
+        '-x', '--extract', metavar='PATH',
+        type="string", dest="extract", default=None,
+        help="extract the blob or image at PATH (e.g. /textures/GL_TEXTURE_2D, level = 0)")
+    optparser.add_option(
+        '-n', '--dump', metavar='INDEX',
+        type="int", dest="dump", default=-1,
+        help="dump to read, when several were written [default: last]")
+    optparser.add_option(
+        '-o', '--output', metavar='FILE',
+        type="string", dest="output", default=None,
+        help="output file [default: stdout]")
+
+    (options, args) = optparser.parse_args(sys.argv[1:])
+
+    if len(args) != 1:
+        optparser.error('incorrect number of arguments')
+
+    stream = open(args[0], 'rb')
+    dumps = read_dumps(stream)
+    if not dumps:
+        sys.stderr.write('error: no state dump in %s\n' % args[0])
+        sys.exit(1)
+
+    if options.output is None:
+        output = sys.stdout.buffer
+    else:
+        output = open(options.output, 'wb')
+
+    if options.list:
+        dump = dumps[options.dump]
+        for chunk in dump.chunks:
+            line = '%s\t%u' % (chunk['path'], chunk['size'])
+            if chunk['compression'] != 'none':
+                line += '\t%u %s' % (chunk['stored_size'], chunk['compression'])
+            output.write((line + '\n').encode('utf-8'))
+    elif options.extract is not None:
+        dump = dumps[options.dump]
+        path = options.extract.rstrip('/')
+        chunk = dump.find(path)
+        if chunk is None:
+            chunk = dump.find(path + '/__data__')
+        if chunk is None:
+            sys.stderr.write('error: no blob or image at %s\n' % options.extract)
+            sys.exit(1)
+        data = read_chunk(stream, dump, chunk)
+        if 'channels' in chunk:
+            data = encode_image(data, chunk)
+        output.write(data)
+    else:
+        # Convert to JSON
+        if options.dump != -1:
+            dumps = [dumps[options.dump]]
+        for dump in dumps:
+            state = load_state(stream, dump)
+            output.write(json.dumps(state, indent=2, sort_keys=False).encode('utf-8'))
+            output.write(b'\n')
+
+
+if __name__ == '__main__':
+    main()
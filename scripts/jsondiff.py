@@ -32,6 +32,8 @@ import re
 import difflib
 import sys
 
+import binstate
+
 
 def strip_object_hook(obj):
     if '__class__' in obj:
@@ -332,9 +334,83 @@ def load(stream, strip_images = True, strip_comments = True):
         return json.load(stream, strict=False, object_hook = object_hook)
 
 
+def strip_images(node):
+    '''Same as strip_object_hook, but on an already parsed document.'''
+    if isinstance(node, dict):
+        for name in list(node.keys()):
+            node[name] = strip_images(node[name])
+        return strip_object_hook(node)
+    elif isinstance(node, list):
+        return [strip_images(element) for element in node]
+    else:
+        return node
+
+
+def resolve_unchanged(node, previous):
+    '''Replace the values that incremental state dumps mark as unchanged with
+    the ones at the same place in the previous state.'''
+    if isinstance(node, dict):
+        if node.get('__unchanged__', False):
+            return previous
+        for name in list(node.keys()):
+            prev = previous.get(name, None) if isinstance(previous, dict) else None
+            node[name] = resolve_unchanged(node[name], prev)
+    elif isinstance(node, list):
+        for i in range(len(node)):
+            prev = previous[i] if isinstance(previous, list) and i < len(previous) else None
+            node[i] = resolve_unchanged(node[i], prev)
+    return node
+
+
+def load_states(stream, strip = True, strip_comments = True):
+    '''Load one or more consecutive states, as written by glretrace when
+    dumping the state at several calls.'''
+    data = stream.read()
+    if strip_comments:
+        data = _strip_comments(data)
+
+    decoder = json.JSONDecoder(strict=False)
+    whitespace = re.compile(r'\s*')
+
+    states = []
+    pos = whitespace.match(data, 0).end()
+    while pos < len(data):
+        state, pos = decoder.raw_decode(data, pos)
+        pos = whitespace.match(data, pos).end()
+        states.append(state)
+
+    return _resolve_states(states, strip)
+
+
+def _resolve_states(states, strip):
+    previous = None
+    for i in range(len(states)):
+        states[i] = resolve_unchanged(states[i], previous)
+        previous = states[i]
+
+    if strip:
+        # Full states share unchanged values, so strip only once resolved
+        states = [strip_images(state) for state in states]
+
+    return states
+
+
+def open_states(filename, strip = True):
+    '''Load the states from either a JSON or a binary state dump.'''
+    stream = open(filename, 'rb')
+    if binstate.is_binary_state(stream):
+        # Images are stripped anyway, so don't bother encoding them
+        states = [binstate.load_state(stream, dump, images = not strip)
+                  for dump in binstate.read_dumps(stream)]
+        return _resolve_states(states, strip)
+    stream.close()
+    return load_states(open(filename, 'rt'), strip)
+
+
 def main():
     optparser = optparse.OptionParser(
-        usage="\n\t%prog [options] <ref_json> <src_json>")
+        usage="\n\t%prog [options] <ref_json> <src_json>\n"
+              "\t%prog [options] <states_json>")
     optparser.add_option(
         '--ignore-added',
         action="store_true", dest="ignore_added", default=False,
@@ -346,18 +422,32 @@ def main():
 
     (options, args) = optparser.parse_args(sys.argv[1:])
 
-    if len(args) != 2:
+    if len(args) not in (1, 2):
         optparser.error('incorrect number of arguments')
 
-    a = load(open(args[0], 'rt'), options.strip_images)
-    b = load(open(args[1], 'rt'), options.strip_images)
+    differ = Differ(ignore_added = options.ignore_added)
+
+    if len(args) == 1:
+        # Show how the state evolves from one dump to the next
+        states = open_states(args[0], options.strip_images)
+        for i in range(1, len(states)):
+            sys.stdout.write('// state %u -> %u\n' % (i - 1, i))
+            differ.visit(states[i - 1], states[i])
+        return
+
+    a = open_states(args[0], options.strip_images)
+    b = open_states(args[1], options.strip_images)
+    if len(a) != len(b):
+        sys.stderr.write('warning: different number of states (%u vs %u)\n' % (len(a), len(b)))
 
     if False:
         dumper = Dumper()
-        dumper.visit(a)
+        dumper.visit(a[0])
 
-    differ = Differ(ignore_added = options.ignore_added)
-    differ.visit(a, b)
+    for i in range(min(len(a), len(b))):
+        if len(a) > 1:
+            sys.stdout.write('// state %u\n' % i)
+        differ.visit(a[i], b[i])
 
 
 if __name__ == '__main__':
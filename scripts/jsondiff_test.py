@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+##########################################################################
+#
+# Copyright 2026 apitrace contributors
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+'''Unit tests for loading incremental state dumps.'''
+
+
+import io
+import os.path
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import jsondiff
+
+
+def _image(width, data):
+    return {'__class__': 'image', '__width__': width, '__data__': data}
+
+
+_unchanged = {'__unchanged__': True}
+
+
+class ResolveUnchangedTest(unittest.TestCase):
+
+    def test_member(self):
+        previous = {'a': _image(2, 'AAAA'), 'b': 1}
+        state = {'a': dict(_unchanged), 'b': 2}
+        self.assertEqual(jsondiff.resolve_unchanged(state, previous),
+                         {'a': _image(2, 'AAAA'), 'b': 2})
+
+    def test_nested(self):
+        previous = {'textures': {'GL_TEXTURE0': [_image(1, 'A'), _image(1, 'B')]}}
+        state = {'textures': {'GL_TEXTURE0': [_image(1, 'C'), dict(_unchanged)]}}
+        self.assertEqual(jsondiff.resolve_unchanged(state, previous),
+                         {'textures': {'GL_TEXTURE0': [_image(1, 'C'), _image(1, 'B')]}})
+
+    def test_whole_state(self):
+        previous = {'a': 1}
+        self.assertEqual(jsondiff.resolve_unchanged(dict(_unchanged), previous), previous)
+
+    def test_missing_previous(self):
+        self.assertEqual(jsondiff.resolve_unchanged({'a': dict(_unchanged)}, None),
+                         {'a': None})
+        self.assertEqual(jsondiff.resolve_unchanged([1, dict(_unchanged)], [1]),
+                         [1, None])
+
+    def test_changed(self):
+        previous = {'a': [1, 2], 'b': {'c': 'x'}}
+        state = {'a': [3], 'b': {'c': 'y', 'd': 'z'}}
+        self.assertEqual(jsondiff.resolve_unchanged(state, previous),
+                         {'a': [3], 'b': {'c': 'y', 'd': 'z'}})
+
+
+class LoadStatesTest(unittest.TestCase):
+
+    def _load(self, data, strip = True):
+        return jsondiff.load_states(io.StringIO(data), strip = strip)
+
+    def test_single(self):
+        self.assertEqual(self._load('{"a": 1}\n'), [{'a': 1}])
+
+    def test_empty(self):
+        self.assertEqual(self._load(''), [])
+        self.assertEqual(self._load('\n  \n'), [])
+
+    def test_consecutive(self):
+        data = '''// call 10
+{
+  "parameters": {"GL_VIEWPORT": [0, 0, 4, 4]},
+  "framebuffer": {"GL_BACK": {"__class__": "image", "__width__": 4, "__data__": "AAAA"}}
+}
+// call 20
+{
+  "parameters": {"GL_VIEWPORT": [0, 0, 8, 8]},
+  "framebuffer": {"GL_BACK": {"__unchanged__": true}}
+}
+'''
+        states = self._load(data, strip = False)
+        self.assertEqual(len(states), 2)
+        self.assertEqual(states[1]['parameters']['GL_VIEWPORT'], [0, 0, 8, 8])
+        self.assertEqual(states[1]['framebuffer']['GL_BACK'],
+                         states[0]['framebuffer']['GL_BACK'])
+        self.assertEqual(states[1]['framebuffer']['GL_BACK']['__data__'], 'AAAA')
+
+    def test_chained(self):
+        # Unchanged values refer to the previous state, which may itself have
+        # taken them from the one before
+        data = '{"a": {"__class__": "blob", "__data__": "x"}}' \
+               '{"a": {"__unchanged__": true}}' \
+               '{"a": {"__unchanged__": true}}'
+        states = self._load(data, strip = False)
+        self.assertEqual([state['a']['__data__'] for state in states], ['x', 'x', 'x'])
+
+    def test_strip(self):
+        data = '{"a": {"__class__": "image", "__data__": "x"}, "b": {"__unchanged__": false, "c": 1}}\n' \
+               '{"a": {"__unchanged__": true}, "b": {"c": 2}}\n'
+        states = self._load(data)
+        self.assertEqual(states, [{'a': None, 'b': {'c': 1}},
+                                  {'a': None, 'b': {'c': 2}}])
+
+    def test_comment_in_string(self):
+        self.assertEqual(self._load('{"a": "// not a comment"} // a comment\n'),
+                         [{'a': '// not a comment'}])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+##########################################################################
+#
+# Copyright 2026 apitrace contributors
+# All Rights Reserved.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in
+# all copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+# THE SOFTWARE.
+#
+##########################################################################/
+
+
+'''Compare the perceptual hashes of two retraces.
+
+The inputs are the output of `glretrace --snapshot-format=PHASH -s - ...`.
+Snapshots match when no tile's average color, nor the range of its channels,
+differs by more than the tolerance, so that only the mismatching snapshots
+(and tiles) need to be dumped and inspected as images.  The coarse 64 bit
+hash is only compared when --hash-distance is given: on near-flat images its
+bits flip on differences well within the tolerance.
+'''
+
+
+import optparse
+import sys
+
+
+class Snapshot:
+
+    def __init__(self, line):
+        fields = line.split()
+        self.name = fields[0]
+        self.width, self.height = [int(n) for n in fields[1].split('x')]
+        self.hash = int(fields[2], 16)
+        self.tileSize = int(fields[3])
+        # Each tile is RRGGBBAA followed by the channel range
+        self.tiles = [int(tile[:8], 16) for tile in fields[4:]]
+        self.ranges = [int(tile[8:] or '0', 16) for tile in fields[4:]]
+        self.tilesX = (self.width + self.tileSize - 1) // self.tileSize
+
+
+def read_snapshots(filename):
+    snapshots = []
+    # Several snapshots share the same name when dumping MRTs
+    occurrences = {}
+    with open(filename, 'rt') as stream:
+        for line in stream:
+            line = line.strip()
+            if not line:
+                continue
+            try:
+                snapshot = Snapshot(line)
+            except (ValueError, IndexError):
+                # Not a hash line (e.g., other retrace output)
+                continue
+            occurrence = occurrences.get(snapshot.name, 0)
+            occurrences[snapshot.name] = occurrence + 1
+            snapshots.append(((snapshot.name, occurrence), snapshot))
+    return snapshots
+
+
+def tile_distance(ref, src):
+    distance = 0
+    for shift in (24, 16, 8, 0):
+        distance = max(distance, abs(((ref >> shift) & 0xff) - ((src >> shift) & 0xff)))
+    return distance
+
+
+def compare(ref, src, options):
+    '''Return a list of reasons why the snapshots mismatch.'''
+
+    if (ref.width, ref.height, ref.tileSize) != (src.width, src.height, src.tileSize):
+        return ['size mismatch (%ux%u vs %ux%u)' % (ref.width, ref.height, src.width, src.height)]
+
+    reasons = []
+
+    if options.hash_distance is not None:
+        bits = bin(ref.hash ^ src.hash).count('1')
+        if bits > options.hash_distance:
+            reasons.append('hash differs in %u bits' % bits)
+
+    for i in range(min(len(ref.tiles), len(src.tiles))):
+        x = (i % ref.tilesX) * ref.tileSize
+        y = (i // ref.tilesX) * ref.tileSize
+        distance = tile_distance(ref.tiles[i], src.tiles[i])
+        if distance > options.tolerance:
+            reasons.append('tile at %u,%u differs by %u' % (x, y, distance))
+            continue
+        distance = abs(ref.ranges[i] - src.ranges[i])
+        if distance > options.tolerance:
+            reasons.append('tile at %u,%u range differs by %u' % (x, y, distance))
+
+    return reasons
+
+
+def main():
+    optparser = optparse.OptionParser(
+        usage="\n\t%prog [options] <ref_hashes> <src_hashes>")
+    optparser.add_option(
+        '-t', '--tolerance',
+        type="int", dest="tolerance", default=2,
+        help="maximum difference of tile average channels [default: %default]")
+    optparser.add_option(
+        '-d', '--hash-distance',
+        type="int", dest="hash_distance", default=None,
+        help="also require the hashes to differ in at most this many bits")
+    optparser.add_option(
+        '-v', '--verbose',
+        action="store_true", dest="verbose", default=False,
+        help="list every mismatching tile")
+
+    (options, args) = optparser.parse_args(sys.argv[1:])
+
+    if len(args) != 2:
+        optparser.error('incorrect number of arguments')
+
+    ref_snapshots = read_snapshots(args[0])
+    src_snapshots = dict(read_snapshots(args[1]))
+
+    failures = 0
+    for key, ref in ref_snapshots:
+        name, occurrence = key
+        label = name if occurrence == 0 else '%s#%u' % (name, occurrence)
+        src = src_snapshots.pop(key, None)
+        if src is None:
+            sys.stdout.write('%s: MISSING\n' % label)
+            failures += 1
+            continue
+        reasons = compare(ref, src, options)
+        if reasons:
+            failures += 1
+            if options.verbose:
+                sys.stdout.write('%s: MISMATCH\n' % label)
+                for reason in reasons:
+                    sys.stdout.write('    %s\n' % reason)
+            else:
+                sys.stdout.write('%s: MISMATCH (%s%s)\n' % (
+                    label, reasons[0], ', ...' if len(reasons) > 1 else ''))
+
+    for name, occurrence in sorted(src_snapshots):
+        label = name if occurrence == 0 else '%s#%u' % (name, occurrence)
+        sys.stdout.write('%s: EXTRA\n' % label)
+        failures += 1
+
+    if failures:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,383 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Do-nothing libGL.so replacement, used by gltrace_bench to measure the cost
+ * of the tracing wrappers without a GPU.
+ *
+ * Only the state the wrappers query back (buffer bindings, client arrays,
+ * mappings) is tracked.  Any entry-point not listed here resolves through
+ * glXGetProcAddressARB to a function that does nothing and returns zero.
+ */
+
+
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+
+#include "os.hpp"
+#include "os_thread.hpp"
+
+
+namespace {
+
+struct ClientArray {
+    GLboolean enabled = GL_FALSE;
+    GLint size = 4;
+    GLenum type = GL_FLOAT;
+    GLsizei stride = 0;
+    const void *pointer = nullptr;
+};
+
+struct ContextState {
+    GLuint arrayBuffer = 0;
+    GLuint elementArrayBuffer = 0;
+    ClientArray vertexArray;
+};
+
+OS_THREAD_LOCAL ContextState *currentState = nullptr;
+
+std::mutex buffersMutex;
+std::map<GLuint, std::vector<char>> buffers;
+
+
+ContextState &
+getState(void)
+{
+    static ContextState dummyState;
+    return currentState ? *currentState : dummyState;
+}
+
+
+GLuint *
+getBinding(GLenum target)
+{
+    switch (target) {
+    case GL_ARRAY_BUFFER:
+        return &getState().arrayBuffer;
+    case GL_ELEMENT_ARRAY_BUFFER:
+        return &getState().elementArrayBuffer;
+    default:
+        return nullptr;
+    }
+}
+
+
+std::vector<char> *
+getBuffer(GLenum target)
+{
+    GLuint *binding = getBinding(target);
+    if (!binding || !*binding) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(buffersMutex);
+    return &buffers[*binding];
+}
+
+
+uintptr_t
+stubNoop(void)
+{
+    return 0;
+}
+
+} /* anonymous namespace */
+
+
+extern "C" {
+
+
+/*
+ * GLX
+ */
+
+PUBLIC GLXContext
+glXCreateContext(Display *dpy, XVisualInfo *vis, GLXContext shareList, Bool direct)
+{
+    return reinterpret_cast<GLXContext>(new ContextState);
+}
+
+PUBLIC void
+glXDestroyContext(Display *dpy, GLXContext ctx)
+{
+    ContextState *state = reinterpret_cast<ContextState *>(ctx);
+    if (currentState == state) {
+        currentState = nullptr;
+    }
+    delete state;
+}
+
+PUBLIC Bool
+glXMakeCurrent(Display *dpy, GLXDrawable drawable, GLXContext ctx)
+{
+    currentState = reinterpret_cast<ContextState *>(ctx);
+    return True;
+}
+
+PUBLIC GLXContext
+glXGetCurrentContext(void)
+{
+    return reinterpret_cast<GLXContext>(currentState);
+}
+
+PUBLIC void
+glXSwapBuffers(Display *dpy, GLXDrawable drawable)
+{
+}
+
+PUBLIC __GLXextFuncPtr
+glXGetProcAddressARB(const GLubyte *procName);
+
+PUBLIC __GLXextFuncPtr
+glXGetProcAddress(const GLubyte *procName)
+{
+    return glXGetProcAddressARB(procName);
+}
+
+
+/*
+ * GL 1.x (exported, as the wrappers resolve these with dlsym)
+ */
+
+PUBLIC const GLubyte * APIENTRY
+glGetString(GLenum name)
+{
+    switch (name) {
+    case GL_VENDOR:
+    case GL_RENDERER:
+        return (const GLubyte *)"apitrace stub";
+    case GL_VERSION:
+        return (const GLubyte *)"4.6.0";
+    case GL_SHADING_LANGUAGE_VERSION:
+        return (const GLubyte *)"4.60";
+    default:
+        return (const GLubyte *)"";
+    }
+}
+
+PUBLIC GLenum APIENTRY
+glGetError(void)
+{
+    return GL_NO_ERROR;
+}
+
+PUBLIC void APIENTRY
+glGetIntegerv(GLenum pname, GLint *params)
+{
+    ContextState &state = getState();
+    switch (pname) {
+    case GL_MAJOR_VERSION:
+        *params = 4;
+        break;
+    case GL_MINOR_VERSION:
+        *params = 6;
+        break;
+    case GL_NUM_EXTENSIONS:
+        *params = 1;
+        break;
+    case GL_CONTEXT_PROFILE_MASK:
+        *params = GL_CONTEXT_COMPATIBILITY_PROFILE_BIT;
+        break;
+    case GL_ARRAY_BUFFER_BINDING:
+        *params = state.arrayBuffer;
+        break;
+    case GL_ELEMENT_ARRAY_BUFFER_BINDING:
+        *params = state.elementArrayBuffer;
+        break;
+    case GL_VERTEX_ARRAY_SIZE:
+        *params = state.vertexArray.size;
+        break;
+    case GL_VERTEX_ARRAY_TYPE:
+        *params = state.vertexArray.type;
+        break;
+    case GL_VERTEX_ARRAY_STRIDE:
+        *params = state.vertexArray.stride;
+        break;
+    default:
+        *params = 0;
+        break;
+    }
+}
+
+PUBLIC GLboolean APIENTRY
+glIsEnabled(GLenum cap)
+{
+    if (cap == GL_VERTEX_ARRAY) {
+        return getState().vertexArray.enabled;
+    }
+    return GL_FALSE;
+}
+
+PUBLIC void APIENTRY
+glGetPointerv(GLenum pname, GLvoid **params)
+{
+    *params = pname == GL_VERTEX_ARRAY_POINTER ? const_cast<void *>(getState().vertexArray.pointer) : nullptr;
+}
+
+PUBLIC void APIENTRY
+glEnableClientState(GLenum array)
+{
+    if (array == GL_VERTEX_ARRAY) {
+        getState().vertexArray.enabled = GL_TRUE;
+    }
+}
+
+PUBLIC void APIENTRY
+glDisableClientState(GLenum array)
+{
+    if (array == GL_VERTEX_ARRAY) {
+        getState().vertexArray.enabled = GL_FALSE;
+    }
+}
+
+PUBLIC void APIENTRY
+glVertexPointer(GLint size, GLenum type, GLsizei stride, const GLvoid *pointer)
+{
+    ClientArray &array = getState().vertexArray;
+    array.size = size;
+    array.type = type;
+    array.stride = stride;
+    array.pointer = pointer;
+}
+
+PUBLIC void APIENTRY glEnable(GLenum cap) {}
+PUBLIC void APIENTRY glDisable(GLenum cap) {}
+PUBLIC void APIENTRY glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {}
+PUBLIC void APIENTRY glColor4f(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {}
+PUBLIC void APIENTRY glClear(GLbitfield mask) {}
+PUBLIC void APIENTRY glDrawArrays(GLenum mode, GLint first, GLsizei count) {}
+PUBLIC void APIENTRY glDrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid *indices) {}
+PUBLIC void APIENTRY glFlush(void) {}
+PUBLIC void APIENTRY glFinish(void) {}
+
+
+} /* extern "C" */
+
+
+/*
+ * Extensions (only reachable through glXGetProcAddressARB)
+ */
+
+static void APIENTRY
+stubBindBuffer(GLenum target, GLuint buffer)
+{
+    GLuint *binding = getBinding(target);
+    if (binding) {
+        *binding = buffer;
+    }
+}
+
+static void APIENTRY
+stubBufferData(GLenum target, GLsizeiptr size, const GLvoid *data, GLenum usage)
+{
+    std::vector<char> *buffer = getBuffer(target);
+    if (buffer) {
+        buffer->assign(size, 0);
+        if (data) {
+            memcpy(buffer->data(), data, size);
+        }
+    }
+}
+
+static void APIENTRY
+stubBufferStorage(GLenum target, GLsizeiptr size, const GLvoid *data, GLbitfield flags)
+{
+    stubBufferData(target, size, data, GL_STATIC_DRAW);
+}
+
+static void * APIENTRY
+stubMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access)
+{
+    std::vector<char> *buffer = getBuffer(target);
+    if (!buffer || size_t(offset + length) > buffer->size()) {
+        return nullptr;
+    }
+    return buffer->data() + offset;
+}
+
+static void APIENTRY
+stubGetBufferPointerv(GLenum target, GLenum pname, GLvoid **params)
+{
+    std::vector<char> *buffer = getBuffer(target);
+    *params = buffer && pname == GL_BUFFER_MAP_POINTER ? buffer->data() : nullptr;
+}
+
+static GLboolean APIENTRY
+stubUnmapBuffer(GLenum target)
+{
+    return GL_TRUE;
+}
+
+static const GLubyte * APIENTRY
+stubGetStringi(GLenum name, GLuint index)
+{
+    return (const GLubyte *)"GL_ARB_buffer_storage";
+}
+
+
+static const struct {
+    const char *name;
+    void *proc;
+} procs[] = {
+    { "glXCreateContext", (void *)&glXCreateContext },
+    { "glXDestroyContext", (void *)&glXDestroyContext },
+    { "glXMakeCurrent", (void *)&glXMakeCurrent },
+    { "glXGetCurrentContext", (void *)&glXGetCurrentContext },
+    { "glXSwapBuffers", (void *)&glXSwapBuffers },
+    { "glGetString", (void *)&glGetString },
+    { "glGetError", (void *)&glGetError },
+    { "glGetIntegerv", (void *)&glGetIntegerv },
+    { "glIsEnabled", (void *)&glIsEnabled },
+    { "glGetPointerv", (void *)&glGetPointerv },
+    { "glEnableClientState", (void *)&glEnableClientState },
+    { "glDisableClientState", (void *)&glDisableClientState },
+    { "glVertexPointer", (void *)&glVertexPointer },
+    { "glBindBuffer", (void *)&stubBindBuffer },
+    { "glBufferData", (void *)&stubBufferData },
+    { "glBufferStorage", (void *)&stubBufferStorage },
+    { "glMapBufferRange", (void *)&stubMapBufferRange },
+    { "glGetBufferPointerv", (void *)&stubGetBufferPointerv },
+    { "glUnmapBuffer", (void *)&stubUnmapBuffer },
+    { "glGetStringi", (void *)&stubGetStringi },
+};
+
+
+extern "C" PUBLIC __GLXextFuncPtr
+glXGetProcAddressARB(const GLubyte *procName)
+{
+    for (auto & proc : procs) {
+        if (strcmp(proc.name, (const char *)procName) == 0) {
+            return (__GLXextFuncPtr)proc.proc;
+        }
+    }
+    return (__GLXextFuncPtr)&stubNoop;
+}
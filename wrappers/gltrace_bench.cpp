@@ -0,0 +1,570 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/*
+ * Tracing overhead microbenchmark.
+ *
+ * Loads the glxtrace wrapper on top of a do-nothing libGL (glstub) and
+ * measures the cost of representative entry-points, both traced and
+ * untraced, so that capture-side changes can be compared with hard numbers.
+ */
+
+
+#include <limits.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glx.h>
+#include <GL/glxext.h>
+
+#include "os.hpp"
+#include "os_process.hpp"
+#include "os_time.hpp"
+
+
+#ifndef GLXTRACE_PATH
+#define GLXTRACE_PATH "glxtrace.so"
+#endif
+
+#ifndef GLSTUB_PATH
+#define GLSTUB_PATH "glstub.so"
+#endif
+
+
+static const char *synopsis = "Measure the overhead of the OpenGL tracing wrappers.";
+
+
+static void
+usage(void)
+{
+    std::cout
+        << "usage: gltrace_bench [OPTIONS] [BENCHMARK]...\n"
+        << synopsis << "\n"
+        "\n"
+        "    -h, --help               Show this help message and exit\n"
+        "    -n, --iterations=N       Calls per benchmark and thread (default 100000)\n"
+        "    -j, --threads=N          Also run multi-threaded variants with N threads\n"
+        "    -o, --output=TRACE_FILE  Trace file to write (default /dev/null)\n"
+        "    --wrapper=PATH           Tracing wrapper (default " GLXTRACE_PATH ")\n"
+        "    --stub=PATH              Stub libGL (default " GLSTUB_PATH ")\n"
+        "    --csv                    Output comma separated values\n"
+    ;
+}
+
+
+enum {
+    WRAPPER_OPT = CHAR_MAX + 1,
+    STUB_OPT,
+    CSV_OPT,
+};
+
+const static char *
+shortOptions = "hn:j:o:";
+
+const static struct option
+longOptions[] = {
+    {"help", no_argument, 0, 'h'},
+    {"iterations", required_argument, 0, 'n'},
+    {"threads", required_argument, 0, 'j'},
+    {"output", required_argument, 0, 'o'},
+    {"wrapper", required_argument, 0, WRAPPER_OPT},
+    {"stub", required_argument, 0, STUB_OPT},
+    {"csv", no_argument, 0, CSV_OPT},
+    {0, 0, 0, 0}
+};
+
+
+/**
+ * Entry-points resolved from either the stub or the wrapper.
+ */
+struct Api
+{
+    PFNGLXGETPROCADDRESSPROC GetProcAddress;
+    decltype(&glXCreateContext) CreateContext;
+    decltype(&glXDestroyContext) DestroyContext;
+    decltype(&glXMakeCurrent) MakeCurrent;
+
+    decltype(&glEnable) Enable;
+    decltype(&glColor4f) Color4f;
+    decltype(&glViewport) Viewport;
+    decltype(&glEnableClientState) EnableClientState;
+    decltype(&glDisableClientState) DisableClientState;
+    decltype(&glVertexPointer) VertexPointer;
+    decltype(&glDrawArrays) DrawArrays;
+    decltype(&glDrawElements) DrawElements;
+
+    PFNGLUNIFORM4FVPROC Uniform4fv;
+    PFNGLUNIFORMMATRIX4FVPROC UniformMatrix4fv;
+    PFNGLBINDBUFFERPROC BindBuffer;
+    PFNGLBUFFERDATAPROC BufferData;
+    PFNGLBUFFERSUBDATAPROC BufferSubData;
+    PFNGLBUFFERSTORAGEPROC BufferStorage;
+    PFNGLMAPBUFFERRANGEPROC MapBufferRange;
+    PFNGLUNMAPBUFFERPROC UnmapBuffer;
+
+    bool load(void *handle);
+};
+
+
+template< class T >
+static bool
+resolve(T &proc, void *handle, const char *name)
+{
+    proc = reinterpret_cast<T>(dlsym(handle, name));
+    if (!proc) {
+        std::cerr << "error: " << name << " not found\n";
+        return false;
+    }
+    return true;
+}
+
+
+template< class T >
+static bool
+resolveExt(T &proc, PFNGLXGETPROCADDRESSPROC getProcAddress, const char *name)
+{
+    proc = reinterpret_cast<T>(getProcAddress((const GLubyte *)name));
+    if (!proc) {
+        std::cerr << "error: " << name << " not found\n";
+        return false;
+    }
+    return true;
+}
+
+
+bool
+Api::load(void *handle)
+{
+    return resolve(GetProcAddress, handle, "glXGetProcAddressARB") &&
+           resolve(CreateContext, handle, "glXCreateContext") &&
+           resolve(DestroyContext, handle, "glXDestroyContext") &&
+           resolve(MakeCurrent, handle, "glXMakeCurrent") &&
+           resolve(Enable, handle, "glEnable") &&
+           resolve(Color4f, handle, "glColor4f") &&
+           resolve(Viewport, handle, "glViewport") &&
+           resolve(EnableClientState, handle, "glEnableClientState") &&
+           resolve(DisableClientState, handle, "glDisableClientState") &&
+           resolve(VertexPointer, handle, "glVertexPointer") &&
+           resolve(DrawArrays, handle, "glDrawArrays") &&
+           resolve(DrawElements, handle, "glDrawElements") &&
+           resolveExt(Uniform4fv, GetProcAddress, "glUniform4fv") &&
+           resolveExt(UniformMatrix4fv, GetProcAddress, "glUniformMatrix4fv") &&
+           resolveExt(BindBuffer, GetProcAddress, "glBindBuffer") &&
+           resolveExt(BufferData, GetProcAddress, "glBufferData") &&
+           resolveExt(BufferSubData, GetProcAddress, "glBufferSubData") &&
+           resolveExt(BufferStorage, GetProcAddress, "glBufferStorage") &&
+           resolveExt(MapBufferRange, GetProcAddress, "glMapBufferRange") &&
+           resolveExt(UnmapBuffer, GetProcAddress, "glUnmapBuffer");
+}
+
+
+/**
+ * Times the measured loops of all threads of a run.
+ *
+ * begin() also acts as a barrier, so that every thread is done with its
+ * setup before any starts issuing calls, and the measured interval spans
+ * from the first begin() to the last end().
+ */
+class LoopTimer
+{
+    std::mutex mutex;
+    std::condition_variable cond;
+    unsigned numThreads;
+    unsigned arrived = 0;
+    long long startTime = LLONG_MAX;
+    long long endTime = LLONG_MIN;
+
+public:
+    LoopTimer(unsigned _numThreads) :
+        numThreads(_numThreads)
+    {}
+
+    void
+    begin(void) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (++arrived == numThreads) {
+                cond.notify_all();
+            } else {
+                cond.wait(lock, [this] { return arrived >= numThreads; });
+            }
+        }
+        long long now = os::getTime();
+        std::lock_guard<std::mutex> lock(mutex);
+        startTime = std::min(startTime, now);
+    }
+
+    void
+    end(void) {
+        long long now = os::getTime();
+        std::lock_guard<std::mutex> lock(mutex);
+        endTime = std::max(endTime, now);
+    }
+
+    long long
+    elapsed(void) const {
+        return endTime - startTime;
+    }
+};
+
+
+/**
+ * A benchmark does its setup with the context already current, and then
+ * issues the measured call `iterations` times, between timer.begin() and
+ * timer.end().
+ */
+struct Benchmark
+{
+    const char *name;
+    size_t dataSize;
+    void (*run)(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize);
+};
+
+
+static void
+benchScalar(const Api &gl, LoopTimer &timer, unsigned iterations, size_t)
+{
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        gl.Color4f(1.0f, 0.5f, 0.25f, (float)i);
+    }
+    timer.end();
+}
+
+
+static void
+benchEnable(const Api &gl, LoopTimer &timer, unsigned iterations, size_t)
+{
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        gl.Enable(GL_DEPTH_TEST);
+    }
+    timer.end();
+}
+
+
+static void
+benchUniform4fv(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize)
+{
+    std::vector<GLfloat> values(dataSize / sizeof(GLfloat), 1.0f);
+    GLsizei count = values.size() / 4;
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        gl.Uniform4fv(i & 15, count, values.data());
+    }
+    timer.end();
+}
+
+
+static void
+benchUniformMatrix4fv(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize)
+{
+    std::vector<GLfloat> values(dataSize / sizeof(GLfloat), 1.0f);
+    GLsizei count = values.size() / 16;
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        gl.UniformMatrix4fv(i & 15, count, GL_FALSE, values.data());
+    }
+    timer.end();
+}
+
+
+static void
+benchBufferSubData(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize)
+{
+    std::vector<char> data(dataSize, 0x55);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 1);
+    gl.BufferData(GL_ARRAY_BUFFER, dataSize, nullptr, GL_DYNAMIC_DRAW);
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        data[i % dataSize] = (char)i;
+        gl.BufferSubData(GL_ARRAY_BUFFER, 0, dataSize, data.data());
+    }
+    timer.end();
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+static void
+benchDrawElementsClientArrays(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize)
+{
+    size_t numVertices = dataSize / (3 * sizeof(GLfloat));
+    std::vector<GLfloat> vertices(numVertices * 3, 0.0f);
+    std::vector<GLushort> indices(numVertices);
+    for (size_t i = 0; i < numVertices; ++i) {
+        indices[i] = (GLushort)(numVertices - 1 - i);
+    }
+
+    gl.EnableClientState(GL_VERTEX_ARRAY);
+    gl.VertexPointer(3, GL_FLOAT, 0, vertices.data());
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        gl.DrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_SHORT, indices.data());
+    }
+    timer.end();
+    gl.DisableClientState(GL_VERTEX_ARRAY);
+}
+
+
+static void
+benchPersistentMapWrite(const Api &gl, LoopTimer &timer, unsigned iterations, size_t dataSize)
+{
+    const GLsizeiptr bufferSize = 16 * dataSize;
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+    gl.BindBuffer(GL_ARRAY_BUFFER, 2);
+    gl.BufferStorage(GL_ARRAY_BUFFER, bufferSize, nullptr, flags);
+    char *map = (char *)gl.MapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, flags);
+    if (!map) {
+        std::cerr << "error: glMapBufferRange failed\n";
+        // Still pass the barrier, so other threads don't wait forever
+        timer.begin();
+        timer.end();
+        return;
+    }
+
+    // Each draw commits the coherent writes made since the previous one
+    timer.begin();
+    for (unsigned i = 0; i < iterations; ++i) {
+        memset(map + (i % 16) * dataSize, (int)i, dataSize);
+        gl.DrawArrays(GL_POINTS, 0, 1);
+    }
+    timer.end();
+
+    gl.UnmapBuffer(GL_ARRAY_BUFFER);
+    gl.BindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+static const Benchmark
+benchmarks[] = {
+    {"glColor4f", 0, benchScalar},
+    {"glEnable", 0, benchEnable},
+    {"glUniform4fv", 16, benchUniform4fv},
+    {"glUniform4fv", 1024, benchUniform4fv},
+    {"glUniformMatrix4fv", 64, benchUniformMatrix4fv},
+    {"glBufferSubData", 64, benchBufferSubData},
+    {"glBufferSubData", 4096, benchBufferSubData},
+    {"glBufferSubData", 262144, benchBufferSubData},
+    {"glDrawElements(client arrays)", 1200, benchDrawElementsClientArrays},
+    {"glDrawElements(client arrays)", 120000, benchDrawElementsClientArrays},
+    {"persistent map write", 4096, benchPersistentMapWrite},
+    {"persistent map write", 262144, benchPersistentMapWrite},
+};
+
+
+// Cap the amount of data traced by a single benchmark run
+#define MAX_BYTES_PER_RUN (256 * 1024 * 1024)
+
+
+static unsigned
+getIterations(const Benchmark &benchmark, unsigned iterations)
+{
+    if (benchmark.dataSize &&
+        (unsigned long long)iterations * benchmark.dataSize > MAX_BYTES_PER_RUN) {
+        iterations = std::max<size_t>(MAX_BYTES_PER_RUN / benchmark.dataSize, 16);
+    }
+    return iterations;
+}
+
+
+static void
+runThread(const Api *gl, const Benchmark *benchmark, LoopTimer *timer, unsigned iterations)
+{
+    GLXContext ctx = gl->CreateContext(nullptr, nullptr, nullptr, True);
+    gl->MakeCurrent(nullptr, 0, ctx);
+    benchmark->run(*gl, *timer, iterations, benchmark->dataSize);
+    gl->MakeCurrent(nullptr, 0, nullptr);
+    gl->DestroyContext(nullptr, ctx);
+}
+
+
+/**
+ * Returns the wall time per call, in nanoseconds, over all threads.
+ *
+ * Only the call loops are timed; context creation and benchmark setup are
+ * not accounted.
+ */
+static double
+measure(const Api &gl, const Benchmark &benchmark, unsigned iterations, unsigned numThreads)
+{
+    // Warm up, so that one-time signature emission and lazy symbol
+    // resolution are not accounted
+    {
+        LoopTimer warmup(1);
+        runThread(&gl, &benchmark, &warmup, std::min(iterations, 16U));
+    }
+
+    numThreads = std::max(numThreads, 1U);
+    LoopTimer timer(numThreads);
+
+    if (numThreads == 1) {
+        runThread(&gl, &benchmark, &timer, iterations);
+    } else {
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < numThreads; ++t) {
+            threads.emplace_back(runThread, &gl, &benchmark, &timer, iterations);
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+    }
+
+    return timer.elapsed() * 1.0e9 / os::timeFrequency / ((double)iterations * numThreads);
+}
+
+
+static bool
+isSelected(const Benchmark &benchmark, int argc, char **argv)
+{
+    if (argc == 0) {
+        return true;
+    }
+    for (int i = 0; i < argc; ++i) {
+        if (strstr(benchmark.name, argv[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned iterations = 100000;
+    unsigned numThreads = 0;
+    const char *output = nullptr;
+    const char *wrapperPath = GLXTRACE_PATH;
+    const char *stubPath = GLSTUB_PATH;
+    bool csv = false;
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, shortOptions, longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'h':
+            usage();
+            return 0;
+        case 'n':
+            iterations = std::max(atoi(optarg), 1);
+            break;
+        case 'j':
+            numThreads = atoi(optarg);
+            break;
+        case 'o':
+            output = optarg;
+            break;
+        case WRAPPER_OPT:
+            wrapperPath = optarg;
+            break;
+        case STUB_OPT:
+            stubPath = optarg;
+            break;
+        case CSV_OPT:
+            csv = true;
+            break;
+        default:
+            std::cerr << "error: unexpected option `" << (char)opt << "`\n";
+            usage();
+            return 1;
+        }
+    }
+
+    if (output) {
+        os::setEnvironment("TRACE_FILE", output);
+    } else if (!getenv("TRACE_FILE")) {
+        os::setEnvironment("TRACE_FILE", "/dev/null");
+    }
+    os::setEnvironment("TRACE_LIBGL", stubPath);
+
+    void *stubHandle = dlopen(stubPath, RTLD_NOW | RTLD_LOCAL);
+    if (!stubHandle) {
+        std::cerr << "error: failed to load " << stubPath << ": " << dlerror() << "\n";
+        return 1;
+    }
+
+    void *wrapperHandle = dlopen(wrapperPath, RTLD_NOW | RTLD_LOCAL);
+    if (!wrapperHandle) {
+        std::cerr << "error: failed to load " << wrapperPath << ": " << dlerror() << "\n";
+        return 1;
+    }
+
+    Api untraced;
+    Api traced;
+    if (!untraced.load(stubHandle) ||
+        !traced.load(wrapperHandle)) {
+        return 1;
+    }
+
+    std::vector<unsigned> threadCounts = {1};
+    if (numThreads > 1) {
+        threadCounts.push_back(numThreads);
+    }
+
+    if (csv) {
+        std::cout << "benchmark,bytes,threads,iterations,untraced_ns,traced_ns,overhead_ns\n";
+    } else {
+        fprintf(stdout, "%-32s %8s %7s %12s %12s %12s\n",
+                "benchmark", "bytes", "threads", "untraced ns", "traced ns", "overhead ns");
+    }
+
+    for (auto & benchmark : benchmarks) {
+        if (!isSelected(benchmark, argc - optind, argv + optind)) {
+            continue;
+        }
+
+        for (unsigned threads : threadCounts) {
+            unsigned n = getIterations(benchmark, iterations);
+            double untracedNs = measure(untraced, benchmark, n, threads);
+            double tracedNs = measure(traced, benchmark, n, threads);
+
+            if (csv) {
+                fprintf(stdout, "\"%s\",%zu,%u,%u,%.1f,%.1f,%.1f\n",
+                        benchmark.name, benchmark.dataSize, threads, n,
+                        untracedNs, tracedNs, tracedNs - untracedNs);
+            } else {
+                fprintf(stdout, "%-32s %8zu %7u %12.1f %12.1f %12.1f\n",
+                        benchmark.name, benchmark.dataSize, threads,
+                        untracedNs, tracedNs, tracedNs - untracedNs);
+            }
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -27,8 +27,10 @@
 
 #include <assert.h>
 
-#include <map>
+#include <atomic>
 #include <memory>
+#include <shared_mutex>
+#include <unordered_map>
 
 #include <os_thread.hpp>
 #include <glproc.hpp>
@@ -38,8 +40,21 @@
 namespace gltrace {
 
 typedef std::shared_ptr<Context> context_ptr_t;
-static std::map<uintptr_t, context_ptr_t> context_map;
-static std::recursive_mutex context_map_mutex;
+
+/*
+ * The context map is read on every context switch but only modified on
+ * context creation/destruction, so guard it with a reader/writer lock, and
+ * let each thread cache its last lookup, so that making the same context
+ * current again doesn't touch the map at all.
+ */
+static std::unordered_map<uintptr_t, context_ptr_t> context_map;
+static std::shared_mutex context_map_mutex;
+
+/*
+ * Bumped whenever a context is added or removed, to invalidate the per-thread
+ * lookup caches, as context ids may be reused.
+ */
+static std::atomic<unsigned> context_map_generation(0);
 
 class ThreadState {
 public:
@@ -49,6 +64,12 @@ public:
                                       * context, but the app still calls some
                                       * GL function that expects one.
                                       */
+
+    // Last context looked up by setContext
+    uintptr_t cached_id = 0;
+    unsigned cached_generation = ~0U;
+    context_ptr_t cached_context;
+
     ThreadState() : dummy_context(new Context)
     {
         current_context = dummy_context;
@@ -74,10 +95,10 @@ static void _retainContext(context_ptr_t ctx)
 
 void retainContext(uintptr_t context_id)
 {
-    context_map_mutex.lock();
-    if (context_map.find(context_id) != context_map.end())
-        _retainContext(context_map[context_id]);
-    context_map_mutex.unlock();
+    std::unique_lock<std::shared_mutex> lock(context_map_mutex);
+    auto it = context_map.find(context_id);
+    if (it != context_map.end())
+        _retainContext(it->second);
 }
 
 static bool _releaseContext(context_ptr_t ctx)
@@ -94,26 +115,30 @@ bool releaseContext(uintptr_t context_id)
 {
     bool res = false;
 
-    context_map_mutex.lock();
+    std::unique_lock<std::shared_mutex> lock(context_map_mutex);
     /*
      * This can potentially called (from glX) with an invalid context_id,
      * so don't assert on it being valid.
      */
-    if (context_map.find(context_id) != context_map.end()) {
-        res = _releaseContext(context_map[context_id]);
-        if (res)
-            context_map.erase(context_id);
+    auto it = context_map.find(context_id);
+    if (it != context_map.end()) {
+        res = _releaseContext(it->second);
+        if (res) {
+            context_map.erase(it);
+            context_map_generation++;
+        }
     }
-    context_map_mutex.unlock();
 
     return res;
 }
 
-static bool
-contextCreated = false;
+static std::atomic<bool>
+contextCreated(false);
 
 void createContext(uintptr_t context_id, uintptr_t shared_context_id)
 {
+    std::unique_lock<std::shared_mutex> lock(context_map_mutex);
+
     // wglCreateContextAttribsARB causes internal calls to wglCreateContext to be
     // traced, causing context to be defined twice.
     if (context_map.find(context_id) != context_map.end()) {
@@ -124,8 +149,6 @@ void createContext(uintptr_t context_id, uintptr_t shared_context_id)
 
     context_ptr_t ctx(new Context);
 
-    context_map_mutex.lock();
-
     if (shared_context_id) {
         auto shredIt = context_map.find(shared_context_id);
         if (shredIt != context_map.end())
@@ -136,8 +159,7 @@ void createContext(uintptr_t context_id, uintptr_t shared_context_id)
 
     _retainContext(ctx);
     context_map[context_id] = ctx;
-
-    context_map_mutex.unlock();
+    context_map_generation++;
 }
 
 void setContext(uintptr_t context_id)
@@ -145,12 +167,25 @@ void setContext(uintptr_t context_id)
     ThreadState *ts = get_ts();
     context_ptr_t ctx;
 
-    context_map_mutex.lock();
-
-    assert(context_map.find(context_id) != context_map.end());
-    ctx = context_map[context_id];
+    unsigned generation = context_map_generation;
+    if (ts->cached_id == context_id &&
+        ts->cached_generation == generation) {
+        ctx = ts->cached_context;
+    } else {
+        std::shared_lock<std::shared_mutex> lock(context_map_mutex);
+
+        auto it = context_map.find(context_id);
+        assert(it != context_map.end());
+        if (it == context_map.end()) {
+            os::log("apitrace: error: %s: unknown context\n", __FUNCTION__);
+            return;
+        }
+        ctx = it->second;
 
-    context_map_mutex.unlock();
+        ts->cached_id = context_id;
+        ts->cached_generation = generation;
+        ts->cached_context = ctx;
+    }
 
     ts->current_context = ctx;
 
@@ -31,34 +31,57 @@
 #include <stdio.h>
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 #include "crc32c.hpp"
+#include "os_process.hpp"
+#include "thread_pool.hpp"
 
 
-#if \
-    (defined(__i386__) && defined(__SSE2__)) /* gcc */ || \
-    defined(_M_IX86) /* msvc */ || \
-    defined(__x86_64__) /* gcc */ || \
-    defined(_M_AMD64) /* msvc */
-
-#  define HAVE_SSE2
-
-// TODO: Detect and leverage SSE 4.1 and 4.2 at runtime
-
-#endif
-
-
-#if defined(HAVE_SSE42)
+#if defined(__i386__) || defined(_M_IX86) || defined(__x86_64__) || defined(_M_AMD64)
+#  define HAVE_X86_CRC32
 #  include <nmmintrin.h>
-#elif defined(HAVE_SSE41)
-#  include <smmintrin.h>
-#elif defined(HAVE_SSE2)
-#  include <emmintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#  if defined(__GNUC__) && !defined(HAVE_SSE42)
+#    define TARGET_CRC32 __attribute__((target("sse4.2")))
+#  else
+#    define TARGET_CRC32
+#  endif
+#elif defined(__aarch64__) && defined(__GNUC__) && (defined(__linux__) || defined(__APPLE__))
+#  define HAVE_ARM_CRC32
+#  include <arm_acle.h>
+#  ifdef __linux__
+#    include <sys/auxv.h>
+#    include <asm/hwcap.h>
+#  endif
+#  ifdef __ARM_FEATURE_CRC32
+#    define TARGET_CRC32
+#  else
+#    define TARGET_CRC32 __attribute__((target("+crc")))
+#  endif
 #endif
 
 
 #define BLOCK_SIZE 512
 
+/*
+ * The hardware paths hash each block as several independent lanes, so that
+ * the latency of the CRC instruction is hidden, and then fold the lanes
+ * together so the result is exactly the CRC32C of the whole block.
+ */
+#define LANE_COUNT 4
+#define LANE_SIZE (BLOCK_SIZE / LANE_COUNT)
+
+/*
+ * Mappings larger than this are hashed by several threads.
+ */
+#define PARALLEL_MIN_SIZE (4 * 1024 * 1024)
+#define PARALLEL_MAX_THREADS 8
+
 
 template< class T >
 static inline T *
@@ -68,102 +91,271 @@ lAlignPtr(T *p, uintptr_t alignment)
 }
 
 
-template< class T >
-static inline T *
-rAlignPtr(T *p, uintptr_t alignment)
+#if defined(HAVE_X86_CRC32) || defined(HAVE_ARM_CRC32)
+
+/*
+ * Raw CRC32C (no pre/post inversion) is linear, so advancing a lane CRC over
+ * LANE_SIZE zero bytes is a 32x32 bit matrix multiplication, which we
+ * evaluate one byte at a time with lookup tables.
+ */
+static uint32_t laneShiftTable[4][256];
+
+static void
+initLaneShiftTable(void)
+{
+    static const uint8_t zeros[LANE_SIZE] = {0};
+    for (unsigned i = 0; i < 4; ++i) {
+        for (unsigned j = 0; j < 256; ++j) {
+            uint32_t crc = j << (8 * i);
+            laneShiftTable[i][j] = ~crc32c_8bytes(zeros, LANE_SIZE, ~crc);
+        }
+    }
+}
+
+static inline uint32_t
+laneShift(uint32_t crc)
 {
-    return reinterpret_cast<T *>((reinterpret_cast<uintptr_t>(p) + alignment - 1) & ~(alignment - 1));
+    return laneShiftTable[0][ crc        & 0xff] ^
+           laneShiftTable[1][(crc >>  8) & 0xff] ^
+           laneShiftTable[2][(crc >> 16) & 0xff] ^
+           laneShiftTable[3][ crc >> 24        ];
 }
 
+static inline uint32_t
+combineLanes(const uint32_t *crc)
+{
+    uint32_t result = crc[0];
+    for (unsigned i = 1; i < LANE_COUNT; ++i) {
+        result = laneShift(result) ^ crc[i];
+    }
+    return ~result;
+}
 
-#ifdef HAVE_SSE2
+#endif /* HAVE_X86_CRC32 || HAVE_ARM_CRC32 */
 
-#ifdef HAVE_SSE41
-    #define mm_stream_load_si128 _mm_stream_load_si128
-    #define mm_extract_epi32_0(x) _mm_extract_epi32(x, 0)
-    #define mm_extract_epi32_1(x) _mm_extract_epi32(x, 1)
-    #define mm_extract_epi32_2(x) _mm_extract_epi32(x, 2)
-    #define mm_extract_epi32_3(x) _mm_extract_epi32(x, 3)
-#else /* !HAVE_SSE41 */
-    #define mm_stream_load_si128 _mm_load_si128
-    #define mm_extract_epi32_0(x) _mm_cvtsi128_si32(x)
-    #define mm_extract_epi32_1(x) _mm_cvtsi128_si32(_mm_shuffle_epi32(x,_MM_SHUFFLE(1,1,1,1)))
-    #define mm_extract_epi32_2(x) _mm_cvtsi128_si32(_mm_shuffle_epi32(x,_MM_SHUFFLE(2,2,2,2)))
-    #define mm_extract_epi32_3(x) _mm_cvtsi128_si32(_mm_shuffle_epi32(x,_MM_SHUFFLE(3,3,3,3)))
-#endif /* !HAVE_SSE41 */
 
-#ifdef HAVE_SSE42
+#ifdef HAVE_X86_CRC32
 
-#define mm_crc32_u32 _mm_crc32_u32
+static TARGET_CRC32 uint32_t
+hashBlockSSE42(const void *p)
+{
+    uint32_t crc[LANE_COUNT] = { ~0U, 0, 0, 0 };
+
+#if defined(__x86_64__) || defined(_M_AMD64)
+    const uint64_t *q = (const uint64_t *)p;
+    uint64_t c0 = crc[0], c1 = crc[1], c2 = crc[2], c3 = crc[3];
+    for (unsigned i = 0; i < LANE_SIZE / sizeof *q; ++i) {
+        c0 = _mm_crc32_u64(c0, q[i + 0 * LANE_SIZE / sizeof *q]);
+        c1 = _mm_crc32_u64(c1, q[i + 1 * LANE_SIZE / sizeof *q]);
+        c2 = _mm_crc32_u64(c2, q[i + 2 * LANE_SIZE / sizeof *q]);
+        c3 = _mm_crc32_u64(c3, q[i + 3 * LANE_SIZE / sizeof *q]);
+    }
+#else
+    const uint32_t *q = (const uint32_t *)p;
+    uint32_t c0 = crc[0], c1 = crc[1], c2 = crc[2], c3 = crc[3];
+    for (unsigned i = 0; i < LANE_SIZE / sizeof *q; ++i) {
+        c0 = _mm_crc32_u32(c0, q[i + 0 * LANE_SIZE / sizeof *q]);
+        c1 = _mm_crc32_u32(c1, q[i + 1 * LANE_SIZE / sizeof *q]);
+        c2 = _mm_crc32_u32(c2, q[i + 2 * LANE_SIZE / sizeof *q]);
+        c3 = _mm_crc32_u32(c3, q[i + 3 * LANE_SIZE / sizeof *q]);
+    }
+#endif
 
-#else /* !HAVE_SSE42 */
+    crc[0] = (uint32_t)c0;
+    crc[1] = (uint32_t)c1;
+    crc[2] = (uint32_t)c2;
+    crc[3] = (uint32_t)c3;
+    return combineLanes(crc);
+}
 
-static inline uint32_t
-mm_crc32_u32(uint32_t crc, uint32_t current)
+static bool
+haveSSE42(void)
 {
-    uint32_t one = current ^ crc;
-    crc  = crc32c_8x256_table[0][ one >> 24        ] ^
-           crc32c_8x256_table[1][(one >> 16) & 0xff] ^
-           crc32c_8x256_table[2][(one >>  8) & 0xff] ^
-           crc32c_8x256_table[3][ one        & 0xff];
-    return crc;
+#if defined(HAVE_SSE42)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
 }
 
-#endif /* !HAVE_SSE42 */
+#endif /* HAVE_X86_CRC32 */
 
-#endif /* HAVE_SSE2 */
 
+#ifdef HAVE_ARM_CRC32
 
-uint32_t
-hashBlock(const void *p)
+static TARGET_CRC32 uint32_t
+hashBlockARMv8(const void *p)
 {
-    assert((uintptr_t)p % BLOCK_SIZE == 0);
+    const uint64_t *q = (const uint64_t *)p;
+    uint32_t c0 = ~0U, c1 = 0, c2 = 0, c3 = 0;
+    for (unsigned i = 0; i < LANE_SIZE / sizeof *q; ++i) {
+        c0 = __crc32cd(c0, q[i + 0 * LANE_SIZE / sizeof *q]);
+        c1 = __crc32cd(c1, q[i + 1 * LANE_SIZE / sizeof *q]);
+        c2 = __crc32cd(c2, q[i + 2 * LANE_SIZE / sizeof *q]);
+        c3 = __crc32cd(c3, q[i + 3 * LANE_SIZE / sizeof *q]);
+    }
 
-    uint32_t crc;
+    uint32_t crc[LANE_COUNT] = { c0, c1, c2, c3 };
+    return combineLanes(crc);
+}
 
-#ifdef HAVE_SSE2
-    crc = 0;
+static bool
+haveARMv8CRC32(void)
+{
+#if defined(__ARM_FEATURE_CRC32) || defined(__APPLE__)
+    return true;
+#else
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#endif
+}
 
-    __m128i *q = (__m128i *)(void *)p;
+#endif /* HAVE_ARM_CRC32 */
 
-    crc = ~crc;
 
-    for (unsigned c = BLOCK_SIZE / (4 * sizeof *q); c; --c) {
-        __m128i m0 = mm_stream_load_si128(q++);
-        __m128i m1 = mm_stream_load_si128(q++);
-        __m128i m2 = mm_stream_load_si128(q++);
-        __m128i m3 = mm_stream_load_si128(q++);
+static uint32_t
+hashBlockGeneric(const void *p)
+{
+    return crc32c_8bytes(p, BLOCK_SIZE);
+}
+
+
+typedef uint32_t (*HashBlockFunc)(const void *p);
 
-        crc = mm_crc32_u32(crc, mm_extract_epi32_0(m0));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_1(m0));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_2(m0));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_3(m0));
+static uint32_t
+hashBlockResolve(const void *p);
 
-        crc = mm_crc32_u32(crc, mm_extract_epi32_0(m1));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_1(m1));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_2(m1));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_3(m1));
+static std::atomic<HashBlockFunc> hashBlockFunc{hashBlockResolve};
 
-        crc = mm_crc32_u32(crc, mm_extract_epi32_0(m2));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_1(m2));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_2(m2));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_3(m2));
 
-        crc = mm_crc32_u32(crc, mm_extract_epi32_0(m3));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_1(m3));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_2(m3));
-        crc = mm_crc32_u32(crc, mm_extract_epi32_3(m3));
+static HashBlockFunc
+selectHashBlock(void)
+{
+#if defined(HAVE_X86_CRC32)
+    if (haveSSE42()) {
+        initLaneShiftTable();
+        return hashBlockSSE42;
+    }
+#elif defined(HAVE_ARM_CRC32)
+    if (haveARMv8CRC32()) {
+        initLaneShiftTable();
+        return hashBlockARMv8;
     }
+#endif
+    return hashBlockGeneric;
+}
 
-    crc = ~crc;
 
-#else /* !HAVE_SSE2 */
+/*
+ * Pick the best implementation on first use.  All of them compute the same
+ * CRC32C, so blocks hashed before and after the switch still compare equal.
+ */
+static uint32_t
+hashBlockResolve(const void *p)
+{
+    static const HashBlockFunc func = selectHashBlock();
 
-    crc = crc32c_8bytes(p, BLOCK_SIZE);
+    hashBlockFunc.store(func, std::memory_order_release);
+    return func(p);
+}
 
-#endif
 
-    return crc;
+uint32_t
+hashBlock(const void *p)
+{
+    assert((uintptr_t)p % BLOCK_SIZE == 0);
+
+    return hashBlockFunc.load(std::memory_order_acquire)(p);
+}
+
+
+/*
+ * Workers for hashing large mappings.  They are started on first use and
+ * kept for the lifetime of the process, so that mapping and unmapping a big
+ * buffer every frame doesn't pay for creating threads each time.
+ *
+ * The pool is deliberately leaked: tracing may still happen from other
+ * atexit handlers after static destructors ran.  A forked child inherits no
+ * workers, so it gets a pool of its own.
+ */
+static ThreadPool *
+getHashPool(size_t &nWorkers)
+{
+    static ThreadPool *pool = nullptr;
+    static size_t poolWorkers = 0;
+    static unsigned long long poolPid = 0;
+    static std::mutex poolMutex;
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+
+    unsigned long long pid = os::getCurrentProcessId();
+    if (!pool || poolPid != pid) {
+        size_t nThreads = std::thread::hardware_concurrency();
+        nThreads = std::min<size_t>(nThreads, PARALLEL_MAX_THREADS);
+        poolWorkers = nThreads > 1 ? nThreads - 1 : 0;
+        pool = poolWorkers ? new ThreadPool(poolWorkers) : nullptr;
+        poolPid = pid;
+    }
+
+    nWorkers = poolWorkers;
+    return pool;
+}
+
+
+/*
+ * Run func(first, last) over [0, nBlocks), splitting the range across the
+ * hashing workers when the mapping is large enough for it to pay off.
+ * Smaller mappings are hashed inline.
+ */
+template< class Func >
+static void
+forEachBlockRange(size_t nBlocks, Func func)
+{
+    if (nBlocks * BLOCK_SIZE < PARALLEL_MIN_SIZE) {
+        func(0, nBlocks, 0);
+        return;
+    }
+
+    size_t nWorkers = 0;
+    ThreadPool *pool = getHashPool(nWorkers);
+
+    size_t nThreads = std::min<size_t>(nWorkers + 1, nBlocks * BLOCK_SIZE / (PARALLEL_MIN_SIZE / 4));
+    if (!pool || nThreads <= 1) {
+        func(0, nBlocks, 0);
+        return;
+    }
+
+    size_t blocksPerThread = (nBlocks + nThreads - 1) / nThreads;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t pending = 0;
+
+    for (size_t t = 1; t < nThreads; ++t) {
+        size_t first = t * blocksPerThread;
+        size_t last = std::min(first + blocksPerThread, nBlocks);
+        if (first < last) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                ++pending;
+            }
+            pool->enqueue([&, first, last, t] {
+                func(first, last, t);
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--pending == 0) {
+                    done.notify_one();
+                }
+            });
+        }
+    }
+
+    func(0, std::min(blocksPerThread, nBlocks), 0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return pending == 0; });
 }
 
 
@@ -203,10 +395,12 @@ void MemoryShadow::cover(void *_ptr, size_t _size, bool _discard)
             hashPtr[i] = hashPtr[0];
         }
     } else {
-        for (size_t i = 0; i < nBlocks; ++i) {
-            hashPtr[i] = hashBlock(p);
-            p += BLOCK_SIZE;
-        }
+        uint32_t *hashes = hashPtr;
+        forEachBlockRange(nBlocks, [=] (size_t first, size_t last, size_t) {
+            for (size_t i = first; i < last; ++i) {
+                hashes[i] = hashBlock(p + i * BLOCK_SIZE);
+            }
+        });
     }
 }
 
@@ -217,13 +411,32 @@ void MemoryShadow::update(Callback callback) const
     const uint8_t *realStop    = realPtr;
 
     const uint8_t *p = lAlignPtr(realPtr, BLOCK_SIZE);
-    for (size_t i = 0; i < nBlocks; ++i) {
-        uint32_t crc = hashBlock(p);
-        if (crc != hashPtr[i]) {
-            realStart = std::min(realStart, p);
-            realStop  = std::max(realStop,  p + BLOCK_SIZE);
+
+    // First and last dirty block seen by each thread
+    struct DirtyRange {
+        size_t first;
+        size_t last;
+    };
+    DirtyRange dirty[PARALLEL_MAX_THREADS];
+    std::fill(dirty, dirty + PARALLEL_MAX_THREADS, DirtyRange{SIZE_MAX, 0});
+
+    const uint32_t *hashes = hashPtr;
+    forEachBlockRange(nBlocks, [=, &dirty] (size_t first, size_t last, size_t t) {
+        DirtyRange range{SIZE_MAX, 0};
+        for (size_t i = first; i < last; ++i) {
+            if (hashBlock(p + i * BLOCK_SIZE) != hashes[i]) {
+                range.first = std::min(range.first, i);
+                range.last = i + 1;
+            }
+        }
+        dirty[t] = range;
+    });
+
+    for (auto & range : dirty) {
+        if (range.first < range.last) {
+            realStart = std::min(realStart, p + range.first * BLOCK_SIZE);
+            realStop  = std::max(realStop,  p + range.last  * BLOCK_SIZE);
         }
-        p += BLOCK_SIZE;
     }
 
     realStart = std::max(realStart, realPtr);
@@ -0,0 +1,126 @@
+/**************************************************************************
+ *
+ * Copyright 2026 apitrace contributors
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+#include "memtrace.hpp"
+
+#include <vector>
+
+#include "crc32c.hpp"
+
+#include "gtest/gtest.h"
+
+
+#define BLOCK_SIZE 512
+
+
+static uint8_t *
+alignBlock(std::vector<uint8_t> &buffer)
+{
+    uintptr_t p = (uintptr_t)buffer.data();
+    return (uint8_t *)((p + BLOCK_SIZE - 1) & ~(uintptr_t)(BLOCK_SIZE - 1));
+}
+
+
+TEST(memtrace, hashBlock)
+{
+    std::vector<uint8_t> buffer(BLOCK_SIZE * 3);
+    uint8_t *p = alignBlock(buffer);
+
+    for (unsigned i = 0; i < BLOCK_SIZE * 2; ++i) {
+        p[i] = (uint8_t)(i * 2654435761U >> 13);
+    }
+
+    // Whatever implementation is dispatched must match the plain CRC32C
+    EXPECT_EQ(hashBlock(p), crc32c_8bytes(p, BLOCK_SIZE));
+    EXPECT_EQ(hashBlock(p + BLOCK_SIZE), crc32c_8bytes(p + BLOCK_SIZE, BLOCK_SIZE));
+
+    memset(p, 0, BLOCK_SIZE);
+    EXPECT_EQ(hashBlock(p), crc32c_8bytes(p, BLOCK_SIZE));
+}
+
+
+static const uint8_t *dirtyPtr;
+static size_t dirtySize;
+
+static void
+dirtyCallback(const void *ptr, size_t size)
+{
+    dirtyPtr = (const uint8_t *)ptr;
+    dirtySize = size;
+}
+
+
+static void
+testUpdate(size_t size)
+{
+    std::vector<uint8_t> buffer(size + BLOCK_SIZE);
+    uint8_t *p = alignBlock(buffer) + 16;
+    size -= 16;
+
+    for (size_t i = 0; i < size; ++i) {
+        p[i] = (uint8_t)i;
+    }
+
+    MemoryShadow shadow;
+    shadow.cover(p, size, false);
+
+    dirtyPtr = nullptr;
+    dirtySize = 0;
+    shadow.update(dirtyCallback);
+    EXPECT_EQ(dirtySize, 0);
+
+    size_t first = size / 3;
+    size_t last = size - size / 5;
+    p[first] ^= 1;
+    p[last] ^= 1;
+
+    shadow.update(dirtyCallback);
+    EXPECT_LE(dirtyPtr, p + first);
+    EXPECT_GT(dirtyPtr + dirtySize, p + last);
+    EXPECT_GT(dirtyPtr, p + first - BLOCK_SIZE);
+    EXPECT_LE(dirtyPtr + dirtySize, p + last + BLOCK_SIZE);
+}
+
+
+TEST(memtrace, update_small)
+{
+    testUpdate(64 * 1024);
+}
+
+
+TEST(memtrace, update_large)
+{
+    // Big enough to be hashed by several threads
+    testUpdate(32 * 1024 * 1024);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}